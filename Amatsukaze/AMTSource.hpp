@@ -15,9 +15,14 @@
 #include <memory>
 #include <mutex>
 #include <set>
+#include <deque>
+#include <condition_variable>
 
+#include "ProcessThread.hpp"
 #include "Tree.hpp"
 #include "List.hpp"
+#include "WaveReader.hpp"
+#include "VirtualTsFile.hpp"
 
 
 namespace av {
@@ -50,7 +55,9 @@ class AMTSource : public IClip, AMTObject
 
 	bool outputQP; // QPe[uo͂邩
 
-	InputContext inputCtx;
+	// srcpathԉft@Cł͂ȂVirtualTsIndex̏ꍇ
+	std::unique_ptr<VirtualTsIOContext> virtualTs;
+	std::unique_ptr<InputContext> inputCtx;
 	CodecContext codecCtx;
 
 #if ENABLE_FFMPEG_FILTER
@@ -79,7 +86,7 @@ class AMTSource : public IClip, AMTObject
 
 	std::mutex mutex;
 
-	File waveFile;
+	WaveReader waveReader;
 
 	int seekDistance;
 
@@ -87,6 +94,10 @@ class AMTSource : public IClip, AMTObject
 	// ܂fR[hĂȂꍇ-1
 	int lastDecodeFrame;
 
+	// OGetFrameŗvꂽt[
+	// GOPfR[_gǂ̔Ɏg
+	int lastRequestFrame;
+
 	// codecCtxOɃfR[ht[ԍ
 	// ܂fR[hĂȂꍇnullptr
 	std::unique_ptr<Frame> prevFrame;
@@ -94,6 +105,65 @@ class AMTSource : public IClip, AMTObject
 	// Onon B QPe[u
 	PVideoFrame nonBQPTable;
 
+	// ǂ݃fR[h
+	// LȏꍇApPbgǂݍ݂ƃfR[hprefetchThreadōsA
+	// GetFrameĂԃXbh̓fR[hς݃t[L[oăt[
+	// iIScriptEnvironmentGetFrameĂԃXbhłgȂj
+	struct PrefetchFrame {
+		std::unique_ptr<Frame> frame;
+		int64_t keyFramePTS; // ̃t[fR[h_keyFramePTS
+		size_t bytes;
+	};
+
+	class PrefetchThread : public ThreadBase {
+	public:
+		PrefetchThread(AMTSource* this_) : this_(this_) { }
+	protected:
+		virtual void run() {
+			this_->PrefetchLoop();
+		}
+	private:
+		AMTSource* this_;
+	};
+
+	bool prefetch;
+	size_t maxPrefetchBytes;
+	PrefetchThread prefetchThread;
+	std::mutex prefetchMutex;
+	std::condition_variable prefetchCond;
+	std::deque<PrefetchFrame> prefetchQueue;
+	size_t prefetchBytes;   // L[ɂt[̍voCg
+	int64_t prefetchKeyPTS; // V[Nŏ̃L[t[pPbgPTS
+	int prefetchSendFailed; // [J[avcodec_send_packets
+	bool prefetchActive;    // [J[fR[_gĂ悢
+	bool prefetchBusy;      // [J[fR[_gp
+	bool prefetchEOF;       // [J[Xg[̏IɓB
+	bool prefetchFinish;
+
+	// _ANZXpGOPfR[_
+	// ꂼꂪƗ͂ƃfR[_AGetFrameĂ񂾃XbhGOPPʂŃfR[h
+	// AviSynthMT[hœɗєт̃NGXgɃfR[hł
+	struct GOPDecoder {
+		std::unique_ptr<VirtualTsIOContext> virtualTs;
+		std::unique_ptr<InputContext> inputCtx;
+		CodecContext codecCtx; // ŏGOPōĈȍ~flushĎg
+		AVStream* videoStream;
+	};
+
+	// GOPfR[_̏o
+	// bNȂŃfR[ĥŃOmutexbNĂo
+	struct GOPOutput {
+		std::map<int, PVideoFrame> frames;
+		std::vector<int64_t> unknownPTS;
+		int numSendFailed;
+	};
+
+	tstring srcpath;
+	std::vector<std::unique_ptr<GOPDecoder>> idleGOPDecoders;
+	int numGOPDecoders;         // 쐬ςGOPfR[_
+	std::set<int> decodingGOPs; // fR[hGOPiL[t[ԍj
+	std::condition_variable gopCond;
+
 	AVCodec* getHWAccelCodec(AVCodecID vcodecId)
 	{
 		switch (vcodecId) {
@@ -125,8 +195,31 @@ class AMTSource : public IClip, AMTObject
 		return avcodec_find_decoder(vcodecId);
 	}
 
+	void OpenInput(std::unique_ptr<VirtualTsIOContext>& vts,
+		std::unique_ptr<InputContext>& input, AVStream*& stream, IScriptEnvironment* env)
+	{
+		if (VirtualTsIndex::IsIndexFile(srcpath)) {
+			vts = std::unique_ptr<VirtualTsIOContext>(new VirtualTsIOContext(srcpath));
+			input = std::unique_ptr<InputContext>(new InputContext(*vts, "mpegts"));
+		}
+		else {
+			input = std::unique_ptr<InputContext>(new InputContext(srcpath));
+		}
+		if (avformat_find_stream_info((*input)(), NULL) < 0) {
+			env->ThrowError("avformat_find_stream_info failed");
+		}
+		stream = GetVideoStream((*input)());
+		if (stream == NULL) {
+			env->ThrowError("Could not find video stream ...");
+		}
+	}
+
 	void MakeCodecContext(IScriptEnvironment* env) {
-		AVCodecID vcodecId = videoStream->codecpar->codec_id;
+		MakeCodecContext(codecCtx, videoStream, env);
+	}
+
+	void MakeCodecContext(CodecContext& decoder, AVStream* stream, IScriptEnvironment* env) {
+		AVCodecID vcodecId = stream->codecpar->codec_id;
 		AVCodec *pCodec = getHWAccelCodec(vcodecId);
 		if (pCodec == NULL) {
 			ctx.warn("w肳ꂽfR[_gpłȂ߃ftHgfR[_g܂");
@@ -135,18 +228,18 @@ class AMTSource : public IClip, AMTObject
 		if (pCodec == NULL) {
 			env->ThrowError("Could not find decoder ...");
 		}
-		codecCtx.Set(pCodec);
-		if (avcodec_parameters_to_context(codecCtx(), videoStream->codecpar) != 0) {
+		decoder.Set(pCodec);
+		if (avcodec_parameters_to_context(decoder(), stream->codecpar) != 0) {
 			env->ThrowError("avcodec_parameters_to_context failed");
 		}
-		codecCtx()->pkt_timebase = videoStream->time_base;
-		codecCtx()->thread_count = GetFFmpegThreads(GetProcessorCount());
+		decoder()->pkt_timebase = stream->time_base;
+		decoder()->thread_count = GetFFmpegThreads(GetProcessorCount());
 
 		// export_mvs for codecview
 		//AVDictionary *opts = NULL;
 		//av_dict_set(&opts, "flags2", "+export_mvs", 0);
 
-		if (avcodec_open2(codecCtx(), pCodec, NULL) != 0) {
+		if (avcodec_open2(decoder(), pCodec, NULL) != 0) {
 			env->ThrowError("avcodec_open2 failed");
 		}
 	}
@@ -354,7 +447,7 @@ class AMTSource : public IClip, AMTObject
 		}
 	}
 
-	PVideoFrame MakeFrame(AVFrame* top, AVFrame* bottom, IScriptEnvironment* env) {
+	PVideoFrame MakeFrame(AVFrame* top, AVFrame* bottom, PVideoFrame& nonBQ, IScriptEnvironment* env) {
 		PVideoFrame ret = env->NewVideoFrame(vi);
 		const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get((AVPixelFormat)(top->format));
 
@@ -387,10 +480,10 @@ class AMTSource : public IClip, AMTObject
 				env->BitBlt(qpframe->GetWritePtr(), qpframe->GetPitch(), 
 					(const BYTE*)qp_table, qpvi.width, qpvi.width, qpvi.height);
 				if (top->pict_type != AV_PICTURE_TYPE_B) {
-					nonBQPTable = qpframe;
+					nonBQ = qpframe;
 				}
 				ret->SetProperty("QP_Table", qpframe);
-				ret->SetProperty("QP_Table_Non_B", nonBQPTable);
+				ret->SetProperty("QP_Table_Non_B", nonBQ);
 				ret->SetProperty("QP_Stride", qp_stride ? qpframe->GetPitch() : 0);
 				ret->SetProperty("QP_ScaleType", qp_scale_type);
 
@@ -416,7 +509,8 @@ class AMTSource : public IClip, AMTObject
 		frameCache.insert(&pcache->treeNode);
 		recentAccessed.push_front(&pcache->listNode);
 
-		if ((int)recentAccessed.size() > seekDistance * 3 / 2) {
+		// GOPfR[_͂ꂼGOPPʂŃt[̂ł̕傫
+		if ((int)recentAccessed.size() > seekDistance * 3 / 2 * (1 + numGOPDecoders)) {
 			// LbVꂽ폜
 			CacheFrame* pdel = recentAccessed.back().value;
 			frameCache.erase(frameCache.it(&pdel->treeNode));
@@ -480,11 +574,41 @@ class AMTSource : public IClip, AMTObject
 #endif
 
 	void OnFrameOutput(Frame& frame, IScriptEnvironment* env)
+	{
+		OnFrameOutput(frame, lastDecodeFrame, prevFrame, nonBQPTable, nullptr, env);
+	}
+
+	// fR[ht[PTSt[ԍɑΉtďo͂
+	// outnullptrȂLbVɓimutexbNĂ邱Ɓj
+	// outoutɓiGOPfR[_pBLbVɂ͐GȂj
+	void OnFrameOutput(Frame& frame, int& lastFrame, std::unique_ptr<Frame>& prev,
+		PVideoFrame& nonBQ, GOPOutput* out, IScriptEnvironment* env)
 	{
 		// ffmpegpts wrap̎dȂ̂ŉ33bit݂̂
 		//i26Ԉȏ゠铮悾Əd\͂邪j
 		int64_t pts = frame()->pts & ((int64_t(1) << 33) - 1);
 
+		// ɏo͍ς݂Ȃtrue
+		auto hasFrame = [&](int n) {
+			if (out != nullptr) {
+				return out->frames.find(n) != out->frames.end();
+			}
+			auto cacheit = frameCache.find(n);
+			if (cacheit != frameCache.end()) {
+				UpdateAccessed(cacheit->value);
+				return true;
+			}
+			return false;
+		};
+		auto putFrame = [&](int n, const PVideoFrame& data) {
+			if (out != nullptr) {
+				out->frames[n] = data;
+			}
+			else {
+				PutFrame(n, data);
+			}
+		};
+
 		int64_t headDiff = 0, tailDiff = 0;
 		auto it = std::lower_bound(frames.begin(), frames.end(), pts, [](const FilterSourceFrame& e, int64_t pts) {
 			return e.framePTS < pts;
@@ -504,33 +628,37 @@ class AMTSource : public IClip, AMTObject
 			tailDiff = pts - frames.back().framePTS;
 			// Ỏ\̂ŁA
 			if (headDiff == 0 || headDiff > tailDiff) {
-				lastDecodeFrame = vi.num_frames;
+				lastFrame = vi.num_frames;
 			}
-			prevFrame = nullptr; // AłȂȂꍇnullZbg
+			prev = nullptr; // AłȂȂꍇnullZbg
 			return;
 		}
 
 		if (it->framePTS != pts) {
 			// vt[Ȃ
-			ctx.incrementCounter(AMT_ERR_UNKNOWN_PTS);
-			ctx.warnF("Unknown PTS frame %lld", pts);
-			prevFrame = nullptr; // AłȂȂꍇnullZbg
+			if (out != nullptr) {
+				// O̓bNĂo
+				out->unknownPTS.push_back(pts);
+			}
+			else {
+				ctx.incrementCounter(AMT_ERR_UNKNOWN_PTS);
+				ctx.warnF("Unknown PTS frame %lld", pts);
+			}
+			prev = nullptr; // AłȂȂꍇnullZbg
 			return;
 		}
 
 		int frameIndex = int(it - frames.begin());
-		auto cacheit = frameCache.find(frameIndex);
 
 		if (it->halfDelay) {
 			// fBCKp
-			if (cacheit != frameCache.end()) {
+			if (hasFrame(frameIndex)) {
 				// łɃLbVɂ
-				UpdateAccessed(cacheit->value);
-				lastDecodeFrame = frameIndex;
+				lastFrame = frameIndex;
 			}
-			else if (prevFrame != nullptr) {
-				PutFrame(frameIndex, MakeFrame((*prevFrame)(), frame(), env));
-				lastDecodeFrame = frameIndex;
+			else if (prev != nullptr) {
+				putFrame(frameIndex, MakeFrame((*prev)(), frame(), nonBQ, env));
+				lastFrame = frameIndex;
 			}
 			else {
 				// Õt[Ȃ̂Ńt[Ȃ
@@ -539,30 +667,21 @@ class AMTSource : public IClip, AMTObject
 			// ̃t[t[QƂĂ炻o
 			auto next = it + 1;
 			if (next != frames.end() && next->framePTS == it->framePTS) {
-				auto cachenext = frameCache.find(frameIndex + 1);
-				if (cachenext != frameCache.end()) {
-					// łɃLbVɂ
-					UpdateAccessed(cachenext->value);
-				}
-				else {
-					PutFrame(frameIndex + 1, MakeFrame(frame(), frame(), env));
+				if (!hasFrame(frameIndex + 1)) {
+					putFrame(frameIndex + 1, MakeFrame(frame(), frame(), nonBQ, env));
 				}
-				lastDecodeFrame = frameIndex + 1;
+				lastFrame = frameIndex + 1;
 			}
 		}
 		else {
 			// ̂܂
-			if (cacheit != frameCache.end()) {
-				// łɃLbVɂ
-				UpdateAccessed(cacheit->value);
-			}
-			else {
-				PutFrame(frameIndex, MakeFrame(frame(), frame(), env));
+			if (!hasFrame(frameIndex)) {
+				putFrame(frameIndex, MakeFrame(frame(), frame(), nonBQ, env));
 			}
-			lastDecodeFrame = frameIndex;
+			lastFrame = frameIndex;
 		}
 
-		prevFrame = std::unique_ptr<Frame>(new Frame(frame));
+		prev = std::unique_ptr<Frame>(new Frame(frame));
 	}
 
 	void UpdateAccessed(CacheFrame* frame) {
@@ -582,7 +701,23 @@ class AMTSource : public IClip, AMTObject
 		return lb->value->data;
 	}
 
+	bool IsFrameReady(Frame& frame, int64_t keyFramePTS, int lastFrame) {
+		// V[Nŏ̃t[łȂȂOK
+		if (lastFrame != -1) return true;
+		// L[t[ȂOK
+		if (frame()->key_frame) return true;
+		// ^CX^vL[t[̂̂ȂL[t[Ɣf
+		if (keyFramePTS != -1 && keyFramePTS == frame()->pts) return true;
+		// ܂L[t[łȂ̂ŁA܂މ\
+		return false;
+	}
+
 	void DecodeLoop(int goal, IScriptEnvironment* env) {
+		if (prefetch) {
+			PrefetchDecodeLoop(goal, env);
+			return;
+		}
+
 		Frame frame;
 		AVPacket packet = AVPacket();
 
@@ -600,18 +735,8 @@ class AMTSource : public IClip, AMTObject
 		// packetL[t[PTS擾
 		// fR[ht[PTSȂL[t[Ɣf
 		int64_t keyFramePTS = -1;
-		auto isFrameReady = [&]() {
-			// V[Nŏ̃t[łȂȂOK
-			if (lastDecodeFrame != -1) return true;
-			// L[t[ȂOK
-			if (frame()->key_frame) return true;
-			// ^CX^vL[t[̂̂ȂL[t[Ɣf
-			if (keyFramePTS != -1 && keyFramePTS == frame()->pts) return true;
-			// ܂L[t[łȂ̂ŁA܂މ\
-			return false;
-		};
 
-		while (av_read_frame(inputCtx(), &packet) == 0) {
+		while (av_read_frame((*inputCtx)(), &packet) == 0) {
 			if (packet.stream_index == videoStream->index) {
 				if ((packet.flags & AV_PKT_FLAG_KEY) && keyFramePTS == -1) {
 					// ŏ̃L[t[PTSoĂ
@@ -623,7 +748,7 @@ class AMTSource : public IClip, AMTObject
 				}
 				while (avcodec_receive_frame(codecCtx(), frame()) == 0) {
 					// ŏ̓L[t[܂ŃXLbv
-					if (isFrameReady()) {
+					if (IsFrameReady(frame, keyFramePTS, lastDecodeFrame)) {
 #if ENABLE_FFMPEG_FILTER
 						OnFrameDecoded(frame, env);
 #else
@@ -645,6 +770,272 @@ class AMTSource : public IClip, AMTObject
 #endif
 	}
 
+	static size_t GetFrameBytes(Frame& frame) {
+		size_t bytes = 0;
+		for (int i = 0; i < AV_NUM_DATA_POINTERS; ++i) {
+			if (frame()->buf[i]) {
+				bytes += frame()->buf[i]->size;
+			}
+		}
+		return bytes;
+	}
+
+	// ǂ݃Xbh
+	// prefetchActive̊ԁAL[ςɂȂ܂ŃpPbgǂŃfR[h
+	void PrefetchLoop() {
+		Frame frame;
+		AVPacket packet = AVPacket();
+		std::unique_lock<std::mutex> lock(prefetchMutex);
+		while (true) {
+			while (!prefetchFinish && (!prefetchActive || prefetchEOF ||
+				(int)prefetchQueue.size() >= decoderSetting.prefetchFrames ||
+				prefetchBytes >= maxPrefetchBytes))
+			{
+				prefetchCond.wait(lock);
+			}
+			if (prefetchFinish) {
+				break;
+			}
+			prefetchBusy = true;
+			int64_t keyFramePTS = prefetchKeyPTS;
+			lock.unlock();
+
+			// fpPbg1fR[h
+			// prefetchBusẙԂ͂̃XbhinputCtxcodecCtxL
+			std::vector<PrefetchFrame> decoded;
+			bool sendFailed = false;
+			bool eof = true;
+			while (av_read_frame((*inputCtx)(), &packet) == 0) {
+				bool isVideo = (packet.stream_index == videoStream->index);
+				if (isVideo) {
+					if ((packet.flags & AV_PKT_FLAG_KEY) && keyFramePTS == -1) {
+						// ŏ̃L[t[PTSoĂ
+						keyFramePTS = packet.pts;
+					}
+					if (avcodec_send_packet(codecCtx(), &packet) != 0) {
+						sendFailed = true;
+					}
+					while (avcodec_receive_frame(codecCtx(), frame()) == 0) {
+						PrefetchFrame pf = { std::unique_ptr<Frame>(new Frame(frame)), keyFramePTS, GetFrameBytes(frame) };
+						decoded.push_back(std::move(pf));
+					}
+				}
+				av_packet_unref(&packet);
+				if (isVideo) {
+					eof = false;
+					break;
+				}
+			}
+
+			lock.lock();
+			prefetchBusy = false;
+			prefetchKeyPTS = keyFramePTS;
+			if (sendFailed) {
+				++prefetchSendFailed;
+			}
+			for (auto& pf : decoded) {
+				prefetchBytes += pf.bytes;
+				prefetchQueue.push_back(std::move(pf));
+			}
+			if (eof) {
+				prefetchEOF = true;
+			}
+			prefetchCond.notify_all();
+		}
+	}
+
+	// ǂ݂~߂inputCtxcodecCtxg悤ɂ
+	// ǂ݂t[̓V[N͎gȂ̂Ŏ̂Ă
+	void PausePrefetch() {
+		std::unique_lock<std::mutex> lock(prefetchMutex);
+		prefetchActive = false;
+		while (prefetchBusy) {
+			prefetchCond.wait(lock);
+		}
+		prefetchQueue.clear();
+		prefetchBytes = 0;
+		prefetchKeyPTS = -1;
+		prefetchEOF = false;
+	}
+
+	void ResumePrefetch() {
+		std::lock_guard<std::mutex> lock(prefetchMutex);
+		prefetchActive = true;
+		prefetchCond.notify_all();
+	}
+
+	void FinishPrefetch() {
+		{
+			std::lock_guard<std::mutex> lock(prefetchMutex);
+			prefetchFinish = true;
+			prefetchCond.notify_all();
+		}
+		prefetchThread.join();
+	}
+
+	// DecodeLoop̐ǂݔ
+	// fR[h͐ǂ݃XbhŝŁAł̓L[t[o
+	void PrefetchDecodeLoop(int goal, IScriptEnvironment* env) {
+		std::unique_lock<std::mutex> lock(prefetchMutex);
+		while (lastDecodeFrame < goal) {
+			while (prefetchQueue.empty() && !prefetchEOF) {
+				prefetchCond.wait(lock);
+			}
+			for (; prefetchSendFailed > 0; --prefetchSendFailed) {
+				ctx.incrementCounter(AMT_ERR_DECODE_PACKET_FAILED);
+				ctx.warn("avcodec_send_packet failed");
+			}
+			if (prefetchQueue.empty()) {
+				// Xg[͑Sēǂݎ
+				break;
+			}
+			PrefetchFrame pf = std::move(prefetchQueue.front());
+			prefetchQueue.pop_front();
+			prefetchBytes -= pf.bytes;
+			prefetchCond.notify_all();
+			lock.unlock();
+
+			// ŏ̓L[t[܂ŃXLbv
+			if (IsFrameReady(*pf.frame, pf.keyFramePTS, lastDecodeFrame)) {
+				OnFrameOutput(*pf.frame, env);
+			}
+			lock.lock();
+		}
+	}
+
+	// n܂GOPikeyFramet[jGOPfR[_ŃfR[hăLbVɓ
+	// mutexbNԂŌĂԂ
+	// fR[h̓bNÔŁÃXbh͕ʂGOPɃfR[hł
+	void DecodeGOP(int n, std::unique_lock<std::mutex>& lock, IScriptEnvironment* env)
+	{
+		int keyNum = frames[n].keyFrame;
+		while (true) {
+			if (frameCache.find(n) != frameCache.end()) {
+				// ҂ĂԂɑ̃XbhfR[h
+				return;
+			}
+			if (decodingGOPs.count(keyNum)) {
+				// GOP𑼂̃XbhfR[hȂ̂ŏÎ҂
+				while (decodingGOPs.count(keyNum)) {
+					gopCond.wait(lock);
+				}
+				return;
+			}
+			if (idleGOPDecoders.empty() && numGOPDecoders >= decoderSetting.gopDecoders) {
+				// 󂢂ĂfR[_Ȃ
+				gopCond.wait(lock);
+				continue;
+			}
+			break;
+		}
+
+		std::unique_ptr<GOPDecoder> decoder;
+		if (idleGOPDecoders.size() > 0) {
+			decoder = std::move(idleGOPDecoders.back());
+			idleGOPDecoders.pop_back();
+		}
+		else {
+			// bNOĂ
+			++numGOPDecoders;
+		}
+		decodingGOPs.insert(keyNum);
+
+		// GOP̍Ō̃t[
+		int goal = keyNum;
+		while (goal + 1 < (int)frames.size() && frames[goal + 1].keyFrame == keyNum) {
+			++goal;
+		}
+
+		GOPOutput out = GOPOutput();
+		lock.unlock();
+		try {
+			if (decoder == nullptr) {
+				decoder = std::unique_ptr<GOPDecoder>(new GOPDecoder());
+				OpenInput(decoder->virtualTs, decoder->inputCtx, decoder->videoStream, env);
+			}
+			DecodeGOPFrames(*decoder, keyNum, goal, out, env);
+		}
+		catch (...) {
+			lock.lock();
+			decodingGOPs.erase(keyNum);
+			if (decoder != nullptr) {
+				idleGOPDecoders.push_back(std::move(decoder));
+			}
+			else {
+				--numGOPDecoders;
+			}
+			gopCond.notify_all();
+			throw;
+		}
+		lock.lock();
+
+		for (int i = 0; i < out.numSendFailed; ++i) {
+			ctx.incrementCounter(AMT_ERR_DECODE_PACKET_FAILED);
+			ctx.warn("avcodec_send_packet failed");
+		}
+		for (int64_t pts : out.unknownPTS) {
+			ctx.incrementCounter(AMT_ERR_UNKNOWN_PTS);
+			ctx.warnF("Unknown PTS frame %lld", pts);
+		}
+		seekDistance = std::max(seekDistance, goal - keyNum + 1);
+		for (auto& frame : out.frames) {
+			if (frameCache.find(frame.first) == frameCache.end()) {
+				PutFrame(frame.first, frame.second);
+			}
+		}
+
+		decodingGOPs.erase(keyNum);
+		idleGOPDecoders.push_back(std::move(decoder));
+		gopCond.notify_all();
+	}
+
+	// GOPfR[_keyNumgoal܂łfR[hibNȂŌĂ΂j
+	void DecodeGOPFrames(GOPDecoder& decoder, int keyNum, int goal, GOPOutput& out, IScriptEnvironment* env)
+	{
+		int64_t fileOffset = frames[keyNum].fileOffset / 188 * 188;
+		if (av_seek_frame((*decoder.inputCtx)(), -1, fileOffset, AVSEEK_FLAG_BYTE) < 0) {
+			THROW(FormatException, "av_seek_frame failed");
+		}
+		if (decoder.codecCtx() == nullptr) {
+			MakeCodecContext(decoder.codecCtx, decoder.videoStream, env);
+		}
+		else {
+			// HWfR[_͍蒼d̂Ńobt@̂Ă邾ɂ
+			avcodec_flush_buffers(decoder.codecCtx());
+		}
+
+		int lastFrame = -1;
+		std::unique_ptr<Frame> prev;
+		PVideoFrame nonBQ;
+		GOPOutput decoded = GOPOutput();
+
+		Frame frame;
+		AVPacket packet = AVPacket();
+		int64_t keyFramePTS = -1;
+		while (lastFrame < goal && av_read_frame((*decoder.inputCtx)(), &packet) == 0) {
+			if (packet.stream_index == decoder.videoStream->index) {
+				if ((packet.flags & AV_PKT_FLAG_KEY) && keyFramePTS == -1) {
+					// ŏ̃L[t[PTSoĂ
+					keyFramePTS = packet.pts;
+				}
+				if (avcodec_send_packet(decoder.codecCtx(), &packet) != 0) {
+					++out.numSendFailed;
+				}
+				while (avcodec_receive_frame(decoder.codecCtx(), frame()) == 0) {
+					// ŏ̓L[t[܂ŃXLbv
+					if (IsFrameReady(frame, keyFramePTS, lastFrame)) {
+						OnFrameOutput(frame, lastFrame, prev, nonBQ, &decoded, env);
+					}
+				}
+			}
+			av_packet_unref(&packet);
+		}
+
+		// GOPÕt[͎Qƃt[Ă\̂ŏo͂Ȃ
+		out.frames.insert(decoded.frames.lower_bound(keyNum), decoded.frames.upper_bound(goal));
+		out.unknownPTS = std::move(decoded.unknownPTS);
+	}
+
 	void registerFailedFrames(int begin, int end, int replace, IScriptEnvironment* env)
 	{
 		for (int f = begin; f < end; ++f) {
@@ -657,10 +1048,16 @@ class AMTSource : public IClip, AMTObject
 		}
 	}
 
+	// base̎seekDistanceȓȂV[NɑOɐi߂
+	bool IsSequential(int n, int base) const {
+		return base != -1 && n > base && n < base + seekDistance;
+	}
+
 public:
 	AMTSource(AMTContext& ctx,
 		const tstring& srcpath,
 		const tstring& audiopath,
+		bool lazyWave,
 		const VideoFormat& vfmt, const AudioFormat& afmt,
 		const std::vector<FilterSourceFrame>& frames,
 		const std::vector<FilterAudioFrame>& audioFrames,
@@ -674,15 +1071,27 @@ public:
 		, audioFrames(audioFrames)
 		, filterdesc(filterdesc)
 		, outputQP(outputQP)
-		, inputCtx(srcpath)
 		, vi()
-		, waveFile(audiopath, _T("rb"))
+		, waveReader(ctx, audiopath, lazyWave)
 #if ENABLE_FFMPEG_FILTER
 		, bufferSrcCtx()
 		, bufferSinkCtx()
 #endif
 		, seekDistance(10)
 		, lastDecodeFrame(-1)
+		, lastRequestFrame(-1)
+		, prefetch(decoderSetting.prefetchFrames > 0)
+		, maxPrefetchBytes((size_t)std::max(decoderSetting.prefetchMemory, 1) * 1024 * 1024)
+		, prefetchThread(this)
+		, prefetchBytes(0)
+		, prefetchKeyPTS(-1)
+		, prefetchSendFailed(0)
+		, prefetchActive(false)
+		, prefetchBusy(false)
+		, prefetchEOF(false)
+		, prefetchFinish(false)
+		, srcpath(srcpath)
+		, numGOPDecoders(0)
 	{
 #if !ENABLE_FFMPEG_FILTER
 		if (this->filterdesc.size()) {
@@ -691,20 +1100,27 @@ public:
 #endif
 		MakeVideoInfo(vfmt, afmt);
 
-		if (avformat_find_stream_info(inputCtx(), NULL) < 0) {
-			env->ThrowError("avformat_find_stream_info failed");
-		}
-		videoStream = GetVideoStream(inputCtx());
-		if (videoStream == NULL) {
-			env->ThrowError("Could not find video stream ...");
-		}
+		OpenInput(virtualTs, inputCtx, videoStream, env);
 
 		// 
 		ResetDecoder(env);
 		UpdateVideoInfo(env);
+
+		if (this->filterdesc.size()) {
+			// tB^ꍇ͐ǂ݁EGOPfR[_͎gȂ
+			prefetch = false;
+			this->decoderSetting.gopDecoders = 0;
+		}
+		if (prefetch) {
+			// ŏGetFrameŃV[N܂ł͎~܂Ă
+			prefetchThread.start();
+		}
 	}
 
 	~AMTSource() {
+		if (prefetch) {
+			FinishPrefetch();
+		}
 		// LbV폜
 		while (recentAccessed.size() > 0) {
 			CacheFrame* pdel = recentAccessed.back().value;
@@ -720,7 +1136,10 @@ public:
 
 	PVideoFrame __stdcall GetFrame(int n, IScriptEnvironment* env)
 	{
-		std::lock_guard<std::mutex> guard(mutex);
+		std::unique_lock<std::mutex> lock(mutex);
+
+		int prevRequest = lastRequestFrame;
+		lastRequestFrame = n;
 
 		// LbVɂΕԂ
 		auto it = frameCache.find(n);
@@ -735,19 +1154,53 @@ public:
 		}
 
 		// LbVɂȂ̂ŃfR[h
-		if (lastDecodeFrame != -1 && n > lastDecodeFrame && n < lastDecodeFrame + seekDistance) {
+		if (IsSequential(n, lastDecodeFrame)) {
 			// Oɂ߂
+			// ǂ݂LȂɃfR[hς݂̃t[L[ɂ
 			DecodeLoop(n, env);
 		}
 		else {
+			// ŏ̃t[⏇̍ĐiÕNGXg̑j̓C̃fR[_V[N
+			// ȍ~͑Oɐi߂ȂfR[hiǂ݂j
+			// C̃fR[_ʂ̈ʒufR[ĥƂ̔єт̃NGXgGOPfR[_ɉ
+			if (decoderSetting.gopDecoders > 0 &&
+				lastDecodeFrame != -1 && !IsSequential(n, prevRequest))
+			{
+				// GOPfR[_ŃfR[h
+				DecodeGOP(n, lock, env);
+				auto gopit = frameCache.find(n);
+				if (gopit != frameCache.end()) {
+					UpdateAccessed(gopit->value);
+					return gopit->value->data;
+				}
+				// GOPfR[_œȂꍇ̓V[NăfR[h
+			}
+
 			// V[NăfR[h
+			// ւ̃V[N◣ꂽʒuւ̃V[N̏ꍇAǂ݂t[͔j
+			// V[N悩ǂ݂
 			int keyNum = frames[n].keyFrame;
 			for (int i = 0; ; ++i) {
 				int64_t fileOffset = frames[keyNum].fileOffset / 188 * 188;
-				if (av_seek_frame(inputCtx(), -1, fileOffset, AVSEEK_FLAG_BYTE) < 0) {
-					THROW(FormatException, "av_seek_frame failed");
+				if (prefetch) {
+					PausePrefetch();
+				}
+				try {
+					if (av_seek_frame((*inputCtx)(), -1, fileOffset, AVSEEK_FLAG_BYTE) < 0) {
+						THROW(FormatException, "av_seek_frame failed");
+					}
+					ResetDecoder(env);
+				}
+				catch (...) {
+					// ~߂܂܂ƎGetFrameǂ݂҂̂ōĊJĂ瓊
+					if (prefetch) {
+						ResumePrefetch();
+					}
+					throw;
+				}
+				if (prefetch) {
+					ResumePrefetch();
 				}
-				ResetDecoder(env);
 				DecodeLoop(n, env);
 				if (frameCache.find(n) != frameCache.end()) {
 					// fR[h
@@ -799,8 +1252,8 @@ public:
 
 			if (audioFrames[(size_t)frameIndex].waveLength != 0) {
 				// waveȂǂ
-				waveFile.seek(audioFrames[(size_t)frameIndex].waveOffset + frameOffset * sampleBytes, SEEK_SET);
-				waveFile.read(MemoryChunk(ptr, readBytes));
+				waveReader.read(audioFrames[(size_t)frameIndex],
+					(int)frameOffset * sampleBytes, MemoryChunk(ptr, readBytes));
 			}
 			else {
 				// Ȃꍇ̓[߂
@@ -836,6 +1289,7 @@ void SaveAMTSource(
 	const tstring& savepath,
 	const tstring& srcpath,
 	const tstring& audiopath,
+	bool lazyWave, // trueȂaudiopath͒AACt@C
 	const VideoFormat& vfmt, const AudioFormat& afmt,
 	const std::vector<FilterSourceFrame>& frames,
 	const std::vector<FilterAudioFrame>& audioFrames,
@@ -844,6 +1298,7 @@ void SaveAMTSource(
 	File file(savepath, _T("wb"));
 	file.writeArray(std::vector<tchar>(srcpath.begin(), srcpath.end()));
 	file.writeArray(std::vector<tchar>(audiopath.begin(), audiopath.end()));
+	file.writeValue(lazyWave);
 	file.writeValue(vfmt);
 	file.writeValue(afmt);
 	file.writeArray(frames);
@@ -858,6 +1313,7 @@ PClip LoadAMTSource(const tstring& loadpath, const char* filterdesc, bool output
 	tstring srcpath(srcpathv.begin(), srcpathv.end());
 	auto& audiopathv = file.readArray<tchar>();
 	tstring audiopath(audiopathv.begin(), audiopathv.end());
+	bool lazyWave = file.readValue<bool>();
 	VideoFormat vfmt = file.readValue<VideoFormat>();
 	AudioFormat afmt = file.readValue<AudioFormat>();
 	auto data = std::unique_ptr<AMTSourceData>(new AMTSourceData());
@@ -865,7 +1321,7 @@ PClip LoadAMTSource(const tstring& loadpath, const char* filterdesc, bool output
 	data->audioFrames = file.readArray<FilterAudioFrame>();
 	DecoderSetting decoderSetting = file.readValue<DecoderSetting>();
 	AMTSource* src = new AMTSource(*g_ctx_for_plugin_filter,
-		srcpath, audiopath, vfmt, afmt, data->frames, data->audioFrames, decoderSetting, filterdesc, outputQP, env);
+		srcpath, audiopath, lazyWave, vfmt, afmt, data->frames, data->audioFrames, decoderSetting, filterdesc, outputQP, env);
 	src->TransferStreamInfo(std::move(data));
 	return src;
 }
@@ -884,14 +1340,12 @@ AVSValue CreateAMTSource(AVSValue args, void* user_data, IScriptEnvironment* env
 class AVSLosslessSource : public IClip
 {
 	LosslessVideoFile file;
-	CCodecPointer codec;
+	std::unique_ptr<LosslessFrameDecoder> decoder;
 	VideoInfo vi;
-	std::unique_ptr<uint8_t[]> codedFrame;
 	std::unique_ptr<uint8_t[]> rawFrame;
 public:
 	AVSLosslessSource(AMTContext& ctx, const tstring& filepath, const VideoFormat& format, IScriptEnvironment* env)
 		: file(ctx, filepath, _T("rb"))
-		, codec(make_unique_ptr(CCodec::CreateInstance(UTVF_ULH0, "Amatsukaze")))
 		, vi()
 	{
 		file.readHeader();
@@ -902,27 +1356,15 @@ public:
 		vi.num_frames = file.getNumFrames();
 		vi.pixel_type = VideoInfo::CS_YV12;
 		vi.SetFPS(format.frameRateNum, format.frameRateDenom);
-		auto extra = file.getExtra();
-		size_t cbGrossWidth[] = { CBGROSSWIDTH_WINDOWS, CBGROSSWIDTH_WINDOWS, CBGROSSWIDTH_WINDOWS };
-		if (codec->DecodeBegin(UTVF_YV12, vi.width, vi.height, cbGrossWidth, extra.data(), (int)extra.size())) {
-			THROW(RuntimeException, "failed to DecodeBegin (UtVideo)");
-		}
-
-		size_t codedSize = codec->EncodeGetOutputSize(UTVF_YV12, vi.width, vi.height);
-		codedFrame = std::unique_ptr<uint8_t[]>(new uint8_t[codedSize]);
+		decoder = std::unique_ptr<LosslessFrameDecoder>(new LosslessFrameDecoder(file));
 
 		rawFrame = std::unique_ptr<uint8_t[]>(new uint8_t[vi.width * vi.height * 3 / 2]);
 	}
 
-	~AVSLosslessSource() {
-		codec->DecodeEnd();
-	}
-
 	PVideoFrame __stdcall GetFrame(int n, IScriptEnvironment* env)
 	{
 		n = std::max(0, std::min(vi.num_frames - 1, n));
-		file.readFrame(n, codedFrame.get());
-		codec->DecodeFrame(rawFrame.get(), codedFrame.get());
+		decoder->decode(file, n, rawFrame.get());
 		PVideoFrame dst = env->NewVideoFrame(vi);
 		CopyYV12(dst, rawFrame.get(), vi.width, vi.height);
 		return dst;
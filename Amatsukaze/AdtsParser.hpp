@@ -106,25 +106,121 @@ struct AdtsHeader {
 };
 #endif
 
+// AACt[2chɃ_E~bNXăfR[h
+// tH[}bgςƂ̍ďł
+class AdtsDecoder : public AMTObject {
+public:
+	enum DecodeResult {
+		DECODE_OK,
+		DECODE_ERROR,      // fR[hG[
+		DECODE_NOT_STEREO, // fR[hł2chɂȂȂ
+	};
+
+	AdtsDecoder(AMTContext&ctx)
+		: AMTObject(ctx)
+		, hAacDec(NULL)
+	{ }
+	~AdtsDecoder() {
+		closeDecoder();
+	}
+
+	// frame: ADTSwb_n܂f[^
+	// samples͎decodeĂяo܂ŗL
+	DecodeResult decode(MemoryChunk frame, NeAACDecFrameInfo& frameInfo, void*& samples) {
+		uint8_t* ptr = frame.data;
+		int len = (int)frame.length;
+		if (hAacDec == NULL) {
+			resetDecoder(frame);
+		}
+		samples = NeAACDecDecode(hAacDec, &frameInfo, ptr, len);
+		if (frameInfo.error != 0) {
+			// tH[}bgςƃG[f̂ŏĂPH킹
+			// ςȎgNeroAACN̓Xg[̓r
+			// tH[}bgς邱Ƃz肵ĂȂ񂾂dȂ
+			//ifixed headerςȂĂ`l\ς邱Ƃ邩ǂł݂ȂƕȂj
+			resetDecoder(frame);
+			samples = NeAACDecDecode(hAacDec, &frameInfo, ptr, len);
+		}
+		if (frameInfo.error != 0) {
+			return DECODE_ERROR;
+		}
+		// _E~bNXĂ̂2chɂȂ͂
+		if (getNumChannels(frameInfo) != 2) {
+			// tH[}bgςƃoO2chɂłȂƂ̂ŁAĂPH킹
+			// ςȎgNeroAACN̓Xg[̓r(ry
+			resetDecoder(frame);
+			samples = NeAACDecDecode(hAacDec, &frameInfo, ptr, len);
+		}
+		if (frameInfo.error != 0 || getNumChannels(frameInfo) != 2) {
+			return DECODE_NOT_STEREO;
+		}
+		return DECODE_OK;
+	}
+
+	static int getNumChannels(const NeAACDecFrameInfo& frameInfo) {
+		return frameInfo.num_front_channels +
+			frameInfo.num_back_channels + frameInfo.num_side_channels + frameInfo.num_lfe_channels;
+	}
+
+private:
+	NeAACDecHandle hAacDec;
+
+	void closeDecoder() {
+		if (hAacDec != NULL) {
+			NeAACDecClose(hAacDec);
+			hAacDec = NULL;
+		}
+	}
+
+	bool resetDecoder(MemoryChunk data) {
+		closeDecoder();
+
+		hAacDec = NeAACDecOpen();
+		NeAACDecConfigurationPtr conf = NeAACDecGetCurrentConfiguration(hAacDec);
+		conf->outputFormat = FAAD_FMT_16BIT;
+		conf->downMatrix = 1; // WAVo͉͂͗pȂ̂2chΏ\
+		NeAACDecSetConfiguration(hAacDec, conf);
+
+		unsigned long samplerate;
+		unsigned char channels;
+		if (NeAACDecInit(hAacDec, data.data, (int)data.length, &samplerate, &channels)) {
+			ctx.warn("NeAACDecInitɎs");
+			return false;
+		}
+		return true;
+	}
+};
+
 class AdtsParser : public AMTObject {
 public:
 	AdtsParser(AMTContext&ctx)
 		: AMTObject(ctx)
-		, hAacDec(NULL)
+		, decoder(ctx)
 		, bytesConsumed_(0)
 		, lastPTS_(-1)
 		, syncOK(false)
+		, deferDecode_(false)
+		, probeKey_(-1)
+		, probeSamplesPerBlock_(0)
+		, probeSampleRate_(0)
 	{
 		createChannelsMap();
 	}
-	~AdtsParser() {
-		closeDecoder();
-	}
 
 	virtual void reset() {
 		decodedBuffer.release();
 	}
 
+	// trueɂƃfR[hf[^o͂ȂidecodedDataSize=0ɂȂj
+	// numDecodedSamples̓fR[hƂ̃Tvi\zlj
+	// tH[}bg񂪕KvȂ̂fixed headerςt[͂ŃfR[h邪
+	// ȊO̓wb_̏񂾂Ńt[
+	// fR[h͌ĂяoAdtsDecodergĕʓrs
+	void setDeferDecode(bool defer) {
+		deferDecode_ = defer;
+		probeKey_ = -1;
+	}
+
 	virtual bool inputFrame(MemoryChunk frame__, std::vector<AudioFrameData>& info, int64_t PTS) {
 		info.clear();
 		decodedBuffer.clear();
@@ -171,99 +267,57 @@ public:
 				if (header.parse(ptr, len)
 					&& header.frame_length <= len)
 				{
-					// Xg[͖͂̂ʓ|Ȃ̂ŃfR[hႤ
-					if (hAacDec == NULL) {
-						resetDecoder(MemoryChunk(ptr, len));
-					}
-					NeAACDecFrameInfo frameInfo;
-					void* samples = NeAACDecDecode(hAacDec, &frameInfo, ptr, len);
-					if (frameInfo.error != 0) {
-						// tH[}bgςƃG[f̂ŏĂPH킹
-						// ςȎgNeroAACN̓Xg[̓r
-						// tH[}bgς邱Ƃz肵ĂȂ񂾂dȂ
-						//ifixed headerςȂĂ`l\ς邱Ƃ邩ǂł݂ȂƕȂj
-						resetDecoder(MemoryChunk(ptr, len));
-						samples = NeAACDecDecode(hAacDec, &frameInfo, ptr, len);
-					}
-					if (frameInfo.error == 0) {
-						// _E~bNXĂ̂2chɂȂ͂
-						int numChannels = frameInfo.num_front_channels +
-							frameInfo.num_back_channels + frameInfo.num_side_channels + frameInfo.num_lfe_channels;
-
-						if (numChannels != 2) {
-							// tH[}bgςƃoO2chɂłȂƂ̂ŁAĂPH킹
-							// ςȎgNeroAACN̓Xg[̓r(ry
-							resetDecoder(MemoryChunk(ptr, len));
-							samples = NeAACDecDecode(hAacDec, &frameInfo, ptr, len);
-
-							numChannels = frameInfo.num_front_channels +
-								frameInfo.num_back_channels + frameInfo.num_side_channels + frameInfo.num_lfe_channels;
-						}
-
-						if (frameInfo.error != 0 || numChannels != 2) {
-							ctx.incrementCounter(AMT_ERR_DECODE_AUDIO);
-							ctx.warn("t[𐳂fR[hł܂ł");
+					AudioFrameData frameData;
+					if (getFrameFormat(ptr, len, frameData)) {
+						// Xg[Ȃ frameInfo.bytesconsumed == header.frame_length ƂȂ͂
+						// Xg[sƓɂȂȂƂ
+						// ̏ꍇA header.frame_length D悷
+						//ĩ̕t[fR[hmオ̂
+						//  L-SMASHheader.frame_lengthăt[XLbvĂ̂
+						//  ꂪۂ̃t[ƈvĂȂƗ̂Łj
+						//frameData.codedDataSize = frameInfo.bytesconsumed;
+						frameData.codedDataSize = header.frame_length;
+
+						// codedBufferf[^ւ̃|C^Ă̂
+						// codedBufferɂ͐GȂ悤ɒӁI
+						frameData.codedData = ptr;
+						// AutoBuffer̓Ċmۂ̂ŃfR[hf[^ւ̃|C^͌œ
+
+						// PTSvZ
+						int64_t duration = 90000 * frameData.numSamples / frameData.format.sampleRate;
+						if (ibytes < prevDataSize) {
+							// t[̊Jñ݂pPbg擪Oꍇ
+							// i܂APESpPbg̋Eƃt[̋EvȂꍇj
+							// ݂̃pPbgPTS͓KpłȂ̂őÕpPbg̒l
+							frameData.PTS = lastPTS_;
+							lastPTS_ += duration;
+							// ݂̃pPbgȂ΃t[o͂łȂ̂ŁAo͂t[݂͌̃pPbg̈ꕔ܂ނ͂
+							ASSERT(ibytes + header.frame_length > prevDataSize);
+							// ܂APTŚi΁j̃t[PTSł
+							if (PTS >= 0) {
+								lastPTS_ = PTS;
+								PTS = -1;
+							}
 						}
 						else {
-							decodedBuffer.add(MemoryChunk((uint8_t*)samples, frameInfo.samples * 2));
-
-							AudioFrameData frameData;
-							frameData.numSamples = frameInfo.original_samples / numChannels;
-							frameData.numDecodedSamples = frameInfo.samples / numChannels;
-							frameData.format.channels = getAudioChannels(header, frameInfo);
-							frameData.format.sampleRate = frameInfo.samplerate;
-							
-							// Xg[Ȃ frameInfo.bytesconsumed == header.frame_length ƂȂ͂
-							// Xg[sƓɂȂȂƂ
-							// ̏ꍇA header.frame_length D悷
-							//ĩ̕t[fR[hmオ̂
-							//  L-SMASHheader.frame_lengthăt[XLbvĂ̂
-							//  ꂪۂ̃t[ƈvĂȂƗ̂Łj
-							//frameData.codedDataSize = frameInfo.bytesconsumed;
-							frameData.codedDataSize = header.frame_length;
-
-							// codedBufferf[^ւ̃|C^Ă̂
-							// codedBufferɂ͐GȂ悤ɒӁI
-							frameData.codedData = ptr;
-							frameData.decodedDataSize = frameInfo.samples * 2;
-							// AutoBuffer̓Ċmۂ̂ŃfR[hf[^ւ̃|C^͌œ
-
-							// PTSvZ
-							int64_t duration = 90000 * frameData.numSamples / frameData.format.sampleRate;
-							if (ibytes < prevDataSize) {
-								// t[̊Jñ݂pPbg擪Oꍇ
-								// i܂APESpPbg̋Eƃt[̋EvȂꍇj
-								// ݂̃pPbgPTS͓KpłȂ̂őÕpPbg̒l
-								frameData.PTS = lastPTS_;
-								lastPTS_ += duration;
-								// ݂̃pPbgȂ΃t[o͂łȂ̂ŁAo͂t[݂͌̃pPbg̈ꕔ܂ނ͂
-								ASSERT(ibytes + header.frame_length > prevDataSize);
-								// ܂APTŚi΁j̃t[PTSł
-								if (PTS >= 0) {
-									lastPTS_ = PTS;
-									PTS = -1;
-								}
-							}
-							else {
-								// PESpPbg̋Eƃt[̋Evꍇ
-								// PESpPbg2Ԗڈȍ~̃t[
-								if (PTS >= 0) {
-									lastPTS_ = PTS;
-									PTS = -1;
-								}
-								frameData.PTS = lastPTS_;
-								lastPTS_ += duration;
+							// PESpPbg̋Eƃt[̋Evꍇ
+							// PESpPbg2Ԗڈȍ~̃t[
+							if (PTS >= 0) {
+								lastPTS_ = PTS;
+								PTS = -1;
 							}
+							frameData.PTS = lastPTS_;
+							lastPTS_ += duration;
+						}
 
-							info.push_back(frameData);
+						info.push_back(frameData);
 
-							// f[^i߂
-							//ASSERT(frameInfo.bytesconsumed == header.frame_length);
-							ibytes += header.frame_length - 1;
-							bytesConsumed_ = ibytes + 1;
+						// f[^i߂
+						//ASSERT(frameInfo.bytesconsumed == header.frame_length);
+						ibytes += header.frame_length - 1;
+						bytesConsumed_ = ibytes + 1;
 
-							syncOK = true;
-						}
+						syncOK = true;
 					}
 				}
 				else {
@@ -289,7 +343,7 @@ public:
 	}
 
 private:
-	NeAACDecHandle hAacDec;
+	AdtsDecoder decoder;
 	AdtsHeader header;
 	std::map<int64_t, AUDIO_CHANNELS> channelsMap;
 
@@ -301,43 +355,79 @@ private:
 	AutoBuffer decodedBuffer;
 	bool syncOK;
 
-	void closeDecoder() {
-		if (hAacDec != NULL) {
-			NeAACDecClose(hAacDec);
-			hAacDec = NULL;
+	// fR[hx[hp
+	bool deferDecode_;
+	int probeKey_; // ŌɃfR[ht[fixed header
+	int probeSamplesPerBlock_;
+	int probeSampleRate_;
+
+	// t[̃TvƃtH[}bg擾
+	// iKvȂfR[hăfR[hf[^decodedBufferɒǉj
+	bool getFrameFormat(uint8_t* ptr, int len, AudioFrameData& frameData) {
+		int numBlocks = header.number_of_raw_data_blocks_in_frame + 1;
+		int key = (header.profile << 8) | (header.sampling_frequency_index << 4) | header.channel_configuration;
+		if (deferDecode_ && header.channel_configuration > 0 && key == probeKey_) {
+			// fixed header̃t[fR[hƂ̏g
+			//iHE-AAC̓wb_ĂȂ̂ōŏ̓fR[hĊmFĂj
+			frameData.numSamples = probeSamplesPerBlock_ * numBlocks;
+			frameData.numDecodedSamples = frameData.numSamples;
+			frameData.format.channels = getHeaderChannels(header);
+			frameData.format.sampleRate = probeSampleRate_;
+			frameData.decodedDataSize = 0;
+			return true;
 		}
-	}
 
-	bool resetDecoder(MemoryChunk data) {
-		closeDecoder();
-
-		hAacDec = NeAACDecOpen();
-		NeAACDecConfigurationPtr conf = NeAACDecGetCurrentConfiguration(hAacDec);
-		conf->outputFormat = FAAD_FMT_16BIT;
-		conf->downMatrix = 1; // WAVo͉͂͗pȂ̂2chΏ\
-		NeAACDecSetConfiguration(hAacDec, conf);
-
-		unsigned long samplerate;
-		unsigned char channels;
-		if (NeAACDecInit(hAacDec, data.data, (int)data.length, &samplerate, &channels)) {
-			ctx.warn("NeAACDecInitɎs");
+		// Xg[͖͂̂ʓ|Ȃ̂ŃfR[hႤ
+		NeAACDecFrameInfo frameInfo;
+		void* samples;
+		AdtsDecoder::DecodeResult result = decoder.decode(MemoryChunk(ptr, len), frameInfo, samples);
+		if (result == AdtsDecoder::DECODE_NOT_STEREO) {
+			ctx.incrementCounter(AMT_ERR_DECODE_AUDIO);
+			ctx.warn("t[𐳂fR[hł܂ł");
+		}
+		if (result != AdtsDecoder::DECODE_OK) {
 			return false;
 		}
+
+		int numChannels = AdtsDecoder::getNumChannels(frameInfo);
+		frameData.numSamples = frameInfo.original_samples / numChannels;
+		frameData.format.channels = getAudioChannels(header, frameInfo);
+		frameData.format.sampleRate = frameInfo.samplerate;
+
+		if (deferDecode_) {
+			// fR[_̃t[͏o͂Ȃ̂
+			// fR[hꍇ̃TvnumSamplesƓƂ
+			frameData.numDecodedSamples = frameData.numSamples;
+			frameData.decodedDataSize = 0;
+			probeKey_ = key;
+			probeSamplesPerBlock_ = frameData.numSamples / numBlocks;
+			probeSampleRate_ = frameData.format.sampleRate;
+		}
+		else {
+			decodedBuffer.add(MemoryChunk((uint8_t*)samples, frameInfo.samples * 2));
+			frameData.numDecodedSamples = frameInfo.samples / numChannels;
+			frameData.decodedDataSize = frameInfo.samples * 2;
+		}
 		return true;
 	}
 
+	static AUDIO_CHANNELS getHeaderChannels(const AdtsHeader& header) {
+		switch (header.channel_configuration) {
+		case 1: return AUDIO_MONO;
+		case 2: return AUDIO_STEREO;
+		case 3: return AUDIO_30;
+		case 4: return AUDIO_31;
+		case 5: return AUDIO_32;
+		case 6: return AUDIO_32_LFE;
+		case 7: return AUDIO_52_LFE; // 4K
+		}
+		return AUDIO_NONE;
+	}
+
 	AUDIO_CHANNELS getAudioChannels(const AdtsHeader& header, const NeAACDecFrameInfo& frameInfo) {
 
 		if (header.channel_configuration > 0) {
-			switch (header.channel_configuration) {
-			case 1: return AUDIO_MONO;
-			case 2: return AUDIO_STEREO;
-			case 3: return AUDIO_30;
-			case 4: return AUDIO_31;
-			case 5: return AUDIO_32;
-			case 6: return AUDIO_32_LFE;
-			case 7: return AUDIO_52_LFE; // 4K
-			}
+			return getHeaderChannels(header);
 		}
 
 		int64_t canonical = channelCanonical(frameInfo.fr_ch_ele, frameInfo.element_id);
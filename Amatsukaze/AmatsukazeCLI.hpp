@@ -72,6 +72,8 @@ static void printHelp(const tchar* bin) {
 		"  --ignore-nicojk-error jRjR擾ŃG[Ă𑱍s\n"
 		"  --no-delogo         SȂiftHg̓Sꍇ͏܂j\n"
 		"  --loose-logo-detection So肵lႭ܂\n"
+		"  --logo-prune <l> ܂΂ȃt[ŃSʎwɍiĂ][0]\n"
+		"                      0 : i荞܂ȂiSS]j\n"
 		"  --max-fade-length <l> S̍őtF[ht[[16]\n"
 		"  --chapter-exe <pX> chapter_exe.exeւ̃pX\n"
 		"  --jls <pX>         join_logo_scp.exeւ̃pX\n"
@@ -93,6 +95,20 @@ static void printHelp(const tchar* bin) {
 		"                      4 : 1920x1080s\n"
 		"                      8 : 1920x1080\n"
 		"                      OR ) 15: ׂďo\n"
+		"  --no-pipelined-split TS͂̓ǂݍ݁ÉE݂1Xbhōs\n"
+		"  --parallel-audio-decode TS͎̉fR[hʃXbhōs\n"
+		"                      ꂽXg[ł͉t[̈ς邱Ƃ\n"
+		"  --lazy-wave         TS͎ɉ͗pWAV炸KvɂȂɃfR[h\n"
+		"  --split-threads <l> TS͈͂ɕĎwXbhŕɉ͂[0]\n"
+		"                      0,1 : ͂Ȃ\n"
+		"                      --parallel-audio-decode--lazy-waveKv\n"
+		"                      ͈͂̋E̓q[XeBbNɊmF̂1XbhƏo͂ς邱Ƃ\n"
+		"  --virtual-int-video ԉft@CɓTS璼ڃfR[h\n"
+		"  --prefetch-frames <l> AMTSourceŕʃXbhŐǂ݃fR[ht[[0]\n"
+		"                      0 : ǂ݂Ȃ\n"
+		"  --prefetch-memory <l> ǂ݃fR[ht[Ɏgő僁(MB)[256]\n"
+		"  --gop-decoders <l> AMTSourceŃ_ANZXGOPPʂŕɃfR[hfR[_[0]\n"
+		"                      0 : gȂ\n"
 		"  --no-remove-tmp     ꎞt@C폜Ɏc\n"
 		"                      ftHg60fps^C~OŐ\n"
 		"  --timefactor <l>  x265NVEncŋ^VFR[gRg[Ƃ̎ԃ[gt@N^[[0.25]\n"
@@ -197,7 +213,13 @@ static std::unique_ptr<ConfigWrapper> parseArgs(AMTContext& ctx, int argc, const
 	conf.inPipe = INVALID_HANDLE_VALUE;
 	conf.outPipe = INVALID_HANDLE_VALUE;
 	conf.maxFadeLength = 16;
+	conf.logoPruneTopK = 0;
 	conf.numEncodeBufferFrames = 16;
+	conf.pipelinedSplit = true;
+	conf.parallelAudioDecode = false;
+	conf.lazyWave = false;
+	conf.numSplitThreads = 0;
+	conf.virtualIntVideo = false;
 	bool nicojk = false;
 
 	for (int i = 1; i < argc; ++i) {
@@ -354,6 +376,30 @@ static std::unique_ptr<ConfigWrapper> parseArgs(AMTContext& ctx, int argc, const
 		else if (key == _T("-eb") || key == _T("--encode-buffer")) {
 			conf.numEncodeBufferFrames = std::stoi(getParam(argc, argv, i++));
 		}
+		else if (key == _T("--no-pipelined-split")) {
+			conf.pipelinedSplit = false;
+		}
+		else if (key == _T("--parallel-audio-decode")) {
+			conf.parallelAudioDecode = true;
+		}
+		else if (key == _T("--lazy-wave")) {
+			conf.lazyWave = true;
+		}
+		else if (key == _T("--split-threads")) {
+			conf.numSplitThreads = std::stoi(getParam(argc, argv, i++));
+		}
+		else if (key == _T("--virtual-int-video")) {
+			conf.virtualIntVideo = true;
+		}
+		else if (key == _T("--prefetch-frames")) {
+			conf.decoderSetting.prefetchFrames = std::stoi(getParam(argc, argv, i++));
+		}
+		else if (key == _T("--prefetch-memory")) {
+			conf.decoderSetting.prefetchMemory = std::stoi(getParam(argc, argv, i++));
+		}
+		else if (key == _T("--gop-decoders")) {
+			conf.decoderSetting.gopDecoders = std::stoi(getParam(argc, argv, i++));
+		}
 		else if (key == _T("--ignore-no-logo")) {
 			conf.ignoreNoLogo = true;
 		}
@@ -366,6 +412,9 @@ static std::unique_ptr<ConfigWrapper> parseArgs(AMTContext& ctx, int argc, const
 		else if (key == _T("--loose-logo-detection")) {
 			conf.looseLogoDetection = true;
 		}
+		else if (key == _T("--logo-prune")) {
+			conf.logoPruneTopK = std::stoi(getParam(argc, argv, i++));
+		}
 		else if (key == _T("--max-fade-length")) {
 			conf.maxFadeLength = std::stoi(getParam(argc, argv, i++));
 		}
@@ -637,6 +686,30 @@ static int amatsukazeTranscodeMain(AMTContext& ctx, const ConfigWrapper& setting
 			test::VerifyMpeg2Ps(ctx, setting);
 		else if (mode == _T("test_readts"))
 			test::ReadTS(ctx, setting);
+		else if (mode == _T("test_readts_perf"))
+			test::TsParsePerformance(ctx, setting);
+		else if (mode == _T("test_split_pipeline"))
+			test::SplitPipeline(ctx, setting);
+		else if (mode == _T("test_split_audiodec"))
+			test::SplitAudioDecode(ctx, setting);
+		else if (mode == _T("test_split_parallel"))
+			test::SplitParallel(ctx, setting);
+		else if (mode == _T("test_virtual_int_video"))
+			test::VirtualIntVideo(ctx, setting);
+		else if (mode == _T("test_amtsource_prefetch"))
+			test::AMTSourcePrefetch(ctx, setting);
+		else if (mode == _T("test_amtsource_gop"))
+			test::AMTSourceGOPDecode(ctx, setting);
+		else if (mode == _T("test_lazywave"))
+			test::LazyWave(ctx, setting);
+		else if (mode == _T("test_pump_perf"))
+			test::DataPumpPerformance(ctx, setting);
+		else if (mode == _T("test_y4m_perf"))
+			test::Y4MWritePerformance(ctx, setting);
+		else if (mode == _T("test_frame_consumer"))
+			test::FrameConsumer(ctx, setting);
+		else if (mode == _T("test_frame_transport"))
+			test::FrameTransportPerformance(ctx, setting);
 		else if (mode == _T("test_aacdec"))
 			test::AacDecode(ctx, setting);
 		else if (mode == _T("test_wavewrite"))
@@ -649,8 +722,32 @@ static int amatsukazeTranscodeMain(AMTContext& ctx, const ConfigWrapper& setting
 			test::ParseArgs(ctx, setting);
 		else if (mode == _T("test_lossless"))
 			test::LosslessFileTest(ctx, setting);
+		else if (mode == _T("test_lossless_parallel"))
+			test::LosslessParallelTest(ctx, setting);
 		else if (mode == _T("test_logoframe"))
 			test::LogoFrameTest(ctx, setting);
+		else if (mode == _T("test_logoframe_perf"))
+			test::LogoFramePerformance(ctx, setting);
+		else if (mode == _T("test_logo_eval"))
+			test::LogoEvaluatePerformance(ctx, setting);
+		else if (mode == _T("test_logo_multifade"))
+			test::LogoMultiFadePerformance(ctx, setting);
+		else if (mode == _T("test_scratch"))
+			test::ScratchArenaTest(ctx, setting);
+		else if (mode == _T("test_logo_analyze_cache"))
+			test::LogoAnalyzeCacheTest(ctx, setting);
+		else if (mode == _T("test_delogo_kernel"))
+			test::DelogoKernelTest(ctx, setting);
+		else if (mode == _T("test_sampled_logoscan"))
+			test::SampledLogoScanTest(ctx, setting);
+		else if (mode == _T("test_logoscan_parallel"))
+			test::LogoScanParallelTest(ctx, setting);
+		else if (mode == _T("test_logo_mask_cache"))
+			test::LogoMaskCacheTest(ctx, setting);
+		else if (mode == _T("test_logo_pruning"))
+			test::LogoCandidatePruningTest(ctx, setting);
+		else if (mode == _T("test_sliding_window"))
+			test::SlidingWindowTest(ctx, setting);
 		else if (mode == _T("test_dualmono"))
 			test::SplitDualMonoAAC(ctx, setting);
 		else if (mode == _T("test_aacdecode"))
@@ -10,6 +10,8 @@
 #include "TranscodeManager.hpp"
 #include "LogoScan.hpp"
 
+#include <random>
+
 namespace test {
 
 static int PrintCRCTable(AMTContext& ctx, const ConfigWrapper& setting)
@@ -148,284 +150,1355 @@ static int ReadTS(AMTContext& ctx, const ConfigWrapper& setting)
 	return 0;
 }
 
-static int AacDecode(AMTContext& ctx, const ConfigWrapper& setting)
+static bool FileEquals(const tstring& path0, const tstring& path1)
 {
-	tstring srcfile = setting.getSrcFilePath() + _T(".aac");
-	tstring testfile = setting.getSrcFilePath() + _T(".wav");
-
-	FILE* fp = fsopenT(srcfile.c_str(), _T("rb"), _SH_DENYNO);
-	if (fp == nullptr) {
-		return 1;
-	}
-
-	enum {
-		BUF_SIZE = 1024 * 1024, // 1MB
-	};
-	auto buf = std::unique_ptr<uint8_t>(new uint8_t[BUF_SIZE]);
-	size_t readBytes = fread(buf.get(), 1, BUF_SIZE, fp);
-
-	AutoBuffer decoded;
-
-	NeAACDecHandle hAacDec = NeAACDecOpen();
-	/*
-	NeAACDecConfigurationPtr conf = NeAACDecGetCurrentConfiguration(hAacDec);
-	conf->outputFormat = FAAD_FMT_16BIT;
-	NeAACDecSetConfiguration(hAacDec, conf);
-	*/
-
-	unsigned long samplerate;
-	unsigned char channels;
-	if (NeAACDecInit(hAacDec, buf.get(), (unsigned long)readBytes, &samplerate, &channels)) {
-		fprintf(stderr, "NeAACDecInit failed\n");
-		return 1;
+	enum { BUF_SIZE = 4 * 1024 * 1024 };
+	File file0(path0, _T("rb"));
+	File file1(path1, _T("rb"));
+	if (file0.size() != file1.size()) {
+		return false;
 	}
-
-	printf("samplerate=%d, channels=%d\n", samplerate, channels);
-
-	for (int i = 0; i < (int)readBytes; ) {
-		NeAACDecFrameInfo frameInfo;
-		void* samples = NeAACDecDecode(hAacDec, &frameInfo, buf.get() + i, (unsigned long)readBytes - i);
-		decoded.add(MemoryChunk((uint8_t*)samples, frameInfo.samples * 2));
-		i += frameInfo.bytesconsumed;
+	auto buf0 = std::unique_ptr<uint8_t[]>(new uint8_t[BUF_SIZE]);
+	auto buf1 = std::unique_ptr<uint8_t[]>(new uint8_t[BUF_SIZE]);
+	while (true) {
+		size_t read0 = file0.read(MemoryChunk(buf0.get(), BUF_SIZE));
+		size_t read1 = file1.read(MemoryChunk(buf1.get(), BUF_SIZE));
+		if (read0 != read1 || memcmp(buf0.get(), buf1.get(), read0) != 0) {
+			return false;
+		}
+		if (read0 == 0) {
+			return true;
+		}
 	}
+}
 
-	// f[^Ɣr
-	FILE* testfp = fsopenT(testfile.c_str(), _T("rb"), _SH_DENYNO);
-	if (testfp == nullptr) {
-		return 1;
-	}
+// pCvCƃVOXbhŏo͂`FbN
+static int SplitPipeline(AMTContext& ctx, const ConfigWrapper& setting)
+{
+	const tstring ref = _T(".ref");
+	std::vector<tstring> outputs = {
+		setting.getAudioFilePath(), setting.getWaveFilePath(), setting.getStreamInfoPath()
+	};
 
-	auto testbuf = std::unique_ptr<uint8_t>(new uint8_t[BUF_SIZE]);
-	size_t testBytes = fread(testbuf.get(), 1, BUF_SIZE, testfp);
-	// data chunkT
-	for (int i = sizeof(RiffHeader); ; ) {
-		if (!(i < (int)testBytes - 8)) {
-			fprintf(stderr, "o͂܂\n");
-			return 1;
+	Stopwatch sw;
+	double elapsed[2] = { 0 };
+	for (int pipelined = 0; pipelined < 2; ++pipelined) {
+		sw.start();
+		{
+			AMTSplitter splitter(ctx, setting);
+			if (setting.getServiceId() > 0) {
+				splitter.setServiceId(setting.getServiceId());
+			}
+			splitter.setPipelined(pipelined != 0);
+			StreamReformInfo reformInfo = splitter.split();
+			reformInfo.serialize(setting.getStreamInfoPath());
 		}
-		if (read32(testbuf.get() + i) == 'data') {
-			int testLength = (int)testBytes - i - 8;
-			const uint16_t* pTest = (const uint16_t*)(testbuf.get() + i + 8);
-			const uint16_t* pDec = (const uint16_t*)decoded.ptr();
-			if (testLength != decoded.size()) {
-				fprintf(stderr, "ʂ̃TCY܂\n");
-				return 1;
+		elapsed[pipelined] = sw.getAndReset();
+		if (pipelined == 0) {
+			// ԉft@C͕̐Ȃ̂ő݂t@CSđΏۂɂ
+			for (int i = 0; File::exists(setting.getIntVideoFilePath(i)); ++i) {
+				outputs.push_back(setting.getIntVideoFilePath(i));
 			}
-			// AAC̃fR[hʂ͏Ȃ̂Ŋۂߌ덷l
-			for (int c = 0; c < testLength / 2; ++c) {
-				if ((std::abs((int)pTest[c] - (int)pDec[c]) > 1)) {
-					fprintf(stderr, "fR[hʂ܂\n");
-					return 1;
-				}
+			for (const auto& path : outputs) {
+				File::copy(path, path + ref);
 			}
-			break;
 		}
-		i += *(uint32_t*)(testbuf.get() + i + 4) + 8;
 	}
+	printf("single: %f sec, pipelined: %f sec\n", elapsed[0], elapsed[1]);
 
-	NeAACDecClose(hAacDec);
-	fclose(fp);
-	fclose(testfp);
+	for (const auto& path : outputs) {
+		if (!FileEquals(path, path + ref)) {
+			THROWF(TestException, "Output does not match: %s", path);
+		}
+	}
 
 	return 0;
 }
 
-static int WaveWriteHeader(AMTContext& ctx, const ConfigWrapper& setting)
+// ͈͂ɕĕTS͂ꍇɏo͂`FbNƑxv
+static int SplitParallel(AMTContext& ctx, const ConfigWrapper& setting)
 {
-	tstring dstfile = setting.getOutFilePath(EncodeFileKey(), EncodeFileKey());
-
-	FILE* fp = fsopenT(dstfile.c_str(), _T("wb"), _SH_DENYNO);
-	if (fp == nullptr) {
-		fprintf(stderr, "failed to open file...\n");
-		return 1;
-	}
+	const tstring ref = _T(".ref");
+	std::vector<tstring> outputs = {
+		setting.getAudioFilePath(), setting.getWaveFilePath(), setting.getStreamInfoPath()
+	};
 
-	int writeSeconds = 300;
-	int sampleRate = 24000;
-	int bitsPerSample = 8;
-	int nChannels = 1;
+	struct Case {
+		int numThreads;
+		int64_t chunkSize;
+		int64_t warmupSize;
+	};
+	const Case cases[] = {
+		{ 0, 0, 0 }, // 
+		{ 4, 4 * 1024 * 1024, 6 * 1024 * 1024 },
+		{ 4, 1024 * 1024, 6 * 1024 * 1024 },
+		// Ԃ킸ɉ͂ꍇ
+		{ 4, 1024 * 1024, 96 * 1024 },
+		// ͂Ă킸O͈̔͂瑱ĉ͂ꍇ
+		{ 4, 1024 * 1024, 3 * TS_PACKET_LENGTH },
+	};
 
-	uint8_t* samples = (uint8_t*)malloc(writeSeconds * sampleRate * nChannels * (bitsPerSample / 2));
-	for (int i = 0; i < writeSeconds * sampleRate; ++i) {
-		for (int c = 0; c < nChannels; ++c) {
-			samples[i * nChannels + c] = (i % sampleRate);
+	Stopwatch sw;
+	for (int i = 0; i < (int)(sizeof(cases) / sizeof(cases[0])); ++i) {
+		const Case& c = cases[i];
+		int numRetries = 0;
+		sw.start();
+		{
+			AMTSplitter splitter(ctx, setting);
+			if (setting.getServiceId() > 0) {
+				splitter.setServiceId(setting.getServiceId());
+			}
+			// ͉͂fR[hxݒłȂƖȂ̂ŁA܂߂ėLɂ
+			splitter.setParallelAudioDecode(true);
+			splitter.setParallelSplit(c.numThreads, c.chunkSize, c.warmupSize);
+			StreamReformInfo reformInfo = splitter.split();
+			reformInfo.serialize(setting.getStreamInfoPath());
+			numRetries = splitter.getNumSplitRetries();
+		}
+		double elapsed = sw.getAndReset();
+		if (i == 0) {
+			for (int v = 0; File::exists(setting.getIntVideoFilePath(v)); ++v) {
+				outputs.push_back(setting.getIntVideoFilePath(v));
+			}
+			for (const auto& path : outputs) {
+				File::copy(path, path + ref);
+			}
+			printf("sequential: %f sec\n", elapsed);
+			continue;
+		}
+		printf("threads=%d chunk=%lldKB warmup=%lldKB: %f sec (retries=%d)\n",
+			c.numThreads, c.chunkSize / 1024, c.warmupSize / 1024, elapsed, numRetries);
+		for (const auto& path : outputs) {
+			if (!FileEquals(path, path + ref)) {
+				THROWF(TestException, "Output does not match: %s", path);
+			}
 		}
 	}
 
-	writeWaveHeader(fp, nChannels, sampleRate, bitsPerSample, writeSeconds * sampleRate);
-	if (fwrite(samples, writeSeconds * sampleRate * nChannels, 1, fp) != 1) {
-		fprintf(stderr, "failed to write file...\n");
-		return 1;
-	}
-
-	free(samples);
-	fclose(fp);
-
 	return 0;
 }
 
-static int ProcessTest(AMTContext& ctx, const ConfigWrapper& setting)
+// ԉft@C̑ɌTSQƂꍇɓfpPbgǂ߂邩`FbN
+static int VirtualIntVideo(AMTContext& ctx, const ConfigWrapper& setting)
 {
-	class ProcTest : public EventBaseSubProcess {
-	public:
-		ProcTest() : EventBaseSubProcess(_T("x264.exe --help")) { }
-	protected:
-		virtual void onOut(bool isErr, MemoryChunk mc) {
-			fwrite(mc.data, mc.length, 1, stdout);
+	Stopwatch sw;
+	double elapsed[2] = { 0 };
+	int64_t intVideoSize[2] = { 0 };
+	for (int virt = 0; virt < 2; ++virt) {
+		sw.start();
+		{
+			AMTSplitter splitter(ctx, setting);
+			if (setting.getServiceId() > 0) {
+				splitter.setServiceId(setting.getServiceId());
+			}
+			splitter.setVirtualIntVideo(virt != 0);
+			splitter.split();
+			intVideoSize[virt] = splitter.getTotalIntVideoSize();
+		}
+		elapsed[virt] = sw.getAndReset();
+	}
+	printf("split: int video file %f sec, virtual %f sec\n", elapsed[0], elapsed[1]);
+
+	// fpPbg1ǂށBȂfalse
+	auto readVideoPacket = [](av::InputContext& inputCtx, AVStream* videoStream, AVPacket& packet) {
+		while (av_read_frame(inputCtx(), &packet) == 0) {
+			if (packet.stream_index == videoStream->index) {
+				return true;
+			}
+			av_packet_unref(&packet);
 		}
+		return false;
 	};
 
-	ProcTest proc;
-	proc.join();
+	int numFiles = 0;
+	for (; File::exists(setting.getIntVideoFilePath(numFiles)); ++numFiles) {
+		tstring indexPath = setting.getIntVideoIndexPath(numFiles);
+		if (!File::exists(indexPath) || !VirtualTsIndex::IsIndexFile(indexPath)) {
+			THROWF(TestException, "No index file: %s", indexPath);
+		}
+		int64_t indexSize = File(indexPath, _T("rb")).size();
+		printf("file %d: int video %lld bytes, index %lld bytes (virtual %lld bytes)\n", numFiles,
+			File(setting.getIntVideoFilePath(numFiles), _T("rb")).size(), indexSize,
+			VirtualTsIndex::deserialize(indexPath).virtualSize());
+
+		av::InputContext psCtx(setting.getIntVideoFilePath(numFiles));
+		av::VirtualTsIOContext virtualIO(indexPath);
+		av::InputContext tsCtx(virtualIO, "mpegts");
+		if (avformat_find_stream_info(psCtx(), NULL) < 0 ||
+			avformat_find_stream_info(tsCtx(), NULL) < 0) {
+			THROW(TestException, "avformat_find_stream_info failed");
+		}
+		AVStream* psStream = av::GetVideoStream(psCtx());
+		AVStream* tsStream = av::GetVideoStream(tsCtx());
+		if (psStream == NULL || tsStream == NULL) {
+			THROW(TestException, "Could not find video stream");
+		}
+
+		int numPackets = 0;
+		while (true) {
+			AVPacket ps = AVPacket(), ts = AVPacket();
+			bool psOK = readVideoPacket(psCtx, psStream, ps);
+			bool tsOK = readVideoPacket(tsCtx, tsStream, ts);
+			bool same = (psOK == tsOK) && (!psOK ||
+				(ps.pts == ts.pts && ps.dts == ts.dts && ps.size == ts.size &&
+					memcmp(ps.data, ts.data, ps.size) == 0));
+			av_packet_unref(&ps);
+			av_packet_unref(&ts);
+			if (!same) {
+				THROWF(TestException, "Video packet %d does not match (file %d)", numPackets, numFiles);
+			}
+			if (!psOK) break;
+			++numPackets;
+		}
+		printf("file %d: %d video packets OK\n", numFiles, numPackets);
+	}
+	if (numFiles == 0) {
+		THROW(TestException, "No int video file");
+	}
+	printf("int video total: %lld bytes -> virtual (not written) %lld bytes\n",
+		intVideoSize[0], intVideoSize[1]);
 
 	return 0;
 }
 
-static int FileStreamInfo(AMTContext& ctx, const ConfigWrapper& setting)
+// AMTSourceeXgpTS͂AMTSourceɓnt[
+static StreamReformInfo SplitForAMTSource(AMTContext& ctx, const ConfigWrapper& setting)
 {
-	StreamReformInfo reformInfo = StreamReformInfo::deserialize(ctx, setting.getStreamInfoPath());
+	std::unique_ptr<AMTSplitter> splitter(new AMTSplitter(ctx, setting));
+	if (setting.getServiceId() > 0) {
+		splitter->setServiceId(setting.getServiceId());
+	}
+	StreamReformInfo reformInfo = splitter->split();
+	splitter = nullptr;
 	reformInfo.prepare(false, false);
-	auto audioDiffInfo = reformInfo.genAudio({ CMTYPE_BOTH });
-	audioDiffInfo.printAudioPtsDiff(ctx);
-	reformInfo.printOutputMapping([&](EncodeFileKey key) {
-		const auto& file = reformInfo.getEncodeFile(key);
-		return setting.getOutFilePath(file.outKey, file.keyMax);
-	});
-	return 0;
+	return reformInfo;
 }
 
-static int ParseArgs(AMTContext& ctx, const ConfigWrapper& setting)
+static uint32_t AMTSourceFrameCRC(const CRC32& crc, PVideoFrame& frame)
 {
-	const_cast<ConfigWrapper&>(setting).CreateTempDir();
-	setting.dump();
-	return 0;
+	uint32_t c = 0;
+	int yuv[] = { PLANAR_Y, PLANAR_U, PLANAR_V };
+	for (int p = 0; p < 3; ++p) {
+		const uint8_t* plane = frame->GetReadPtr(yuv[p]);
+		int pitch = frame->GetPitch(yuv[p]);
+		int rowsize = frame->GetRowSize(yuv[p]);
+		int height = frame->GetHeight(yuv[p]);
+		for (int y = 0; y < height; ++y) {
+			c = crc.calc(plane + y * pitch, rowsize, c);
+		}
+	}
+	return c;
 }
 
-static int LosslessTest(AMTContext& ctx, const ConfigWrapper& setting)
+// AMTSource̐ǂ݃fR[h̏o̓`FbNƑxv
+// ǂ݂EȂœANZXp^[̏o͂v邱
+static int AMTSourcePrefetch(AMTContext& ctx, const ConfigWrapper& setting)
 {
-	auto env = make_unique_ptr(CreateScriptEnvironment2());
-	auto codecEnc = make_unique_ptr(CCodec::CreateInstance(UTVF_ULH0, "Amatsukaze"));
-	auto codecDec = make_unique_ptr(CCodec::CreateInstance(UTVF_ULH0, "Amatsukaze"));
-
-	{
-		PClip clip = env->Invoke("Import", to_string(setting.getFilterScriptPath()).c_str()).AsClip();
+	StreamReformInfo reformInfo = SplitForAMTSource(ctx, setting);
 
-		VideoInfo vi = clip->GetVideoInfo();
+	const auto& fmt = reformInfo.getFormat(EncodeFileKey(0, 0));
+	const auto& frames = reformInfo.getFilterSourceFrames(0);
+	const auto& audioFrames = reformInfo.getFilterSourceAudioFrames(0);
+	int numFrames = (int)frames.size();
 
-		size_t cbGrossWidth[] = { CBGROSSWIDTH_WINDOWS, CBGROSSWIDTH_WINDOWS, CBGROSSWIDTH_WINDOWS };
-		size_t rawSize = vi.width * vi.height * 3 / 2;
-		size_t outSize = codecEnc->EncodeGetOutputSize(UTVF_YV12, vi.width, vi.height);
-		size_t headerSize = codecEnc->EncodeGetExtraDataSize();
-		auto memIn = std::unique_ptr<uint8_t[]>(new uint8_t[rawSize]);
-		auto memOut = std::unique_ptr<uint8_t[]>(new uint8_t[outSize]);
-		auto memDec = std::unique_ptr<uint8_t[]>(new uint8_t[rawSize]);
-		auto memHeader = std::unique_ptr<uint8_t[]>(new uint8_t[headerSize]);
+	CRC32 crc;
+	auto frameCRC = [&](PVideoFrame& frame) {
+		return AMTSourceFrameCRC(crc, frame);
+	};
 
-		if (codecEnc->EncodeGetExtraData(memHeader.get(), headerSize, UTVF_YV12, vi.width, vi.height)) {
-			THROW(RuntimeException, "failed to EncodeGetExtraData (UtVideo)");
-		}
-		if (codecEnc->EncodeBegin(UTVF_YV12, vi.width, vi.height, cbGrossWidth)) {
-			THROW(RuntimeException, "failed to EncodeBegin (UtVideo)");
+	// ԂɑSt[
+	std::vector<int> sequential(numFrames);
+	for (int i = 0; i < numFrames; ++i) {
+		sequential[i] = i;
+	}
+	// єс{ւ̃V[N
+	std::vector<int> scattered;
+	for (int i = 0; i < numFrames; i += 97) {
+		for (int k = 0; k < 8 && i + k < numFrames; ++k) {
+			scattered.push_back(i + k);
 		}
-		if (codecDec->DecodeBegin(UTVF_YV12, vi.width, vi.height, cbGrossWidth, memHeader.get(), headerSize)) {
-			THROW(RuntimeException, "failed to DecodeBegin (UtVideo)");
+		if (i >= 300) {
+			scattered.push_back(i - 300);
 		}
+	}
 
-		size_t totalRawSize = 0;
-		size_t totalCompSize = 0;
-
-		for (int i = 0; i < 100; ++i) {
-			PVideoFrame frame = clip->GetFrame(i + 100, env.get());
-			CopyYV12(memIn.get(), frame, vi.width, vi.height);
+	int prefetchFrames[] = { 0, 60 };
+	std::vector<uint32_t> refSeq, refScat;
+	for (int prefetch : prefetchFrames) {
+		DecoderSetting decoderSetting = setting.getDecoderSetting();
+		decoderSetting.prefetchFrames = prefetch;
 
-			bool keyFrame = false;
-			size_t outSize = codecEnc->EncodeFrame(memOut.get(), &keyFrame, memIn.get());
-			codecDec->DecodeFrame(memDec.get(), memOut.get());
+		auto env = make_unique_ptr(CreateScriptEnvironment2());
+		PClip clip = new av::AMTSource(ctx,
+			setting.getIntVideoSourcePath(0), setting.getWaveSourcePath(), setting.isLazyWave(),
+			fmt.videoFormat, fmt.audioFormat[0], frames, audioFrames, decoderSetting, "", false, env.get());
+
+		Stopwatch sw;
+		std::vector<uint32_t> seq, scat;
+		sw.start();
+		for (int n : sequential) {
+			PVideoFrame frame = clip->GetFrame(n, env.get());
+			seq.push_back(frameCRC(frame));
+		}
+		double seqTime = sw.getAndReset();
+		for (int n : scattered) {
+			PVideoFrame frame = clip->GetFrame(n, env.get());
+			scat.push_back(frameCRC(frame));
+		}
+		double scatTime = sw.getAndReset();
+		printf("prefetch %3d: sequential %.2f sec (%.1f fps), scattered %.2f sec\n",
+			prefetch, seqTime, numFrames / seqTime, scatTime);
 
-			if (memcmp(memIn.get(), memDec.get(), rawSize)) {
-				printf("UtVideo Encode/Decode Test Error\n");
+		if (prefetch == 0) {
+			refSeq = seq;
+			refScat = scat;
+		}
+		else {
+			if (seq != refSeq) {
+				THROWF(TestException, "Sequential output does not match (prefetch=%d)", prefetch);
+			}
+			if (scat != refScat) {
+				THROWF(TestException, "Scattered output does not match (prefetch=%d)", prefetch);
 			}
-
-			totalRawSize += rawSize;
-			totalCompSize += outSize;
 		}
-
-		codecEnc->EncodeEnd();
-		codecDec->DecodeEnd();
-
-		float ratio = (float)totalCompSize / (float)totalRawSize;
-		printf("Compression ratio: %.1f%%\n", ratio * 100.0f);
 	}
 
 	return 0;
 }
 
-static int LosslessFileTest(AMTContext& ctx, const ConfigWrapper& setting)
+// AMTSourceGOPfR[_̏o̓`FbNƑxv
+// CalcFade2̂悤ȑOɍLEBhE𕡐Xbh瓯ɗv
+// 1fR[_ŏɎ擾ꍇƏo͂v邱
+static int AMTSourceGOPDecode(AMTContext& ctx, const ConfigWrapper& setting)
 {
-	size_t cbGrossWidth[] = { CBGROSSWIDTH_WINDOWS, CBGROSSWIDTH_WINDOWS, CBGROSSWIDTH_WINDOWS };
-	auto env = make_unique_ptr(CreateScriptEnvironment2());
-	auto codec = make_unique_ptr(CCodec::CreateInstance(UTVF_ULH0, "Amatsukaze"));
-
-	{
-		int numframes = 100;
-		LosslessVideoFile file(ctx, setting.getOutFilePath(EncodeFileKey(), EncodeFileKey()), _T("wb"));
-		PClip clip = env->Invoke("Import", to_string(setting.getFilterScriptPath()).c_str()).AsClip();
-
-		VideoInfo vi = clip->GetVideoInfo();
+	StreamReformInfo reformInfo = SplitForAMTSource(ctx, setting);
+
+	const auto& fmt = reformInfo.getFormat(EncodeFileKey(0, 0));
+	const auto& frames = reformInfo.getFilterSourceFrames(0);
+	const auto& audioFrames = reformInfo.getFilterSourceAudioFrames(0);
+	int numFrames = (int)frames.size();
+
+	enum { DIST = 8 };
+	std::vector<int> requests;
+	for (int c = DIST; c + DIST < numFrames; c += 120) {
+		for (int i = -DIST; i <= DIST; ++i) {
+			requests.push_back(c + i);
+		}
+	}
 
-		size_t rawSize = vi.width * vi.height * 3 / 2;
-		size_t outSize = codec->EncodeGetOutputSize(UTVF_YV12, vi.width, vi.height);
-		size_t extraSize = codec->EncodeGetExtraDataSize();
-		auto memIn = std::unique_ptr<uint8_t[]>(new uint8_t[rawSize]);
-		auto memOut = std::unique_ptr<uint8_t[]>(new uint8_t[outSize]);
-		auto memDec = std::unique_ptr<uint8_t[]>(new uint8_t[rawSize]);
-		std::vector<uint8_t> extra(extraSize);
+	CRC32 crc;
+	int gopDecoders[] = { 0, 4 };
+	std::vector<uint32_t> ref;
+	for (int numDecoders : gopDecoders) {
+		DecoderSetting decoderSetting = setting.getDecoderSetting();
+		decoderSetting.gopDecoders = numDecoders;
 
-		if (codec->EncodeGetExtraData(extra.data(), extraSize, UTVF_YV12, vi.width, vi.height)) {
-			THROW(RuntimeException, "failed to EncodeGetExtraData (UtVideo)");
+		auto env = make_unique_ptr(CreateScriptEnvironment2());
+		PClip clip = new av::AMTSource(ctx,
+			setting.getIntVideoSourcePath(0), setting.getWaveSourcePath(), setting.isLazyWave(),
+			fmt.videoFormat, fmt.audioFormat[0], frames, audioFrames, decoderSetting, "", false, env.get());
+
+		std::vector<uint32_t> result(requests.size());
+		Stopwatch sw;
+		sw.start();
+		if (numDecoders == 0) {
+			for (int i = 0; i < (int)requests.size(); ++i) {
+				PVideoFrame frame = clip->GetFrame(requests[i], env.get());
+				result[i] = AMTSourceFrameCRC(crc, frame);
+			}
 		}
-		if (codec->EncodeBegin(UTVF_YV12, vi.width, vi.height, cbGrossWidth)) {
-			THROW(RuntimeException, "failed to EncodeBegin (UtVideo)");
+		else {
+			ParallelTaskPool pool(numDecoders);
+			pool.run((int)requests.size(), [&](int task, int worker) {
+				PVideoFrame frame = clip->GetFrame(requests[task], env.get());
+				result[task] = AMTSourceFrameCRC(crc, frame);
+			});
 		}
-		file.writeHeader(vi.width, vi.height, numframes, extra);
-
-		for (int i = 0; i < numframes; ++i) {
-			PVideoFrame frame = clip->GetFrame(i + 100, env.get());
-			CopyYV12(memIn.get(), frame, vi.width, vi.height);
+		double elapsed = sw.getAndReset();
+		printf("gop decoders %d: %d frames %.2f sec\n", numDecoders, (int)requests.size(), elapsed);
 
-			bool keyFrame = false;
-			size_t codedSize = codec->EncodeFrame(memOut.get(), &keyFrame, memIn.get());
-			file.writeFrame(memOut.get(), (int)codedSize);
+		if (numDecoders == 0) {
+			ref = result;
+		}
+		else if (result != ref) {
+			THROWF(TestException, "Output does not match (gop decoders=%d)", numDecoders);
 		}
-		codec->EncodeEnd();
 	}
 
-	{
-		LosslessVideoFile file(ctx, setting.getOutFilePath(EncodeFileKey(), EncodeFileKey()), _T("rb"));
-		file.readHeader();
-
-		int width = file.getWidth();
-		int height = file.getHeight();
-		int numframes = file.getNumFrames();
-		auto extra = file.getExtra();
+	return 0;
+}
 
-		size_t rawSize = width * height * 3 / 2;
-		size_t outSize = codec->EncodeGetOutputSize(UTVF_YV12, width, height);
-		auto memDec = std::unique_ptr<uint8_t[]>(new uint8_t[rawSize]);
-		auto memOut = std::unique_ptr<uint8_t[]>(new uint8_t[outSize]);
+// TS͂̉fR[hʃXbhōsꍇ̏o̓`FbNƑxv
+static int SplitAudioDecode(AMTContext& ctx, const ConfigWrapper& setting)
+{
+	const tstring ref = _T(".ref");
+	std::vector<tstring> outputs = {
+		setting.getAudioFilePath(), setting.getWaveFilePath(), setting.getStreamInfoPath()
+	};
 
-		if (codec->DecodeBegin(UTVF_YV12, width, height, cbGrossWidth, extra.data(), (int)extra.size())) {
-			THROW(RuntimeException, "failed to DecodeBegin (UtVideo)");
+	Stopwatch sw;
+	double elapsed[2] = { 0 };
+	for (int parallel = 0; parallel < 2; ++parallel) {
+		sw.start();
+		{
+			AMTSplitter splitter(ctx, setting);
+			if (setting.getServiceId() > 0) {
+				splitter.setServiceId(setting.getServiceId());
+			}
+			splitter.setParallelAudioDecode(parallel != 0);
+			StreamReformInfo reformInfo = splitter.split();
+			reformInfo.serialize(setting.getStreamInfoPath());
 		}
-
-		for (int i = 0; i < numframes; ++i) {
-			int64_t codedSize = file.readFrame(i, memOut.get());
-			if (codec->DecodeFrame(memDec.get(), memOut.get()) != rawSize) {
-				THROW(RuntimeException, "failed to DecodeFrame (UtVideo)");
+		elapsed[parallel] = sw.getAndReset();
+		if (parallel == 0) {
+			for (const auto& path : outputs) {
+				File::copy(path, path + ref);
+			}
+		}
+	}
+	printf("split: inline decode %f sec, parallel decode %f sec\n", elapsed[0], elapsed[1]);
+
+	for (const auto& path : outputs) {
+		if (!FileEquals(path, path + ref)) {
+			THROWF(TestException, "Output does not match: %s", path);
+		}
+	}
+
+	// Xg[ɂႢ邽
+	// ԉt@C̃t[1,2,4Xg[ɕĉ̓Xbh猩Ԃv
+	std::vector<uint8_t> aac;
+	{
+		File file(setting.getAudioFilePath(), _T("rb"));
+		aac.resize((size_t)file.size());
+		file.read(MemoryChunk(aac.data(), aac.size()));
+	}
+	std::vector<MemoryChunk> frames;
+	AdtsHeader header;
+	for (size_t pos = 0; pos < aac.size(); pos += header.frame_length) {
+		int len = (int)std::min<size_t>(aac.size() - pos, 1 << 13);
+		if (!header.parse(aac.data() + pos, len) || header.frame_length > len) {
+			break;
+		}
+		frames.emplace_back(aac.data() + pos, header.frame_length);
+	}
+
+	class CountWorkers : public AudioDecodeWorkers {
+	public:
+		CountWorkers(AMTContext& ctx) : AudioDecodeWorkers(ctx), totalBytes(0) { }
+		int64_t totalBytes;
+	protected:
+		virtual void onDecoded(int id, bool success, MemoryChunk pcm) {
+			totalBytes += pcm.length;
+		}
+	};
+
+	for (int numStreams : { 1, 2, 4 }) {
+		int64_t totalBytes[2] = { 0 };
+		sw.start();
+		{
+			std::vector<std::unique_ptr<AdtsDecoder>> decoders;
+			for (int s = 0; s < numStreams; ++s) {
+				decoders.emplace_back(new AdtsDecoder(ctx));
+			}
+			for (const auto& frame : frames) {
+				for (int s = 0; s < numStreams; ++s) {
+					NeAACDecFrameInfo frameInfo;
+					void* samples;
+					if (decoders[s]->decode(frame, frameInfo, samples) == AdtsDecoder::DECODE_OK) {
+						totalBytes[0] += frameInfo.samples * 2;
+					}
+				}
+			}
+		}
+		elapsed[0] = sw.getAndReset();
+		sw.start();
+		{
+			CountWorkers workers(ctx);
+			for (int i = 0; i < (int)frames.size(); ++i) {
+				for (int s = 0; s < numStreams; ++s) {
+					workers.put(s, i, frames[i]);
+				}
+				workers.pop();
+			}
+			workers.join();
+			totalBytes[1] = workers.totalBytes;
+		}
+		elapsed[1] = sw.getAndReset();
+		printf("%d audio streams (%d frames): inline %f sec, parallel %f sec\n",
+			numStreams, (int)frames.size(), elapsed[0], elapsed[1]);
+		if (totalBytes[0] != totalBytes[1]) {
+			THROW(TestException, "Decoded size does not match");
+		}
+	}
+
+	return 0;
+}
+
+// ͗pWAV炸ɕKvȎɃfR[hꍇf[^ǂ߂邩`FbN
+static int LazyWave(AMTContext& ctx, const ConfigWrapper& setting)
+{
+	const tstring ref = _T(".ref");
+
+	Stopwatch sw;
+	double elapsed[2] = { 0 };
+	for (int lazy = 0; lazy < 2; ++lazy) {
+		sw.start();
+		{
+			AMTSplitter splitter(ctx, setting);
+			if (setting.getServiceId() > 0) {
+				splitter.setServiceId(setting.getServiceId());
+			}
+			splitter.setLazyWave(lazy != 0);
+			StreamReformInfo reformInfo = splitter.split();
+			reformInfo.serialize(setting.getStreamInfoPath());
+		}
+		elapsed[lazy] = sw.getAndReset();
+		if (lazy == 0) {
+			File::copy(setting.getWaveFilePath(), setting.getWaveFilePath() + ref);
+			File::copy(setting.getStreamInfoPath(), setting.getStreamInfoPath() + ref);
+		}
+	}
+	printf("split: with wave %f sec, lazy %f sec (wave %lld bytes)\n",
+		elapsed[0], elapsed[1], File(setting.getWaveFilePath() + ref, _T("rb")).size());
+
+	// fR[_̃t[WAVt@Cł͖(waveLength=0)ɂȂ邪
+	// xfR[hł͑Õt[̂Ńf[^
+	// WAVt@CɃf[^t[r
+	StreamReformInfo refInfo = StreamReformInfo::deserialize(ctx, setting.getStreamInfoPath() + ref);
+	StreamReformInfo lazyInfo = StreamReformInfo::deserialize(ctx, setting.getStreamInfoPath());
+	refInfo.prepare(false, false);
+	lazyInfo.prepare(false, false);
+	if (refInfo.getNumVideoFile() != lazyInfo.getNumVideoFile()) {
+		THROW(TestException, "Number of video files does not match");
+	}
+
+	WaveReader waveReader(ctx, setting.getWaveFilePath() + ref, false);
+	WaveReader lazyReader(ctx, setting.getAudioFilePath(), true);
+	std::vector<uint8_t> expected, actual;
+	int numFrames = 0;
+	sw.start();
+	for (int pass = 0; pass < 2; ++pass) {
+		for (int v = 0; v < refInfo.getNumVideoFile(); ++v) {
+			auto refFrames = refInfo.getFilterSourceAudioFrames(v);
+			auto lazyFrames = lazyInfo.getFilterSourceAudioFrames(v);
+			if (refFrames.size() != lazyFrames.size()) {
+				THROW(TestException, "Number of audio frames does not match");
+			}
+			if (pass == 1) {
+				// tɓǂŃV[N̓mF
+				std::reverse(refFrames.begin(), refFrames.end());
+				std::reverse(lazyFrames.begin(), lazyFrames.end());
+			}
+			for (int i = 0; i < (int)refFrames.size(); ++i) {
+				if (refFrames[i].waveLength == 0) continue;
+				expected.resize(refFrames[i].waveLength);
+				actual.resize(refFrames[i].waveLength);
+				waveReader.read(refFrames[i], 0, MemoryChunk(expected.data(), expected.size()));
+				lazyReader.read(lazyFrames[i], 0, MemoryChunk(actual.data(), actual.size()));
+				if (expected != actual) {
+					THROWF(TestException, "Wave data does not match at frame %d", refFrames[i].frameIndex);
+				}
+				++numFrames;
+			}
+		}
+	}
+	printf("compared %d frames in %f sec\n", numFrames, sw.getAndReset());
+
+	return 0;
+}
+
+// DataPumpThreadSpscDataPumpThread̃X[vbgr
+// ft[Ŏgobt@i`\jŌv
+template <typename Pump>
+static void MeasureDataPump(const char* name, int bufferingItems, int numItems, int workPerItem)
+{
+	class CountPump : public Pump {
+	public:
+		CountPump(int bufferingItems, int workPerItem)
+			: Pump(bufferingItems), workPerItem(workPerItem), sum(0) { }
+		int workPerItem;
+		int64_t sum;
+	protected:
+		virtual void OnDataReceived(std::unique_ptr<int>&& data) {
+			// 󂯎葤̏Ԃ̑
+			int64_t v = *data;
+			for (int i = 0; i < workPerItem; ++i) {
+				v = v * 6364136223846793005LL + 1442695040888963407LL;
+			}
+			sum += (v == 0) ? 1 : *data;
+		}
+	};
+
+	CountPump pump(bufferingItems, workPerItem);
+	Stopwatch sw;
+	sw.start();
+	pump.start();
+	for (int i = 0; i < numItems; ++i) {
+		pump.put(std::unique_ptr<int>(new int(i)), 1);
+	}
+	pump.join();
+	double elapsed = sw.getAndReset();
+
+	int64_t expected = (int64_t)numItems * (numItems - 1) / 2;
+	if (pump.sum != expected) {
+		THROWF(TestException, "%s: sum does not match", name);
+	}
+	int64_t prodWaits, consWaits;
+	pump.getNumWaits(prodWaits, consWaits);
+	double prodWait, consWait;
+	pump.getTotalWait(prodWait, consWait);
+	printf("%-8s buf=%2d work=%4d: %10.0f items/s wakeups(prod=%lld cons=%lld) wait(prod=%.3fs cons=%.3fs)\n",
+		name, bufferingItems, workPerItem, numItems / elapsed, prodWaits, consWaits, prodWait, consWait);
+}
+
+static int DataPumpPerformance(AMTContext& ctx, const ConfigWrapper& setting)
+{
+	enum { NUM_ITEMS = 1000 * 1000 };
+	for (int bufferingItems : { 1, 4, 8, 16 }) {
+		for (int workPerItem : { 0, 1000 }) {
+			MeasureDataPump<DataPumpThread<std::unique_ptr<int>, true>>(
+				"mutex", bufferingItems, NUM_ITEMS, workPerItem);
+			MeasureDataPump<SpscDataPumpThread<std::unique_ptr<int>, true>>(
+				"spsc", bufferingItems, NUM_ITEMS, workPerItem);
+		}
+	}
+	return 0;
+}
+
+// Y4MWriteȑo̓X[vbg
+// t[NULɏŌv
+static int Y4MWritePerformance(AMTContext& ctx, const ConfigWrapper& setting)
+{
+	// ȑO̎iS̈obt@ɃRs[Ă珑ށj
+	class CopyWriter : public Y4MWriter {
+	public:
+		CopyWriter(VideoInfo vi, VideoFormat fmt) : Y4MWriter(vi, fmt), file(_T("NUL"), _T("wb")), total(0) { }
+		File file;
+		AutoBuffer buffer;
+		size_t total;
+	protected:
+		virtual void onWrite(const MemoryChunk* chunks, int numChunks) {
+			buffer.clear();
+			for (int i = 0; i < numChunks; ++i) {
+				buffer.add(chunks[i]);
+			}
+			file.write(buffer.get());
+			total += buffer.size();
+		}
+	};
+	// ̈̂܂܏
+	class GatherWriter : public Y4MWriter {
+	public:
+		GatherWriter(VideoInfo vi, VideoFormat fmt) : Y4MWriter(vi, fmt), file(_T("NUL"), _T("wb")), total(0) { }
+		File file;
+		size_t total;
+	protected:
+		virtual void onWrite(const MemoryChunk* chunks, int numChunks) {
+			for (int i = 0; i < numChunks; ++i) {
+				file.write(chunks[i]);
+				total += chunks[i].length;
+			}
+		}
+	};
+
+	auto env = make_unique_ptr(CreateScriptEnvironment2());
+
+	struct TestCase { int width, height, pixelType; const char* name; };
+	TestCase cases[] = {
+		{ 1920, 1080, VideoInfo::CS_YV12, "1080p 8bit" },
+		{ 1920, 1080, VideoInfo::CS_YUV420P10, "1080p 10bit" },
+		{ 1440, 1080, VideoInfo::CS_YV12, "1440x1080 8bit" },
+		{ 1440, 1080, VideoInfo::CS_YUV420P10, "1440x1080 10bit" },
+	};
+	enum { NUM_FRAMES = 600 };
+
+	for (const TestCase& tc : cases) {
+		VideoInfo vi = VideoInfo();
+		vi.width = tc.width;
+		vi.height = tc.height;
+		vi.pixel_type = tc.pixelType;
+		vi.fps_numerator = 60000;
+		vi.fps_denominator = 1001;
+		vi.num_frames = NUM_FRAMES;
+
+		VideoFormat fmt = VideoFormat();
+		fmt.width = tc.width;
+		fmt.height = tc.height;
+		fmt.sarWidth = fmt.sarHeight = 1;
+		fmt.progressive = true;
+
+		// 2݂Ɏg
+		PVideoFrame frames[2];
+		bool padded = false;
+		for (int i = 0; i < 2; ++i) {
+			frames[i] = env->NewVideoFrame(vi);
+			int yuv[] = { PLANAR_Y, PLANAR_U, PLANAR_V };
+			for (int c = 0; c < 3; ++c) {
+				uint8_t* plane = frames[i]->GetWritePtr(yuv[c]);
+				int pitch = frames[i]->GetPitch(yuv[c]);
+				int rowsize = frames[i]->GetRowSize(yuv[c]);
+				int height = frames[i]->GetHeight(yuv[c]);
+				for (int y = 0; y < height; ++y) {
+					for (int x = 0; x < rowsize; ++x) {
+						plane[x + y * pitch] = (uint8_t)(x + y * 3 + c * 5 + i * 7);
+					}
+				}
+				padded |= (pitch != rowsize);
+			}
+		}
+
+		// o͓ev邱ƂmF
+		{
+			class CheckWriter : public Y4MWriter {
+			public:
+				CheckWriter(VideoInfo vi, VideoFormat fmt) : Y4MWriter(vi, fmt) { }
+				AutoBuffer buffer;
+			protected:
+				virtual void onWrite(const MemoryChunk* chunks, int numChunks) {
+					for (int i = 0; i < numChunks; ++i) {
+						buffer.add(chunks[i]);
+					}
+				}
+			};
+			CheckWriter writer(vi, fmt);
+			writer.inputFrame(frames[0]);
+			writer.inputFrame(frames[1]);
+			std::string frameHeader = "FRAME\n";
+			MemoryChunk out = writer.buffer.get();
+			size_t pos = out.length;
+			for (int i = 1; i >= 0; --i) {
+				int yuv[] = { PLANAR_V, PLANAR_U, PLANAR_Y };
+				for (int c = 0; c < 3; ++c) {
+					const uint8_t* plane = frames[i]->GetReadPtr(yuv[c]);
+					int pitch = frames[i]->GetPitch(yuv[c]);
+					int rowsize = frames[i]->GetRowSize(yuv[c]);
+					int height = frames[i]->GetHeight(yuv[c]);
+					for (int y = height - 1; y >= 0; --y) {
+						pos -= rowsize;
+						if (memcmp(out.data + pos, plane + y * pitch, rowsize)) {
+							THROWF(TestException, "%s: frame data mismatch", tc.name);
+						}
+					}
+				}
+				pos -= frameHeader.size();
+				if (memcmp(out.data + pos, frameHeader.data(), frameHeader.size())) {
+					THROWF(TestException, "%s: frame header mismatch", tc.name);
+				}
+			}
+			if (memcmp(out.data, "YUV4MPEG2 ", 10) || out.data[pos - 1] != 0x0a) {
+				THROWF(TestException, "%s: stream header mismatch", tc.name);
+			}
+		}
+
+		CopyWriter copyWriter(vi, fmt);
+		GatherWriter gatherWriter(vi, fmt);
+		Stopwatch sw;
+
+		sw.start();
+		for (int i = 0; i < NUM_FRAMES; ++i) {
+			copyWriter.inputFrame(frames[i & 1]);
+		}
+		double copyTime = sw.getAndReset();
+
+		sw.start();
+		for (int i = 0; i < NUM_FRAMES; ++i) {
+			gatherWriter.inputFrame(frames[i & 1]);
+		}
+		double gatherTime = sw.getAndReset();
+
+		if (copyWriter.total != gatherWriter.total) {
+			THROWF(TestException, "%s: output size mismatch", tc.name);
+		}
+
+		double MB = copyWriter.total / (1024.0 * 1024.0);
+		printf("%-16s%s: copy %7.1f MB/s gather %7.1f MB/s\n", tc.name,
+			padded ? "(padded)" : "        ", MB / copyTime, MB / gatherTime);
+	}
+
+	return 0;
+}
+
+// GR[_̑Y4MEncodeWriteȑo͂󂯎
+// -i ŋLw肷ƃOAw肵Ȃstdinǂ݁A
+// -a Ŏw肵t@Cɏ
+static int FrameConsumer(AMTContext& ctx, const ConfigWrapper& setting)
+{
+	File dst(setting.getModeArgs(), _T("wb"));
+	tstring ringName = setting.getSrcFilePath();
+	if (ringName.size() > 0) {
+		SharedFrameRingReader ring(ringName);
+		while (true) {
+			MemoryChunk frame = ring.beginRead();
+			if (frame.length == 0) {
+				break;
+			}
+			dst.write(frame);
+			ring.endRead();
+		}
+	}
+	else {
+		HANDLE hStdIn = GetStdHandle(STD_INPUT_HANDLE);
+		std::vector<uint8_t> buf(1024 * 1024);
+		while (true) {
+			DWORD bytesRead = 0;
+			if (ReadFile(hStdIn, buf.data(), (DWORD)buf.size(), &bytesRead, NULL) == 0 || bytesRead == 0) {
+				break;
+			}
+			dst.write(MemoryChunk(buf.data(), bytesRead));
+		}
+	}
+	return 0;
+}
+
+// Y4MEncodeWriter̃t[]ipCv/Lj̔r
+// GR[_̑AmatsukazeCLI.exetest_frame_consumerN
+static int FrameTransportPerformance(AMTContext& ctx, const ConfigWrapper& setting)
+{
+	tstring consumerExe = pathNormalize(GetModuleDirectory()) + _T("/AmatsukazeCLI.exe");
+	if (!File::exists(consumerExe)) {
+		THROWF(TestException, "%s not found", consumerExe);
+	}
+
+	auto env = make_unique_ptr(CreateScriptEnvironment2());
+
+	struct TestCase { int width, height, pixelType, numFrames; const char* name; };
+	TestCase cases[] = {
+		{ 1920, 1080, VideoInfo::CS_YUV420P10, 600, "1080p 10bit" },
+		{ 3840, 2160, VideoInfo::CS_YUV420P10, 150, "2160p 10bit" },
+	};
+
+	int ringSeq = 0;
+	for (const TestCase& tc : cases) {
+		VideoInfo vi = VideoInfo();
+		vi.width = tc.width;
+		vi.height = tc.height;
+		vi.pixel_type = tc.pixelType;
+		vi.fps_numerator = 60000;
+		vi.fps_denominator = 1001;
+		vi.num_frames = tc.numFrames;
+
+		VideoFormat fmt = VideoFormat();
+		fmt.width = tc.width;
+		fmt.height = tc.height;
+		fmt.sarWidth = fmt.sarHeight = 1;
+		fmt.progressive = true;
+
+		PVideoFrame frames[2];
+		size_t frameBytes = 0;
+		for (int i = 0; i < 2; ++i) {
+			frames[i] = env->NewVideoFrame(vi);
+			int yuv[] = { PLANAR_Y, PLANAR_U, PLANAR_V };
+			for (int c = 0; c < 3; ++c) {
+				uint8_t* plane = frames[i]->GetWritePtr(yuv[c]);
+				int pitch = frames[i]->GetPitch(yuv[c]);
+				int rowsize = frames[i]->GetRowSize(yuv[c]);
+				int height = frames[i]->GetHeight(yuv[c]);
+				for (int y = 0; y < height; ++y) {
+					for (int x = 0; x < rowsize; ++x) {
+						plane[x + y * pitch] = (uint8_t)(x + y * 3 + c * 5 + i * 7);
+					}
+				}
+				if (i == 0) {
+					frameBytes += (size_t)rowsize * height;
+				}
+			}
+		}
+
+		auto run = [&](bool shm, const tstring& outpath, int numFrames) {
+			tstring ringName = shm
+				? StringFormat(_T("AmatsukazeFrameRing_%d_%d"), (int)GetCurrentProcessId(), ringSeq++)
+				: tstring();
+			tstring args = StringFormat(_T("\"%s\" --mode test_frame_consumer -a \"%s\""), consumerExe, outpath);
+			if (shm) {
+				args += StringFormat(_T(" -i \"%s\""), ringName);
+			}
+			Stopwatch sw;
+			sw.start();
+			Y4MEncodeWriter writer(ctx, args, vi, fmt, ringName);
+			for (int i = 0; i < numFrames; ++i) {
+				writer.inputFrame(frames[i & 1]);
+			}
+			writer.finish();
+			return sw.getAndReset();
+		};
+
+		// o͂v邱ƂmF
+		tstring pipeOut = setting.getIntVideoFilePath(0) + _T(".pipe.y4m");
+		tstring shmOut = setting.getIntVideoFilePath(0) + _T(".shm.y4m");
+		run(false, pipeOut, 8);
+		run(true, shmOut, 8);
+		if (!FileEquals(pipeOut, shmOut)) {
+			THROWF(TestException, "%s: output does not match", tc.name);
+		}
+
+		// vZXNI܂ł̎ԂŌv
+		double pipeTime = run(false, _T("NUL"), tc.numFrames);
+		double shmTime = run(true, _T("NUL"), tc.numFrames);
+		double MB = (double)frameBytes * tc.numFrames / (1024.0 * 1024.0);
+		printf("%-12s: pipe %7.1f MB/s shared memory %7.1f MB/s\n",
+			tc.name, MB / pipeTime, MB / shmTime);
+	}
+
+	return 0;
+}
+
+static int TsParsePerformance(AMTContext& ctx, const ConfigWrapper& setting)
+{
+	enum {
+		READ_SIZE = 4 * 1024 * 1024,
+		MAX_SIZE = 512 * 1024 * 1024,
+		NUM_PASSES = 3,
+	};
+
+	class CountParser : public TsPacketParser {
+	public:
+		CountParser(AMTContext& ctx) : TsPacketParser(ctx), numPackets(0), pidSum(0) { }
+		int64_t numPackets;
+		int64_t pidSum;
+	protected:
+		virtual void onTsPacket(TsPacket packet) {
+			++numPackets;
+			pidSum += packet.PID();
+		}
+	};
+
+	// fBXNx܂߂Ȃ悤ɐɃɓǂł
+	File srcfile(setting.getSrcFilePath(), _T("rb"));
+	size_t size = (size_t)std::min<int64_t>(srcfile.size(), MAX_SIZE);
+	auto data = std::unique_ptr<uint8_t[]>(new uint8_t[size]);
+	size_t total = 0;
+	while (total < size) {
+		total += srcfile.read(MemoryChunk(data.get() + total, size - total));
+	}
+
+	int64_t numPackets[2] = { 0 };
+	int64_t pidSum[2] = { 0 };
+	double packetsPerSec[2] = { 0 };
+	for (int fast = 0; fast < 2; ++fast) {
+		Stopwatch sw;
+		for (int pass = 0; pass < NUM_PASSES; ++pass) {
+			CountParser parser(ctx);
+			parser.setFastPath(fast != 0);
+			sw.start();
+			// AMTSplitter::readAllƓPʂœ
+			for (size_t pos = 0; pos < size; pos += READ_SIZE) {
+				parser.inputTS(MemoryChunk(data.get() + pos, std::min<size_t>(READ_SIZE, size - pos)));
+			}
+			parser.flush();
+			sw.stop();
+			numPackets[fast] = parser.numPackets;
+			pidSum[fast] = parser.pidSum;
+		}
+		double sec = sw.getTotal() / NUM_PASSES;
+		packetsPerSec[fast] = numPackets[fast] / sec;
+		printf("%s: %f sec for %lld packets ... %.0f packets/s (%.1f MB/s)\n",
+			fast ? "batch" : "legacy", sec, numPackets[fast],
+			packetsPerSec[fast], size / sec / (1024 * 1024));
+	}
+	printf("speedup: %.2fx\n", packetsPerSec[1] / packetsPerSec[0]);
+
+	if (numPackets[0] != numPackets[1] || pidSum[0] != pidSum[1]) {
+		THROW(TestException, "batch output does not match legacy output");
+	}
+
+	return 0;
+}
+
+static int AacDecode(AMTContext& ctx, const ConfigWrapper& setting)
+{
+	tstring srcfile = setting.getSrcFilePath() + _T(".aac");
+	tstring testfile = setting.getSrcFilePath() + _T(".wav");
+
+	FILE* fp = fsopenT(srcfile.c_str(), _T("rb"), _SH_DENYNO);
+	if (fp == nullptr) {
+		return 1;
+	}
+
+	enum {
+		BUF_SIZE = 1024 * 1024, // 1MB
+	};
+	auto buf = std::unique_ptr<uint8_t>(new uint8_t[BUF_SIZE]);
+	size_t readBytes = fread(buf.get(), 1, BUF_SIZE, fp);
+
+	AutoBuffer decoded;
+
+	NeAACDecHandle hAacDec = NeAACDecOpen();
+	/*
+	NeAACDecConfigurationPtr conf = NeAACDecGetCurrentConfiguration(hAacDec);
+	conf->outputFormat = FAAD_FMT_16BIT;
+	NeAACDecSetConfiguration(hAacDec, conf);
+	*/
+
+	unsigned long samplerate;
+	unsigned char channels;
+	if (NeAACDecInit(hAacDec, buf.get(), (unsigned long)readBytes, &samplerate, &channels)) {
+		fprintf(stderr, "NeAACDecInit failed\n");
+		return 1;
+	}
+
+	printf("samplerate=%d, channels=%d\n", samplerate, channels);
+
+	for (int i = 0; i < (int)readBytes; ) {
+		NeAACDecFrameInfo frameInfo;
+		void* samples = NeAACDecDecode(hAacDec, &frameInfo, buf.get() + i, (unsigned long)readBytes - i);
+		decoded.add(MemoryChunk((uint8_t*)samples, frameInfo.samples * 2));
+		i += frameInfo.bytesconsumed;
+	}
+
+	// f[^Ɣr
+	FILE* testfp = fsopenT(testfile.c_str(), _T("rb"), _SH_DENYNO);
+	if (testfp == nullptr) {
+		return 1;
+	}
+
+	auto testbuf = std::unique_ptr<uint8_t>(new uint8_t[BUF_SIZE]);
+	size_t testBytes = fread(testbuf.get(), 1, BUF_SIZE, testfp);
+	// data chunkT
+	for (int i = sizeof(RiffHeader); ; ) {
+		if (!(i < (int)testBytes - 8)) {
+			fprintf(stderr, "o͂܂\n");
+			return 1;
+		}
+		if (read32(testbuf.get() + i) == 'data') {
+			int testLength = (int)testBytes - i - 8;
+			const uint16_t* pTest = (const uint16_t*)(testbuf.get() + i + 8);
+			const uint16_t* pDec = (const uint16_t*)decoded.ptr();
+			if (testLength != decoded.size()) {
+				fprintf(stderr, "ʂ̃TCY܂\n");
+				return 1;
+			}
+			// AAC̃fR[hʂ͏Ȃ̂Ŋۂߌ덷l
+			for (int c = 0; c < testLength / 2; ++c) {
+				if ((std::abs((int)pTest[c] - (int)pDec[c]) > 1)) {
+					fprintf(stderr, "fR[hʂ܂\n");
+					return 1;
+				}
+			}
+			break;
+		}
+		i += *(uint32_t*)(testbuf.get() + i + 4) + 8;
+	}
+
+	NeAACDecClose(hAacDec);
+	fclose(fp);
+	fclose(testfp);
+
+	return 0;
+}
+
+static int WaveWriteHeader(AMTContext& ctx, const ConfigWrapper& setting)
+{
+	tstring dstfile = setting.getOutFilePath(EncodeFileKey(), EncodeFileKey());
+
+	FILE* fp = fsopenT(dstfile.c_str(), _T("wb"), _SH_DENYNO);
+	if (fp == nullptr) {
+		fprintf(stderr, "failed to open file...\n");
+		return 1;
+	}
+
+	int writeSeconds = 300;
+	int sampleRate = 24000;
+	int bitsPerSample = 8;
+	int nChannels = 1;
+
+	uint8_t* samples = (uint8_t*)malloc(writeSeconds * sampleRate * nChannels * (bitsPerSample / 2));
+	for (int i = 0; i < writeSeconds * sampleRate; ++i) {
+		for (int c = 0; c < nChannels; ++c) {
+			samples[i * nChannels + c] = (i % sampleRate);
+		}
+	}
+
+	writeWaveHeader(fp, nChannels, sampleRate, bitsPerSample, writeSeconds * sampleRate);
+	if (fwrite(samples, writeSeconds * sampleRate * nChannels, 1, fp) != 1) {
+		fprintf(stderr, "failed to write file...\n");
+		return 1;
+	}
+
+	free(samples);
+	fclose(fp);
+
+	return 0;
+}
+
+static int ProcessTest(AMTContext& ctx, const ConfigWrapper& setting)
+{
+	class ProcTest : public EventBaseSubProcess {
+	public:
+		ProcTest() : EventBaseSubProcess(_T("x264.exe --help")) { }
+	protected:
+		virtual void onOut(bool isErr, MemoryChunk mc) {
+			fwrite(mc.data, mc.length, 1, stdout);
+		}
+	};
+
+	ProcTest proc;
+	proc.join();
+
+	return 0;
+}
+
+static int FileStreamInfo(AMTContext& ctx, const ConfigWrapper& setting)
+{
+	StreamReformInfo reformInfo = StreamReformInfo::deserialize(ctx, setting.getStreamInfoPath());
+	reformInfo.prepare(false, false);
+	auto audioDiffInfo = reformInfo.genAudio({ CMTYPE_BOTH });
+	audioDiffInfo.printAudioPtsDiff(ctx);
+	reformInfo.printOutputMapping([&](EncodeFileKey key) {
+		const auto& file = reformInfo.getEncodeFile(key);
+		return setting.getOutFilePath(file.outKey, file.keyMax);
+	});
+	return 0;
+}
+
+static int ParseArgs(AMTContext& ctx, const ConfigWrapper& setting)
+{
+	const_cast<ConfigWrapper&>(setting).CreateTempDir();
+	setting.dump();
+	return 0;
+}
+
+static int LosslessTest(AMTContext& ctx, const ConfigWrapper& setting)
+{
+	auto env = make_unique_ptr(CreateScriptEnvironment2());
+	auto codecEnc = make_unique_ptr(CCodec::CreateInstance(UTVF_ULH0, "Amatsukaze"));
+	auto codecDec = make_unique_ptr(CCodec::CreateInstance(UTVF_ULH0, "Amatsukaze"));
+
+	{
+		PClip clip = env->Invoke("Import", to_string(setting.getFilterScriptPath()).c_str()).AsClip();
+
+		VideoInfo vi = clip->GetVideoInfo();
+
+		size_t cbGrossWidth[] = { CBGROSSWIDTH_WINDOWS, CBGROSSWIDTH_WINDOWS, CBGROSSWIDTH_WINDOWS };
+		size_t rawSize = vi.width * vi.height * 3 / 2;
+		size_t outSize = codecEnc->EncodeGetOutputSize(UTVF_YV12, vi.width, vi.height);
+		size_t headerSize = codecEnc->EncodeGetExtraDataSize();
+		auto memIn = std::unique_ptr<uint8_t[]>(new uint8_t[rawSize]);
+		auto memOut = std::unique_ptr<uint8_t[]>(new uint8_t[outSize]);
+		auto memDec = std::unique_ptr<uint8_t[]>(new uint8_t[rawSize]);
+		auto memHeader = std::unique_ptr<uint8_t[]>(new uint8_t[headerSize]);
+
+		if (codecEnc->EncodeGetExtraData(memHeader.get(), headerSize, UTVF_YV12, vi.width, vi.height)) {
+			THROW(RuntimeException, "failed to EncodeGetExtraData (UtVideo)");
+		}
+		if (codecEnc->EncodeBegin(UTVF_YV12, vi.width, vi.height, cbGrossWidth)) {
+			THROW(RuntimeException, "failed to EncodeBegin (UtVideo)");
+		}
+		if (codecDec->DecodeBegin(UTVF_YV12, vi.width, vi.height, cbGrossWidth, memHeader.get(), headerSize)) {
+			THROW(RuntimeException, "failed to DecodeBegin (UtVideo)");
+		}
+
+		size_t totalRawSize = 0;
+		size_t totalCompSize = 0;
+
+		for (int i = 0; i < 100; ++i) {
+			PVideoFrame frame = clip->GetFrame(i + 100, env.get());
+			CopyYV12(memIn.get(), frame, vi.width, vi.height);
+
+			bool keyFrame = false;
+			size_t outSize = codecEnc->EncodeFrame(memOut.get(), &keyFrame, memIn.get());
+			codecDec->DecodeFrame(memDec.get(), memOut.get());
+
+			if (memcmp(memIn.get(), memDec.get(), rawSize)) {
+				printf("UtVideo Encode/Decode Test Error\n");
+			}
+
+			totalRawSize += rawSize;
+			totalCompSize += outSize;
+		}
+
+		codecEnc->EncodeEnd();
+		codecDec->DecodeEnd();
+
+		float ratio = (float)totalCompSize / (float)totalRawSize;
+		printf("Compression ratio: %.1f%%\n", ratio * 100.0f);
+	}
+
+	return 0;
+}
+
+static int LosslessFileTest(AMTContext& ctx, const ConfigWrapper& setting)
+{
+	size_t cbGrossWidth[] = { CBGROSSWIDTH_WINDOWS, CBGROSSWIDTH_WINDOWS, CBGROSSWIDTH_WINDOWS };
+	auto env = make_unique_ptr(CreateScriptEnvironment2());
+	auto codec = make_unique_ptr(CCodec::CreateInstance(UTVF_ULH0, "Amatsukaze"));
+
+	tstring filepath = setting.getOutFilePath(EncodeFileKey(), EncodeFileKey());
+	tstring v1path = filepath + _T(".v1");
+
+	int width, height;
+	std::vector<uint8_t> extra;
+	std::vector<std::vector<uint8_t>> codedFrames;
+	std::vector<uint32_t> rawCRCs;
+	const CRC32* crc = ctx.getCRC();
+	Stopwatch sw;
+
+	{
+		int numframes = 100;
+		LosslessVideoFile file(ctx, filepath, _T("wb"));
+		PClip clip = env->Invoke("Import", to_string(setting.getFilterScriptPath()).c_str()).AsClip();
+
+		VideoInfo vi = clip->GetVideoInfo();
+		width = vi.width;
+		height = vi.height;
+
+		size_t rawSize = vi.width * vi.height * 3 / 2;
+		size_t outSize = codec->EncodeGetOutputSize(UTVF_YV12, vi.width, vi.height);
+		size_t extraSize = codec->EncodeGetExtraDataSize();
+		auto memIn = std::unique_ptr<uint8_t[]>(new uint8_t[rawSize]);
+		auto memOut = std::unique_ptr<uint8_t[]>(new uint8_t[outSize]);
+		extra.resize(extraSize);
+
+		if (codec->EncodeGetExtraData(extra.data(), extraSize, UTVF_YV12, vi.width, vi.height)) {
+			THROW(RuntimeException, "failed to EncodeGetExtraData (UtVideo)");
+		}
+		if (codec->EncodeBegin(UTVF_YV12, vi.width, vi.height, cbGrossWidth)) {
+			THROW(RuntimeException, "failed to EncodeBegin (UtVideo)");
+		}
+		file.writeHeader(vi.width, vi.height, numframes, extra);
+
+		double writeTime = 0;
+		for (int i = 0; i < numframes; ++i) {
+			PVideoFrame frame = clip->GetFrame(i + 100, env.get());
+			CopyYV12(memIn.get(), frame, vi.width, vi.height);
+			rawCRCs.push_back(crc->calc(memIn.get(), (int)rawSize, 0));
+
+			bool keyFrame = false;
+			size_t codedSize = codec->EncodeFrame(memOut.get(), &keyFrame, memIn.get());
+			codedFrames.emplace_back(memOut.get(), memOut.get() + codedSize);
+
+			sw.start();
+			file.writeFrame(memOut.get(), (int)codedSize);
+			writeTime += sw.current();
+		}
+		sw.start();
+		file.close();
+		writeTime += sw.current();
+		codec->EncodeEnd();
+
+		printf("v2 write: %.1fms\n", writeTime * 1000);
+	}
+
+	// `(v1)̃t@C
+	{
+		File file(v1path, _T("wb"));
+		int header[] = { 0x012345, 1, width, height };
+		file.write(MemoryChunk((uint8_t*)header, sizeof(header)));
+		file.writeArray(extra);
+		std::vector<int> framesizes;
+		for (const auto& frame : codedFrames) {
+			framesizes.push_back((int)frame.size());
+		}
+		file.writeArray(framesizes);
+		for (auto& frame : codedFrames) {
+			file.write(MemoryChunk(frame.data(), frame.size()));
+		}
+	}
+
+	const tstring paths[] = { filepath, v1path };
+	for (const tstring& path : paths) {
+		LosslessVideoFile file(ctx, path, _T("rb"));
+		file.readHeader();
+
+		if (file.getWidth() != width || file.getHeight() != height ||
+			file.getNumFrames() != (int)codedFrames.size() || file.getExtra() != extra)
+		{
+			THROW(RuntimeException, "header mismatch");
+		}
+
+		size_t rawSize = width * height * 3 / 2;
+		auto memDec = std::unique_ptr<uint8_t[]>(new uint8_t[rawSize]);
+
+		if (codec->DecodeBegin(UTVF_YV12, width, height, cbGrossWidth, extra.data(), (int)extra.size())) {
+			THROW(RuntimeException, "failed to DecodeBegin (UtVideo)");
+		}
+
+		double readTime = 0;
+		for (int i = 0; i < file.getNumFrames(); ++i) {
+			sw.start();
+			MemoryChunk coded = file.getFrame(i);
+			readTime += sw.current();
+			if (coded != MemoryChunk(codedFrames[i].data(), codedFrames[i].size())) {
+				THROWF(RuntimeException, "coded frame mismatch at %d", i);
+			}
+			if (codec->DecodeFrame(memDec.get(), coded.data) != rawSize) {
+				THROW(RuntimeException, "failed to DecodeFrame (UtVideo)");
+			}
+			if (crc->calc(memDec.get(), (int)rawSize, 0) != rawCRCs[i]) {
+				THROWF(RuntimeException, "decoded frame mismatch at %d", i);
 			}
 		}
 
 		codec->DecodeEnd();
+
+		printf("%s read: %.1fms\n", (path == v1path) ? "v1" : "v2", readTime * 1000);
+	}
+
+	removeT(v1path.c_str());
+
+	return 0;
+}
+
+// SXLworkfile񈳏k/kŏāÃt[ɖ߂邱Ɓ{xv
+static int LosslessParallelTest(AMTContext& ctx, const ConfigWrapper& setting)
+{
+	auto env = make_unique_ptr(CreateScriptEnvironment2());
+	PClip clip = env->Invoke("Import", to_string(setting.getFilterScriptPath()).c_str()).AsClip();
+	VideoInfo vi = clip->GetVideoInfo();
+
+	const CRC32* crc = ctx.getCRC();
+	int numframes = 100;
+	size_t rawSize = vi.width * vi.height * 3 / 2;
+	std::vector<std::unique_ptr<uint8_t[]>> frames;
+	std::vector<uint32_t> rawCRCs;
+	for (int i = 0; i < numframes; ++i) {
+		PVideoFrame frame = clip->GetFrame(i + 100, env.get());
+		frames.emplace_back(new uint8_t[rawSize]);
+		CopyYV12(frames.back().get(), frame, vi.width, vi.height);
+		rawCRCs.push_back(crc->calc(frames.back().get(), (int)rawSize, 0));
+	}
+
+	struct Mode {
+		LOSSLESS_CODEC codec;
+		int numThreads;
+		const char* name;
+	} modes[] = {
+		{ LOSSLESS_UTVIDEO, 1, "utvideo 1 thread" },
+		{ LOSSLESS_UTVIDEO, 4, "utvideo 4 threads" },
+		{ LOSSLESS_RAW, 1, "raw" },
+	};
+
+	tstring filepath = setting.getOutFilePath(EncodeFileKey(), EncodeFileKey());
+	auto memDec = std::unique_ptr<uint8_t[]>(new uint8_t[rawSize]);
+	Stopwatch sw;
+	for (const auto& mode : modes) {
+		sw.start();
+		{
+			logo::ParallelLosslessWriter writer(ctx, filepath,
+				vi.width, vi.height, numframes, mode.codec, mode.numThreads);
+			for (int i = 0; i < numframes; ++i) {
+				memcpy(writer.getFrameBuffer(), frames[i].get(), rawSize);
+				writer.addFrame();
+			}
+			writer.close();
+		}
+		double writeTime = sw.current();
+
+		LosslessVideoFile file(ctx, filepath, _T("rb"));
+		file.readHeader();
+		if (file.getCodec() != mode.codec || file.getNumFrames() != numframes) {
+			THROW(RuntimeException, "header mismatch");
+		}
+		int64_t fileSize = 0;
+		LosslessFrameDecoder decoder(file);
+		for (int i = 0; i < numframes; ++i) {
+			fileSize += file.getFrame(i).length;
+			decoder.decode(file, i, memDec.get());
+			if (crc->calc(memDec.get(), (int)rawSize, 0) != rawCRCs[i]) {
+				THROWF(RuntimeException, "frame mismatch at %d (%s)", i, mode.name);
+			}
+		}
+
+		printf("%s: write %.1fms, %.1fMB\n", mode.name, writeTime * 1000, fileSize / (1024.0 * 1024.0));
 	}
 
 	return 0;
@@ -448,6 +1521,862 @@ static int LogoFrameTest(AMTContext& ctx, const ConfigWrapper& setting)
 	return 0;
 }
 
+// LogoFramẽt[]SEXbhςČv
+// ]ʂ̓Xbhɂ炸v邱
+static int LogoFramePerformance(AMTContext& ctx, const ConfigWrapper& setting)
+{
+	const std::vector<tstring>& allLogos = setting.getLogoPath();
+	std::vector<int> threadCounts = { 1, 2, 4, ParallelTaskPool::getDefaultNumThreads() };
+	std::vector<int> logoCounts = { 1 };
+	if (allLogos.size() > 1) {
+		logoCounts.push_back((int)allLogos.size());
+	}
+
+	for (int numLogos : logoCounts) {
+		std::vector<tstring> logos(allLogos.begin(), allLogos.begin() + numLogos);
+		tstring refBase = setting.getTmpLogoFramePath(0) + _T(".ref");
+		for (int numThreads : threadCounts) {
+			auto env = make_unique_ptr(CreateScriptEnvironment2());
+			PClip clip = env->Invoke("Import", to_string(setting.getFilterScriptPath()).c_str()).AsClip();
+			int numFrames = clip->GetVideoInfo().num_frames;
+
+			logo::LogoFrame logof(ctx, logos, 0.35f);
+			logof.setNumThreads(numThreads);
+			Stopwatch sw;
+			sw.start();
+			logof.scanFrames(clip, env.get());
+			double elapsed = sw.getAndReset();
+			printf("logos=%d threads=%2d: %.2f sec (%.1f fps)\n",
+				numLogos, numThreads, elapsed, numFrames / elapsed);
+
+			tstring outBase = (numThreads == 1) ? refBase : setting.getTmpLogoFramePath(0);
+			logof.dumpResult(outBase);
+			if (numThreads != 1) {
+				for (int i = 0; i < numLogos; ++i) {
+					if (!FileEquals(StringFormat(_T("%s%d"), outBase, i), StringFormat(_T("%s%d"), refBase, i))) {
+						THROWF(TestException, "Result does not match (logos=%d threads=%d)", numLogos, numThreads);
+					}
+				}
+			}
+		}
+	}
+
+	return 0;
+}
+
+// S]̃eXgpt[iOf[V + mCYj
+static std::vector<std::unique_ptr<float[]>> MakeLogoEvalFrames(
+	const logo::LogoHeader& header, float maxv, int numFrames, std::mt19937& rng)
+{
+	int YSize = header.w * header.h;
+	std::uniform_real_distribution<float> noise(0.0f, maxv * 0.25f);
+	std::vector<std::unique_ptr<float[]>> frames;
+	for (int i = 0; i < numFrames; ++i) {
+		auto frame = std::unique_ptr<float[]>(new float[YSize + 8]());
+		for (int y = 0; y < header.h; ++y) {
+			for (int x = 0; x < header.w; ++x) {
+				float base = maxv * 0.75f * (x + y + i * 7) / (header.w + header.h + numFrames * 7);
+				frame[x + y * header.w] = std::min(maxv, base + noise(rng));
+			}
+		}
+		frames.push_back(std::move(frame));
+	}
+	return frames;
+}
+
+// EvaluateLogõubNłƏ]̔r
+static int LogoEvaluatePerformance(AMTContext& ctx, const ConfigWrapper& setting)
+{
+	enum { NUM_FRAMES = 64, NUM_ITERATIONS = 20 };
+	// ]l͍wi1ɂȂ悤KĂ̂ŁA̒x̌덷͖ɂȂȂ
+	const float tolerance = 1e-3f;
+
+	std::mt19937 rng(12345);
+	for (const tstring& logopath : setting.getLogoPath()) {
+		logo::LogoHeader header;
+		logo::LogoDataParam param(logo::LogoData::Load(logopath, &header), &header);
+		param.CreateLogoMask(0.35f);
+
+		int YSize = header.w * header.h;
+		auto memWork = std::unique_ptr<float[]>(new float[YSize + 8]);
+
+		for (int bits : { 8, 10 }) {
+			float maxv = (float)((1 << bits) - 1);
+			auto frames = MakeLogoEvalFrames(header, maxv, NUM_FRAMES, rng);
+
+			// EvaluateLogoiAVX2gAVX2ŁjSIMDȂ̃ubNłƏ]Ɉv邱
+			float maxDiff = 0;
+			for (int i = 0; i < NUM_FRAMES; ++i) {
+				for (float fade : { 0.0f, 0.5f, 1.0f }) {
+					float v = param.EvaluateLogo(frames[i].get(), maxv, fade, memWork.get());
+					float scalar = param.EvaluateLogoScalar(frames[i].get(), maxv, fade, memWork.get());
+					float ref = param.EvaluateLogoRef(frames[i].get(), maxv, fade, memWork.get());
+					if (!(std::abs(v - scalar) <= tolerance)) {
+						THROWF(TestException, "EvaluateLogo/scalar mismatch: %f vs %f (frame %d fade %.1f %s %dbit)",
+							v, scalar, i, fade, logopath, bits);
+					}
+					if (!(std::abs(v - ref) <= tolerance)) {
+						THROWF(TestException, "EvaluateLogo/ref mismatch: %f vs %f (frame %d fade %.1f %s %dbit)",
+							v, ref, i, fade, logopath, bits);
+					}
+					maxDiff = std::max(maxDiff, std::max(std::abs(v - scalar), std::abs(v - ref)));
+				}
+			}
+
+			Stopwatch sw;
+			float sink = 0;
+			sw.start();
+			for (int it = 0; it < NUM_ITERATIONS; ++it) {
+				for (int i = 0; i < NUM_FRAMES; ++i) {
+					sink += param.EvaluateLogoRef(frames[i].get(), maxv, 0, memWork.get());
+				}
+			}
+			double refTime = sw.getAndReset();
+			sw.start();
+			for (int it = 0; it < NUM_ITERATIONS; ++it) {
+				for (int i = 0; i < NUM_FRAMES; ++i) {
+					sink += param.EvaluateLogo(frames[i].get(), maxv, 0, memWork.get());
+				}
+			}
+			double newTime = sw.getAndReset();
+
+			int numEval = NUM_ITERATIONS * NUM_FRAMES;
+			printf("%dx%d mask=%d %2dbit: ref %.1fus new %.1fus (x%.2f) maxdiff=%g (%g)\n",
+				header.w, header.h, param.getMaskPixels(), bits,
+				refTime * 1e6 / numEval, newTime * 1e6 / numEval, refTime / newTime, maxDiff, sink);
+			// x͊ˑȂ̂ŖڕWix3jłbZ[W
+			if (refTime / newTime < 3.0) {
+				printf("  speedup x%.2f is below the x3 target\n", refTime / newTime);
+			}
+		}
+	}
+
+	return 0;
+}
+
+// EvaluateLogoMultiFadefadelƂEvaluateLogo̔r
+static int LogoMultiFadePerformance(AMTContext& ctx, const ConfigWrapper& setting)
+{
+	enum { NUM_FRAMES = 64, NUM_ITERATIONS = 10 };
+	// ]l͍wi1ɂȂ悤KĂ
+	// ô͉ZƃXP[IE̊ۂ߂Ȃ̂ŁA̒xɎ܂
+	const float tolerance = 1e-3f;
+
+	std::mt19937 rng(12345);
+	for (const tstring& logopath : setting.getLogoPath()) {
+		logo::LogoHeader header;
+		logo::LogoDataParam param(logo::LogoData::Load(logopath, &header), &header);
+		param.CreateLogoMask(0.35f);
+
+		int YSize = header.w * header.h;
+		auto memWork = std::unique_ptr<float[]>(new float[YSize * 2 + 8]);
+
+		// AMTAnalyzeLogoReMakeLogofadel
+		std::vector<float> fades11, fades20;
+		for (int f = 0; f <= 10; ++f) fades11.push_back((float)f / 10.0f);
+		for (int f = 0; f < 20; ++f) fades20.push_back(0.1f * f);
+
+		for (int bits : { 8, 10 }) {
+			float maxv = (float)((1 << bits) - 1);
+			auto frames = MakeLogoEvalFrames(header, maxv, NUM_FRAMES, rng);
+
+			for (const auto& fades : { fades11, fades20 }) {
+				int numFades = (int)fades.size();
+				std::vector<float> results(numFades);
+
+				float maxDiff = 0;
+				for (int i = 0; i < NUM_FRAMES; ++i) {
+					param.EvaluateLogoMultiFade(frames[i].get(), maxv, fades.data(), numFades, results.data(), memWork.get());
+					for (int f = 0; f < numFades; ++f) {
+						float ref = param.EvaluateLogo(frames[i].get(), maxv, fades[f], memWork.get());
+						maxDiff = std::max(maxDiff, std::abs(results[f] - ref));
+					}
+				}
+				if (maxDiff > tolerance) {
+					THROWF(TestException, "EvaluateLogoMultiFade result mismatch: %f (%s %dbit %d fades)",
+						maxDiff, logopath, bits, numFades);
+				}
+
+				Stopwatch sw;
+				float sink = 0;
+				sw.start();
+				for (int it = 0; it < NUM_ITERATIONS; ++it) {
+					for (int i = 0; i < NUM_FRAMES; ++i) {
+						for (int f = 0; f < numFades; ++f) {
+							sink += param.EvaluateLogo(frames[i].get(), maxv, fades[f], memWork.get());
+						}
+					}
+				}
+				double loopTime = sw.getAndReset();
+				sw.start();
+				for (int it = 0; it < NUM_ITERATIONS; ++it) {
+					for (int i = 0; i < NUM_FRAMES; ++i) {
+						param.EvaluateLogoMultiFade(frames[i].get(), maxv, fades.data(), numFades, results.data(), memWork.get());
+						sink += results[0];
+					}
+				}
+				double multiTime = sw.getAndReset();
+
+				int numEval = NUM_ITERATIONS * NUM_FRAMES;
+				printf("%dx%d mask=%d %2dbit %2d fades: loop %.1fus/frame multi %.1fus/frame (x%.2f) maxdiff=%g (%g)\n",
+					header.w, header.h, param.getMaskPixels(), bits, numFades,
+					loopTime * 1e6 / numEval, multiTime * 1e6 / numEval, loopTime / multiTime, maxDiff, sink);
+			}
+		}
+	}
+
+	return 0;
+}
+
+// ScratchArena̓mFƁAt[newƂ̔r
+static int ScratchArenaTest(AMTContext& ctx, const ConfigWrapper& setting)
+{
+	{
+		ScratchArena::Scope outer;
+		float* a = outer.alloc<float>(100);
+		uint8_t* b = outer.alloc<uint8_t>(3);
+		float* c = nullptr;
+		{
+			ScratchArena::Scope inner;
+			c = inner.alloc<float>(1 << 20); // V`NKv
+			for (void* p : { (void*)a, (void*)b, (void*)c }) {
+				if (((uintptr_t)p % ScratchArena::ALIGN) != 0) {
+					THROW(TestException, "scratch memory is not aligned");
+				}
+			}
+		}
+		// Scope𔲂̂œʒuėp
+		ScratchArena::Scope inner;
+		if (inner.alloc<float>(1 << 20) != c) {
+			THROW(TestException, "scratch memory is not reused");
+		}
+	}
+
+	// AMTAnalyzeLogoƓ悤ȃt[̈ꎞobt@
+	enum { NUM_TASKS = 20000, YSIZE = 400 * 120 };
+	ParallelTaskPool pool;
+	Stopwatch sw;
+	std::atomic<int64_t> sink(0);
+	auto work = [&](float* copy, float* deint, float* w) {
+		copy[0] = deint[YSIZE - 1] = w[YSIZE * 2 - 1] = 1.0f;
+		sink += (int64_t)(copy[0] + deint[YSIZE - 1] + w[YSIZE * 2 - 1]);
+	};
+
+	sw.start();
+	pool.run(NUM_TASKS, [&](int task, int worker) {
+		auto memCopy = std::unique_ptr<float[]>(new float[YSIZE + 8]);
+		auto memDeint = std::unique_ptr<float[]>(new float[YSIZE + 8]);
+		auto memWork = std::unique_ptr<float[]>(new float[YSIZE * 2 + 8]);
+		work(memCopy.get(), memDeint.get(), memWork.get());
+	});
+	double newTime = sw.getAndReset();
+
+	ScratchArena::resetStats();
+	sw.start();
+	pool.run(NUM_TASKS, [&](int task, int worker) {
+		ScratchArena::Scope scratch;
+		float* memCopy = scratch.alloc<float>(YSIZE + 8);
+		float* memDeint = scratch.alloc<float>(YSIZE + 8);
+		float* memWork = scratch.alloc<float>(YSIZE * 2 + 8);
+		work(memCopy, memDeint, memWork);
+	});
+	double arenaTime = sw.getAndReset();
+	ScratchArena::Stats stats = ScratchArena::getStats();
+
+	if (stats.numRequests != NUM_TASKS * 3) {
+		THROWF(TestException, "unexpected number of requests: %lld", stats.numRequests);
+	}
+	// [J[ɍŏ̐񂾂q[vmۂ
+	if (stats.numHeapAllocs > pool.getNumThreads() * 4) {
+		THROWF(TestException, "too many heap allocations: %lld", stats.numHeapAllocs);
+	}
+
+	printf("%d threads: new %.1fms, arena %.1fms (x%.2f) requests=%lld heap=%lld peak=%lldKB (%lld)\n",
+		pool.getNumThreads(), newTime * 1000, arenaTime * 1000, newTime / arenaTime,
+		stats.numRequests, stats.numHeapAllocs, stats.peakBytes / 1024, (int64_t)sink);
+
+	return 0;
+}
+
+// AMTAnalyzeLogȍo͂̑ɁAR[hԍlɎt[ԂNbv
+class TestAnalyzeClip : public IClip
+{
+	VideoInfo vi;
+	std::vector<PVideoFrame> frames;
+	std::atomic<int> numGetFrame;
+public:
+	TestAnalyzeClip(int numRecords, IScriptEnvironment* env)
+		: vi()
+		, numGetFrame(0)
+	{
+		vi.pixel_type = VideoInfo::CS_BGR32;
+		vi.width = 64;
+		vi.height = nblocks((int)sizeof(logo::LogoAnalyzeFrame) * 8, vi.width * 4);
+		vi.num_frames = nblocks(numRecords, 8);
+		for (int n = 0; n < vi.num_frames; ++n) {
+			PVideoFrame frame = env->NewVideoFrame(vi);
+			logo::LogoAnalyzeFrame* pDst = reinterpret_cast<logo::LogoAnalyzeFrame*>(frame->GetWritePtr());
+			for (int i = 0; i < 8; ++i) {
+				std::fill_n(pDst[i].p, 11, (float)(n * 8 + i));
+			}
+			frames.push_back(frame);
+		}
+	}
+
+	int getNumGetFrame() const { return numGetFrame; }
+
+	PVideoFrame __stdcall GetFrame(int n, IScriptEnvironment* env) {
+		++numGetFrame;
+		return frames[std::max(0, std::min(vi.num_frames - 1, n))];
+	}
+	void __stdcall GetAudio(void* buf, __int64 start, __int64 count, IScriptEnvironment* env) { }
+	const VideoInfo& __stdcall GetVideoInfo() { return vi; }
+	bool __stdcall GetParity(int n) { return false; }
+	int __stdcall SetCacheHints(int cachehints, int frame_range) { return 0; }
+};
+
+// AMTEraseLogỏ͌ʃLbV
+static int LogoAnalyzeCacheTest(AMTContext& ctx, const ConfigWrapper& setting)
+{
+	enum { NUM_RECORDS = 8 * 1000, DIST = 4 };
+	auto env = make_unique_ptr(CreateScriptEnvironment2());
+	auto clip = new TestAnalyzeClip(NUM_RECORDS, env.get());
+	PClip clipRef = clip;
+	int numAnalyzeFrames = clip->GetVideoInfo().num_frames;
+
+	auto expected = [&](int rec) {
+		return (float)(std::max(0, std::min(numAnalyzeFrames - 1, rec >> 3)) * 8 + (rec & 7));
+	};
+
+	// ԂɏiCalcFade2ƓANZXj
+	{
+		logo::LogoAnalyzeCache cache(clipRef);
+		for (int n = 0; n < NUM_RECORDS; ++n) {
+			for (int i = -DIST; i <= DIST; ++i) {
+				int rec = std::max(0, std::min(NUM_RECORDS - 1, n + i)) + i;
+				if (cache.get(rec, env.get()).p[0] != expected(rec)) {
+					THROWF(TestException, "wrong record %d", rec);
+				}
+			}
+		}
+		// 擪Ɩ͔͈͊ÕR[hQƂ̂ŁA̕]Ɏ擾
+		if (cache.getNumFetches() > numAnalyzeFrames + 2) {
+			THROWF(TestException, "too many fetches: %lld (%d frames)", cache.getNumFetches(), numAnalyzeFrames);
+		}
+		printf("sequential: %d output frames, %lld fetches (no cache: %d)\n",
+			(int)NUM_RECORDS, cache.getNumFetches(), (int)NUM_RECORDS * (DIST * 2 + 1));
+	}
+
+	// Xbh΂΂̏Ԃŏ
+	{
+		logo::LogoAnalyzeCache cache(clipRef);
+		ParallelTaskPool pool(4);
+		pool.run(NUM_RECORDS, [&](int task, int worker) {
+			int n = (task * 7919) % NUM_RECORDS;
+			for (int i = -DIST; i <= DIST; ++i) {
+				int rec = std::max(0, std::min(NUM_RECORDS - 1, n + i)) + i;
+				if (cache.get(rec, env.get()).p[0] != expected(rec)) {
+					THROWF(TestException, "wrong record %d", rec);
+				}
+			}
+		});
+		printf("random MT: %lld fetches\n", cache.getNumFetches());
+	}
+
+	return 0;
+}
+
+// SJ[lAVX2łƃXJ[ł̔r{xv
+template <typename pixel_t>
+static void DelogoKernelTestT(int bits, std::mt19937& rng)
+{
+	enum { W = 333, H = 120, IMGPITCH = 352, NUM_ITERATIONS = 200 };
+	float maxv = (float)((1 << bits) - 1);
+
+	// Sa1ȏAbiAddLogőtϊj
+	std::uniform_real_distribution<float> distA(1.0f, 3.0f);
+	std::uniform_real_distribution<float> distB(-2.0f, 0.0f);
+	std::uniform_int_distribution<int> distPix(0, (int)maxv);
+	std::vector<float> A(W * H), B(W * H);
+	for (int i = 0; i < W * H; ++i) {
+		A[i] = distA(rng);
+		B[i] = distB(rng);
+	}
+	std::vector<pixel_t> src(IMGPITCH * H);
+	for (auto& p : src) {
+		p = (pixel_t)distPix(rng);
+	}
+
+	for (float fade : { 0.0f, 0.3f, 0.7f, 1.0f }) {
+		for (bool field : { false, true }) {
+			std::vector<pixel_t> ref = src;
+			std::vector<pixel_t> v = src;
+			if (field) {
+				for (int parity = 0; parity < 2; ++parity) {
+					logo::DelogoPlane(ref.data() + parity * IMGPITCH, W, H / 2, W * 2, IMGPITCH * 2, maxv,
+						A.data() + parity * W, B.data() + parity * W, fade);
+					logo::DelogoPlane_AVX2(v.data() + parity * IMGPITCH, W, H / 2, W * 2, IMGPITCH * 2, maxv,
+						A.data() + parity * W, B.data() + parity * W, fade);
+				}
+			}
+			else {
+				logo::DelogoPlane(ref.data(), W, H, W, IMGPITCH, maxv, A.data(), B.data(), fade);
+				logo::DelogoPlane_AVX2(v.data(), W, H, W, IMGPITCH, maxv, A.data(), B.data(), fade);
+			}
+			for (int i = 0; i < IMGPITCH * H; ++i) {
+				if (ref[i] != v[i]) {
+					THROWF(TestException, "Delogo mismatch at (%d,%d): %d vs %d (%dbit fade=%.1f field=%d)",
+						i % IMGPITCH, i / IMGPITCH, (int)ref[i], (int)v[i], bits, fade, (int)field);
+				}
+			}
+		}
+	}
+
+	std::vector<pixel_t> work = src;
+	Stopwatch sw;
+	sw.start();
+	for (int it = 0; it < NUM_ITERATIONS; ++it) {
+		logo::DelogoPlane(work.data(), W, H, W, IMGPITCH, maxv, A.data(), B.data(), 0.5f);
+	}
+	double refTime = sw.getAndReset();
+	sw.start();
+	for (int it = 0; it < NUM_ITERATIONS; ++it) {
+		logo::DelogoPlane_AVX2(work.data(), W, H, W, IMGPITCH, maxv, A.data(), B.data(), 0.5f);
+	}
+	double avx2Time = sw.getAndReset();
+
+	double mpix = (double)W * H * NUM_ITERATIONS / 1e6;
+	printf("%2dbit: scalar %.0f Mpix/s, AVX2 %.0f Mpix/s (x%.2f)\n",
+		bits, mpix / refTime, mpix / avx2Time, refTime / avx2Time);
+}
+
+static int DelogoKernelTest(AMTContext& ctx, const ConfigWrapper& setting)
+{
+	if (!IsAVX2Available()) {
+		printf("AVX2Ȃ̂ŃXLbv\n");
+		return 0;
+	}
+	std::mt19937 rng(12345);
+	DelogoKernelTestT<uint8_t>(8, rng);
+	DelogoKernelTestT<uint16_t>(10, rng);
+	DelogoKernelTestT<uint16_t>(16, rng);
+	return 0;
+}
+
+// ԈXLƑSt[XLŃSĔr
+static int SampledLogoScanTest(AMTContext& ctx, const ConfigWrapper& setting)
+{
+	// XL͈͎͂w肳ꂽSɍ킹
+	const auto& logoPath = setting.getLogoPath();
+	if (logoPath.size() == 0) {
+		THROW(ArgumentException, "Sw肳Ă܂");
+	}
+	logo::LogoHeader header;
+	logo::LogoData::Load(logoPath[0], &header);
+
+	// R[obNŃfR[ht[
+	static int numRead;
+	auto cb = [](float progress, int nread, int total, int ngather) {
+		if (total == 0) numRead = nread;
+		return true;
+	};
+
+	tstring base = setting.getOutFilePath(EncodeFileKey(), EncodeFileKey());
+	tstring workfile = base + _T(".logowork");
+	tstring dstpath[2] = { base + _T(".full.lgd"), base + _T(".sampled.lgd") };
+	int nread[2];
+	double elapsed[2];
+	Stopwatch sw;
+	for (int i = 0; i < 2; ++i) {
+		numRead = 0;
+		sw.start();
+		logo::LogoAnalyzer analyzer(ctx,
+			setting.getSrcFilePath().c_str(), setting.getServiceId(), workfile.c_str(), dstpath[i].c_str(),
+			header.imgx, header.imgy, header.w, header.h, 12, 10000, cb,
+			LOSSLESS_UTVIDEO, 0, i == 1);
+		analyzer.ScanLogo();
+		elapsed[i] = sw.getAndReset();
+		nread[i] = numRead;
+	}
+	printf("full: %d frames %.2fs, sampled: %d frames %.2fs\n",
+		nread[0], elapsed[0], nread[1], elapsed[1]);
+
+	logo::LogoData full = logo::LogoData::Load(dstpath[0], &header);
+	logo::LogoData sampled = logo::LogoData::Load(dstpath[1], &header);
+	printf("logo mean diff: %f\n", logo::LogoMeanDiff(full, sampled));
+
+	if (nread[1] >= nread[0]) {
+		THROW(TestException, "sampled scan decoded all frames");
+	}
+	return 0;
+}
+
+// LogoScanɏWvĂi\[gŔwiF߂錳̎jƓSɂȂ邩
+static int LogoScanParallelTest(AMTContext& ctx, const ConfigWrapper& setting)
+{
+	const int W = 256, H = 128, UVW = W / 2, UVH = H / 2;
+	const int NUM_FRAMES = 4000;
+	const int thy = 12;
+	const size_t frameSize = W * H * 3 / 2;
+
+	// PFwi + mCY + S̃t[i3炢͒PFŗ悤ɂj
+	std::mt19937 rng(4321);
+	std::vector<std::unique_ptr<uint8_t[]>> frames;
+	for (int i = 0; i < NUM_FRAMES; ++i) {
+		int noise = (rng() % 10 < 3) ? 20 : 5;
+		int bg[3] = { 16 + (int)(rng() % 220), 16 + (int)(rng() % 225), 16 + (int)(rng() % 225) };
+		frames.emplace_back(new uint8_t[frameSize]);
+		uint8_t* planes[3] = { frames.back().get(), frames.back().get() + W * H, frames.back().get() + W * H + UVW * UVH };
+		for (int p = 0; p < 3; ++p) {
+			int w = (p == 0) ? W : UVW;
+			int h = (p == 0) ? H : UVH;
+			for (int y = 0; y < h; ++y) {
+				for (int x = 0; x < w; ++x) {
+					int v = bg[p] + (int)(rng() % (noise * 2 + 1)) - noise;
+					int dx = x * 2 - w, dy = y * 2 - h;
+					if (dx * dx * 4 + dy * dy * 16 < w * w) {
+						v = (v + 200) / 2;
+					}
+					planes[p][x + y * w] = (uint8_t)std::max(0, std::min(255, v));
+				}
+			}
+		}
+	}
+
+	// ̎ŏWv
+	std::vector<logo::LogoColor> ref[3] = {
+		std::vector<logo::LogoColor>(W * H),
+		std::vector<logo::LogoColor>(UVW * UVH),
+		std::vector<logo::LogoColor>(UVW * UVH)
+	};
+	int refFrames = 0;
+	Stopwatch sw;
+	sw.start();
+	for (int i = 0; i < NUM_FRAMES; ++i) {
+		const uint8_t* planes[3] = { frames[i].get(), frames[i].get() + W * H, frames[i].get() + W * H + UVW * UVH };
+		int bg[3];
+		bool valid = true;
+		for (int p = 0; p < 3 && valid; ++p) {
+			int w = (p == 0) ? W : UVW;
+			int h = (p == 0) ? H : UVH;
+			std::vector<short> tmp;
+			for (int x = 0; x < w; ++x) {
+				tmp.push_back(planes[p][x]);
+				tmp.push_back(planes[p][x + (h - 1) * w]);
+			}
+			for (int y = 1; y < h - 1; ++y) {
+				tmp.push_back(planes[p][y * w]);
+				tmp.push_back(planes[p][w - 1 + y * w]);
+			}
+			std::sort(tmp.begin(), tmp.end());
+			if (abs(tmp.front() - tmp.back()) > thy) {
+				valid = false;
+				break;
+			}
+			int n = (int)tmp.size();
+			double t = 0;
+			int nn = 0;
+			for (int k = n / 4; k < n - (n / 4); k++, nn++) t += tmp[k];
+			bg[p] = (int)((t + nn / 2) / nn);
+		}
+		if (!valid) continue;
+		for (int p = 0; p < 3; ++p) {
+			for (int k = 0; k < (int)ref[p].size(); ++k) {
+				ref[p][k].Add(planes[p][k], bg[p]);
+			}
+		}
+		++refFrames;
+	}
+	double refTime = sw.getAndReset();
+	int planeIds[3] = { PLANAR_Y, PLANAR_U, PLANAR_V };
+	logo::LogoData refLogo(W, H, 1, 1);
+	for (int p = 0; p < 3; ++p) {
+		for (int k = 0; k < (int)ref[p].size(); ++k) {
+			ref[p][k].Normalize(255);
+			if (!ref[p][k].GetAB(refLogo.GetA(planeIds[p])[k], refLogo.GetB(planeIds[p])[k], refFrames)) {
+				THROW(TestException, "reference logo failed");
+			}
+		}
+	}
+
+	const int threads[] = { 1, 2, 4, 8 };
+	for (int numThreads : threads) {
+		ParallelTaskPool pool(numThreads);
+		logo::LogoScan logoscan(W, H, 1, 1, thy, pool.getNumThreads());
+		std::atomic<int> numValid(0);
+		sw.start();
+		pool.run(NUM_FRAMES, [&](int task, int worker) {
+			const uint8_t* ptr = frames[task].get();
+			if (logoscan.AddFrame(ptr, ptr + W * H, ptr + W * H + UVW * UVH, W, UVW, worker)) {
+				++numValid;
+			}
+		});
+		logoscan.Normalize(255);
+		double elapsed = sw.getAndReset();
+		auto scanLogo = logoscan.GetLogo(false);
+		if (numValid != refFrames || scanLogo == nullptr) {
+			THROWF(TestException, "valid frames mismatch: %d vs %d", (int)numValid, refFrames);
+		}
+		for (int p = 0; p < 3; ++p) {
+			int n = (int)ref[p].size();
+			if (memcmp(scanLogo->GetA(planeIds[p]), refLogo.GetA(planeIds[p]), n * sizeof(float)) ||
+				memcmp(scanLogo->GetB(planeIds[p]), refLogo.GetB(planeIds[p]), n * sizeof(float)))
+			{
+				THROWF(TestException, "logo mismatch (plane %d, %d threads)", p, numThreads);
+			}
+		}
+		printf("%d threads: %.1fms (ref %.1fms, x%.2f)\n",
+			numThreads, elapsed * 1000, refTime * 1000, refTime / elapsed);
+	}
+
+	printf("%d/%d valid frames\n", refFrames, NUM_FRAMES);
+	return 0;
+}
+
+// CreateLogoMask̃LbVǂݍ񂾌ʂvZʂƓɂȂ邩
+static int LogoMaskCacheTest(AMTContext& ctx, const ConfigWrapper& setting)
+{
+	enum { NUM_FRAMES = 16 };
+	const float maskratio = 0.35f;
+
+	std::mt19937 rng(12345);
+	tstring base = setting.getOutFilePath(EncodeFileKey(), EncodeFileKey());
+	int index = 0;
+	for (const tstring& logopath : setting.getLogoPath()) {
+		tstring cachepath = StringFormat(_T("%s-%d.kcache"), base, index++);
+		removeT(cachepath.c_str());
+
+		logo::LogoHeader header;
+		logo::LogoData logodata = logo::LogoData::Load(logopath, &header);
+		auto makeParam = [&]() {
+			logo::LogoDataParam param(logo::LogoData(header.w, header.h, header.logUVx, header.logUVy), &header);
+			logo::DeintLogo(param, logodata, header.w, header.h);
+			return param;
+		};
+
+		Stopwatch sw;
+		logo::LogoDataParam created = makeParam();
+		sw.start();
+		created.CreateLogoMask(maskratio);
+		double createTime = sw.getAndReset();
+
+		logo::LogoDataParam miss = makeParam();
+		if (miss.CreateLogoMask(maskratio, cachepath)) {
+			THROW(TestException, "cache hit before it was created");
+		}
+		logo::LogoDataParam hit = makeParam();
+		sw.start();
+		if (!hit.CreateLogoMask(maskratio, cachepath)) {
+			THROW(TestException, "cache was not used");
+		}
+		double loadTime = sw.getAndReset();
+		logo::LogoDataParam other = makeParam();
+		if (other.CreateLogoMask(0.1f, cachepath)) {
+			THROW(TestException, "cache hit with different maskratio");
+		}
+
+		// vZʂ͕񉻂Ă񓯂ɂȂ
+		int YSize = header.w * header.h;
+		for (logo::LogoDataParam* param : { &miss, &hit }) {
+			if (param->getMaskPixels() != created.getMaskPixels() ||
+				memcmp(param->GetMask(), created.GetMask(), YSize) ||
+				memcmp(param->GetKernels(), created.GetKernels(), created.getMaskPixels() * 25 * sizeof(float)))
+			{
+				THROWF(TestException, "logo mask mismatch (%s)", logopath);
+			}
+		}
+		auto frames = MakeLogoEvalFrames(header, 255.0f, NUM_FRAMES, rng);
+		auto memWork = std::unique_ptr<float[]>(new float[YSize + 8]);
+		for (int i = 0; i < NUM_FRAMES; ++i) {
+			for (float fade : { 0.0f, 0.5f, 1.0f }) {
+				float ref = created.EvaluateLogo(frames[i].get(), 255.0f, fade, memWork.get());
+				float v = hit.EvaluateLogo(frames[i].get(), 255.0f, fade, memWork.get());
+				if (ref != v) {
+					THROWF(TestException, "EvaluateLogo mismatch: %f vs %f (%s)", ref, v, logopath);
+				}
+			}
+		}
+
+		printf("%dx%d mask=%d: create %.2fms, cache load %.2fms\n",
+			header.w, header.h, created.getMaskPixels(), createTime * 1000, loadTime * 1000);
+		removeT(cachepath.c_str());
+	}
+
+	return 0;
+}
+
+// ⃍Si荞łSS]ꍇƓSI΂邩
+static int LogoCandidatePruningTest(AMTContext& ctx, const ConfigWrapper& setting)
+{
+	// ₪Ȃƍi荞݂NtopK̂ŁA
+	// w胍SEE㉺ΑɈڂSɑ4ȏɂ
+	std::vector<tstring> logos = setting.getLogoPath();
+	std::vector<tstring> decoys;
+	for (int i = 0; i < (int)setting.getLogoPath().size(); ++i) {
+		logo::LogoHeader header;
+		logo::LogoData logodata = logo::LogoData::Load(setting.getLogoPath()[i], &header);
+		for (int m = 0; m < 2; ++m) {
+			logo::LogoHeader moved = header;
+			if (m == 0) {
+				moved.imgx = header.imgw - header.w - header.imgx;
+			}
+			else {
+				moved.imgy = header.imgh - header.h - header.imgy;
+			}
+			tstring path = StringFormat(_T("%s.decoy%d.lgd"), setting.getTmpLogoFramePath(0), (int)decoys.size());
+			logodata.Save(path, &moved);
+			decoys.push_back(path);
+		}
+	}
+	logos.insert(logos.end(), decoys.begin(), decoys.end());
+	int numLogos = (int)logos.size();
+	if (numLogos <= 3) {
+		THROW(ArgumentException, "S2ȏw肵Ă");
+	}
+
+	int refBest = -1;
+	float refRatio = 0;
+	double refTime = 0;
+	tstring refPath = setting.getTmpLogoFramePath(0) + _T(".ref");
+	for (int topK = 0; topK < numLogos; ++topK) {
+		auto env = make_unique_ptr(CreateScriptEnvironment2());
+		PClip clip = env->Invoke("Import", to_string(setting.getFilterScriptPath()).c_str()).AsClip();
+
+		logo::LogoFrame logof(ctx, logos, 0.35f);
+		logof.setCandidatePruning(numLogos, topK);
+		Stopwatch sw;
+		sw.start();
+		logof.scanFrames(clip, env.get());
+		double elapsed = sw.getAndReset();
+		logof.selectLogo(numLogos);
+
+		tstring outPath = (topK == 0) ? refPath : setting.getTmpLogoFramePath(0);
+		logof.writeResult(outPath);
+		if (topK == 0) {
+			// 0͍i荞݂Ȃ
+			refBest = logof.getBestLogo();
+			refRatio = logof.getLogoRatio();
+			refTime = elapsed;
+			printf("all %d logos: %.2f sec best=%d\n", numLogos, elapsed, refBest);
+			continue;
+		}
+		printf("top %d: %.2f sec best=%d (saved %.2f sec)\n",
+			topK, elapsed, logof.getBestLogo(), refTime - elapsed);
+		if (logof.getBestLogo() != refBest || logof.getLogoRatio() != refRatio) {
+			THROWF(TestException, "Best logo does not match (top %d: %d vs %d)", topK, logof.getBestLogo(), refBest);
+		}
+		if (!FileEquals(outPath, refPath)) {
+			THROWF(TestException, "Result does not match (top %d)", topK);
+		}
+	}
+
+	for (const tstring& path : decoys) {
+		removeT(path.c_str());
+	}
+
+	return 0;
+}
+
+// SlidingWindoẘevlEBhE𑖍lƈv邩
+// iLogoFrame::writeResultƓgŔrj
+static void SlidingWindowTestT(const std::vector<float>& data_, int halfWin, bool verify,
+	double& bruteTime, double& slidingTime)
+{
+	const int numFrames = (int)data_.size() - halfWin * 2;
+	const int winFrames = halfWin * 2 + 1;
+	auto data = data_.begin() + halfWin;
+
+	std::vector<float> refMax(numFrames), refMedian(numFrames);
+	std::vector<float> medianBuf(winFrames);
+	Stopwatch sw;
+	sw.start();
+	for (int i = 0; i < numFrames; ++i) {
+		refMax[i] = *std::max_element(data + i - halfWin, data + i + halfWin + 1);
+		std::copy(data + i - halfWin, data + i + halfWin + 1, medianBuf.begin());
+		std::sort(medianBuf.begin(), medianBuf.end());
+		refMedian[i] = medianBuf[halfWin];
+	}
+	bruteTime += sw.getAndReset();
+
+	std::vector<float> resMax(numFrames), resMedian(numFrames);
+	SlidingWindowMax<float> maxWin;
+	SlidingWindowMedian<float> medianWin;
+	sw.start();
+	for (int j = -halfWin; j <= halfWin; ++j) {
+		maxWin.push(j, data[j]);
+		medianWin.push(data[j]);
+	}
+	for (int i = 0; i < numFrames; ++i) {
+		if (i > 0) {
+			maxWin.push(i + halfWin, data[i + halfWin]);
+			maxWin.popBefore(i - halfWin);
+			medianWin.push(data[i + halfWin]);
+			medianWin.pop(data[i - halfWin - 1]);
+		}
+		resMax[i] = maxWin.get();
+		resMedian[i] = medianWin.get();
+	}
+	slidingTime += sw.getAndReset();
+
+	if (!verify) return;
+	for (int i = 0; i < numFrames; ++i) {
+		if (resMax[i] != refMax[i]) {
+			THROWF(TestException, "Max mismatch at %d (win=%d): %f vs %f", i, winFrames, resMax[i], refMax[i]);
+		}
+		if (resMedian[i] != refMedian[i]) {
+			THROWF(TestException, "Median mismatch at %d (win=%d): %f vs %f", i, winFrames, resMedian[i], refMedian[i]);
+		}
+	}
+}
+
+static std::vector<float> MakeSlidingWindowTestData(int numFrames, int halfWin, bool quantize, std::mt19937& rng)
+{
+	// SXRAۂԂƂɕ\/\؂ւlɃmCY悹
+	std::uniform_real_distribution<float> noise(-0.3f, 0.3f);
+	std::uniform_int_distribution<int> segLen(1, 3000);
+	std::vector<float> data(numFrames + halfWin * 2);
+	float base = 0.5f;
+	int next = 0;
+	for (int i = 0; i < (int)data.size(); ++i) {
+		if (i >= next) {
+			base = -base;
+			next = i + segLen(rng);
+		}
+		float v = base + noise(rng);
+		// lꍇmF
+		data[i] = quantize ? std::round(v * 8) / 8 : v;
+	}
+	return data;
+}
+
+static int SlidingWindowTest(AMTContext& ctx, const ConfigWrapper& setting)
+{
+	std::mt19937 rng(12345);
+	double bruteTime = 0, slidingTime = 0;
+
+	// 
+	const int halfWins[] = { 0, 1, 2, 7, 15, 30, 90 };
+	for (int halfWin : halfWins) {
+		for (int quantize = 0; quantize < 2; ++quantize) {
+			auto data = MakeSlidingWindowTestData(20000, halfWin, quantize != 0, rng);
+			SlidingWindowTestT(data, halfWin, true, bruteTime, slidingTime);
+		}
+	}
+
+	// xi500kt[A30fps/60fpsł̈ړ1bEfBA0.5bj
+	const int NUM_FRAMES = 500000;
+	const int benchWins[] = { 8, 15, 30 };
+	for (int halfWin : benchWins) {
+		auto data = MakeSlidingWindowTestData(NUM_FRAMES, halfWin, false, rng);
+		bruteTime = slidingTime = 0;
+		SlidingWindowTestT(data, halfWin, true, bruteTime, slidingTime);
+		printf("%d frames win=%d: brute %.3fs, sliding %.3fs (x%.1f)\n",
+			NUM_FRAMES, halfWin * 2 + 1, bruteTime, slidingTime, bruteTime / slidingTime);
+	}
+
+	return 0;
+}
+
 class TestSplitDualMono : public DualMonoSplitter
 {
 	std::unique_ptr<File> file0;
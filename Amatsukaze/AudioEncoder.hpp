@@ -4,6 +4,7 @@
 
 #include "ProcessThread.hpp"
 #include "StreamReform.hpp"
+#include "WaveReader.hpp"
 
 namespace wave {
 
@@ -34,7 +35,7 @@ void set4(int8_t dst[4], const char* src) {
 } // namespace wave {
 
 void EncodeAudio(AMTContext& ctx, const tstring& encoder_args,
-	const tstring& audiopath, const AudioFormat& afmt,
+	const tstring& audiopath, bool lazyWave, const AudioFormat& afmt,
 	const std::vector<FilterAudioFrame>& audioFrames)
 {
 	using namespace wave;
@@ -73,7 +74,7 @@ void EncodeAudio(AMTContext& ctx, const tstring& encoder_args,
 		}
 	}
 
-	File srcFile(audiopath, _T("rb"));
+	WaveReader reader(ctx, audiopath, lazyWave);
 	AutoBuffer buffer;
 	int frameWaveLength = audioSamplesPerFrame * bytesPerSample * nchannels;
 	MemoryChunk mc = buffer.space(frameWaveLength);
@@ -82,8 +83,7 @@ void EncodeAudio(AMTContext& ctx, const tstring& encoder_args,
 	for (size_t i = 0; i < audioFrames.size(); ++i) {
 		if (audioFrames[i].waveLength != 0) {
 			// waveȂǂ
-			srcFile.seek(audioFrames[i].waveOffset, SEEK_SET);
-			srcFile.read(mc);
+			reader.read(audioFrames[i], 0, mc);
 		}
 		else {
 			// Ȃꍇ̓[߂
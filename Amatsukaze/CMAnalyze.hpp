@@ -302,6 +302,11 @@ private:
 			std::vector<tstring> allLogoPath = logoPath;
 			allLogoPath.insert(allLogoPath.end(), eraseLogoPath.begin(), eraseLogoPath.end());
 			logo::LogoFrame logof(ctx, allLogoPath, 0.35f);
+			// SƂ͂܂΂ȃt[ŌiĂSt[]
+			// I΂郍Sς\̂Ŏw肳ꂽƂ
+			if (setting_.getLogoPruneTopK() > 0) {
+				logof.setCandidatePruning((int)logoPath.size(), setting_.getLogoPruneTopK());
+			}
 			logof.scanFrames(clip, env.get());
 
 			if (logoPath.size() > 0) {
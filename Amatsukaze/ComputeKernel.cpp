@@ -10,9 +10,10 @@
 #include <intrin.h>
 #include <immintrin.h>
 #include <stdio.h>
+#include <stdint.h>
 
 struct CPUInfo {
-	bool initialized, avx, avx2;
+	bool initialized, avx, avx2, fma3;
 };
 
 static CPUInfo g_cpuinfo;
@@ -22,6 +23,7 @@ static inline void InitCPUInfo() {
 		int cpuinfo[4];
 		__cpuid(cpuinfo, 1);
 		g_cpuinfo.avx = cpuinfo[2] & (1 << 28) || false;
+		g_cpuinfo.fma3 = cpuinfo[2] & (1 << 12) || false;
 		bool osxsaveSupported = cpuinfo[2] & (1 << 27) || false;
 		g_cpuinfo.avx2 = false;
 		if (osxsaveSupported && g_cpuinfo.avx)
@@ -29,6 +31,7 @@ static inline void InitCPUInfo() {
 			// _XCR_XFEATURE_ENABLED_MASK = 0
 			unsigned long long xcrFeatureMask = _xgetbv(0);
 			g_cpuinfo.avx = (xcrFeatureMask & 0x6) == 0x6;
+			g_cpuinfo.fma3 = g_cpuinfo.fma3 && g_cpuinfo.avx;
 			if (g_cpuinfo.avx) {
 				__cpuid(cpuinfo, 7);
 				g_cpuinfo.avx2 = cpuinfo[1] & (1 << 5) || false;
@@ -48,6 +51,11 @@ bool IsAVX2Available() {
 	return g_cpuinfo.avx2;
 }
 
+bool IsFMA3Available() {
+	InitCPUInfo();
+	return g_cpuinfo.fma3;
+}
+
 // https://qiita.com/beru/items/fff00c19968685dada68
 // in  : ( x7, x6, x5, x4, x3, x2, x1, x0 )
 // out : ( -,  -,  -, xsum )
@@ -119,3 +127,166 @@ float CalcCorrelation5x5_AVX(const float* k, const float* Y, int x, int y, int w
 	if (pavg) *pavg = avg;
 	return sum;
 };
+
+// LogoDataParam::CorrelationScoreAVX2+FMA
+// ɘA8f1ubNƂāAubNPʂ8fɕ]
+// offsets[b]: ubNb̐擪fiSj̈ʒu
+// kernels: [ubN][^bv(25)][8], ksums: [ubN][8]iJ[l̍vj
+// scales,scales2: [ubN][(256 >> cshift)][8]
+// }XNÕ[̓J[lƃXP[[Ȃ̂ŕ]l̓[ɂȂ
+float CorrelationScorePacked_AVX2(const float* Y, int w, int numBlocks, const int* offsets,
+	const float* kernels, const float* ksums, const float* scales, const float* scales2, int cshift)
+{
+	enum { PACK = 8, KSIZE = 5, KLEN = KSIZE * KSIZE };
+	const int clen = 256 >> cshift;
+
+	const __m256i laneIdx = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	const __m256i vmaxc = _mm256_set1_epi32(255);
+	const __m256 vone = _mm256_set1_ps(1.0f);
+	const __m256 vminusone = _mm256_set1_ps(-1.0f);
+	const __m256 vklen = _mm256_set1_ps((float)KLEN);
+	const __m128i vshift = _mm_cvtsi32_si128(cshift);
+
+	auto vresult = _mm256_setzero_ps();
+	for (int b = 0; b < numBlocks; ++b) {
+		const float* base = Y + offsets[b];
+		const float* k = kernels + b * KLEN * PACK;
+
+		// 5x5̘ai񂲂Ƃɏc̘aĂ牡ɑjƃJ[lƂ̐Ϙa
+		auto vdot = _mm256_setzero_ps();
+		auto vbox = _mm256_setzero_ps();
+		for (int kx = -2; kx <= 2; ++kx) {
+			auto vcol = _mm256_setzero_ps();
+			for (int ky = -2; ky <= 2; ++ky) {
+				const auto v = _mm256_loadu_ps(base + kx + ky * w);
+				vcol = _mm256_add_ps(vcol, v);
+				vdot = _mm256_fmadd_ps(_mm256_loadu_ps(k + ((kx + 2) + (ky + 2) * KSIZE) * PACK), v, vdot);
+			}
+			vbox = _mm256_add_ps(vbox, vcol);
+		}
+		const auto vavg = _mm256_div_ps(vbox, vklen);
+		// sum(k * (Y - avg)) = sum(k * Y) - avg * sum(k)
+		const auto vsum = _mm256_fnmadd_ps(vavg, _mm256_loadu_ps(ksums + b * PACK), vdot);
+
+		// avgPF̏ꍇ̃XP[擾
+		auto vc = _mm256_cvttps_epi32(vavg);
+		vc = _mm256_max_epi32(_mm256_min_epi32(vc, vmaxc), _mm256_setzero_si256());
+		const auto vidx = _mm256_add_epi32(_mm256_slli_epi32(_mm256_srl_epi32(vc, vshift), 3), laneIdx);
+		const auto vscale = _mm256_i32gather_ps(scales + b * clen * PACK, vidx, 4);
+		const auto vscale2 = _mm256_i32gather_ps(scales2 + b * clen * PACK, vidx, 4);
+
+		// 1𒴂镔͎̂ĂāAւlȉ̏ꍇ͈ꕔɖ߂
+		const auto vnorm = _mm256_min_ps(vone, _mm256_max_ps(vminusone, _mm256_mul_ps(vsum, vscale)));
+		vresult = _mm256_fmadd_ps(vnorm, vscale2, vresult);
+	}
+
+	float result;
+	_mm_store_ss(&result, hsum256_ps(vresult));
+	_mm256_zeroupper();
+	return result;
+}
+
+// ptr[pos + 188 * i] (0 <= i < numPacket) S0x47ɂȂŏposԂ
+// numPacket̃pPbgSĂʒuBȂ-1
+int64_t FindTsSync_AVX2(const uint8_t* ptr, int64_t len, int numPacket)
+{
+	enum { TS_PACKET_LENGTH = 188, TS_SYNC_BYTE = 0x47 };
+	// posend
+	const int64_t end = len - (int64_t)TS_PACKET_LENGTH * numPacket + 1;
+	const __m256i sync = _mm256_set1_epi8(TS_SYNC_BYTE);
+	int64_t pos = 0;
+	for (; pos + 32 <= end; pos += 32) {
+		__m256i m = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(ptr + pos)), sync);
+		for (int i = 1; i < numPacket && _mm256_movemask_epi8(m); ++i) {
+			m = _mm256_and_si256(m, _mm256_cmpeq_epi8(
+				_mm256_loadu_si256((const __m256i*)(ptr + pos + TS_PACKET_LENGTH * i)), sync));
+		}
+		unsigned int bits = (unsigned int)_mm256_movemask_epi8(m);
+		if (bits) {
+			unsigned long idx;
+			_BitScanForward(&idx, bits);
+			_mm256_zeroupper();
+			return pos + idx;
+		}
+	}
+	_mm256_zeroupper();
+	for (; pos < end; ++pos) {
+		int i = 0;
+		for (; i < numPacket; ++i) {
+			if (ptr[pos + TS_PACKET_LENGTH * i] != TS_SYNC_BYTE) break;
+		}
+		if (i == numPacket) return pos;
+	}
+	return -1;
+}
+
+// AMTEraseLogo::Delogo8f
+// dst = clamp(fade * (A * src + B * maxv) + (1 - fade) * src + 0.5, 0, maxv)
+// XJ[łƓŏZƉZŝŌʂ͊SɈviFMA͎gȂj
+// tB[h̓sb`2{ɂČĂяo
+static inline __m256 LoadPixels8(const uint8_t* src) {
+	return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)src)));
+}
+
+static inline __m256 LoadPixels8(const uint16_t* src) {
+	return _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)src)));
+}
+
+static inline void StorePixels8(uint8_t* dst, __m256i v) {
+	const __m128i v16 = _mm_packus_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+	_mm_storel_epi64((__m128i*)dst, _mm_packus_epi16(v16, v16));
+}
+
+static inline void StorePixels8(uint16_t* dst, __m256i v) {
+	_mm_storeu_si128((__m128i*)dst,
+		_mm_packus_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)));
+}
+
+template <typename pixel_t>
+static void Delogo_AVX2(pixel_t* dst, int w, int h, int logopitch, int imgpitch,
+	float maxv, const float* A, const float* B, float fade)
+{
+	const float invfade = 1 - fade;
+	const __m256 vmaxv = _mm256_set1_ps(maxv);
+	const __m256 vfade = _mm256_set1_ps(fade);
+	const __m256 vinvfade = _mm256_set1_ps(invfade);
+	const __m256 vhalf = _mm256_set1_ps(0.5f);
+	const __m256 vzero = _mm256_setzero_ps();
+	for (int y = 0; y < h; ++y) {
+		pixel_t* d = dst + y * imgpitch;
+		const float* a = A + y * logopitch;
+		const float* b = B + y * logopitch;
+		int x = 0;
+		for (; x + 8 <= w; x += 8) {
+			const __m256 srcv = LoadPixels8(d + x);
+			const __m256 bg = _mm256_add_ps(
+				_mm256_mul_ps(_mm256_loadu_ps(a + x), srcv),
+				_mm256_mul_ps(_mm256_loadu_ps(b + x), vmaxv));
+			const __m256 tmp = _mm256_add_ps(_mm256_mul_ps(vfade, bg), _mm256_mul_ps(vinvfade, srcv));
+			const __m256 v = _mm256_min_ps(_mm256_max_ps(_mm256_add_ps(tmp, vhalf), vzero), vmaxv);
+			StorePixels8(d + x, _mm256_cvttps_epi32(v));
+		}
+		for (; x < w; ++x) {
+			float srcv = d[x];
+			float bg = a[x] * srcv + b[x] * maxv;
+			float tmp = fade * bg + invfade * srcv;
+			float v = tmp + 0.5f;
+			v = (v < 0.0f) ? 0.0f : v;
+			v = (maxv < v) ? maxv : v;
+			d[x] = (pixel_t)v;
+		}
+	}
+	_mm256_zeroupper();
+}
+
+void DelogoU8_AVX2(uint8_t* dst, int w, int h, int logopitch, int imgpitch,
+	float maxv, const float* A, const float* B, float fade)
+{
+	Delogo_AVX2(dst, w, h, logopitch, imgpitch, maxv, A, B, fade);
+}
+
+void DelogoU16_AVX2(uint16_t* dst, int w, int h, int logopitch, int imgpitch,
+	float maxv, const float* A, const float* B, float fade)
+{
+	Delogo_AVX2(dst, w, h, logopitch, imgpitch, maxv, A, B, fade);
+}
@@ -403,6 +403,136 @@ private:
 	FILE* fp_;
 };
 
+/** @brief ǂݍݐpŃ}bvĐ擪珇ɓǂރt@C
+* read()̓}bvꂽ𒼐ڎwMemoryChunkԂ̂ŃRs[Ȃ
+* Ԃf[^͎read()seek()ĂԂ܂ŗL
+* t@CŜ}bv32bitőȂ̂windowSize}bv
+*/
+class MappedFile : NonCopyable
+{
+public:
+	MappedFile(const tstring& path, size_t windowSize = 64 * 1024 * 1024)
+		: path_(path)
+		, hFile_(INVALID_HANDLE_VALUE)
+		, hMap_(NULL)
+		, view_(NULL)
+		, viewOffset_(0)
+		, viewSize_(0)
+		, pos_(0)
+	{
+		// ǂ݂悤ɃV[PVANZXw
+		hFile_ = CreateFileW(path.c_str(), GENERIC_READ,
+			FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+			OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (hFile_ == INVALID_HANDLE_VALUE) {
+			THROWF(IOException, "t@CJ܂: %s", GetFullPath(path));
+		}
+		LARGE_INTEGER sz;
+		if (GetFileSizeEx(hFile_, &sz) == FALSE) {
+			CloseHandle(hFile_);
+			THROWF(IOException, "GetFileSizeEx failed: %s", GetFullPath(path));
+		}
+		size_ = sz.QuadPart;
+		// ̃t@C̓}bvłȂ̂ŉȂ
+		if (size_ > 0) {
+			hMap_ = CreateFileMappingW(hFile_, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (hMap_ == NULL) {
+				CloseHandle(hFile_);
+				THROWF(IOException, "CreateFileMapping failed: %s", GetFullPath(path));
+			}
+		}
+		// r[̈ʒu̓AP[Vxɍ킹Kv
+		SYSTEM_INFO sysinfo;
+		GetSystemInfo(&sysinfo);
+		granularity_ = sysinfo.dwAllocationGranularity;
+		windowSize_ = std::max<size_t>(windowSize / granularity_, 1) * granularity_;
+	}
+	~MappedFile() {
+		unmap();
+		if (hMap_ != NULL) {
+			CloseHandle(hMap_);
+		}
+		CloseHandle(hFile_);
+	}
+	/** @brief ݈ʒuőmaxBytesԂBt@CI[ł͒0 */
+	MemoryChunk read(size_t maxBytes) {
+		if (pos_ >= size_) {
+			return MemoryChunk();
+		}
+		if (pos_ < viewOffset_ || pos_ >= viewOffset_ + (int64_t)viewSize_) {
+			map(pos_);
+		}
+		size_t offset = (size_t)(pos_ - viewOffset_);
+		size_t length = std::min(maxBytes, viewSize_ - offset);
+		pos_ += length;
+		return MemoryChunk(view_ + offset, length);
+	}
+	void seek(int64_t offset, int origin) {
+		switch (origin) {
+		case SEEK_SET: break;
+		case SEEK_CUR: offset += pos_; break;
+		case SEEK_END: offset += size_; break;
+		default:
+			THROWF(IOException, "failed to seek file: %s", GetFullPath(path_));
+		}
+		if (offset < 0) {
+			THROWF(IOException, "failed to seek file: %s", GetFullPath(path_));
+		}
+		pos_ = offset;
+	}
+	/** @brief offsetlengthoCgw|C^ԂBget()read()ĂԂ܂ŗL */
+	const uint8_t* get(int64_t offset, size_t length) {
+		if (offset < 0 || offset + (int64_t)length > size_) {
+			THROWF(IOException, "out of range access to mapped file: %s", GetFullPath(path_));
+		}
+		if (offset < viewOffset_ || offset + (int64_t)length > viewOffset_ + (int64_t)viewSize_) {
+			map(offset, length);
+		}
+		return view_ + (size_t)(offset - viewOffset_);
+	}
+	int64_t pos() const {
+		return pos_;
+	}
+	int64_t size() const {
+		return size_;
+	}
+private:
+	const tstring path_; // G[bZ[W\p
+	HANDLE hFile_;
+	HANDLE hMap_;
+	uint8_t* view_;
+	int64_t viewOffset_;
+	size_t viewSize_;
+	int64_t size_;
+	int64_t pos_;
+	size_t granularity_;
+	size_t windowSize_;
+
+	// posminLengthoCgȏオ悤Ƀ}bv
+	void map(int64_t pos, size_t minLength = 0) {
+		unmap();
+		int64_t offset = pos / granularity_ * granularity_;
+		int64_t window = std::max<int64_t>(windowSize_, pos - offset + minLength);
+		size_t size = (size_t)std::min<int64_t>(window, size_ - offset);
+		view_ = (uint8_t*)MapViewOfFile(hMap_, FILE_MAP_READ,
+			(DWORD)(offset >> 32), (DWORD)offset, size);
+		if (view_ == NULL) {
+			THROWF(IOException, "MapViewOfFile failed: %s", GetFullPath(path_));
+		}
+		viewOffset_ = offset;
+		viewSize_ = size;
+	}
+
+	void unmap() {
+		if (view_ != NULL) {
+			UnmapViewOfFile(view_);
+			view_ = NULL;
+			viewOffset_ = 0;
+			viewSize_ = 0;
+		}
+	}
+};
+
 template <typename T>
 void WriteArray(const File& file, const std::vector<T>& arr) {
 	file.writeValue((int)arr.size());
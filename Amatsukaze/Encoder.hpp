@@ -10,6 +10,7 @@
 #include "ReaderWriterFFmpeg.hpp"
 #include "TranscodeSetting.hpp"
 #include "FilteredSource.hpp"
+#include "SharedFrameRing.hpp"
 
 class Y4MWriter {
 	static const char* getPixelFormat(VideoInfo vi) {
@@ -57,38 +58,48 @@ public:
 			getPixelFormat(vi), outfmt.progressive ? "p" : "t",
 			vi.fps_numerator, vi.fps_denominator,
 			outfmt.sarWidth, outfmt.sarHeight);
-		header = sb.str();
-		header.push_back(0x0a);
 		frameHeader = "FRAME";
 		frameHeader.push_back(0x0a);
+		// ŏ̃t[̓Xg[wb_FRAMEwb_1̗̈ŏo
+		firstFrameHeader = sb.str();
+		firstFrameHeader.push_back(0x0a);
+		firstFrameHeader += frameHeader;
 		nc = vi.IsY() ? 1 : 3;
+		// wb_ + Ssoȍꍇ̍ő吔
+		chunks.reserve(1 + vi.height * nc);
 	}
+	// t[f[^̓Rs[PVideoFramẽ𒼐ړn
+	// pitch == rowsizẽv[1̗̈AłȂ΍sƂ̗̈ɂȂ
 	void inputFrame(const PVideoFrame& frame) {
-		if (n++ == 0) {
-			buffer.add(MemoryChunk((uint8_t*)header.data(), header.size()));
-		}
-		buffer.add(MemoryChunk((uint8_t*)frameHeader.data(), frameHeader.size()));
+		chunks.clear();
+		const std::string& fh = (n++ == 0) ? firstFrameHeader : frameHeader;
+		chunks.push_back(MemoryChunk((uint8_t*)fh.data(), fh.size()));
 		int yuv[] = { PLANAR_Y, PLANAR_U, PLANAR_V };
 		for (int c = 0; c < nc; ++c) {
 			const uint8_t* plane = frame->GetReadPtr(yuv[c]);
 			int pitch = frame->GetPitch(yuv[c]);
 			int height = frame->GetHeight(yuv[c]);
 			int rowsize = frame->GetRowSize(yuv[c]);
-			for (int y = 0; y < height; ++y) {
-				buffer.add(MemoryChunk((uint8_t*)plane + y * pitch, rowsize));
+			if (pitch == rowsize) {
+				chunks.push_back(MemoryChunk((uint8_t*)plane, (size_t)rowsize * height));
+			}
+			else {
+				for (int y = 0; y < height; ++y) {
+					chunks.push_back(MemoryChunk((uint8_t*)plane + y * pitch, rowsize));
+				}
 			}
-			onWrite(buffer.get());
-			buffer.clear();
 		}
+		onWrite(chunks.data(), (int)chunks.size());
 	}
 protected:
-	virtual void onWrite(MemoryChunk mc) = 0;
+	// 1t[̗̈惊XgB߂t[͎̃QƂȂ
+	virtual void onWrite(const MemoryChunk* chunks, int numChunks) = 0;
 private:
 	int n;
 	int nc;
-	std::string header;
+	std::string firstFrameHeader;
 	std::string frameHeader;
-	AutoBuffer buffer;
+	std::vector<MemoryChunk> chunks;
 };
 
 class Y4MEncodeWriter : AMTObject, NonCopyable
@@ -100,11 +111,19 @@ class Y4MEncodeWriter : AMTObject, NonCopyable
 		return "Unknown";
 	}
 public:
-	Y4MEncodeWriter(AMTContext& ctx, const tstring& encoder_args, VideoInfo vi, VideoFormat fmt)
+	// sharedMemNamew肷ƁAt[stdinł͂Ȃ̖ŐLOɏ
+	// iGR[_SharedFrameRingReaderœǂޕKvj
+	Y4MEncodeWriter(AMTContext& ctx, const tstring& encoder_args, VideoInfo vi, VideoFormat fmt,
+		const tstring& sharedMemName = _T(""))
 		: AMTObject(ctx)
 		, y4mWriter_(new MyVideoWriter(this, vi, fmt))
+		, frameRing_(sharedMemName.size() > 0
+			? new SharedFrameRingWriter(sharedMemName, getMaxFrameSize(vi), NUM_RING_SLOTS) : nullptr)
 		, process_(new StdRedirectedSubProcess(encoder_args, 5))
 	{
+		if (frameRing_ != nullptr) {
+			frameRing_->setPeerProcess(process_->getProcessHandle());
+		}
 		ctx.infoF("y4m format: YUV%sp%d %s %dx%d SAR %d:%d %d/%dfps",
 			getYUV(vi), vi.BitsPerComponent(), fmt.progressive ? "progressive" : "tff",
 			fmt.width, fmt.height, fmt.sarWidth, fmt.sarHeight, vi.fps_numerator, vi.fps_denominator);
@@ -122,6 +141,9 @@ public:
 
 	void finish() {
 		if (y4mWriter_ != NULL) {
+			if (frameRing_ != nullptr) {
+				frameRing_->finish();
+			}
 			process_->finishWrite();
 			int ret = process_->join();
 			if (ret != 0) {
@@ -148,18 +170,37 @@ private:
 			, this_(this_)
 		{ }
 	protected:
-		virtual void onWrite(MemoryChunk mc) {
-			this_->onVideoWrite(mc);
+		virtual void onWrite(const MemoryChunk* chunks, int numChunks) {
+			this_->onVideoWrite(chunks, numChunks);
 		}
 	private:
 		Y4MEncodeWriter* this_;
 	};
 
+	enum { NUM_RING_SLOTS = 4 };
+
 	std::unique_ptr<MyVideoWriter> y4mWriter_;
+	std::unique_ptr<SharedFrameRingWriter> frameRing_;
 	std::unique_ptr<StdRedirectedSubProcess> process_;
 
-	void onVideoWrite(MemoryChunk mc) {
-		process_->write(mc);
+	// Y4M1t[iwb_݁j̍őTCY
+	static size_t getMaxFrameSize(VideoInfo vi) {
+		size_t frameSize = 0;
+		int yuv[] = { PLANAR_Y, PLANAR_U, PLANAR_V };
+		for (int c = 0; c < (vi.IsY() ? 1 : 3); ++c) {
+			frameSize += (size_t)vi.RowSize(yuv[c]) * (vi.height >> vi.GetPlaneHeightSubsampling(yuv[c]));
+		}
+		// Xg[wb_FRAMEwb_
+		return frameSize + 1024;
+	}
+
+	void onVideoWrite(const MemoryChunk* chunks, int numChunks) {
+		if (frameRing_ != nullptr) {
+			frameRing_->write(chunks, numChunks);
+		}
+		else {
+			process_->write(chunks, numChunks);
+		}
 	}
 };
 
@@ -242,10 +283,10 @@ public:
 
 private:
 
-	class SpDataPumpThread : public DataPumpThread<std::unique_ptr<PVideoFrame>, true> {
+	class SpDataPumpThread : public SpscDataPumpThread<std::unique_ptr<PVideoFrame>, true> {
 	public:
 		SpDataPumpThread(AMTFilterVideoEncoder* this_, int bufferingFrames)
-			: DataPumpThread(bufferingFrames)
+			: SpscDataPumpThread(bufferingFrames)
 			, this_(this_)
 		{ }
 	protected:
@@ -325,10 +366,10 @@ private:
 		AMTSimpleVideoEncoder * this_;
 	};
 
-	class SpDataPumpThread : public DataPumpThread<std::unique_ptr<av::Frame>> {
+	class SpDataPumpThread : public SpscDataPumpThread<std::unique_ptr<av::Frame>> {
 	public:
 		SpDataPumpThread(AMTSimpleVideoEncoder* this_, int bufferingFrames)
-			: DataPumpThread(bufferingFrames)
+			: SpscDataPumpThread(bufferingFrames)
 			, this_(this_)
 		{ }
 	protected:
@@ -12,6 +12,9 @@
 #pragma once
 
 #include "TranscodeSetting.hpp"
+#include "ProcessThread.hpp"
+#include "ScratchArena.hpp"
+#include "SlidingWindow.hpp"
 #include "logo.h"
 #include "AMTLogo.hpp"
 #include "TsInfo.hpp"
@@ -40,9 +43,75 @@ float CalcCorrelation5x5(const float* k, const float* Y, int x, int y, int w, fl
 	return sum;
 }
 
+// LogoDataParam::CorrelationScoreのブロック版
+// 横に連続する8画素を1ブロックとして評価する（レイアウトはCreatePackedMask参照）
+float CorrelationScorePacked(const float* Y, int w, int numBlocks, const int* offsets,
+	const float* kernels, const float* ksums, const float* scales, const float* scales2, int cshift)
+{
+	enum { PACK = 8, KSIZE = 5, KLEN = KSIZE * KSIZE };
+	const int clen = 256 >> cshift;
+	float result = 0;
+	for (int b = 0; b < numBlocks; ++b) {
+		for (int lane = 0; lane < PACK; ++lane) {
+			const float* base = Y + offsets[b] + lane;
+			const float* k = kernels + b * KLEN * PACK + lane;
+			float dot = 0.0f;
+			float box = 0.0f;
+			for (int kx = -2; kx <= 2; ++kx) {
+				float col = 0.0f;
+				for (int ky = -2; ky <= 2; ++ky) {
+					float v = base[kx + ky * w];
+					col += v;
+					dot += k[((kx + 2) + (ky + 2) * KSIZE) * PACK] * v;
+				}
+				box += col;
+			}
+			float avg = box / KLEN;
+			float sum = dot - avg * ksums[b * PACK + lane];
+			int sidx = (b * clen + (std::max(0, std::min(255, (int)avg)) >> cshift)) * PACK + lane;
+			float normalized = std::max(-1.0f, std::min(1.0f, sum * scales[sidx]));
+			result += normalized * scales2[sidx];
+		}
+	}
+	return result;
+}
+
+// CorrelationScorePackedの1ブロック分の各レーンの相関（正規化前）と5x5平均
+void CorrelationLanesPacked(const float* Y, int w, int offset,
+	const float* kernels, const float* ksums, float* sums, float* avgs)
+{
+	enum { PACK = 8, KSIZE = 5, KLEN = KSIZE * KSIZE };
+	for (int lane = 0; lane < PACK; ++lane) {
+		const float* base = Y + offset + lane;
+		const float* k = kernels + lane;
+		float dot = 0.0f;
+		float box = 0.0f;
+		for (int kx = -2; kx <= 2; ++kx) {
+			float col = 0.0f;
+			for (int ky = -2; ky <= 2; ++ky) {
+				float v = base[kx + ky * w];
+				col += v;
+				dot += k[((kx + 2) + (ky + 2) * KSIZE) * PACK] * v;
+			}
+			box += col;
+		}
+		float avg = box / KLEN;
+		sums[lane] = dot - avg * ksums[lane];
+		avgs[lane] = avg;
+	}
+}
+
 // ComputeKernel.cpp
 bool IsAVXAvailable();
+bool IsAVX2Available();
+bool IsFMA3Available();
 float CalcCorrelation5x5_AVX(const float* k, const float* Y, int x, int y, int w, float* pavg);
+float CorrelationScorePacked_AVX2(const float* Y, int w, int numBlocks, const int* offsets,
+	const float* kernels, const float* ksums, const float* scales, const float* scales2, int cshift);
+void DelogoU8_AVX2(uint8_t* dst, int w, int h, int logopitch, int imgpitch,
+	float maxv, const float* A, const float* B, float fade);
+void DelogoU16_AVX2(uint16_t* dst, int w, int h, int logopitch, int imgpitch,
+	float maxv, const float* A, const float* B, float fade);
 
 #if 0
 float CalcCorrelation5x5_Debug(const float* k, const float* Y, int x, int y, int w, float* pavg)
@@ -64,7 +133,8 @@ class LogoDataParam : public LogoData
 		KSIZE = 5,
 		KLEN = KSIZE * KSIZE,
 		CSHIFT = 3,
-		CLEN = 256 >> CSHIFT
+		CLEN = 256 >> CSHIFT,
+		PACK = 8 // CorrelationScorePackedのブロック幅
 	};
 	int imgw, imgh, imgx, imgy; // この4つはすべて2の倍数
 	std::unique_ptr<uint8_t[]> mask;
@@ -77,8 +147,42 @@ class LogoDataParam : public LogoData
 	float thresh;
 	int maskpixels;
 	float blackScore;
+	float blackScoreRef;
+
+	// 評価用にmaskをPACK画素単位のブロックにまとめたもの（SoA）
+	int numBlocks;
+	std::unique_ptr<int[]> packOffsets;     // [ブロック] 先頭画素の位置
+	std::unique_ptr<float[]> packKernels;   // [ブロック][KLEN][PACK]
+	std::unique_ptr<float[]> packKsums;     // [ブロック][PACK]
+	std::unique_ptr<float[]> packScales;    // [ブロック][CLEN][PACK]
+	std::unique_ptr<float[]> packScales2;   // [ブロック][CLEN][PACK]
 
 	float(*pCalcCorrelation5x5)(const float* k, const float* Y, int x, int y, int w, float* pavg);
+	float(*pCorrelationScorePacked)(const float* Y, int w, int numBlocks, const int* offsets,
+		const float* kernels, const float* ksums, const float* scales, const float* scales2, int cshift);
+
+	// CreateLogoMaskの結果のキャッシュファイル
+	// ヘッダの後に mask[w*h], kernels[maskpixels*KLEN], scales[maskpixels*CLEN] が続く
+	enum {
+		MASK_CACHE_MAGIC = 0x484B4C41, // 'ALKH'
+		MASK_CACHE_VERSION = 2, // CreateLogoMaskの計算を変えたら上げること
+	};
+	// 使った相関計算の種類（MaskCacheHeader::kernel）
+	enum {
+		KERNEL_CORR5X5_AVX = 1, // CalcCorrelation5x5_AVX
+		KERNEL_PACKED_AVX2 = 2, // CorrelationScorePacked_AVX2（AVX2+FMA3）
+	};
+	struct MaskCacheHeader {
+		int magic;
+		int version;
+		uint32_t hash; // ロゴ(Y)のCRC
+		float maskratio;
+		int kernel; // 相関計算に使った関数（KERNEL_*の組み合わせ。結果がわずかに異なるので区別する）
+		int w, h;
+		int maskpixels;
+		float blackScore;
+		float blackScoreRef;
+	};
 public:
 	LogoDataParam() { }
 
@@ -120,17 +224,21 @@ public:
 		// 相関下限パラメータ
 		const float corrLowerLimit = 0.2f;
 
-		pCalcCorrelation5x5 = IsAVXAvailable() ? CalcCorrelation5x5_AVX : CalcCorrelation5x5;
+		SelectKernels();
 
 		int YSize = w * h;
 		auto memWork = std::unique_ptr<float[]>(new float[YSize * CLEN + 8]);
 
+		// 各背景・各行は独立に計算できるので並列に計算する
+		// 順序で結果が変わる部分（ソートと合計）は逐次処理と同じ結果になるようにしている
+		ParallelTaskPool pool;
+
 		// 各単色背景にロゴを乗せる
-		for (int c = 0; c < CLEN; ++c) {
+		pool.run(CLEN, [&](int c, int worker) {
 			float *slice = &memWork[c * YSize];
 			std::fill_n(slice, YSize, (float)(c << CSHIFT));
 			AddLogo(slice, 255);
-		}
+		});
 
 		auto makeKernel = [](float* k, float* Y, int x, int y, int w) {
 			// コピー
@@ -150,8 +258,13 @@ public:
 			 // 単色背景にロゴを乗せた画像の各ピクセルを中心とする5x5ウィンドウの
 			 // 画素値の分散の大きい順にmaskratio割合のピクセルを着目点とする
 		std::vector<std::pair<float, int>> variance(YSize);
+		// ピクセルインデックスを生成
+		for (int i = 0; i < YSize; ++i) {
+			variance[i].second = i;
+		}
 		// 各ピクセルの分散を計算（計算されていないところはゼロ初期化されてる）
-		for (int y = 2; y < h - 2; ++y) {
+		pool.run(std::max(0, h - 4), [&](int task, int worker) {
+			int y = task + 2;
 			for (int x = 2; x < w - 2; ++x) {
 				// 真ん中の色を取る
 				float *slice = &memWork[(CLEN >> 1) * YSize];
@@ -160,16 +273,14 @@ public:
 				variance[x + y * w].first = std::accumulate(k, k + KLEN, 0.0f,
 					[](float sum, float val) { return sum + val * val; });
 			}
-		}
-		// ピクセルインデックスを生成
-		for (int i = 0; i < YSize; ++i) {
-			variance[i].second = i;
-		}
-		// 降順ソート
-		std::sort(variance.begin(), variance.end(), std::greater<std::pair<float, int>>());
+		});
+		// 降順で上位maskpixels個を取る
+		// (分散,インデックス)の組は重複しないのでソートした場合と同じ集合になる
+		maskpixels = std::min(YSize, (int)(YSize * maskratio));
+		std::nth_element(variance.begin(), variance.begin() + maskpixels, variance.end(),
+			std::greater<std::pair<float, int>>());
 		// 計算結果からmask生成
 		mask = std::unique_ptr<uint8_t[]>(new uint8_t[YSize]());
-		maskpixels = std::min(YSize, (int)(YSize * maskratio));
 		for (int i = 0; i < maskpixels; ++i) {
 			mask[variance[i].second] = 1;
 		}
@@ -183,9 +294,20 @@ public:
 		kernels = std::unique_ptr<float[]>(new float[maskpixels * KLEN + 8]);
 		// 各ピクセルx各単色背景での相関値スケール
 		scales = std::unique_ptr<ScaleLimit[]>(new ScaleLimit[maskpixels * CLEN]);
-		int count = 0;
-		float avgCorr = 0.0f;
-		for (int y = 2; y < h - 2; ++y) {
+		// 各行の先頭のインデックス
+		std::vector<int> rowStart(h + 1);
+		for (int y = 0; y < h; ++y) {
+			int count = rowStart[y];
+			if (y >= 2 && y < h - 2) {
+				for (int x = 2; x < w - 2; ++x) {
+					count += mask[x + y * w];
+				}
+			}
+			rowStart[y + 1] = count;
+		}
+		pool.run(std::max(0, h - 4), [&](int task, int worker) {
+			int y = task + 2;
+			int count = rowStart[y];
 			for (int x = 2; x < w - 2; ++x) {
 				if (mask[x + y * w]) {
 					float* k = &kernels[count * KLEN];
@@ -193,11 +315,16 @@ public:
 					makeKernel(k, memWork.get(), x, y, w);
 					for (int i = 0; i < CLEN; ++i) {
 						float *slice = &memWork[i * YSize];
-						avgCorr += s[i].scale = std::abs(pCalcCorrelation5x5(k, slice, x, y, w, nullptr));
+						s[i].scale = std::abs(pCalcCorrelation5x5(k, slice, x, y, w, nullptr));
 					}
 					++count;
 				}
 			}
+		});
+		// 合計は逐次処理と同じ順序で足す
+		float avgCorr = 0.0f;
+		for (int i = 0; i < maskpixels * CLEN; ++i) {
+			avgCorr += scales[i].scale;
 		}
 		avgCorr /= maskpixels * CLEN;
 		// 相関下限（これより小さい相関のピクセルはスケールしない）
@@ -223,35 +350,104 @@ public:
 		}
 #endif
 
+		CreatePackedMask();
+
 		// 黒背景の評価値（これがはっきり出たときの基準）
 		float *slice = &memWork[(16 >> CSHIFT) * YSize];
 		blackScore = CorrelationScore(slice, 255);
+		blackScoreRef = CorrelationScoreRef(slice, 255);
+	}
+
+	// CreateLogoMaskと同じだが、結果をcachepathにキャッシュする
+	// キャッシュはロゴのCRCとmaskratioで照合して、合わなければ作り直して上書きする
+	// キャッシュの書き込みに失敗しても何もしない
+	// 戻り値: キャッシュから読み込めたらtrue
+	bool CreateLogoMask(float maskratio, const tstring& cachepath)
+	{
+		uint32_t hash = GetLogoHash();
+		if (LoadMaskCache(cachepath, hash, maskratio)) {
+			return true;
+		}
+		CreateLogoMask(maskratio);
+		SaveMaskCache(cachepath, hash, maskratio);
+		return false;
 	}
 
 	float EvaluateLogo(const float *src, float maxv, float fade, float* work, int stride = -1)
 	{
-		// ロゴを評価 //
-		const float *logoAY = GetA(PLANAR_Y);
-		const float *logoBY = GetB(PLANAR_Y);
+		EraseLogoForEval(src, maxv, fade, work, stride);
+		// 正規化
+		return CorrelationScore(work, maxv) / blackScore;
+	}
 
-		if (stride == -1) {
-			stride = w;
+	// fades[0～numFades-1]の各fade値でEvaluateLogoした値をresultsに入れる
+	// ロゴ除去後の画素値も各画素の相関（正規化前）も5x5平均もfadeの1次式なので、
+	// fade=0とfade=1の相関と平均を1回だけ計算して、各fadeではクランプとScaleLimitの適用だけ行う
+	// EvaluateLogoとは加算順序とスケール選択境界の丸めだけが異なる
+	// workは2*w*h+8要素必要
+	void EvaluateLogoMultiFade(const float *src, float maxv,
+		const float* fades, int numFades, float* results, float* work, int stride = -1)
+	{
+		if (packOffsets == nullptr) {
+			// ブロックがないので1つずつ評価
+			for (int f = 0; f < numFades; ++f) {
+				results[f] = EvaluateLogo(src, maxv, fades[f], work, stride);
+			}
+			return;
+		}
+
+		float* work0 = work; // fade=0（元画像）
+		float* work1 = work + w * h; // fade=1（ロゴ完全除去）
+		EraseLogoForEval(src, maxv, 0.0f, work0, stride);
+		EraseLogoForEval(src, maxv, 1.0f, work1, stride);
+
+		std::fill_n(results, numFades, 0.0f);
+		for (int b = 0; b < numBlocks; ++b) {
+			const float* kernels = &packKernels[b * KLEN * PACK];
+			const float* ksums = &packKsums[b * PACK];
+			const float* scales = &packScales[b * CLEN * PACK];
+			const float* scales2 = &packScales2[b * CLEN * PACK];
+			float sum0[PACK], avg0[PACK], sum1[PACK], avg1[PACK];
+			CorrelationLanesPacked(work0, w, packOffsets[b], kernels, ksums, sum0, avg0);
+			CorrelationLanesPacked(work1, w, packOffsets[b], kernels, ksums, sum1, avg1);
+			for (int lane = 0; lane < PACK; ++lane) {
+				sum1[lane] -= sum0[lane];
+				avg1[lane] -= avg0[lane];
+			}
+			for (int f = 0; f < numFades; ++f) {
+				float fade = fades[f];
+				float result = 0;
+				for (int lane = 0; lane < PACK; ++lane) {
+					float avg = avg0[lane] + fade * avg1[lane];
+					float sum = sum0[lane] + fade * sum1[lane];
+					int sidx = (std::max(0, std::min(255, (int)avg)) >> CSHIFT) * PACK + lane;
+					float normalized = std::max(-1.0f, std::min(1.0f, sum * scales[sidx]));
+					result += normalized * scales2[sidx];
+				}
+				results[f] += result;
+			}
+		}
+		for (int f = 0; f < numFades; ++f) {
+			results[f] /= blackScore;
 		}
+	}
 
-		// ロゴを除去
-		for (int y = 0; y < h; ++y) {
-			for (int x = 0; x < w; ++x) {
-				float srcv = src[x + y * stride];
-				float a = logoAY[x + y * w];
-				float b = logoBY[x + y * w];
-				float bg = a * srcv + b * maxv;
-				float dstv = fade * bg + (1 - fade) * srcv;
-				work[x + y * w] = dstv;
-			}
+	// 比較用（EvaluateLogoと同じブロック版だが常にSIMDなしの実装を使う）
+	float EvaluateLogoScalar(const float *src, float maxv, float fade, float* work, int stride = -1)
+	{
+		EraseLogoForEval(src, maxv, fade, work, stride);
+		if (packOffsets == nullptr) {
+			return CorrelationScoreRef(work, maxv) / blackScore;
 		}
+		return CorrelationScorePacked(work, w, numBlocks, packOffsets.get(),
+			packKernels.get(), packKsums.get(), packScales.get(), packScales2.get(), CSHIFT) / blackScore;
+	}
 
-		// 正規化
-		return CorrelationScore(work, maxv) / blackScore;
+	// 比較用（1画素ずつ評価する従来の実装）
+	float EvaluateLogoRef(const float *src, float maxv, float fade, float* work, int stride = -1)
+	{
+		EraseLogoForEval(src, maxv, fade, work, stride);
+		return CorrelationScoreRef(work, maxv) / blackScoreRef;
 	}
 
 	std::unique_ptr<LogoDataParam> MakeFieldLogo(bool bottom)
@@ -284,8 +480,222 @@ public:
 
 private:
 
+	uint32_t GetLogoHash() const
+	{
+		CRC32 crc;
+		int dims[] = { w, h };
+		uint32_t hash = crc.calc((const uint8_t*)dims, sizeof(dims), 0);
+		hash = crc.calc((const uint8_t*)aY, w * h * sizeof(float), hash);
+		hash = crc.calc((const uint8_t*)bY, w * h * sizeof(float), hash);
+		return hash;
+	}
+
+	// このCPUで使う相関計算の種類
+	static int GetKernelType()
+	{
+		int kernel = 0;
+		if (IsAVXAvailable()) {
+			kernel |= KERNEL_CORR5X5_AVX;
+		}
+		if (IsAVX2Available() && IsFMA3Available()) {
+			kernel |= KERNEL_PACKED_AVX2;
+		}
+		return kernel;
+	}
+
+	void SelectKernels()
+	{
+		int kernel = GetKernelType();
+		pCalcCorrelation5x5 = (kernel & KERNEL_CORR5X5_AVX) ? CalcCorrelation5x5_AVX : CalcCorrelation5x5;
+		pCorrelationScorePacked = (kernel & KERNEL_PACKED_AVX2)
+			? CorrelationScorePacked_AVX2 : CorrelationScorePacked;
+	}
+
+	bool LoadMaskCache(const tstring& cachepath, uint32_t hash, float maskratio)
+	{
+		try {
+			MappedFile file(cachepath);
+			if (file.size() < (int64_t)sizeof(MaskCacheHeader)) {
+				return false;
+			}
+			MaskCacheHeader header = *(const MaskCacheHeader*)file.get(0, sizeof(MaskCacheHeader));
+			if (header.magic != MASK_CACHE_MAGIC || header.version != MASK_CACHE_VERSION ||
+				header.hash != hash || header.maskratio != maskratio ||
+				header.kernel != GetKernelType() || header.w != w || header.h != h)
+			{
+				return false;
+			}
+			int YSize = w * h;
+			size_t maskSize = YSize;
+			size_t kernelSize = (size_t)header.maskpixels * KLEN * sizeof(float);
+			size_t scaleSize = (size_t)header.maskpixels * CLEN * sizeof(ScaleLimit);
+			int64_t offset = sizeof(MaskCacheHeader);
+			if (file.size() != offset + (int64_t)(maskSize + kernelSize + scaleSize)) {
+				return false;
+			}
+
+			SelectKernels();
+
+			maskpixels = header.maskpixels;
+			mask = std::unique_ptr<uint8_t[]>(new uint8_t[YSize]);
+			kernels = std::unique_ptr<float[]>(new float[maskpixels * KLEN + 8]);
+			scales = std::unique_ptr<ScaleLimit[]>(new ScaleLimit[maskpixels * CLEN]);
+			memcpy(mask.get(), file.get(offset, maskSize), maskSize);
+			offset += maskSize;
+			if (kernelSize > 0) {
+				memcpy(kernels.get(), file.get(offset, kernelSize), kernelSize);
+				offset += kernelSize;
+				memcpy(scales.get(), file.get(offset, scaleSize), scaleSize);
+			}
+			blackScore = header.blackScore;
+			blackScoreRef = header.blackScoreRef;
+
+			CreatePackedMask();
+			return true;
+		}
+		catch (const IOException&) {
+			// 読めなければ作り直す
+		}
+		return false;
+	}
+
+	void SaveMaskCache(const tstring& cachepath, uint32_t hash, float maskratio)
+	{
+		// 他のプロセスが読んでいる途中のファイルを壊さないように別名で書いてから置き換える
+		tstring tmppath = StringFormat(_T("%s.%d-%d.tmp"), cachepath, GetCurrentProcessId(), GetCurrentThreadId());
+		try {
+			{
+				File file(tmppath, _T("wb"));
+				MaskCacheHeader header = MaskCacheHeader();
+				header.magic = MASK_CACHE_MAGIC;
+				header.version = MASK_CACHE_VERSION;
+				header.hash = hash;
+				header.maskratio = maskratio;
+				header.kernel = GetKernelType();
+				header.w = w;
+				header.h = h;
+				header.maskpixels = maskpixels;
+				header.blackScore = blackScore;
+				header.blackScoreRef = blackScoreRef;
+				file.writeValue(header);
+				file.write(MemoryChunk(mask.get(), w * h));
+				file.write(MemoryChunk((uint8_t*)kernels.get(), maskpixels * KLEN * sizeof(float)));
+				file.write(MemoryChunk((uint8_t*)scales.get(), maskpixels * CLEN * sizeof(ScaleLimit)));
+			}
+			if (MoveFileEx(tmppath.c_str(), cachepath.c_str(), MOVEFILE_REPLACE_EXISTING) == FALSE) {
+				removeT(tmppath.c_str());
+			}
+		}
+		catch (const IOException&) {
+			removeT(tmppath.c_str());
+		}
+	}
+
+	// 評価用にロゴを除去した画像をworkに作る
+	void EraseLogoForEval(const float *src, float maxv, float fade, float* work, int stride)
+	{
+		const float *logoAY = GetA(PLANAR_Y);
+		const float *logoBY = GetB(PLANAR_Y);
+
+		if (stride == -1) {
+			stride = w;
+		}
+
+		// ロゴを除去
+		for (int y = 0; y < h; ++y) {
+			for (int x = 0; x < w; ++x) {
+				float srcv = src[x + y * stride];
+				float a = logoAY[x + y * w];
+				float b = logoBY[x + y * w];
+				float bg = a * srcv + b * maxv;
+				float dstv = fade * bg + (1 - fade) * srcv;
+				work[x + y * w] = dstv;
+			}
+		}
+	}
+
+	// maskの画素を横PACK画素単位のブロックにまとめる
+	// ブロックはロゴの内側(x=2～w-3)に収まるように置き、1画素は1つのブロックにだけ入れる
+	// ブロック内のマスク外のレーンはカーネルとスケールをゼロにする
+	void CreatePackedMask()
+	{
+		numBlocks = 0;
+		packOffsets = nullptr;
+		if (w - 4 < PACK) {
+			// ブロックが入らないので従来の計算
+			return;
+		}
+
+		int YSize = w * h;
+		// 画素 -> kernels,scalesのインデックス
+		std::vector<int> pixelIndex(YSize, -1);
+		int count = 0;
+		for (int y = 2; y < h - 2; ++y) {
+			for (int x = 2; x < w - 2; ++x) {
+				if (mask[x + y * w]) {
+					pixelIndex[x + y * w] = count++;
+				}
+			}
+		}
+
+		std::vector<int> offsets;
+		std::vector<int> laneIndex; // [ブロック][PACK] マスク外は-1
+		for (int y = 2; y < h - 2; ++y) {
+			for (int x = 2; x < w - 2; ++x) {
+				if (pixelIndex[x + y * w] < 0) {
+					continue;
+				}
+				// xより左の画素は割り当て済みなのでブロックを左にずらしても問題ない
+				int bx = std::min(x, w - 2 - PACK);
+				offsets.push_back(bx + y * w);
+				for (int lane = 0; lane < PACK; ++lane) {
+					int& idx = pixelIndex[bx + lane + y * w];
+					laneIndex.push_back(idx);
+					idx = -1; // 割り当て済み
+				}
+			}
+		}
+
+		numBlocks = (int)offsets.size();
+		packOffsets = std::unique_ptr<int[]>(new int[numBlocks]);
+		packKernels = std::unique_ptr<float[]>(new float[numBlocks * KLEN * PACK]());
+		packKsums = std::unique_ptr<float[]>(new float[numBlocks * PACK]());
+		packScales = std::unique_ptr<float[]>(new float[numBlocks * CLEN * PACK]());
+		packScales2 = std::unique_ptr<float[]>(new float[numBlocks * CLEN * PACK]());
+		for (int b = 0; b < numBlocks; ++b) {
+			packOffsets[b] = offsets[b];
+			for (int lane = 0; lane < PACK; ++lane) {
+				int idx = laneIndex[b * PACK + lane];
+				if (idx < 0) {
+					continue;
+				}
+				float ksum = 0.0f;
+				for (int i = 0; i < KLEN; ++i) {
+					float k = kernels[idx * KLEN + i];
+					packKernels[(b * KLEN + i) * PACK + lane] = k;
+					ksum += k;
+				}
+				packKsums[b * PACK + lane] = ksum;
+				for (int i = 0; i < CLEN; ++i) {
+					packScales[(b * CLEN + i) * PACK + lane] = scales[idx * CLEN + i].scale;
+					packScales2[(b * CLEN + i) * PACK + lane] = scales[idx * CLEN + i].scale2;
+				}
+			}
+		}
+	}
+
 	// 画素ごとにロゴとの相関を計算
 	float CorrelationScore(const float *work, float maxv)
+	{
+		if (packOffsets == nullptr) {
+			return CorrelationScoreRef(work, maxv);
+		}
+		return pCorrelationScorePacked(work, w, numBlocks, packOffsets.get(),
+			packKernels.get(), packKsums.get(), packScales.get(), packScales2.get(), CSHIFT);
+	}
+
+	// 1画素ずつ計算する従来の実装
+	float CorrelationScoreRef(const float *work, float maxv)
 	{
 		const uint8_t* mask = GetMask();
 		const float* kernels = GetKernels();
@@ -333,6 +743,13 @@ private:
 	}
 };
 
+// CreateLogoMaskのキャッシュファイルパス
+// variantはロゴファイルから作ったどのロゴか（インタレ解除・フィールド）
+static tstring GetLogoMaskCachePath(const tstring& logoPath, const tchar* variant)
+{
+	return logoPath + _T(".") + variant + _T(".kcache");
+}
+
 static void approxim_line(int n, double sum_x, double sum_y, double sum_x2, double sum_xy, double& a, double& b)
 {
 	// doubleやfloatにはNaNが定義されているのでゼロ除算で例外は発生しない
@@ -363,6 +780,16 @@ public:
 		sumFB += f * b;
 	}
 
+	// 別に集計した値を合算（Normalize前に行うこと）
+	void Merge(const LogoColor& o)
+	{
+		sumF += o.sumF;
+		sumB += o.sumB;
+		sumF2 += o.sumF2;
+		sumB2 += o.sumB2;
+		sumFB += o.sumFB;
+	}
+
 	// 値を0～1に正規化
 	void Normalize(int maxv)
 	{
@@ -403,23 +830,38 @@ class LogoScan
 	int logUVy;
 	int thy;
 
-	std::vector<short> tmpY, tmpU, tmpV;
+	// スレッド毎の作業領域と部分和
+	// 画素値の和は整数なので合算順序によらず同じ値になる
+	struct Partial {
+		std::vector<short> tmpY, tmpU, tmpV;
+		int nframes;
+		std::unique_ptr<LogoColor[]> logoY, logoU, logoV;
+	};
+	std::vector<std::unique_ptr<Partial>> partials;
 
+	// 合算結果（Normalizeで部分和を合算する）
 	int nframes;
 	std::unique_ptr<LogoColor[]> logoY, logoU, logoV;
 
 	/*--------------------------------------------------------------------
 	*	真中らへんを平均
+	*	ソートしたときのn/4～n-n/4番目の平均なので全体をソートする必要はない
 	*-------------------------------------------------------------------*/
-	int med_average(const std::vector<short>& s)
+	static int med_average(std::vector<short>& s)
 	{
 		double t = 0;
-		int nn = 0;
 
 		int n = (int)s.size();
+		int lo = n / 4;
+		int hi = n - (n / 4);
+		int nn = hi - lo;
+
+		// [lo,hi)にlo～hi-1番目の要素を集める
+		std::nth_element(s.begin(), s.begin() + lo, s.end());
+		std::nth_element(s.begin() + lo, s.begin() + hi, s.end());
 
 		// 真中らへんを平均
-		for (int i = n / 4; i < n - (n / 4); i++, nn++)
+		for (int i = lo; i < hi; i++)
 			t += s[i];
 
 		t = (t + nn / 2) / nn;
@@ -427,6 +869,30 @@ class LogoScan
 		return ((int)t);
 	}
 
+	int sizeUV() const {
+		return (scanw >> logUVx) * (scanh >> logUVy);
+	}
+
+	// 部分和を合算結果に足してクリア
+	void Merge()
+	{
+		int sizeY = scanw * scanh;
+		for (auto& p : partials) {
+			for (int i = 0; i < sizeY; ++i) {
+				logoY[i].Merge(p->logoY[i]);
+				p->logoY[i] = LogoColor();
+			}
+			for (int i = 0; i < sizeUV(); ++i) {
+				logoU[i].Merge(p->logoU[i]);
+				logoV[i].Merge(p->logoV[i]);
+				p->logoU[i] = LogoColor();
+				p->logoV[i] = LogoColor();
+			}
+			nframes += p->nframes;
+			p->nframes = 0;
+		}
+	}
+
 	static float calcDist(float a, float b) {
 		return (1.0f / 3.0f) * (a - 1) * (a - 1) + (a - 1) * b + b * b;
 	}
@@ -455,7 +921,8 @@ class LogoScan
 
 public:
 	// thy: オリジナルだとデフォルト30*8=240（8bitだと12くらい？）
-	LogoScan(int scanw, int scanh, int logUVx, int logUVy, int thy)
+	// numThreads: AddFrameを同時に呼ぶスレッド数（スレッド毎に部分和を持つ）
+	LogoScan(int scanw, int scanh, int logUVx, int logUVy, int thy, int numThreads = 1)
 		: scanw(scanw)
 		, scanh(scanh)
 		, logUVx(logUVx)
@@ -466,10 +933,22 @@ public:
 		, logoU(new LogoColor[scanw*scanh >> (logUVx + logUVy)])
 		, logoV(new LogoColor[scanw*scanh >> (logUVx + logUVy)])
 	{
+		for (int i = 0; i < std::max(1, numThreads); ++i) {
+			auto p = std::unique_ptr<Partial>(new Partial());
+			p->nframes = 0;
+			p->logoY = std::unique_ptr<LogoColor[]>(new LogoColor[scanw*scanh]);
+			p->logoU = std::unique_ptr<LogoColor[]>(new LogoColor[sizeUV()]);
+			p->logoV = std::unique_ptr<LogoColor[]>(new LogoColor[sizeUV()]);
+			partials.push_back(std::move(p));
+		}
 	}
 
+	int GetNumThreads() const { return (int)partials.size(); }
+
 	void Normalize(int mavx)
 	{
+		Merge();
+
 		int scanUVw = scanw >> logUVx;
 		int scanUVh = scanh >> logUVy;
 
@@ -565,41 +1044,94 @@ public:
 		return  data;
 	}
 
+	// 現時点までに追加したフレームからロゴを推定（Normalize前に呼ぶ 内部状態は変更しない）
+	// 間引きスキャンの収束判定用
+	std::unique_ptr<LogoData> EstimateLogo(int maxv) const
+	{
+		int scanUVw = scanw >> logUVx;
+		int scanUVh = scanh >> logUVy;
+		auto data = std::unique_ptr<LogoData>(new LogoData(scanw, scanh, logUVx, logUVy));
+		int numFrames = GetNumFrames();
+		auto estimate = [&](const LogoColor* src, std::unique_ptr<LogoColor[]> Partial::*part, int plane, int n) {
+			float *A = data->GetA(plane);
+			float *B = data->GetB(plane);
+			for (int i = 0; i < n; ++i) {
+				LogoColor color = src[i];
+				for (auto& p : partials) {
+					color.Merge(((*p).*part)[i]);
+				}
+				color.Normalize(maxv);
+				if (!color.GetAB(A[i], B[i], numFrames)) return false;
+			}
+			return true;
+		};
+		if (!estimate(logoY.get(), &Partial::logoY, PLANAR_Y, scanw * scanh) ||
+			!estimate(logoU.get(), &Partial::logoU, PLANAR_U, scanUVw * scanUVh) ||
+			!estimate(logoV.get(), &Partial::logoV, PLANAR_V, scanUVw * scanUVh))
+		{
+			return nullptr;
+		}
+		return data;
+	}
+
+	int GetNumFrames() const {
+		int n = nframes;
+		for (auto& p : partials) {
+			n += p->nframes;
+		}
+		return n;
+	}
+
+	// 背景色
+	struct Background {
+		int y, u, v;
+	};
+
+	// thread: 0～numThreads-1 同じthreadで同時に呼ばないこと
 	template <typename pixel_t>
 	void AddScanFrame(
 		const pixel_t* srcY,
 		const pixel_t* srcU,
 		const pixel_t* srcV,
 		int pitchY, int pitchUV,
-		int bgY, int bgU, int bgV)
+		int bgY, int bgU, int bgV,
+		int thread = 0)
 	{
 		int scanUVw = scanw >> logUVx;
 		int scanUVh = scanh >> logUVy;
+		Partial& p = *partials[thread];
 
 		for (int y = 0; y < scanh; ++y) {
 			for (int x = 0; x < scanw; ++x) {
-				logoY[x + y * scanw].Add(srcY[x + y * pitchY], bgY);
+				p.logoY[x + y * scanw].Add(srcY[x + y * pitchY], bgY);
 			}
 		}
 		for (int y = 0; y < scanUVh; ++y) {
 			for (int x = 0; x < scanUVw; ++x) {
-				logoU[x + y * scanUVw].Add(srcU[x + y * pitchUV], bgU);
-				logoV[x + y * scanUVw].Add(srcV[x + y * pitchUV], bgV);
+				p.logoU[x + y * scanUVw].Add(srcU[x + y * pitchUV], bgU);
+				p.logoV[x + y * scanUVw].Add(srcV[x + y * pitchUV], bgV);
 			}
 		}
 
-		++nframes;
+		++p.nframes;
 	}
 
+	// 枠が単一色ならtrueを返してbgに背景色を入れる
+	// thread: 0～numThreads-1 同じthreadで同時に呼ばないこと
 	template <typename pixel_t>
-	bool AddFrame(
+	bool GetBackground(
 		const pixel_t* srcY,
 		const pixel_t* srcU,
 		const pixel_t* srcV,
-		int pitchY, int pitchUV)
+		int pitchY, int pitchUV,
+		Background& bg,
+		int thread = 0)
 	{
 		int scanUVw = scanw >> logUVx;
 		int scanUVh = scanh >> logUVy;
+		std::vector<short>& tmpY = partials[thread]->tmpY;
+		std::vector<short>& tmpU = partials[thread]->tmpU;
+		std::vector<short>& tmpV = partials[thread]->tmpV;
 
 		tmpY.clear();
 		tmpU.clear();
@@ -635,25 +1167,43 @@ public:
 		}
 
 		// 最小と最大が閾値以上離れている場合、単一色でないと判断
-		std::sort(tmpY.begin(), tmpY.end());
-		if (abs(tmpY.front() - tmpY.back()) > thy) { // オリジナルだと thy * 8
+		auto range = [](const std::vector<short>& v) {
+			auto mm = std::minmax_element(v.begin(), v.end());
+			return abs(*mm.first - *mm.second);
+		};
+		if (range(tmpY) > thy) { // オリジナルだと thy * 8
 			return false;
 		}
-		std::sort(tmpU.begin(), tmpU.end());
-		if (abs(tmpU.front() - tmpU.back()) > thy) { // オリジナルだと thy * 8
+		if (range(tmpU) > thy) { // オリジナルだと thy * 8
 			return false;
 		}
-		std::sort(tmpV.begin(), tmpV.end());
-		if (abs(tmpV.front() - tmpV.back()) > thy) { // オリジナルだと thy * 8
+		if (range(tmpV) > thy) { // オリジナルだと thy * 8
 			return false;
 		}
 
-		int bgY = med_average(tmpY);
-		int bgU = med_average(tmpU);
-		int bgV = med_average(tmpV);
+		bg.y = med_average(tmpY);
+		bg.u = med_average(tmpU);
+		bg.v = med_average(tmpV);
+
+		return true;
+	}
+
+	// thread: 0～numThreads-1 同じthreadで同時に呼ばないこと
+	template <typename pixel_t>
+	bool AddFrame(
+		const pixel_t* srcY,
+		const pixel_t* srcU,
+		const pixel_t* srcV,
+		int pitchY, int pitchUV,
+		int thread = 0)
+	{
+		Background bg;
+		if (!GetBackground(srcY, srcU, srcV, pitchY, pitchUV, bg, thread)) {
+			return false;
+		}
 
 		// 有効フレームを追加
-		AddScanFrame(srcY, srcU, srcV, pitchY, pitchUV, bgY, bgU, bgV);
+		AddScanFrame(srcY, srcU, srcV, pitchY, pitchUV, bg.y, bg.u, bg.v, thread);
 
 		return true;
 	}
@@ -673,26 +1223,8 @@ public:
 		using namespace av;
 
 		InputContext inputCtx(src);
-		if (avformat_find_stream_info(inputCtx(), NULL) < 0) {
-			THROW(FormatException, "avformat_find_stream_info failed");
-		}
-		AVStream *videoStream = av::GetVideoStream(inputCtx(), serviceid);
-		if (videoStream == NULL) {
-			THROW(FormatException, "Could not find video stream ...");
-		}
-		AVCodecID vcodecId = videoStream->codecpar->codec_id;
-		AVCodec *pCodec = avcodec_find_decoder(vcodecId);
-		if (pCodec == NULL) {
-			THROW(FormatException, "Could not find decoder ...");
-		}
-		CodecContext codecCtx(pCodec);
-		if (avcodec_parameters_to_context(codecCtx(), videoStream->codecpar) != 0) {
-			THROW(FormatException, "avcodec_parameters_to_context failed");
-		}
-		codecCtx()->thread_count = GetFFmpegThreads(GetProcessorCount() - 2);
-		if (avcodec_open2(codecCtx(), pCodec, NULL) != 0) {
-			THROW(FormatException, "avcodec_open2 failed");
-		}
+		CodecContext codecCtx;
+		AVStream *videoStream = openVideo(inputCtx, codecCtx, serviceid);
 
 		bool first = true;
 		Frame frame;
@@ -721,14 +1253,120 @@ public:
 		if (avcodec_send_packet(codecCtx(), NULL) != 0) {
 			THROW(FormatException, "avcodec_send_packet failed");
 		}
-		while (avcodec_receive_frame(codecCtx(), frame()) == 0) {
-			onFrame(frame());
+		while (avcodec_receive_frame(codecCtx(), frame()) == 0) {
+			onFrame(frame());
+		}
+	}
+
+	// 間引き読み込み
+	// ファイル全体はデコードせず、等間隔のバイト位置にシークして
+	// キーフレームから最大framesPerPointフレームだけデコードする
+	// サンプル点はinitialPoints分割から始めてラウンドごとに中間点を追加（密度2倍）していき、
+	// onSampleRoundがfalseを返すか、サンプル間隔がminIntervalバイトを下回ったら終了
+	void readSampled(const tstring& src, int serviceid,
+		int initialPoints, int framesPerPoint, int64_t minInterval)
+	{
+		using namespace av;
+
+		int64_t filesize;
+		{ File file(src, _T("rb")); filesize = file.size(); }
+
+		InputContext inputCtx(src);
+		CodecContext codecCtx;
+		AVStream *videoStream = openVideo(inputCtx, codecCtx, serviceid);
+
+		bool first = true;
+		Frame frame;
+		AVPacket packet = AVPacket();
+		int64_t numDiv = std::max(2, initialPoints);
+		for (int round = 0; ; ++round) {
+			// 2ラウンド目以降は前のラウンドにない点（奇数番目）だけ読む
+			int step = (round == 0) ? 1 : 2;
+			int numPoints = 0;
+			for (int64_t i = 1; i < numDiv; i += step) {
+				int64_t startpos = filesize * i / numDiv;
+				if (av_seek_frame(inputCtx(), -1, startpos, AVSEEK_FLAG_BYTE) < 0) {
+					THROW(FormatException, "av_seek_frame failed");
+				}
+				avcodec_flush_buffers(codecCtx());
+				++numPoints;
+
+				int numDecoded = 0;
+				while (numDecoded < framesPerPoint && av_read_frame(inputCtx(), &packet) == 0) {
+					if (packet.stream_index == videoStream->index) {
+						if (avcodec_send_packet(codecCtx(), &packet) != 0) {
+							THROW(FormatException, "avcodec_send_packet failed");
+						}
+						while (avcodec_receive_frame(codecCtx(), frame()) == 0) {
+							// シーク直後はIフレームまでスキップ
+							if (numDecoded == 0 && !frame()->key_frame) {
+								continue;
+							}
+							if (first) {
+								onFirstFrame(videoStream, frame());
+								first = false;
+							}
+							currentPos = packet.pos;
+							if (!onFrame(frame())) {
+								av_packet_unref(&packet);
+								return;
+							}
+							if (++numDecoded >= framesPerPoint) {
+								break;
+							}
+						}
+					}
+					int64_t packetpos = packet.pos;
+					av_packet_unref(&packet);
+					if (numDecoded == 0 && packetpos != -1 &&
+						packetpos - startpos > filesize / numDiv)
+					{
+						// 次のサンプル点まで読んでもキーフレームがなかったらこの点は諦める
+						break;
+					}
+				}
+			}
+			if (!onSampleRound(round, numPoints)) {
+				break;
+			}
+			if (filesize / (numDiv * 2) < minInterval) {
+				break;
+			}
+			numDiv *= 2;
+		}
+	}
+
+protected:
+	virtual void onFirstFrame(AVStream *videoStream, AVFrame* frame) { };
+	virtual bool onFrame(AVFrame* frame) { return true; };
+	// readSampledの各ラウンド終了時に呼ばれる falseを返すと終了
+	virtual bool onSampleRound(int round, int numPoints) { return true; };
+
+private:
+	AVStream* openVideo(av::InputContext& inputCtx, av::CodecContext& codecCtx, int serviceid)
+	{
+		if (avformat_find_stream_info(inputCtx(), NULL) < 0) {
+			THROW(FormatException, "avformat_find_stream_info failed");
+		}
+		AVStream *videoStream = av::GetVideoStream(inputCtx(), serviceid);
+		if (videoStream == NULL) {
+			THROW(FormatException, "Could not find video stream ...");
+		}
+		AVCodecID vcodecId = videoStream->codecpar->codec_id;
+		AVCodec *pCodec = avcodec_find_decoder(vcodecId);
+		if (pCodec == NULL) {
+			THROW(FormatException, "Could not find decoder ...");
+		}
+		codecCtx.Set(pCodec);
+		if (avcodec_parameters_to_context(codecCtx(), videoStream->codecpar) != 0) {
+			THROW(FormatException, "avcodec_parameters_to_context failed");
+		}
+		codecCtx()->thread_count = GetFFmpegThreads(GetProcessorCount() - 2);
+		if (avcodec_open2(codecCtx(), pCodec, NULL) != 0) {
+			THROW(FormatException, "avcodec_open2 failed");
 		}
+		return videoStream;
 	}
-
-protected:
-	virtual void onFirstFrame(AVStream *videoStream, AVFrame* frame) { };
-	virtual bool onFrame(AVFrame* frame) { return true; };
 };
 
 static void DeintLogo(LogoData& dst, LogoData& src, int w, int h)
@@ -760,6 +1398,26 @@ static void DeintLogo(LogoData& dst, LogoData& src, int w, int h)
 	}
 }
 
+// 2つのロゴのA,Bの差の絶対値の全プレーン平均
+static float LogoMeanDiff(LogoData& a, LogoData& b)
+{
+	int w = a.getWidth();
+	int h = a.getHeight();
+	int sizeY = w * h;
+	int sizeUV = (w >> a.getLogUVx()) * (h >> a.getLogUVy());
+	double sum = 0;
+	const int planes[] = { PLANAR_Y, PLANAR_U, PLANAR_V };
+	for (int plane : planes) {
+		int n = (plane == PLANAR_Y) ? sizeY : sizeUV;
+		const float *aA = a.GetA(plane), *aB = a.GetB(plane);
+		const float *bA = b.GetA(plane), *bB = b.GetB(plane);
+		for (int i = 0; i < n; ++i) {
+			sum += std::abs(aA[i] - bA[i]) + std::abs(aB[i] - bB[i]);
+		}
+	}
+	return (float)(sum / (2 * (sizeY + sizeUV * 2)));
+}
+
 template <typename pixel_t>
 void DeintY(float* dst, const pixel_t* src, int srcPitch, int w, int h)
 {
@@ -789,6 +1447,162 @@ void CopyY(float* dst, const pixel_t* src, int srcPitch, int w, int h)
 	}
 }
 
+// 有効フレームをLosslessVideoFileに書き込む
+// UtVideoの圧縮はフレーム毎に独立なので、BATCH_PER_THREAD*スレッド数フレームずつまとめてワーカーで圧縮し、
+// その間に呼び出し側は次のバッチを埋める。圧縮したフレームは追加した順に書き込む
+class ParallelLosslessWriter : AMTObject
+{
+	enum { BATCH_PER_THREAD = 4 };
+
+	struct Batch {
+		std::vector<std::unique_ptr<uint8_t[]>> raw;
+		std::vector<std::unique_ptr<uint8_t[]>> coded;
+		std::vector<size_t> codedSizes;
+		int numFrames;
+	};
+
+	LosslessVideoFile file;
+	LOSSLESS_CODEC codecType;
+	int width, height;
+	size_t rawSize;
+	std::unique_ptr<uint8_t[]> rawBuffer; // 無圧縮のときの書き込みバッファ
+	std::vector<CCodecPointer> codecs; // ワーカー毎
+	Batch batches[2];
+	int current; // 追加中のバッチ
+	bool encoding; // 反対側のバッチを圧縮中か
+	// ワーカーがbatchesとcodecsを参照するので、それらより先に破棄(ワーカーを終了)されるように最後に置く
+	// メンバは宣言と逆順に破棄されるので、これより前に移動するとワーカーが破棄済みのメンバを触る
+	std::unique_ptr<ParallelTaskPool> pool;
+
+	void startEncode(Batch& batch) {
+		pool->start(batch.numFrames, [this, &batch](int task, int worker) {
+			bool keyFrame = false;
+			batch.codedSizes[task] = codecs[worker]->EncodeFrame(
+				batch.coded[task].get(), &keyFrame, batch.raw[task].get());
+		});
+		encoding = true;
+	}
+
+	// 圧縮中のバッチを待って書き込む
+	void finishEncode() {
+		if (!encoding) return;
+		encoding = false;
+		pool->wait();
+		Batch& batch = batches[current ^ 1];
+		for (int i = 0; i < batch.numFrames; ++i) {
+			file.writeFrame(batch.coded[i].get(), (int)batch.codedSizes[i]);
+		}
+		batch.numFrames = 0;
+	}
+
+public:
+	// numThreads <= 0 ならプロセッサ数
+	ParallelLosslessWriter(AMTContext& ctx, const tstring& filepath,
+		int width, int height, int maxFrames, LOSSLESS_CODEC codecType, int numThreads)
+		: AMTObject(ctx)
+		, file(ctx, filepath, _T("wb"))
+		, codecType(codecType)
+		, width(width)
+		, height(height)
+		, rawSize((size_t)width * height * 3 / 2)
+		, current(0)
+		, encoding(false)
+	{
+		std::vector<uint8_t> extra;
+		if (codecType == LOSSLESS_RAW) {
+			rawBuffer = std::unique_ptr<uint8_t[]>(new uint8_t[rawSize]);
+		}
+		else {
+			pool = std::unique_ptr<ParallelTaskPool>(new ParallelTaskPool(numThreads));
+			size_t cbGrossWidth[] = { CBGROSSWIDTH_WINDOWS, CBGROSSWIDTH_WINDOWS, CBGROSSWIDTH_WINDOWS };
+			for (int i = 0; i < pool->getNumThreads(); ++i) {
+				codecs.push_back(make_unique_ptr(CCodec::CreateInstance(UTVF_ULH0, "Amatsukaze")));
+				CCodec* codec = codecs.back().get();
+				// 同じパラメータなので追加データはどのインスタンスでも同じ
+				std::vector<uint8_t> codecExtra(codec->EncodeGetExtraDataSize());
+				if (codec->EncodeGetExtraData(codecExtra.data(), codecExtra.size(), UTVF_YV12, width, height)) {
+					THROW(RuntimeException, "failed to EncodeGetExtraData (UtVideo)");
+				}
+				if (codec->EncodeBegin(UTVF_YV12, width, height, cbGrossWidth)) {
+					THROW(RuntimeException, "failed to EncodeBegin (UtVideo)");
+				}
+				if (i == 0) {
+					extra = codecExtra;
+				}
+			}
+			size_t codedSize = codecs[0]->EncodeGetOutputSize(UTVF_YV12, width, height);
+			int batchSize = BATCH_PER_THREAD * pool->getNumThreads();
+			for (auto& batch : batches) {
+				for (int i = 0; i < batchSize; ++i) {
+					batch.raw.emplace_back(new uint8_t[rawSize]);
+					batch.coded.emplace_back(new uint8_t[codedSize]);
+				}
+				batch.codedSizes.resize(batchSize);
+				batch.numFrames = 0;
+			}
+		}
+		file.writeHeader(width, height, maxFrames, extra, codecType);
+	}
+
+	~ParallelLosslessWriter() {
+		if (encoding) {
+			// デストラクタから例外を出すとstd::terminateになるので全部ここで止める
+			try {
+				pool->wait();
+			}
+			catch (const Exception& e) {
+				ctx.warnF("ParallelLosslessWriter: encode failed: %s", e.message());
+			}
+			catch (const std::exception& e) {
+				ctx.warnF("ParallelLosslessWriter: encode failed: %s", e.what());
+			}
+			catch (...) {
+				ctx.warn("ParallelLosslessWriter: encode failed: unknown exception");
+			}
+		}
+		for (auto& codec : codecs) {
+			codec->EncodeEnd();
+		}
+	}
+
+	// 次のフレームを書き込むバッファ(YV12 width*height*3/2バイト)
+	uint8_t* getFrameBuffer() {
+		if (codecType == LOSSLESS_RAW) {
+			return rawBuffer.get();
+		}
+		Batch& batch = batches[current];
+		return batch.raw[batch.numFrames].get();
+	}
+
+	// getFrameBuffer()に書いたフレームを追加
+	void addFrame() {
+		if (codecType == LOSSLESS_RAW) {
+			file.writeFrame(rawBuffer.get(), (int)rawSize);
+			return;
+		}
+		Batch& batch = batches[current];
+		if (++batch.numFrames == (int)batch.raw.size()) {
+			finishEncode();
+			startEncode(batch);
+			current ^= 1;
+		}
+	}
+
+	// 残りのフレームを書き込んでファイルを閉じる
+	void close() {
+		if (codecType != LOSSLESS_RAW) {
+			finishEncode();
+			Batch& batch = batches[current];
+			if (batch.numFrames > 0) {
+				startEncode(batch);
+				current ^= 1;
+				finishEncode();
+			}
+		}
+		file.close();
+	}
+};
+
 typedef bool(*LOGO_ANALYZE_CB)(float progress, int nread, int total, int ngather);
 
 class LogoAnalyzer : AMTObject
@@ -803,6 +1617,9 @@ class LogoAnalyzer : AMTObject
 	int scanx, scany;
 	int scanw, scanh, thy;
 	int numMaxFrames;
+	LOSSLESS_CODEC workCodec; // workfileの格納形式
+	int numThreads; // workfileの圧縮スレッド数（0ならプロセッサ数）
+	bool sampleScan; // trueならファイル全体をデコードせずキーフレームを間引き読み込み
 	int logUVx, logUVy;
 	int imgw, imgh;
 	int numFrames;
@@ -813,34 +1630,103 @@ class LogoAnalyzer : AMTObject
 	// 今の所可逆圧縮が8bitのみなので対応は8bitのみ
 	class InitialLogoCreator : SimpleVideoReader
 	{
+		enum {
+			SAMPLE_INITIAL_POINTS = 16, // 間引きスキャンの最初のサンプル点数
+			SAMPLE_FRAMES_PER_POINT = 15, // 1サンプル点でデコードするフレーム数
+			SAMPLE_MIN_FRAMES = 100, // 収束判定を始める最小有効フレーム数
+			BATCH_PER_THREAD = 8, // スキャンをまとめて並列処理するフレーム数（スレッド当たり）
+		};
 		LogoAnalyzer* pThis;
-		CCodecPointer codec;
-		size_t scanDataSize;
-		size_t codedSize;
 		int readCount;
 		int64_t filesize;
-		std::unique_ptr<uint8_t[]> memScanData;
-		std::unique_ptr<uint8_t[]> memCoded;
-		std::unique_ptr<LosslessVideoFile> file;
+		float sampleProgress;
+		std::unique_ptr<LogoData> prevEstimate;
+		std::unique_ptr<ParallelLosslessWriter> writer;
 		std::unique_ptr<LogoScan> logoscan;
+		// スキャン部分のコピー(YV12)をためて並列にLogoScanに追加する
+		std::vector<std::unique_ptr<uint8_t[]>> batch;
+		std::vector<LogoScan::Background> batchBg;
+		std::vector<uint8_t> batchValid;
+		int batchCount;
+		std::unique_ptr<ParallelTaskPool> pool;
+
+		void processBatch()
+		{
+			if (batchCount == 0) return;
+
+			int scanw = pThis->scanw;
+			int scanh = pThis->scanh;
+			int scanUVw = scanw >> pThis->logUVx;
+			int offU = scanw * scanh;
+			int offV = offU + scanUVw * (scanh >> pThis->logUVy);
+			size_t frameSize = scanw * scanh * 3 / 2;
+
+			// 単一色判定はフレーム毎に独立なので並列に行う
+			pool->run(batchCount, [&](int task, int worker) {
+				const uint8_t* ptr = batch[task].get();
+				batchValid[task] = logoscan->GetBackground(ptr, ptr + offU, ptr + offV,
+					scanw, scanUVw, batchBg[task], worker);
+			});
+
+			// 採用するフレームはデコード順に決めるので逐次処理と同じになる
+			for (int i = 0; i < batchCount; ++i) {
+				if (!batchValid[i]) continue;
+				if (pThis->numFrames >= pThis->numMaxFrames) {
+					batchValid[i] = false;
+					continue;
+				}
+				++pThis->numFrames;
+
+				// 有効なフレームは保存しておく
+				// 圧縮と書き込みはwriterがワーカースレッドで行う
+				memcpy(writer->getFrameBuffer(), batch[i].get(), frameSize);
+				writer->addFrame();
+			}
+
+			// ワーカー毎の部分和に足しておいてNormalizeで合算する
+			pool->run(batchCount, [&](int task, int worker) {
+				if (!batchValid[task]) return;
+				const uint8_t* ptr = batch[task].get();
+				const auto& bg = batchBg[task];
+				logoscan->AddScanFrame(ptr, ptr + offU, ptr + offV,
+					scanw, scanUVw, bg.y, bg.u, bg.v, worker);
+			});
+
+			batchCount = 0;
+		}
 	public:
 		InitialLogoCreator(LogoAnalyzer* pThis)
 			: SimpleVideoReader(pThis->ctx)
 			, pThis(pThis)
-			, codec(make_unique_ptr(CCodec::CreateInstance(UTVF_ULH0, "Amatsukaze")))
-			, scanDataSize(pThis->scanw * pThis->scanh * 3 / 2)
-			, codedSize(codec->EncodeGetOutputSize(UTVF_YV12, pThis->scanw, pThis->scanh))
 			, readCount()
-			, memScanData(new uint8_t[scanDataSize])
-			, memCoded(new uint8_t[codedSize])
+			, sampleProgress(-1)
+			, batchCount()
 		{ }
 		void readAll(const tstring& src, int serviceid)
 		{
 			{ File file(src, _T("rb")); filesize = file.size(); }
 
-			SimpleVideoReader::readAll(src, serviceid);
+			if (pThis->sampleScan) {
+				// サンプル間隔がGOPより十分大きい範囲で密度を上げていく
+				sampleProgress = 0;
+				SimpleVideoReader::readSampled(src, serviceid,
+					SAMPLE_INITIAL_POINTS, SAMPLE_FRAMES_PER_POINT, 8 * 1024 * 1024);
+				pThis->ctx.infoF("Sampled scan: %d frames decoded, %d logo frames", readCount, pThis->numFrames);
+			}
+			else {
+				SimpleVideoReader::readAll(src, serviceid);
+			}
+
+			if (logoscan == nullptr) {
+				THROW(FormatException, "No video frame");
+			}
+
+			processBatch();
 
-			codec->EncodeEnd();
+			if (writer != nullptr) {
+				writer->close();
+				writer = nullptr;
+			}
 
 			logoscan->Normalize(255);
 			pThis->logodata = logoscan->GetLogo(false);
@@ -851,17 +1737,6 @@ class LogoAnalyzer : AMTObject
 	protected:
 		virtual void onFirstFrame(AVStream *videoStream, AVFrame* frame)
 		{
-			size_t extraSize = codec->EncodeGetExtraDataSize();
-			std::vector<uint8_t> extra(extraSize);
-			size_t cbGrossWidth[] = { CBGROSSWIDTH_WINDOWS, CBGROSSWIDTH_WINDOWS, CBGROSSWIDTH_WINDOWS };
-
-			if (codec->EncodeGetExtraData(extra.data(), extraSize, UTVF_YV12, pThis->scanw, pThis->scanh)) {
-				THROW(RuntimeException, "failed to EncodeGetExtraData (UtVideo)");
-			}
-			if (codec->EncodeBegin(UTVF_YV12, pThis->scanw, pThis->scanh, cbGrossWidth)) {
-				THROW(RuntimeException, "failed to EncodeBegin (UtVideo)");
-			}
-
 			const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get((AVPixelFormat)(frame->format));
 
 			pThis->logUVx = desc->log2_chroma_w;
@@ -869,13 +1744,20 @@ class LogoAnalyzer : AMTObject
 			pThis->imgw = frame->width;
 			pThis->imgh = frame->height;
 
-			file = std::unique_ptr<LosslessVideoFile>(
-				new LosslessVideoFile(pThis->ctx, pThis->workfile, _T("wb")));
-			logoscan = std::unique_ptr<LogoScan>(
-				new LogoScan(pThis->scanw, pThis->scanh, pThis->logUVx, pThis->logUVy, pThis->thy));
-
 			// フレーム数は最大フレーム数（実際はそこまで書き込まないこともある）
-			file->writeHeader(pThis->scanw, pThis->scanh, pThis->numMaxFrames, extra);
+			writer = std::unique_ptr<ParallelLosslessWriter>(new ParallelLosslessWriter(pThis->ctx,
+				pThis->workfile, pThis->scanw, pThis->scanh, pThis->numMaxFrames, pThis->workCodec, pThis->numThreads));
+			pool = std::unique_ptr<ParallelTaskPool>(new ParallelTaskPool(pThis->numThreads));
+			logoscan = std::unique_ptr<LogoScan>(new LogoScan(pThis->scanw, pThis->scanh,
+				pThis->logUVx, pThis->logUVy, pThis->thy, pool->getNumThreads()));
+
+			int batchSize = BATCH_PER_THREAD * pool->getNumThreads();
+			for (int i = 0; i < batchSize; ++i) {
+				batch.emplace_back(new uint8_t[pThis->scanw * pThis->scanh * 3 / 2]);
+			}
+			batchBg.resize(batchSize);
+			batchValid.resize(batchSize);
+			batchCount = 0;
 
 			pThis->numFrames = 0;
 		};
@@ -894,18 +1776,13 @@ class LogoAnalyzer : AMTObject
 			const uint8_t* scanU = frame->data[1] + offUV;
 			const uint8_t* scanV = frame->data[2] + offUV;
 
-			if (logoscan->AddFrame(scanY, scanU, scanV, pitchY, pitchUV)) {
-				++pThis->numFrames;
-
-				// 有効なフレームは保存しておく
-				CopyYV12(memScanData.get(), scanY, scanU, scanV, pitchY, pitchUV, pThis->scanw, pThis->scanh);
-				bool keyFrame = false;
-				size_t codedSize = codec->EncodeFrame(memCoded.get(), &keyFrame, memScanData.get());
-				file->writeFrame(memCoded.get(), (int)codedSize);
+			CopyYV12(batch[batchCount++].get(), scanY, scanU, scanV, pitchY, pitchUV, pThis->scanw, pThis->scanh);
+			if (batchCount == (int)batch.size()) {
+				processBatch();
 			}
 
 			if ((readCount % 200) == 0) {
-				float progress = (float)currentPos / filesize * 50;
+				float progress = (sampleProgress >= 0) ? sampleProgress : (float)currentPos / filesize * 50;
 				if (pThis->cb(progress, readCount, 0, pThis->numFrames) == false) {
 					THROW(RuntimeException, "Cancel requested");
 				}
@@ -913,6 +1790,35 @@ class LogoAnalyzer : AMTObject
 
 			return true;
 		};
+		virtual bool onSampleRound(int round, int numPoints)
+		{
+			// 1ラウンドごとにサンプル数が倍になるので進捗は半分ずつ進める
+			sampleProgress = 50 - 50 / (float)(2 << round);
+			if (pThis->cb(sampleProgress, readCount, 0, pThis->numFrames) == false) {
+				THROW(RuntimeException, "Cancel requested");
+			}
+			if (logoscan == nullptr) {
+				return true;
+			}
+			processBatch();
+			if (pThis->numFrames < SAMPLE_MIN_FRAMES) {
+				return true;
+			}
+			// ロゴの推定値が前のラウンドからほとんど変わらなくなったら終了
+			auto estimate = logoscan->EstimateLogo(255);
+			if (estimate == nullptr) {
+				return true;
+			}
+			bool converged = false;
+			if (prevEstimate != nullptr) {
+				float diff = LogoMeanDiff(*prevEstimate, *estimate);
+				pThis->ctx.debugF("Sampled scan round %d: %d points, %d logo frames, diff %.5f",
+					round, numPoints, pThis->numFrames, diff);
+				converged = (diff < 0.002f);
+			}
+			prevEstimate = std::move(estimate);
+			return !converged;
+		}
 	};
 
 	void MakeInitialLogo()
@@ -924,50 +1830,42 @@ class LogoAnalyzer : AMTObject
 	void ReMakeLogo()
 	{
 		// 複数fade値でロゴを評価 //
-		auto codec = make_unique_ptr(CCodec::CreateInstance(UTVF_ULH0, "Amatsukaze"));
 
 		// ロゴを評価用にインタレ解除
 		LogoDataParam deintLogo(LogoData(scanw, scanh, logUVx, logUVy), scanw, scanh, scanx, scany);
 		DeintLogo(deintLogo, *logodata, scanw, scanh);
 		deintLogo.CreateLogoMask(0.1f);
 
-		size_t cbGrossWidth[] = { CBGROSSWIDTH_WINDOWS, CBGROSSWIDTH_WINDOWS, CBGROSSWIDTH_WINDOWS };
 		size_t scanDataSize = scanw * scanh * 3 / 2;
 		size_t YSize = scanw * scanh;
-		size_t codedSize = codec->EncodeGetOutputSize(UTVF_YV12, scanw, scanh);
-		size_t extraSize = codec->EncodeGetExtraDataSize();
 		auto memScanData = std::unique_ptr<uint8_t[]>(new uint8_t[scanDataSize]);
-		auto memCoded = std::unique_ptr<uint8_t[]>(new uint8_t[codedSize]);
 
 		auto memDeint = std::unique_ptr<float[]>(new float[YSize + 8]);
-		auto memWork = std::unique_ptr<float[]>(new float[YSize + 8]);
+		auto memWork = std::unique_ptr<float[]>(new float[YSize * 2 + 8]);
 
 		const int numFade = 20;
+		float fades[numFade];
+		for (int fi = 0; fi < numFade; ++fi) {
+			fades[fi] = 0.1f * fi;
+		}
 		auto minFades = std::unique_ptr<int[]>(new int[numFrames]);
 		{
 			LosslessVideoFile file(ctx, workfile, _T("rb"));
 			file.readHeader();
-			auto extra = file.getExtra();
-
-			if (codec->DecodeBegin(UTVF_YV12, scanw, scanh, cbGrossWidth, extra.data(), (int)extra.size())) {
-				THROW(RuntimeException, "failed to DecodeBegin (UtVideo)");
-			}
+			LosslessFrameDecoder decoder(file);
 
 			// 全フレームループ
 			for (int i = 0; i < numFrames; ++i) {
-				int64_t codedSize = file.readFrame(i, memCoded.get());
-				if (codec->DecodeFrame(memScanData.get(), memCoded.get()) != scanDataSize) {
-					THROW(RuntimeException, "failed to DecodeFrame (UtVideo)");
-				}
+				decoder.decode(file, i, memScanData.get());
 				// フレームをインタレ解除
 				DeintY(memDeint.get(), memScanData.get(), scanw, scanw, scanh);
-				// fade値ループ
+				// 全fade値でロゴを評価
+				float results[numFade];
+				deintLogo.EvaluateLogoMultiFade(memDeint.get(), 255.0f, fades, numFade, results, memWork.get());
 				float minResult = FLT_MAX;
 				int minFadeIndex = 0;
 				for (int fi = 0; fi < numFade; ++fi) {
-					float fade = 0.1f * fi;
-					// ロゴを評価
-					float result = std::abs(deintLogo.EvaluateLogo(memDeint.get(), 255.0f, fade, memWork.get()));
+					float result = std::abs(results[fi]);
 					if (result < minResult) {
 						minResult = result;
 						minFadeIndex = fi;
@@ -982,8 +1880,6 @@ class LogoAnalyzer : AMTObject
 					}
 				}
 			}
-
-			codec->DecodeEnd();
 		}
 
 		// 評価値を集約
@@ -995,14 +1891,21 @@ class LogoAnalyzer : AMTObject
 		int maxi = (int)(std::max_element(numMinFades.begin(), numMinFades.end()) - numMinFades.begin());
 		printf("maxi = %d (%.1f%%)\n", maxi, numMinFades[maxi] / (float)numFrames * 100.0f);
 
-		LogoScan logoscan(scanw, scanh, logUVx, logUVy, thy);
+		ParallelTaskPool pool(numThreads);
+		LogoScan logoscan(scanw, scanh, logUVx, logUVy, thy, pool.getNumThreads());
 		{
-			LosslessVideoFile file(ctx, workfile, _T("rb"));
-			file.readHeader();
-			auto extra = file.getExtra();
-
-			if (codec->DecodeBegin(UTVF_YV12, scanw, scanh, cbGrossWidth, extra.data(), (int)extra.size())) {
-				THROW(RuntimeException, "failed to DecodeBegin (UtVideo)");
+			// ファイルのマップとデコーダはスレッド毎に持つ
+			struct Worker {
+				std::unique_ptr<LosslessVideoFile> file;
+				std::unique_ptr<LosslessFrameDecoder> decoder;
+				std::unique_ptr<uint8_t[]> buf;
+			};
+			std::vector<Worker> workers(pool.getNumThreads());
+			for (auto& w : workers) {
+				w.file = std::unique_ptr<LosslessVideoFile>(new LosslessVideoFile(ctx, workfile, _T("rb")));
+				w.file->readHeader();
+				w.decoder = std::unique_ptr<LosslessFrameDecoder>(new LosslessFrameDecoder(*w.file));
+				w.buf = std::unique_ptr<uint8_t[]>(new uint8_t[scanDataSize]);
 			}
 
 			int scanUVw = scanw >> logUVx;
@@ -1011,21 +1914,21 @@ class LogoAnalyzer : AMTObject
 			int offV = offU + scanUVw * scanUVh;
 
 			// 全フレームループ
-			for (int i = 0; i < numFrames; ++i) {
-				int64_t codedSize = file.readFrame(i, memCoded.get());
-				if (codec->DecodeFrame(memScanData.get(), memCoded.get()) != scanDataSize) {
-					THROW(RuntimeException, "failed to DecodeFrame (UtVideo)");
-				}
-				// ロゴのあるフレームだけAddFrame
-				if (minFades[i] > 8) { // TODO: 調整
-					const uint8_t* ptr = memScanData.get();
-					logoscan.AddFrame(ptr, ptr + offU, ptr + offV, scanw, scanUVw);
-				}
-
-				if ((i % 2000) == 0) printf("%d frames\n", i);
+			// 部分和は整数なので並列に足してもLogoScanの結果は逐次処理と同じ
+			const int chunk = 2000;
+			for (int start = 0; start < numFrames; start += chunk) {
+				printf("%d frames\n", start);
+				pool.run(std::min(chunk, numFrames - start), [&](int task, int worker) {
+					int i = start + task;
+					// ロゴのあるフレームだけAddFrame
+					if (minFades[i] > 8) { // TODO: 調整
+						Worker& w = workers[worker];
+						w.decoder->decode(*w.file, i, w.buf.get());
+						const uint8_t* ptr = w.buf.get();
+						logoscan.AddFrame(ptr, ptr + offU, ptr + offV, scanw, scanUVw, worker);
+					}
+				});
 			}
-
-			codec->DecodeEnd();
 		}
 
 		// ロゴ作成
@@ -1040,7 +1943,7 @@ class LogoAnalyzer : AMTObject
 public:
 	LogoAnalyzer(AMTContext& ctx, const tchar* srcpath, int serviceid, const tchar* workfile, const tchar* dstpath,
 		int imgx, int imgy, int w, int h, int thy, int numMaxFrames,
-		LOGO_ANALYZE_CB cb)
+		LOGO_ANALYZE_CB cb, LOSSLESS_CODEC workCodec = LOSSLESS_UTVIDEO, int numThreads = 0, bool sampleScan = false)
 		: AMTObject(ctx)
 		, srcpath(srcpath)
 		, serviceid(serviceid)
@@ -1052,6 +1955,9 @@ public:
 		, scanh(h)
 		, thy(thy)
 		, numMaxFrames(numMaxFrames)
+		, workCodec(workCodec)
+		, numThreads(numThreads)
+		, sampleScan(sampleScan)
 		, cb(cb)
 	{
 		//
@@ -1099,6 +2005,27 @@ extern "C" __declspec(dllexport) int ScanLogo(AMTContext* ctx,
 	return false;
 }
 
+// workCodec: workfileの格納形式(LOSSLESS_CODEC) 1にすると無圧縮で書くのでCPU負荷が減る代わりにディスクを使う
+// numThreads: workfileの圧縮スレッド数（0ならプロセッサ数）
+// sampleScan: 1にするとファイル全体をデコードせず等間隔のキーフレームだけ読んでロゴを作る
+extern "C" __declspec(dllexport) int ScanLogoEx(AMTContext* ctx,
+	const tchar* srcpath, int serviceid, const tchar* workfile, const tchar* dstpath,
+	int imgx, int imgy, int w, int h, int thy, int numMaxFrames,
+	int workCodec, int numThreads, int sampleScan, LOGO_ANALYZE_CB cb)
+{
+	try {
+		LogoAnalyzer analyzer(*ctx,
+			srcpath, serviceid, workfile, dstpath, imgx, imgy, w, h, thy, numMaxFrames, cb,
+			(workCodec == LOSSLESS_RAW) ? LOSSLESS_RAW : LOSSLESS_UTVIDEO, numThreads, sampleScan != 0);
+		analyzer.ScanLogo();
+		return true;
+	}
+	catch (const Exception& exception) {
+		ctx->setError(exception);
+	}
+	return false;
+}
+
 struct LogoAnalyzeFrame
 {
 	float p[11], t[11], b[11];
@@ -1122,9 +2049,10 @@ class AMTAnalyzeLogo : public GenericVideoFilter
 	PVideoFrame GetFrameT(int n, IScriptEnvironment2* env)
 	{
 		size_t YSize = header.w * header.h;
-		auto memCopy = std::unique_ptr<float[]>(new float[YSize + 8]);
-		auto memDeint = std::unique_ptr<float[]>(new float[YSize + 8]);
-		auto memWork = std::unique_ptr<float[]>(new float[YSize + 8]);
+		ScratchArena::Scope scratch;
+		float* memCopy = scratch.alloc<float>(YSize + 8);
+		float* memDeint = scratch.alloc<float>(YSize + 8);
+		float* memWork = scratch.alloc<float>(YSize * 2 + 8);
 
 		PVideoFrame dst = env->NewVideoFrame(vi);
 		LogoAnalyzeFrame* pDst = reinterpret_cast<LogoAnalyzeFrame*>(dst->GetWritePtr());
@@ -1144,16 +2072,23 @@ class AMTAnalyzeLogo : public GenericVideoFilter
 			int off = header.imgx + header.imgy * pitchY;
 			int offUV = (header.imgx >> header.logUVx) + (header.imgy >> header.logUVy) * pitchUV;
 
-			CopyY(memCopy.get(), srcY + off, pitchY, header.w, header.h);
+			CopyY(memCopy, srcY + off, pitchY, header.w, header.h);
 
 			// フレームをインタレ解除
-			DeintY(memDeint.get(), srcY + off, pitchY, header.w, header.h);
+			DeintY(memDeint, srcY + off, pitchY, header.w, header.h);
 
 			LogoAnalyzeFrame info;
+			float fades[11];
+			for (int f = 0; f <= 10; ++f) {
+				fades[f] = (float)f / 10.0f;
+			}
+			deintLogo->EvaluateLogoMultiFade(memDeint, maxv, fades, 11, info.p, memWork);
+			fieldLogoT->EvaluateLogoMultiFade(memCopy, maxv, fades, 11, info.t, memWork, header.w * 2);
+			fieldLogoB->EvaluateLogoMultiFade(memCopy + header.w, maxv, fades, 11, info.b, memWork, header.w * 2);
 			for (int f = 0; f <= 10; ++f) {
-				info.p[f] = std::abs(deintLogo->EvaluateLogo(memDeint.get(), maxv, (float)f / 10.0f, memWork.get()));
-				info.t[f] = std::abs(fieldLogoT->EvaluateLogo(memCopy.get(), maxv, (float)f / 10.0f, memWork.get(), header.w * 2));
-				info.b[f] = std::abs(fieldLogoB->EvaluateLogo(memCopy.get() + header.w, maxv, (float)f / 10.0f, memWork.get(), header.w * 2));
+				info.p[f] = std::abs(info.p[f]);
+				info.t[f] = std::abs(info.t[f]);
+				info.b[f] = std::abs(info.b[f]);
 			}
 
 			pDst[i] = info;
@@ -1179,12 +2114,12 @@ public:
 		deintLogo = std::unique_ptr<LogoDataParam>(
 			new LogoDataParam(LogoData(header.w, header.h, header.logUVx, header.logUVy), &header));
 		DeintLogo(*deintLogo, *logo, header.w, header.h);
-		deintLogo->CreateLogoMask(maskratio);
+		deintLogo->CreateLogoMask(maskratio, GetLogoMaskCachePath(logoPath, _T("deint")));
 
 		fieldLogoT = logo->MakeFieldLogo(false);
-		fieldLogoT->CreateLogoMask(maskratio);
+		fieldLogoT->CreateLogoMask(maskratio, GetLogoMaskCachePath(logoPath, _T("top")));
 		fieldLogoB = logo->MakeFieldLogo(true);
-		fieldLogoB->CreateLogoMask(maskratio);
+		fieldLogoB->CreateLogoMask(maskratio, GetLogoMaskCachePath(logoPath, _T("bottom")));
 
 		// for debug
 		//LogoHeader hT = header;
@@ -1237,28 +2172,120 @@ public:
 	}
 };
 
+// AMTAnalyzeLogoの出力（1フレームに8フレーム分の解析結果）のキャッシュ
+// 連続するフレームの処理ではほとんど同じ解析結果を使うので、解析クリップの各フレームは1回だけ取得する
+// スロットは解析フレーム番号で決まるので、近い範囲を処理しているスレッド同士で共有できる
+// 取得中はロックしないので、別スレッドが同じフレームを重複して取得することはある
+class LogoAnalyzeCache
+{
+public:
+	enum { NUM_SLOTS = 16 }; // 2のべき乗
+
+	LogoAnalyzeCache(PClip analyzeclip)
+		: analyzeclip(analyzeclip)
+		, numFetches(0)
+	{
+		for (auto& slot : slots) {
+			slot.valid = false;
+		}
+	}
+
+	// rec番目の解析結果（解析クリップのrec/8フレーム目のrec%8番目）
+	LogoAnalyzeFrame get(int rec, IScriptEnvironment* env)
+	{
+		int analyze_n = rec >> 3;
+		int idx = rec & 7;
+		Slot& slot = slots[analyze_n & (NUM_SLOTS - 1)];
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (slot.valid && slot.n == analyze_n) {
+				return slot.frames[idx];
+			}
+		}
+
+		Slot fetched;
+		{
+			PVideoFrame frame = analyzeclip->GetFrame(analyze_n, env);
+			const LogoAnalyzeFrame* pInfo =
+				reinterpret_cast<const LogoAnalyzeFrame*>(frame->GetReadPtr());
+			std::copy(pInfo, pInfo + 8, fetched.frames);
+		}
+		fetched.valid = true;
+		fetched.n = analyze_n;
+
+		std::lock_guard<std::mutex> lock(mutex);
+		slot = fetched;
+		++numFetches;
+		return fetched.frames[idx];
+	}
+
+	// 解析クリップからフレームを取得した回数
+	int64_t getNumFetches() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return numFetches;
+	}
+
+private:
+	struct Slot {
+		bool valid;
+		int n;
+		LogoAnalyzeFrame frames[8];
+	};
+
+	PClip analyzeclip;
+	std::mutex mutex;
+	Slot slots[NUM_SLOTS];
+	int64_t numFetches;
+};
+
+// ロゴ除去（1プレーン）
+// フィールド処理はlogopitchとimgpitchを2倍にして呼び出す
+template <typename pixel_t>
+void DelogoPlane(pixel_t* dst, int w, int h, int logopitch, int imgpitch, float maxv, const float* A, const float* B, float fade)
+{
+	for (int y = 0; y < h; ++y) {
+		for (int x = 0; x < w; ++x) {
+			float srcv = dst[x + y * imgpitch];
+			float a = A[x + y * logopitch];
+			float b = B[x + y * logopitch];
+			float bg = a * srcv + b * maxv;
+			float tmp = fade * bg + (1 - fade) * srcv;
+			dst[x + y * imgpitch] = (pixel_t)std::min(std::max(tmp + 0.5f, 0.0f), maxv);
+		}
+	}
+}
+
+// DelogoPlaneのAVX2版（結果は同じ）
+static void DelogoPlane_AVX2(uint8_t* dst, int w, int h, int logopitch, int imgpitch, float maxv, const float* A, const float* B, float fade)
+{
+	DelogoU8_AVX2(dst, w, h, logopitch, imgpitch, maxv, A, B, fade);
+}
+
+static void DelogoPlane_AVX2(uint16_t* dst, int w, int h, int logopitch, int imgpitch, float maxv, const float* A, const float* B, float fade)
+{
+	DelogoU16_AVX2(dst, w, h, logopitch, imgpitch, maxv, A, B, fade);
+}
+
 class AMTEraseLogo : public GenericVideoFilter
 {
 	PClip analyzeclip;
+	LogoAnalyzeCache analyzeCache;
 
 	std::vector<int> frameResult;
 	std::unique_ptr<LogoDataParam> logo;
 	LogoHeader header;
 	int mode;
 	int maxFadeLength;
+	bool avx2;
 
 	template <typename pixel_t>
 	void Delogo(pixel_t* dst, int w, int h, int logopitch, int imgpitch, float maxv, const float* A, const float* B, float fade)
 	{
-		for (int y = 0; y < h; ++y) {
-			for (int x = 0; x < w; ++x) {
-				float srcv = dst[x + y * imgpitch];
-				float a = A[x + y * logopitch];
-				float b = B[x + y * logopitch];
-				float bg = a * srcv + b * maxv;
-				float tmp = fade * bg + (1 - fade) * srcv;
-				dst[x + y * imgpitch] = (pixel_t)std::min(std::max(tmp + 0.5f, 0.0f), maxv);
-			}
+		if (avx2) {
+			DelogoPlane_AVX2(dst, w, h, logopitch, imgpitch, maxv, A, B, fade);
+		}
+		else {
+			DelogoPlane(dst, w, h, logopitch, imgpitch, maxv, A, B, fade);
 		}
 	}
 
@@ -1269,23 +2296,10 @@ class AMTEraseLogo : public GenericVideoFilter
 		};
 		LogoAnalyzeFrame frames[DIST * 2 + 1];
 
-		int prev_n = INT_MAX;
-		PVideoFrame frame;
 		for (int i = -DIST; i <= DIST; ++i) {
 			int nsrc = std::max(0, std::min(vi.num_frames - 1, n + i));
-			int analyze_n = (nsrc + i) >> 3;
-			int idx = (nsrc + i) & 7;
-
-			if (analyze_n != prev_n) {
-				frame = analyzeclip->GetFrame(analyze_n, env);
-				prev_n = analyze_n;
-			}
-
-			const LogoAnalyzeFrame* pInfo =
-				reinterpret_cast<const LogoAnalyzeFrame*>(frame->GetReadPtr());
-			frames[i + DIST] = pInfo[idx];
+			frames[i + DIST] = analyzeCache.get(nsrc + i, env);
 		}
-		frame = nullptr;
 
 		int minfades[DIST * 2 + 1];
 		for (int i = 0; i < DIST * 2 + 1; ++i) {
@@ -1325,15 +2339,15 @@ class AMTEraseLogo : public GenericVideoFilter
 		else {
 			// ロゴ解析結果を大局的に使って、
 			// 切り替わり周辺だけリアルタイム解析結果を使う
+			// 前後の範囲（端はクランプ）が全部同じ結果か
 			int halfWidth = (maxFadeLength >> 1);
-			std::vector<int> frames(halfWidth * 2 + 1);
-			for (int i = -halfWidth; i <= halfWidth; ++i) {
-				int nsrc = std::max(0, std::min(vi.num_frames - 1, n + i));
-				frames[i + halfWidth] = frameResult[nsrc];
-			}
-			if (std::all_of(frames.begin(), frames.end(), [&](int p) { return p == frames[0]; })) {
+			int first = std::max(0, std::min(vi.num_frames - 1, n - halfWidth));
+			int last = std::max(0, std::min(vi.num_frames - 1, n + halfWidth));
+			if (std::all_of(frameResult.begin() + first, frameResult.begin() + last + 1,
+				[&](int p) { return p == frameResult[first]; }))
+			{
 				// ON or OFF
-				fadeT = fadeB = ((frames[halfWidth] == 2) ? 1.0f : 0.0f);
+				fadeT = fadeB = ((frameResult[first] == 2) ? 1.0f : 0.0f);
 			}
 			else {
 				// 切り替わりを含む
@@ -1466,8 +2480,10 @@ public:
 	AMTEraseLogo(PClip clip, PClip analyzeclip, const tstring& logoPath, const tstring& logofPath, int mode, int maxFadeLength, IScriptEnvironment* env)
 		: GenericVideoFilter(clip)
 		, analyzeclip(analyzeclip)
+		, analyzeCache(analyzeclip)
 		, mode(mode)
 		, maxFadeLength(maxFadeLength)
+		, avx2(IsAVX2Available())
 	{
 		try {
 			logo = std::unique_ptr<LogoDataParam>(
@@ -1531,6 +2547,11 @@ class LogoFrame : AMTObject
 	int framesPerSec;
 	VideoInfo vi;
 
+	// 評価スレッド数（0ならプロセッサ数）
+	int numThreads;
+	// 1回にまとめて取得するフレーム数（スレッド当たり）
+	enum { BATCH_FRAMES_PER_THREAD = 4 };
+
 	struct EvalResult {
 		float corr0, corr1;
 	};
@@ -1542,58 +2563,204 @@ class LogoFrame : AMTObject
 	int bestLogo;
 	float logoRatio;
 
+	// 候補の絞り込み（setCandidatePruning参照）
+	enum { PRUNE_SAMPLE_FRAMES = 100 }; // 絞り込みに使うフレーム数
+	int pruneCandidates;
+	int pruneTopK;
+	std::vector<uint8_t> logoEnabled; // 0のロゴは評価しない
+
+	struct Summary {
+		float cost;    // 消した後のゴミの量
+		int numFrames;  // 検出したフレーム数
+	};
+
+	// 0番目～numCandidatesまでのロゴの評価結果を集計
+	std::vector<Summary> summarize(const EvalResult* results, int nframes, int numCandidates) const
+	{
+		std::vector<Summary> logoSummary(numCandidates);
+		for (int n = 0; n < nframes; ++n) {
+			for (int i = 0; i < numCandidates; ++i) {
+				auto& r = results[n * numLogos + i];
+				// ロゴを検出 かつ 消せてる
+				if (r.corr0 > THRESH && std::abs(r.corr1) < THRESH) {
+					logoSummary[i].numFrames++;
+					logoSummary[i].cost += std::abs(r.corr1);
+				}
+			}
+		}
+		return logoSummary;
+	}
+
+	// 小さいほど合っている
+	static float calcLogoScore(const Summary& s, int nframes)
+	{
+		// (消した後のゴミの量の平均) * (検出したフレーム割合の逆数)
+		return (s.numFrames == 0) ? INFINITY :
+			(s.cost / s.numFrames) * (nframes / (float)s.numFrames);
+	}
+
 	template <typename pixel_t>
-	void ScanFrame(PVideoFrame& frame, float* memDeint, float* memWork, float maxv, EvalResult* outResult)
+	void ScanLogo(const PVideoFrame& frame, int logoIndex, float maxv, EvalResult& outResult)
 	{
 		const pixel_t* srcY = reinterpret_cast<const pixel_t*>(frame->GetReadPtr(PLANAR_Y));
 		int pitchY = frame->GetPitch(PLANAR_Y);
 
-		for (int i = 0; i < numLogos; ++i) {
-			LogoDataParam& logo = deintArr[i];
-			if (logo.isValid() == false ||
-				logo.getImgWidth() != vi.width ||
-				logo.getImgHeight() != vi.height)
-			{
-				outResult[i].corr0 = 0;
-				outResult[i].corr1 = -1;
-				continue;
-			}
+		LogoDataParam& logo = deintArr[logoIndex];
+		if (!logoEnabled[logoIndex] ||
+			logo.isValid() == false ||
+			logo.getImgWidth() != vi.width ||
+			logo.getImgHeight() != vi.height)
+		{
+			outResult.corr0 = 0;
+			outResult.corr1 = -1;
+			return;
+		}
 
-			// フレームをインタレ解除
-			int off = logo.getImgX() + logo.getImgY() * pitchY;
-			DeintY(memDeint, srcY + off, pitchY, logo.getWidth(), logo.getHeight());
+		// 作業領域は評価するスレッドのもの
+		ScratchArena::Scope scratch;
+		size_t YSize = logo.getWidth() * logo.getHeight();
+		float* memDeint = scratch.alloc<float>(YSize + 8);
+		float* memWork = scratch.alloc<float>(YSize + 8);
+
+		// フレームをインタレ解除
+		int off = logo.getImgX() + logo.getImgY() * pitchY;
+		DeintY(memDeint, srcY + off, pitchY, logo.getWidth(), logo.getHeight());
 
-			// ロゴ評価
-			outResult[i].corr0 = logo.EvaluateLogo(memDeint, maxv, 0, memWork);
-			outResult[i].corr1 = logo.EvaluateLogo(memDeint, maxv, 1, memWork);
+		// ロゴ評価
+		outResult.corr0 = logo.EvaluateLogo(memDeint, maxv, 0, memWork);
+		outResult.corr1 = logo.EvaluateLogo(memDeint, maxv, 1, memWork);
+	}
+
+	// まばらに取ったフレームで候補ロゴを評価して、スコアの良い上位pruneTopK個以外を評価対象から外す
+	// 戻り値: 絞り込みにかかった時間(秒)
+	template <typename pixel_t>
+	double PruneCandidates(PClip clip, IScriptEnvironment2* env, float maxv, int numWorkers)
+	{
+		Stopwatch sw;
+		sw.start();
+
+		int numSamples = std::min(vi.num_frames, (int)PRUNE_SAMPLE_FRAMES);
+		std::vector<PVideoFrame> frames;
+		for (int i = 0; i < numSamples; ++i) {
+			// 等間隔に取る（両端は避ける）
+			int n = (int)(((int64_t)vi.num_frames * (2 * i + 1)) / (2 * numSamples));
+			frames.push_back(clip->GetFrame(n, env));
+		}
+
+		std::vector<EvalResult> results(numSamples * numLogos);
+		{
+			ParallelTaskPool pool(numWorkers);
+			pool.run(numSamples * pruneCandidates, [&](int task, int worker) {
+				int f = task / pruneCandidates;
+				int i = task % pruneCandidates;
+				ScanLogo<pixel_t>(frames[f], i, maxv, results[f * numLogos + i]);
+			});
+		}
+
+		auto logoSummary = summarize(results.data(), numSamples, pruneCandidates);
+		std::vector<std::pair<float, int>> scores;
+		for (int i = 0; i < pruneCandidates; ++i) {
+			scores.emplace_back(calcLogoScore(logoSummary[i], numSamples), i);
+		}
+		std::stable_sort(scores.begin(), scores.end(),
+			[](const std::pair<float, int>& a, const std::pair<float, int>& b) { return a.first < b.first; });
+		// サンプルで1回も検出されなかった候補（INFINITY）同士は区別できないので、
+		// 検出された候補がpruneTopK個に満たなければ絞り込まない
+		int numDetected = (int)std::count_if(scores.begin(), scores.end(),
+			[](const std::pair<float, int>& s) { return std::isfinite(s.first); });
+		if (numDetected < pruneTopK) {
+			ctx.infoF("Logo candidates not pruned: only %d of %d detected in sample frames",
+				numDetected, pruneCandidates);
+			return sw.getAndReset();
+		}
+		// pruneTopK番目と同じスコアの候補は外さない
+		float border = scores[pruneTopK - 1].first;
+		for (int k = pruneTopK; k < pruneCandidates; ++k) {
+			if (scores[k].first > border) {
+				logoEnabled[scores[k].second] = false;
+			}
 		}
+
+		return sw.getAndReset();
 	}
 
+	// フレーム取得はこのスレッドで順番に行い、
+	// 取得済みフレームの評価（フレーム x ロゴ）をワーカーで並列に行う
+	// 各評価は独立しているので結果はスレッド数によらず同じ
 	template <typename pixel_t>
 	void IterateFrames(PClip clip, IScriptEnvironment2* env)
 	{
-		auto memDeint = std::unique_ptr<float[]>(new float[maxYSize + 8]);
-		auto memWork = std::unique_ptr<float[]>(new float[maxYSize + 8]);
 		float maxv = (float)((1 << vi.BitsPerComponent()) - 1);
 		evalResults = std::unique_ptr<EvalResult[]>(new EvalResult[vi.num_frames * numLogos]);
-		for (int n = 0; n < vi.num_frames; ++n) {
-			PVideoFrame frame = clip->GetFrame(n, env);
-			ScanFrame<pixel_t>(frame, memDeint.get(), memWork.get(), maxv, &evalResults[n * numLogos]);
 
-			if ((n % 5000) == 0) {
-				ctx.infoF("%6d/%d", n, vi.num_frames);
+		int numWorkers = (numThreads > 0) ? numThreads : ParallelTaskPool::getDefaultNumThreads();
+		ScratchArena::Stats scratchStart = ScratchArena::getStats();
+
+		logoEnabled.assign(numLogos, true);
+		double pruneTime = 0;
+		if (pruneTopK > 0 && pruneCandidates > pruneTopK) {
+			pruneTime = PruneCandidates<pixel_t>(clip, env, maxv, numWorkers);
+		}
+		int numEnabled = (int)std::count(logoEnabled.begin(), logoEnabled.end(), (uint8_t)true);
+		Stopwatch sw;
+		sw.start();
+
+		// 評価中に次のフレームを取得するため2つのバッチを交互に使う
+		const int batchFrames = BATCH_FRAMES_PER_THREAD * numWorkers;
+		std::vector<PVideoFrame> batch[2];
+		auto fetchBatch = [&](int start, std::vector<PVideoFrame>& frames) {
+			int end = std::min(vi.num_frames, start + batchFrames);
+			for (int n = start; n < end; ++n) {
+				frames.push_back(clip->GetFrame(n, env));
+				if ((n % 5000) == 0) {
+					ctx.infoF("%6d/%d", n, vi.num_frames);
+				}
 			}
+		};
+
+		// 例外で抜けた場合もワーカーが止まってからバッファを破棄するよう最後に作る
+		ParallelTaskPool pool(numWorkers);
+		int cur = 0;
+		fetchBatch(0, batch[cur]);
+		for (int start = 0; start < vi.num_frames; start += batchFrames) {
+			const std::vector<PVideoFrame>& frames = batch[cur];
+			pool.start((int)frames.size() * numLogos, [&, start](int task, int worker) {
+				int f = task / numLogos;
+				int i = task % numLogos;
+				ScanLogo<pixel_t>(frames[f], i, maxv, evalResults[(start + f) * numLogos + i]);
+			});
+			fetchBatch(start + batchFrames, batch[cur ^ 1]);
+			pool.wait();
+			batch[cur].clear();
+			cur ^= 1;
 		}
 		numFrames = vi.num_frames;
 		framesPerSec = (int)std::round((float)vi.fps_numerator / vi.fps_denominator);
 
+		if (numEnabled < numLogos) {
+			// 外したロゴも評価した場合の時間は評価したロゴ数に比例するとして見積もる
+			// （フレーム取得の時間も含むので多めに見積もられる）
+			double scanTime = sw.getAndReset();
+			double estimatedTime = scanTime * numLogos / std::max(1, numEnabled);
+			ctx.infoF("Logo candidates pruned %d -> %d: pre-pass %.2fs, saved %.2fs (estimated)",
+				pruneCandidates, pruneTopK, pruneTime, estimatedTime - scanTime - pruneTime);
+		}
+
+		ScratchArena::Stats scratchEnd = ScratchArena::getStats();
+		ctx.debugF("Scratch: %lld requests, %lld heap allocs",
+			scratchEnd.numRequests - scratchStart.numRequests,
+			scratchEnd.numHeapAllocs - scratchStart.numHeapAllocs);
+
 		ctx.info("Finished");
 	}
 
 public:
 	LogoFrame(AMTContext& ctx, const std::vector<tstring>& logofiles, float maskratio)
 		: AMTObject(ctx)
+		, numThreads(0)
 		, bestLogo(-1)
+		, pruneCandidates(0)
+		, pruneTopK(0)
 	{
 		numLogos = (int)logofiles.size();
 		logoArr = std::unique_ptr<LogoDataParam[]>(new LogoDataParam[logofiles.size()]);
@@ -1606,7 +2773,7 @@ public:
 				logoArr[i] = LogoDataParam(LogoData::Load(logofiles[i], &header), &header);
 				deintArr[i] = LogoDataParam(LogoData(header.w, header.h, header.logUVx, header.logUVy), &header);
 				DeintLogo(deintArr[i], logoArr[i], header.w, header.h);
-				deintArr[i].CreateLogoMask(maskratio);
+				deintArr[i].CreateLogoMask(maskratio, GetLogoMaskCachePath(logofiles[i], _T("deint")));
 
 				int YSize = header.w * header.h;
 				maxYSize = std::max(maxYSize, YSize);
@@ -1617,6 +2784,21 @@ public:
 		}
 	}
 
+	// 0ならプロセッサ数
+	void setNumThreads(int n)
+	{
+		numThreads = n;
+	}
+
+	// scanFramesで全フレームを評価する前に、まばらに取ったフレームで候補ロゴを絞り込む
+	// numCandidates: selectLogoに渡す候補数と同じ（これ以降のロゴは絞り込まずに全フレーム評価する）
+	// topK: 残す候補数（0なら絞り込まない。topK番目と同スコアの候補は残す）
+	void setCandidatePruning(int numCandidates, int topK)
+	{
+		pruneCandidates = std::min(numCandidates, numLogos);
+		pruneTopK = topK;
+	}
+
 	void scanFrames(PClip clip, IScriptEnvironment2* env)
 	{
 		vi = clip->GetVideoInfo();
@@ -1651,27 +2833,11 @@ public:
 		if (numCandidates < 0) {
 			numCandidates = numLogos;
 		}
-		struct Summary {
-			float cost;    // 消した後のゴミの量
-			int numFrames;  // 検出したフレーム数
-		};
-		std::vector<Summary> logoSummary(numCandidates);
-		for (int n = 0; n < numFrames; ++n) {
-			for (int i = 0; i < numCandidates; ++i) {
-				auto& r = evalResults[n * numLogos + i];
-				// ロゴを検出 かつ 消せてる
-				if (r.corr0 > THRESH && std::abs(r.corr1) < THRESH) {
-					logoSummary[i].numFrames++;
-					logoSummary[i].cost += std::abs(r.corr1);
-				}
-			}
-		}
+		std::vector<Summary> logoSummary = summarize(evalResults.get(), numFrames, numCandidates);
 		std::vector<float> logoScore(numCandidates);
 		for (int i = 0; i < numCandidates; ++i) {
 			auto& s = logoSummary[i];
-			// (消した後のゴミの量の平均) * (検出したフレーム割合の逆数)
-			logoScore[i] = (s.numFrames == 0) ? INFINITY :
-				(s.cost / s.numFrames) * (numFrames / (float)s.numFrames);
+			logoScore[i] = calcLogoScore(s, numFrames);
 #if 1
 			ctx.debugF("logo%d: %f * %f = %f", i + 1,
 				(s.cost / s.numFrames),
@@ -1712,6 +2878,10 @@ public:
 			auto& r = evalResults[n * numLogos + logoIndex];
 			// corr0のマイナスとcorr1のプラスはノイズなので消す
 			rawScores[n] = std::max(0.0f, r.corr0) + std::min(0.0f, r.corr1);
+			// NaNが入るとスライディングウィンドウの最大値・メディアンが壊れるのでロゴなし扱いにする
+			if (!std::isfinite(rawScores[n])) {
+				rawScores[n] = 0.0f;
+			}
 		}
 		// 両端を端の値で埋める
 		std::fill(rawScores_.begin(), rawScores, rawScores[0]);
@@ -1723,14 +2893,36 @@ public:
 		};
 
 		// フィルタで均す
+		// ウィンドウは1フレームずつずらすだけなので、最大値とメディアンは出入りする要素だけ更新する
+		// 移動平均は判定の境界で結果が変わらないように今まで通り毎回足す（O(w)なので重くない）
 		std::vector<FrameResult> frameResult(numFrames);
-		std::vector<float> medianBuf(medianFrames);
+		SlidingWindowMax<float> beforeMaxWin; // [i-halfAvgFrames,i)
+		SlidingWindowMax<float> afterMaxWin; // [i+1,i+1+halfAvgFrames)
+		SlidingWindowMedian<float> medianWin; // [i-halfMedianFrames,i+halfMedianFrames]
+		for (int j = -halfAvgFrames; j < 0; ++j) {
+			beforeMaxWin.push(j, rawScores[j]);
+		}
+		for (int j = 1; j < 1 + halfAvgFrames; ++j) {
+			afterMaxWin.push(j, rawScores[j]);
+		}
+		for (int j = -halfMedianFrames; j <= halfMedianFrames; ++j) {
+			medianWin.push(rawScores[j]);
+		}
 		for (int i = 0; i < numFrames; ++i) {
+			if (i > 0) {
+				beforeMaxWin.push(i - 1, rawScores[i - 1]);
+				beforeMaxWin.popBefore(i - halfAvgFrames);
+				afterMaxWin.push(i + halfAvgFrames, rawScores[i + halfAvgFrames]);
+				afterMaxWin.popBefore(i + 1);
+				medianWin.push(rawScores[i + halfMedianFrames]);
+				medianWin.pop(rawScores[i - halfMedianFrames - 1]);
+			}
+
 			// MinMax
 			// 前の最大値と後ろの最大値の小さい方を取る
 			// 動きの多い映像でロゴがかき消されることがあるので、それを救済する
-			float beforeMax = *std::max_element(rawScores + i - halfAvgFrames, rawScores + i);
-			float afterMax = *std::max_element(rawScores + i + 1, rawScores + i + 1 + halfAvgFrames);
+			float beforeMax = beforeMaxWin.get();
+			float afterMax = afterMaxWin.get();
 			float minMax = std::min(beforeMax, afterMax);
 			int minMaxResult = (std::abs(minMax) < threshL) ? 1 : (minMax < 0.0f) ? 0 : 2;
 
@@ -1745,10 +2937,7 @@ public:
 			frameResult[i].result = (minMaxResult != avgResult) ? 1 : minMaxResult;
 
 			// 生の値は動きが激しいので少しメディアンフィルタをかけておく
-			std::copy(rawScores + i - halfMedianFrames,
-				rawScores + i + halfMedianFrames + 1, medianBuf.begin());
-			std::sort(medianBuf.begin(), medianBuf.end());
-			frameResult[i].score = medianBuf[halfMedianFrames];
+			frameResult[i].score = medianWin.get();
 		}
 
 		// 不明部分を推測
@@ -7,8 +7,45 @@
 */
 #pragma once
 
+#include <intrin.h>
+#include <emmintrin.h>
+
 #include "StreamUtils.hpp"
 
+// ComputeKernel.cpp
+bool IsAVX2Available();
+int64_t FindTsSync_AVX2(const uint8_t* ptr, int64_t len, int numPacket);
+
+// ptr[pos + TS_PACKET_LENGTH * i] (0 <= i < numPacket) SēoCgɂȂŏposԂ
+// numPacket̃pPbgSĂʒuBȂ-1
+static int64_t FindTsSync_SSE2(const uint8_t* ptr, int64_t len, int numPacket) {
+	// posend
+	const int64_t end = len - (int64_t)TS_PACKET_LENGTH * numPacket + 1;
+	const __m128i sync = _mm_set1_epi8(TS_SYNC_BYTE);
+	int64_t pos = 0;
+	for (; pos + 16 <= end; pos += 16) {
+		__m128i m = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(ptr + pos)), sync);
+		for (int i = 1; i < numPacket && _mm_movemask_epi8(m); ++i) {
+			m = _mm_and_si128(m, _mm_cmpeq_epi8(
+				_mm_loadu_si128((const __m128i*)(ptr + pos + TS_PACKET_LENGTH * i)), sync));
+		}
+		int bits = _mm_movemask_epi8(m);
+		if (bits) {
+			unsigned long idx;
+			_BitScanForward(&idx, bits);
+			return pos + idx;
+		}
+	}
+	for (; pos < end; ++pos) {
+		int i = 0;
+		for (; i < numPacket; ++i) {
+			if (ptr[pos + TS_PACKET_LENGTH * i] != TS_SYNC_BYTE) break;
+		}
+		if (i == numPacket) return pos;
+	}
+	return -1;
+}
+
 /** @brief TSpPbg̃A_ve[VtB[h */
 struct AdapdationField : public MemoryChunk {
 	AdapdationField(uint8_t* data, int length) : MemoryChunk(data, length) { }
@@ -275,33 +312,43 @@ class TsPacketParser : public AMTObject {
 	enum {
 		// R[hTƂɃ`FbNpPbg
 		CHECK_PACKET_NUM = 8,
+		// onTsPacketBatchɂ܂Ƃ߂ēnőpPbg
+		BATCH_PACKET_NUM = 256,
 	};
 public:
 	TsPacketParser(AMTContext& ctx)
 		: AMTObject(ctx)
 		, syncOK(false)
-	{ }
+		, fastPath(true)
+		, useAVX2(IsAVX2Available())
+		, resetCount(0)
+		, inputBase(nullptr)
+		, inputOffset(0)
+		, bufferOffset(0)
+	{
+		batch.reserve(BATCH_PACKET_NUM);
+	}
 
 	/** @brief TSf[^ */
 	void inputTS(MemoryChunk data) {
+		inputBase = data.data;
+		inputTSBody(data);
+		inputOffset += data.length;
+	}
 
-		buffer.add(data);
-
-		if (syncOK) {
-			outPackets();
-		}
-		while (buffer.size() >= CHECK_PACKET_NUM*TS_PACKET_LENGTH) {
-			// `FbN̂ɏ\ȗʂ
-			if (checkSyncByte(buffer.ptr(), CHECK_PACKET_NUM)) {
-				syncOK = true;
-				outPackets();
-			}
-			else {
-				// _̂1oCgXLbv
-				syncOK = false;
-				buffer.trimHead(1);
-			}
+	/** @brief ؂肾ꂽpPbg̓͑Ŝ̐擪̈ʒu
+	* ptronTsPacket(Batch)ɓnꂽpPbg̃f[^iĂяôݗLj
+	*/
+	int64_t getPacketOffset(const uint8_t* ptr) const {
+		if (buffer.size() > 0 && ptr >= buffer.ptr() && ptr < buffer.ptr() + buffer.size()) {
+			return bufferOffset + (ptr - buffer.ptr());
 		}
+		return inputOffset + (ptr - inputBase);
+	}
+
+	/** @brief pXgifalseɂƏ]1pPbg̏ɂȂj */
+	void setFastPath(bool enable) {
+		fastPath = enable;
 	}
 
 	/** @brief obt@tbV */
@@ -311,10 +358,10 @@ public:
 			if (checkSyncByte(buffer.ptr(), 1))
 			{
 				checkAndOutPacket(MemoryChunk(buffer.ptr(), TS_PACKET_LENGTH));
-				buffer.trimHead(TS_PACKET_LENGTH);
+				trimBuffer(TS_PACKET_LENGTH);
 			}
 			else {
-				buffer.trimHead(1);
+				trimBuffer(1);
 			}
 		}
 	}
@@ -323,15 +370,174 @@ public:
 	void reset() {
 		buffer.clear();
 		syncOK = false;
+		++resetCount;
 	}
 
 protected:
 	/** @brief ؂肾ꂽTSpPbg */
 	virtual void onTsPacket(TsPacket packet) = 0;
 
+	/** @brief ؂肾ꂽTSpPbg܂Ƃ߂ď
+	* packets͓̓f[^𒼐ڎwĂ̂ŌĂяôݗL
+	* ftHgonTsPacketԂɌĂ
+	*/
+	virtual void onTsPacketBatch(TsPacket* packets, int num) {
+		int count = resetCount;
+		for (int i = 0; i < num; ++i) {
+			onTsPacket(packets[i]);
+			if (count != resetCount) {
+				// resetꂽĉ͎Ă
+				break;
+			}
+		}
+	}
+
 private:
 	AutoBuffer buffer;
 	bool syncOK;
+	bool fastPath;
+	bool useAVX2;
+	int resetCount;
+	std::vector<TsPacket> batch;
+
+	// pPbg̈ʒuvZp
+	const uint8_t* inputBase;  // ̓̓f[^
+	int64_t inputOffset;       // inputBasëʒu
+	int64_t bufferOffset;      // buffer̐擪̈ʒu
+
+	// bufferɓ͓̂̓f[^obt@̈ꕔȂ̂ňʒu͕K
+	void addBuffer(MemoryChunk data) {
+		if (buffer.size() == 0) {
+			bufferOffset = getPacketOffset(data.data);
+		}
+		buffer.add(data);
+	}
+
+	void trimBuffer(size_t length) {
+		buffer.trimHead(length);
+		bufferOffset += length;
+	}
+
+	void inputTSBody(MemoryChunk data) {
+		if (!fastPath) {
+			inputTSLegacy(data);
+			return;
+		}
+
+		if (buffer.size() > 0) {
+			// O̎cƂȂڕobt@ɃRs[ď
+			size_t bridge = std::min(data.length,
+				(size_t)(2 * CHECK_PACKET_NUM * TS_PACKET_LENGTH));
+			addBuffer(MemoryChunk(data.data, bridge));
+			int count = resetCount;
+			size_t consumed = processSpan(buffer.ptr(), buffer.size());
+			if (count != resetCount) {
+				// onTsPacketresetꂽ
+				return;
+			}
+			trimBuffer(consumed);
+			if (bridge == data.length) {
+				return;
+			}
+			// c͕KCHECK_PACKET_NUMpPbgȂ̂łȂڕɎ܂Ă
+			// -> ̓f[^̈ʒuɖ߂Ēڏ𑱂
+			size_t skip = bridge - buffer.size();
+			buffer.clear();
+			data.data += skip;
+			data.length -= skip;
+		}
+
+		// ̓f[^璼ڃpPbg؂oiRs[Ȃj
+		int count = resetCount;
+		size_t consumed = processSpan(data.data, data.length);
+		if (count != resetCount) {
+			return;
+		}
+		if (consumed < data.length) {
+			addBuffer(MemoryChunk(data.data + consumed, data.length - consumed));
+		}
+	}
+
+	int64_t findSync(const uint8_t* ptr, size_t len) {
+		if (useAVX2) {
+			return FindTsSync_AVX2(ptr, (int64_t)len, CHECK_PACKET_NUM);
+		}
+		return FindTsSync_SSE2(ptr, (int64_t)len, CHECK_PACKET_NUM);
+	}
+
+	// ptrlenoCgďoCgԂ
+	// Ȃ͎̓͂ƂȂďKv
+	// 1oCg炵ēTSIMDňCɂȊOinputTSLegacyƓ
+	size_t processSpan(uint8_t* ptr, size_t len) {
+		const size_t checkLength = CHECK_PACKET_NUM * TS_PACKET_LENGTH;
+		int count = resetCount;
+		size_t pos = 0;
+		if (syncOK) {
+			pos = outPacketsBatch(ptr, pos, len);
+			if (count != resetCount) return len;
+		}
+		while (len - pos >= checkLength) {
+			int64_t found = findSync(ptr + pos, len - pos);
+			if (found < 0) {
+				// Ȃ̂Ń`FbNłȂƂ܂ŃXLbv
+				syncOK = false;
+				pos = len - checkLength + 1;
+			}
+			else {
+				syncOK = true;
+				pos = outPacketsBatch(ptr, pos + (size_t)found, len);
+				if (count != resetCount) return len;
+			}
+		}
+		return pos;
+	}
+
+	// outPacketsƓBATCH_PACKET_NUM܂Ƃ߂ďo͂
+	size_t outPacketsBatch(uint8_t* ptr, size_t pos, size_t len) {
+		int count = resetCount;
+		bool cont = true;
+		while (cont) {
+			batch.clear();
+			while ((int)batch.size() < BATCH_PACKET_NUM) {
+				if (len - pos < 2 * TS_PACKET_LENGTH || !checkSyncByte(ptr + pos, 2)) {
+					cont = false;
+					break;
+				}
+				TsPacket packet(ptr + pos);
+				if (packet.parse() && packet.check()) {
+					batch.push_back(packet);
+				}
+				pos += TS_PACKET_LENGTH;
+			}
+			if (batch.size() > 0) {
+				onTsPacketBatch(batch.data(), (int)batch.size());
+				if (count != resetCount) return len;
+			}
+		}
+		return pos;
+	}
+
+	// ]̏
+	void inputTSLegacy(MemoryChunk data) {
+
+		addBuffer(data);
+
+		if (syncOK) {
+			outPackets();
+		}
+		while (buffer.size() >= CHECK_PACKET_NUM*TS_PACKET_LENGTH) {
+			// `FbN̂ɏ\ȗʂ
+			if (checkSyncByte(buffer.ptr(), CHECK_PACKET_NUM)) {
+				syncOK = true;
+				outPackets();
+			}
+			else {
+				// _̂1oCgXLbv
+				syncOK = false;
+				trimBuffer(1);
+			}
+		}
+	}
 
 	// numPacket̃pPbg̓oCgĂ邩`FbN
 	bool checkSyncByte(uint8_t* ptr, int numPacket) {
@@ -350,7 +556,7 @@ private:
 		{
 			checkAndOutPacket(MemoryChunk(buffer.ptr(), TS_PACKET_LENGTH));
 			// onTsPacketresetĂ΂邩Ȃ̂Œ
-			buffer.trimHead(TS_PACKET_LENGTH);
+			trimBuffer(TS_PACKET_LENGTH);
 		}
 	}
 
@@ -370,7 +576,17 @@ public:
 
 class PesParser : public TsPacketHandler {
 public:
-	PesParser() : contCounter(0) {}
+	PesParser() : contCounter(0), packetTag(-1), pesTag(-1) {}
+
+	/** @brief ɓ͂TSpPbg̃^Oit@CʒuȂǁjZbg */
+	void setPacketTag(int64_t tag) {
+		packetTag = tag;
+	}
+
+	/** @brief o͒PESpPbg̍ŏTSpPbg̃^OionPesPacket̒Ŏgj */
+	int64_t getPesTag() const {
+		return pesTag;
+	}
 
 	/** @brief TSpPbg(`FbNς) */
 	virtual void onTsPacket(int64_t clock, TsPacket packet) {
@@ -397,6 +613,9 @@ public:
 			}
 
 			MemoryChunk payload = packet.payload();
+			if (buffer.size() == 0) {
+				pesTag = packetTag;
+			}
 			buffer.add(payload);
 
 			// `FbN
@@ -408,6 +627,7 @@ public:
 					// pPbg̃XgA
 					checkAndOutPacket(clock, MemoryChunk(buffer.ptr(), lengthIncludeHeader));
 					buffer.trimHead(lengthIncludeHeader);
+					pesTag = packetTag;
 				}
 			}
 		}
@@ -419,6 +639,8 @@ protected:
 private:
 	AutoBuffer buffer;
 	int contCounter;
+	int64_t packetTag;
+	int64_t pesTag;
 
 	// pPbg`FbNďo
 	void checkAndOutPacket(int64_t clock, MemoryChunk data) {
@@ -13,7 +13,10 @@
 #include <deque>
 #include <string>
 #include <mutex>
+#include <atomic>
 #include <condition_variable>
+#include <functional>
+#include <exception>
 
 #include "StreamUtils.hpp"
 #include "PerformanceUtil.hpp"
@@ -78,6 +81,8 @@ public:
 		, current_(0)
 		, finished_(false)
 		, error_(false)
+		, numProducerWaits_(0)
+		, numConsumerWaits_(0)
 	{ }
 
 	~DataPumpThread() {
@@ -96,6 +101,7 @@ public:
 			THROW(InvalidOperationException, "DataPumpThread is already finished");
 		}
 		while (current_ >= maximum_) {
+			++numProducerWaits_;
 			if (PERF) producer.start();
 			cond_full_.wait(lock);
 			if (PERF) producer.stop();
@@ -125,11 +131,20 @@ public:
 
 	bool isRunning() { return ThreadBase::isRunning(); }
 
+	// OnDataReceivedŗO
+	bool isError() const { return error_; }
+
 	void getTotalWait(double& prod, double& cons) {
 		prod = producer.getTotal();
 		cons = consumer.getTotal();
 	}
 
+	// ҂ɓ
+	void getNumWaits(int64_t& prod, int64_t& cons) {
+		prod = numProducerWaits_;
+		cons = numConsumerWaits_;
+	}
+
 protected:
 	virtual void OnDataReceived(T&& data) = 0;
 
@@ -146,6 +161,9 @@ private:
 	bool finished_;
 	bool error_;
 
+	int64_t numProducerWaits_;
+	int64_t numConsumerWaits_;
+
 	Stopwatch producer;
 	Stopwatch consumer;
 
@@ -158,6 +176,7 @@ private:
 				while (data_.size() == 0) {
 					// data_.size()==0finished_ȂI
 					if (finished_ || error_) return;
+					++numConsumerWaits_;
 					if (PERF) consumer.start();
 					cond_empty_.wait(lock);
 					if (PERF) consumer.stop();
@@ -183,6 +202,440 @@ private:
 	}
 };
 
+// DataPumpThread̃VOvf[TEVORV[}
+// put()͏ɓ1̃XbhĂԂ
+// L[̓bNt[̃Oobt@ŁA҂ꍇ͂΂炭XsĂQ
+// iXs񐔂̓XsɃf[^ǂŒj
+template <typename T, bool PERF = false>
+class SpscDataPumpThread : private ThreadBase
+{
+public:
+	// capacity: Oobt@̗vfi0Ȃő1024maximumɍ킹j
+	SpscDataPumpThread(size_t maximum, size_t capacity = 0)
+		: maximum_(maximum)
+		, current_(0)
+		, head_(0)
+		, tail_(0)
+		, finished_(false)
+		, error_(false)
+		, producerSleeping_(false)
+		, consumerSleeping_(false)
+		, producerSpin_(MIN_SPIN)
+		, consumerSpin_(MIN_SPIN)
+		, numProducerWaits_(0)
+		, numConsumerWaits_(0)
+	{
+		size_t slots = 2;
+		size_t required = (capacity > 0) ? capacity : std::min<size_t>(maximum, 1024);
+		while (slots < required) {
+			slots <<= 1;
+		}
+		ring_.resize(slots);
+		mask_ = slots - 1;
+	}
+
+	~SpscDataPumpThread() {
+		if (isRunning()) {
+			THROW(InvalidOperationException, "call join() before destroy object ...");
+		}
+	}
+
+	void put(T&& data, size_t amount)
+	{
+		if (error_) {
+			THROW(RuntimeException, "DataPumpThread error");
+		}
+		if (finished_) {
+			THROW(InvalidOperationException, "DataPumpThread is already finished");
+		}
+		size_t tail = tail_.load(std::memory_order_relaxed);
+		auto canPut = [&]() {
+			return (tail - head_.load() <= mask_ && current_.load() < maximum_) || error_;
+		};
+		if (!canPut()) {
+			if (PERF) producer.start();
+			waitFor(canPut, producerSleeping_, condProducer_, producerSpin_, numProducerWaits_);
+			if (PERF) producer.stop();
+			if (error_) {
+				THROW(RuntimeException, "DataPumpThread error");
+			}
+		}
+		Slot& slot = ring_[tail & mask_];
+		slot.data = std::move(data);
+		slot.amount = amount;
+		current_ += amount;
+		tail_.store(tail + 1);
+		wake(consumerSleeping_, condConsumer_);
+	}
+
+	void start() {
+		finished_ = false;
+		producer.reset();
+		consumer.reset();
+		ThreadBase::start();
+	}
+
+	void join() {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			finished_ = true;
+			condConsumer_.notify_one();
+		}
+		ThreadBase::join();
+	}
+
+	bool isRunning() { return ThreadBase::isRunning(); }
+
+	// OnDataReceivedŗO
+	bool isError() const { return error_; }
+
+	void getTotalWait(double& prod, double& cons) {
+		prod = producer.getTotal();
+		cons = consumer.getTotal();
+	}
+
+	// Q񐔁iXsɏꂽꍇ͊܂܂Ȃj
+	void getNumWaits(int64_t& prod, int64_t& cons) {
+		prod = numProducerWaits_;
+		cons = numConsumerWaits_;
+	}
+
+protected:
+	virtual void OnDataReceived(T&& data) = 0;
+
+private:
+	enum {
+		MIN_SPIN = 64,
+		MAX_SPIN = 16 * 1024,
+		NUM_YIELD = 4,
+	};
+
+	struct Slot {
+		T data;
+		size_t amount;
+	};
+
+	std::vector<Slot> ring_;
+	size_t mask_;
+	size_t maximum_;
+	std::atomic<size_t> current_;
+
+	// vf[TƃRV[}ʁXɏނ̂ŕʂ̃LbVCɒu
+	char pad0_[64];
+	std::atomic<size_t> head_; // RV[}
+	char pad1_[64];
+	std::atomic<size_t> tail_; // vf[T
+	char pad2_[64];
+
+	std::atomic<bool> finished_;
+	std::atomic<bool> error_;
+
+	std::mutex mutex_;
+	std::condition_variable condProducer_;
+	std::condition_variable condConsumer_;
+	std::atomic<bool> producerSleeping_;
+	std::atomic<bool> consumerSleeping_;
+
+	int producerSpin_;
+	int consumerSpin_;
+	int64_t numProducerWaits_;
+	int64_t numConsumerWaits_;
+
+	Stopwatch producer;
+	Stopwatch consumer;
+
+	// 葤̃f[^ύXseq_cstŏ܂Ă̂
+	// sleepingtO𗧂ĂĂĊmF΋NR͂Ȃ
+	template <typename Pred>
+	void waitFor(Pred pred, std::atomic<bool>& sleeping,
+		std::condition_variable& cond, int& spin, int64_t& numWaits)
+	{
+		for (int i = 0; i < spin; ++i) {
+			if (pred()) {
+				spin = std::min<int>(spin * 2, MAX_SPIN);
+				return;
+			}
+			YieldProcessor();
+		}
+		for (int i = 0; i < NUM_YIELD; ++i) {
+			if (pred()) return;
+			SwitchToThread();
+		}
+		spin = std::max<int>(spin / 2, MIN_SPIN);
+		std::unique_lock<std::mutex> lock(mutex_);
+		sleeping = true;
+		while (!pred()) {
+			++numWaits;
+			cond.wait(lock);
+		}
+		sleeping = false;
+	}
+
+	void wake(std::atomic<bool>& sleeping, std::condition_variable& cond) {
+		if (sleeping) {
+			std::lock_guard<std::mutex> lock(mutex_);
+			cond.notify_one();
+		}
+	}
+
+	virtual void run()
+	{
+		while (true) {
+			size_t head = head_.load(std::memory_order_relaxed);
+			auto canGet = [&]() {
+				return tail_.load() != head || finished_ || error_;
+			};
+			if (!canGet()) {
+				if (PERF) consumer.start();
+				waitFor(canGet, consumerSleeping_, condConsumer_, consumerSpin_, numConsumerWaits_);
+				if (PERF) consumer.stop();
+			}
+			if (tail_.load() == head) {
+				// f[^Ȃfinished_ȂI
+				if (finished_ || error_) return;
+				continue;
+			}
+			Slot& slot = ring_[head & mask_];
+			T data = std::move(slot.data);
+			size_t amount = slot.amount;
+			current_ -= amount;
+			head_.store(head + 1);
+			wake(producerSleeping_, condProducer_);
+			if (error_ == false) {
+				try {
+					OnDataReceived(std::move(data));
+				}
+				catch (Exception&) {
+					error_ = true;
+					// QĂvf[TɃG[ʒm
+					wake(producerSleeping_, condProducer_);
+				}
+			}
+		}
+	}
+};
+
+// t@C݂ʃXbhōs
+// ݂͂܂Ƃ߂ĂXbhɓn
+// 1̃XbhĂԌ菑ݏ͕ێ
+class AsyncFileWriter : private DataPumpThread<std::pair<const File*, std::vector<uint8_t>>>
+{
+	typedef std::pair<const File*, std::vector<uint8_t>> Item;
+public:
+	AsyncFileWriter(size_t chunkSize = 1024 * 1024, size_t maxPending = 32 * 1024 * 1024)
+		: DataPumpThread(maxPending)
+		, chunkSize_(chunkSize)
+		, current_(nullptr)
+	{ }
+
+	void start() {
+		DataPumpThread::start();
+	}
+
+	// filejoin()܂ŔjȂ
+	void write(const File& file, MemoryChunk mc) {
+		if (current_ != &file) {
+			flushBuffer();
+			current_ = &file;
+		}
+		buffer_.insert(buffer_.end(), mc.data, mc.data + mc.length);
+		if (buffer_.size() >= chunkSize_) {
+			flushBuffer();
+		}
+	}
+
+	// cSďŃXbhI
+	// ݂ɎsĂĂXbh͕KIĂO𓊂
+	void join() {
+		try {
+			flushBuffer();
+		}
+		catch (const Exception&) {
+			// XbhŃG[NĂputO𓊂iisError()ŏEj
+			buffer_.clear();
+		}
+		current_ = nullptr;
+		DataPumpThread::join();
+		if (isError()) {
+			THROW(IOException, "t@C݂Ɏs");
+		}
+	}
+
+	bool isRunning() { return DataPumpThread::isRunning(); }
+
+protected:
+	virtual void OnDataReceived(Item&& data) {
+		data.first->write(MemoryChunk(data.second.data(), data.second.size()));
+	}
+
+private:
+	size_t chunkSize_;
+	const File* current_;
+	std::vector<uint8_t> buffer_;
+
+	void flushBuffer() {
+		if (buffer_.size() > 0) {
+			size_t amount = buffer_.size();
+			put(Item(current_, std::move(buffer_)), amount);
+			buffer_ = std::vector<uint8_t>();
+			buffer_.reserve(chunkSize_);
+		}
+	}
+};
+
+// Œ萔̃[J[XbhŃ^XN0`numTasks-1Ɏs
+// e[J[͋LJE^玟̃^XN̂ŁAI[J[c󂯂
+// ^XN֐ɂ̓[J[ԍn̂ŁA[J[̍Ɨ̈g
+class ParallelTaskPool : NonCopyable
+{
+public:
+	typedef std::function<void(int taskIndex, int workerIndex)> TaskFunc;
+
+	// numThreads <= 0 ȂvZbT
+	ParallelTaskPool(int numThreads = 0)
+		: finished_(false)
+		, generation_(0)
+		, numTasks_(0)
+		, numRunning_(0)
+		, nextTask_(0)
+		, failed_(false)
+	{
+		if (numThreads <= 0) {
+			numThreads = getDefaultNumThreads();
+		}
+		for (int i = 0; i < numThreads; ++i) {
+			workers_.emplace_back(new Worker(this, i));
+		}
+		for (auto& w : workers_) {
+			w->start();
+		}
+	}
+
+	~ParallelTaskPool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			finished_ = true;
+			condStart_.notify_all();
+		}
+		for (auto& w : workers_) {
+			w->join();
+		}
+	}
+
+	static int getDefaultNumThreads() {
+		SYSTEM_INFO si;
+		GetSystemInfo(&si);
+		return std::max(1, (int)si.dwNumberOfProcessors);
+	}
+
+	int getNumThreads() const {
+		return (int)workers_.size();
+	}
+
+	// ^XNJnĖ߂Bfuncwait()߂܂ŗLł邱
+	void start(int numTasks, TaskFunc func) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (numRunning_ > 0) {
+			THROW(InvalidOperationException, "previous tasks are still running");
+		}
+		func_ = std::move(func);
+		numTasks_ = numTasks;
+		nextTask_ = 0;
+		failed_ = false;
+		error_ = nullptr;
+		numRunning_ = (int)workers_.size();
+		++generation_;
+		condStart_.notify_all();
+	}
+
+	// start()^XNSďI܂ő҂
+	// ^XNŗOꍇ͎c̃^XNsɂ̗O𓊂
+	void wait() {
+		std::exception_ptr error;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			while (numRunning_ > 0) {
+				condDone_.wait(lock);
+			}
+			func_ = nullptr;
+			std::swap(error, error_);
+		}
+		if (error) {
+			std::rethrow_exception(error);
+		}
+	}
+
+	void run(int numTasks, TaskFunc func) {
+		start(numTasks, std::move(func));
+		wait();
+	}
+
+private:
+	class Worker : public ThreadBase {
+	public:
+		Worker(ParallelTaskPool* pool, int index) : pool_(pool), index_(index) { }
+	protected:
+		virtual void run() {
+			pool_->workerMain(index_);
+		}
+	private:
+		ParallelTaskPool* pool_;
+		int index_;
+	};
+
+	std::vector<std::unique_ptr<Worker>> workers_;
+
+	std::mutex mutex_;
+	std::condition_variable condStart_;
+	std::condition_variable condDone_;
+	bool finished_;
+	int generation_;
+	TaskFunc func_;
+	int numTasks_;
+	int numRunning_;
+	std::atomic<int> nextTask_;
+	std::atomic<bool> failed_;
+	std::exception_ptr error_;
+
+	void workerMain(int index) {
+		int generation = 0;
+		while (true) {
+			{
+				std::unique_lock<std::mutex> lock(mutex_);
+				while (generation_ == generation && !finished_) {
+					condStart_.wait(lock);
+				}
+				if (finished_) {
+					return;
+				}
+				generation = generation_;
+			}
+			while (!failed_) {
+				int task = nextTask_++;
+				if (task >= numTasks_) {
+					break;
+				}
+				try {
+					func_(task, index);
+				}
+				catch (...) {
+					std::lock_guard<std::mutex> lock(mutex_);
+					if (!error_) {
+						error_ = std::current_exception();
+					}
+					failed_ = true;
+				}
+			}
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				if (--numRunning_ == 0) {
+					condDone_.notify_all();
+				}
+			}
+		}
+	}
+};
+
 class SubProcess
 {
 public:
@@ -236,12 +689,37 @@ public:
 			THROW(RuntimeException, "failed to write to stdin pipe (bytes written mismatch)");
 		}
 	}
+	// ̗̈ɏ
+	// pCvɂWriteFileGathergȂ̂ŁÄ͂܂Ƃ߂Ă珑݁A
+	// 傫̈͂̂܂܏
+	void write(const MemoryChunk* chunks, int numChunks) {
+		for (int i = 0; i < numChunks; ++i) {
+			const MemoryChunk& mc = chunks[i];
+			if (mc.length >= GATHER_DIRECT_SIZE) {
+				flushGather();
+				write(mc);
+			}
+			else {
+				if (gatherBuffer_.size() + mc.length > GATHER_BUFFER_SIZE) {
+					flushGather();
+				}
+				if (gatherBuffer_.capacity() < GATHER_BUFFER_SIZE) {
+					gatherBuffer_.reserve(GATHER_BUFFER_SIZE);
+				}
+				gatherBuffer_.insert(gatherBuffer_.end(), mc.data, mc.data + mc.length);
+			}
+		}
+		flushGather();
+	}
 	size_t readErr(MemoryChunk mc) {
 		return readGeneric(mc, stdErrPipe_.readHandle);
 	}
 	size_t readOut(MemoryChunk mc) {
 		return readGeneric(mc, stdOutPipe_.readHandle);
 	}
+	HANDLE getProcessHandle() const {
+		return pi_.hProcess;
+	}
 	void finishWrite() {
 		stdInPipe_.closeWrite();
 	}
@@ -291,11 +769,24 @@ private:
 		HANDLE writeHandle;
 	};
 
+	enum {
+		GATHER_DIRECT_SIZE = 64 * 1024,
+		GATHER_BUFFER_SIZE = 1024 * 1024,
+	};
+
 	PROCESS_INFORMATION pi_ = PROCESS_INFORMATION();
 	Pipe stdErrPipe_;
 	Pipe stdOutPipe_;
 	Pipe stdInPipe_;
 	DWORD exitCode_;
+	std::vector<uint8_t> gatherBuffer_;
+
+	void flushGather() {
+		if (gatherBuffer_.size() > 0) {
+			write(MemoryChunk(gatherBuffer_.data(), gatherBuffer_.size()));
+			gatherBuffer_.clear();
+		}
+	}
 
 	size_t readGeneric(MemoryChunk mc, HANDLE readHandle)
 	{
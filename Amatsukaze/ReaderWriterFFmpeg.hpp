@@ -135,6 +135,61 @@ private:
 	AVCodecContext *ctx_;
 };
 
+// t@CȊOǂݍނƂɎg
+class ReadIOContext : NonCopyable {
+public:
+	ReadIOContext(int bufsize)
+		: ctx_()
+		, pos_()
+	{
+		unsigned char* buffer = (unsigned char*)av_malloc(bufsize);
+		ctx_ = avio_alloc_context(buffer, bufsize, 0, this, read_packet_, NULL, seek_);
+	}
+	~ReadIOContext() {
+		av_free(ctx_->buffer);
+		av_free(ctx_);
+	}
+	AVIOContext* operator()() {
+		return ctx_;
+	}
+protected:
+	// posősizeoCgǂœǂ񂾃oCgԂiI[Ȃ0j
+	virtual int onRead(int64_t pos, uint8_t* buf, int size) = 0;
+	virtual int64_t getSize() = 0;
+private:
+	AVIOContext* ctx_;
+	int64_t pos_;
+	static int read_packet_(void *opaque, uint8_t *buf, int buf_size) {
+		ReadIOContext* this_ = (ReadIOContext*)opaque;
+		try {
+			int ret = this_->onRead(this_->pos_, buf, buf_size);
+			if (ret <= 0) {
+				return AVERROR_EOF;
+			}
+			this_->pos_ += ret;
+			return ret;
+		}
+		catch (const Exception&) {
+			// FFmpeg̒OŔȂ̂ŃG[ŕԂ
+			return AVERROR(EIO);
+		}
+	}
+	static int64_t seek_(void *opaque, int64_t offset, int whence) {
+		ReadIOContext* this_ = (ReadIOContext*)opaque;
+		switch (whence & ~AVSEEK_FORCE) {
+		case AVSEEK_SIZE: return this_->getSize();
+		case SEEK_SET: break;
+		case SEEK_CUR: offset += this_->pos_; break;
+		case SEEK_END: offset += this_->getSize(); break;
+		default: return -1;
+		}
+		if (offset < 0) {
+			return -1;
+		}
+		return this_->pos_ = offset;
+	}
+};
+
 class InputContext : NonCopyable {
 public:
 	InputContext(const tstring& src)
@@ -144,6 +199,20 @@ public:
 			THROW(IOException, "failed avformat_open_input");
 		}
 	}
+	// ioCtxǂށBioCtx͂蒷邱
+	InputContext(ReadIOContext& ioCtx, const char* format)
+		: ctx_()
+	{
+		ctx_ = avformat_alloc_context();
+		if (ctx_ == NULL) {
+			THROW(IOException, "failed avformat_alloc_context");
+		}
+		ctx_->pb = ioCtx();
+		// sctx_͉
+		if (avformat_open_input(&ctx_, NULL, av_find_input_format(format), NULL) != 0) {
+			THROW(IOException, "failed avformat_open_input");
+		}
+	}
 	~InputContext() {
 		avformat_close_input(&ctx_);
 	}
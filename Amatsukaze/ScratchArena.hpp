@@ -0,0 +1,211 @@
+/**
+* Thread local scratch memory
+* Copyright (c) 2017-2019 Nekopanda
+*
+* This software is released under the MIT License.
+* http://opensource.org/licenses/mit-license.php
+*/
+#pragma once
+
+#include <malloc.h>
+
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <algorithm>
+
+#include "CoreUtils.hpp"
+
+// Xbh̍Ɨ̈
+// tB^GetFramê悤ɓ傫̈ꎞobt@𖈉gŁA
+// XbhԂŋLq[vGȂ悤ɂ邽߂̂
+// ScratchArena::ScopeŊmۂ̈Scope𔲂Ɖi̊mۂōėpj
+// Scope͓qɂł邪AXbhō쐬Ƌtɔj邱
+class ScratchArena : NonCopyable
+{
+public:
+	enum { ALIGN = 64 };
+
+	// SXbh̍vivpj
+	struct Stats {
+		int64_t numRequests; // alloc()̌Ăяo
+		int64_t numHeapAllocs; // q[vmۂ
+		int64_t peakBytes; // 1XbhœɎgőoCg
+	};
+
+	class Scope : NonCopyable
+	{
+	public:
+		Scope()
+			: arena_(current())
+			, chunk_(arena_.chunk_)
+			, offset_(arena_.offset_)
+			, used_(arena_.used_)
+		{ }
+		~Scope() {
+			arena_.release(chunk_, offset_, used_);
+		}
+		// ALIGNoCgEɑvfn̗̈i͂Ȃj
+		template <typename T>
+		T* alloc(size_t n) {
+			return static_cast<T*>(arena_.allocate(n * sizeof(T)));
+		}
+	private:
+		ScratchArena& arena_;
+		size_t chunk_;
+		size_t offset_;
+		size_t used_;
+	};
+
+	// JE^̓XbhɎĂ̂ŁAőSXbhv
+	static Stats getStats() {
+		Registry& r = registry();
+		std::lock_guard<std::mutex> lock(r.mutex);
+		Stats stats = r.retired;
+		for (ScratchArena* arena : r.arenas) {
+			stats.numRequests += arena->counters_.numRequests.load(std::memory_order_relaxed);
+			stats.numHeapAllocs += arena->counters_.numHeapAllocs.load(std::memory_order_relaxed);
+			stats.peakBytes = std::max(stats.peakBytes, arena->counters_.peakBytes.load(std::memory_order_relaxed));
+		}
+		return stats;
+	}
+
+	// ̃XbhmۂĂȂƂɌĂԂ
+	static void resetStats() {
+		Registry& r = registry();
+		std::lock_guard<std::mutex> lock(r.mutex);
+		r.retired = Stats();
+		for (ScratchArena* arena : r.arenas) {
+			arena->counters_.numRequests.store(0, std::memory_order_relaxed);
+			arena->counters_.numHeapAllocs.store(0, std::memory_order_relaxed);
+			arena->counters_.peakBytes.store(0, std::memory_order_relaxed);
+		}
+	}
+
+	// ̃Xbh̍Ɨ̈
+	static ScratchArena& current() {
+		thread_local ScratchArena arena;
+		return arena;
+	}
+
+	~ScratchArena() {
+		for (auto& chunk : chunks_) {
+			_aligned_free(chunk.data);
+		}
+		// IXbh͍̕vɑĂ
+		Registry& r = registry();
+		std::lock_guard<std::mutex> lock(r.mutex);
+		r.retired.numRequests += counters_.numRequests.load(std::memory_order_relaxed);
+		r.retired.numHeapAllocs += counters_.numHeapAllocs.load(std::memory_order_relaxed);
+		r.retired.peakBytes = std::max(r.retired.peakBytes, counters_.peakBytes.load(std::memory_order_relaxed));
+		r.arenas.erase(std::find(r.arenas.begin(), r.arenas.end(), this));
+	}
+
+private:
+	struct Chunk {
+		uint8_t* data;
+		size_t size;
+	};
+	// ̃XbȟvpJE^
+	// ނ̂͂̃XbhȂ̂ŁigetStatsőXbhǂނ߂atomicɂĂ邾j
+	// read-modify-write͂relaxedœǂݏiXbhԂŃLbVC荇Ȃj
+	struct Counters {
+		std::atomic<int64_t> numRequests;
+		std::atomic<int64_t> numHeapAllocs;
+		std::atomic<int64_t> peakBytes;
+	};
+
+	// ĂSXbh̍Ɨ̈ƁAIXbh̃JE^̍v
+	struct Registry {
+		std::mutex mutex;
+		std::vector<ScratchArena*> arenas;
+		Stats retired;
+		Registry() : retired() { }
+	};
+
+	std::vector<Chunk> chunks_;
+	size_t chunk_; // gp̃`N
+	size_t offset_; // gp̃`N̎̊mۈʒu
+	size_t used_; // gp̃oCg
+	Counters counters_;
+
+	ScratchArena()
+		: chunk_(0)
+		, offset_(0)
+		, used_(0)
+	{
+		counters_.numRequests.store(0, std::memory_order_relaxed);
+		counters_.numHeapAllocs.store(0, std::memory_order_relaxed);
+		counters_.peakBytes.store(0, std::memory_order_relaxed);
+		Registry& r = registry();
+		std::lock_guard<std::mutex> lock(r.mutex);
+		r.arenas.push_back(this);
+	}
+
+	static Registry& registry() {
+		static Registry r;
+		return r;
+	}
+
+	static void increment(std::atomic<int64_t>& counter) {
+		counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+
+	uint8_t* allocChunk(size_t size) {
+		uint8_t* data = static_cast<uint8_t*>(_aligned_malloc(size, ALIGN));
+		if (data == nullptr) {
+			THROWF(RuntimeException, "failed to allocate scratch memory (%zu bytes)", size);
+		}
+		increment(counters_.numHeapAllocs);
+		return data;
+	}
+
+	void* allocate(size_t bytes) {
+		bytes = (std::max<size_t>(bytes, 1) + ALIGN - 1) & ~(size_t)(ALIGN - 1);
+		increment(counters_.numRequests);
+		while (chunk_ < chunks_.size() && offset_ + bytes > chunks_[chunk_].size) {
+			++chunk_;
+			offset_ = 0;
+		}
+		if (chunk_ == chunks_.size()) {
+			// Ȃ̂ŒǉivŔ{ɂȂ悤Ɂj
+			size_t capacity = 0;
+			for (auto& chunk : chunks_) {
+				capacity += chunk.size;
+			}
+			Chunk chunk = { nullptr, std::max(bytes, capacity) };
+			chunk.data = allocChunk(chunk.size);
+			chunks_.push_back(chunk);
+			offset_ = 0;
+		}
+		void* ptr = chunks_[chunk_].data + offset_;
+		offset_ += bytes;
+		used_ += bytes;
+		updatePeak((int64_t)used_);
+		return ptr;
+	}
+
+	void release(size_t chunk, size_t offset, size_t used) {
+		chunk_ = chunk;
+		offset_ = offset;
+		used_ = used;
+		if (used_ == 0 && chunks_.size() > 1) {
+			// S󂢂1̃`Nɂ܂Ƃ߂āA͒ǉȂŎ܂悤ɂ
+			size_t capacity = 0;
+			for (auto& c : chunks_) {
+				capacity += c.size;
+				_aligned_free(c.data);
+			}
+			chunks_.clear();
+			Chunk c = { nullptr, capacity };
+			c.data = allocChunk(capacity);
+			chunks_.push_back(c);
+		}
+	}
+
+	void updatePeak(int64_t bytes) {
+		if (counters_.peakBytes.load(std::memory_order_relaxed) < bytes) {
+			counters_.peakBytes.store(bytes, std::memory_order_relaxed);
+		}
+	}
+};
@@ -0,0 +1,227 @@
+/**
+* Shared memory frame ring
+* Copyright (c) 2017-2019 Nekopanda
+*
+* This software is released under the MIT License.
+* http://opensource.org/licenses/mit-license.php
+*/
+#pragma once
+
+#include <Windows.h>
+
+#include "StreamUtils.hpp"
+
+// GR[_vZXւ̃t[]p L̃Oobt@
+// Ott@C}bsOɃXbgׂ1Xbg1t[
+// ͋L̏/ǂݍݍς݃Xbg2̃Cxgōs
+// i"<O>_data": ݑǂݍݑ, "<O>_space": ǂݍݑݑj
+class SharedFrameRingBase : NonCopyable
+{
+public:
+	~SharedFrameRingBase() {
+		if (header_ != NULL) {
+			UnmapViewOfFile(header_);
+		}
+		closeHandle(hMap_);
+		closeHandle(hData_);
+		closeHandle(hSpace_);
+		closeHandle(peer_);
+	}
+
+protected:
+	enum {
+		RING_MAGIC = 0x46544D41, // 'AMTF'
+		RING_VERSION = 1,
+		HEADER_SIZE = 4096,
+		SLOT_ALIGN = 4096,
+		SLOT_HEADER_SIZE = 8, // Xbg擪Ƀf[^(uint64_t)
+		WAIT_TIMEOUT_MS = 1000,
+	};
+
+	struct Header {
+		uint32_t magic;
+		uint32_t version;
+		uint32_t numSlots;
+		uint32_t producerPid;
+		uint64_t slotStride;
+		volatile LONG closed; // ݑI
+		uint8_t pad0[36];
+		// ݑƓǂݍݑŕʂ̃LbVCɒu
+		volatile LONG64 writeCount; // ݍς݃Xbg
+		uint8_t pad1[56];
+		volatile LONG64 readCount; // ǂݍݍς݃Xbg
+	};
+
+	HANDLE hMap_;
+	HANDLE hData_;
+	HANDLE hSpace_;
+	HANDLE peer_; // vZX
+	Header* header_;
+
+	SharedFrameRingBase()
+		: hMap_(NULL)
+		, hData_(NULL)
+		, hSpace_(NULL)
+		, peer_(NULL)
+		, header_(NULL)
+	{ }
+
+	static tstring dataEventName(const tstring& name) {
+		return name + _T("_data");
+	}
+	static tstring spaceEventName(const tstring& name) {
+		return name + _T("_space");
+	}
+
+	static void closeHandle(HANDLE& h) {
+		if (h != NULL) {
+			CloseHandle(h);
+			h = NULL;
+		}
+	}
+
+	uint8_t* getSlot(int64_t count) {
+		return (uint8_t*)header_ + HEADER_SIZE +
+			(size_t)(count % header_->numSlots) * (size_t)header_->slotStride;
+	}
+
+	// Cxg҂i^CAEg߂̂ŌĂяoŏԂmF邱Ɓj
+	// vZXIĂfalse
+	bool waitEvent(HANDLE ev) {
+		HANDLE handles[] = { ev, peer_ };
+		DWORD ret = WaitForMultipleObjects((peer_ != NULL) ? 2 : 1, handles, FALSE, WAIT_TIMEOUT_MS);
+		if (ret == WAIT_FAILED) {
+			THROW(RuntimeException, "failed to wait shared memory ring event");
+		}
+		return ret != WAIT_OBJECT_0 + 1;
+	}
+};
+
+class SharedFrameRingWriter : public SharedFrameRingBase
+{
+public:
+	// maxFrameSize: 1t[̍őoCg
+	SharedFrameRingWriter(const tstring& name, size_t maxFrameSize, int numSlots)
+	{
+		uint64_t stride = (SLOT_HEADER_SIZE + maxFrameSize + SLOT_ALIGN - 1) / SLOT_ALIGN * SLOT_ALIGN;
+		uint64_t total = HEADER_SIZE + stride * numSlots;
+		hMap_ = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+			(DWORD)(total >> 32), (DWORD)total, name.c_str());
+		if (hMap_ == NULL) {
+			THROW(RuntimeException, "failed to create shared memory");
+		}
+		if (GetLastError() == ERROR_ALREADY_EXISTS) {
+			THROW(RuntimeException, "shared memory name is already used");
+		}
+		header_ = (Header*)MapViewOfFile(hMap_, FILE_MAP_ALL_ACCESS, 0, 0, (size_t)total);
+		if (header_ == NULL) {
+			THROW(RuntimeException, "failed to map shared memory");
+		}
+		hData_ = CreateEventW(NULL, FALSE, FALSE, dataEventName(name).c_str());
+		hSpace_ = CreateEventW(NULL, FALSE, FALSE, spaceEventName(name).c_str());
+		if (hData_ == NULL || hSpace_ == NULL) {
+			THROW(RuntimeException, "failed to create shared memory ring event");
+		}
+		header_->version = RING_VERSION;
+		header_->numSlots = numSlots;
+		header_->producerPid = GetCurrentProcessId();
+		header_->slotStride = stride;
+		header_->closed = 0;
+		header_->writeCount = 0;
+		header_->readCount = 0;
+		// magic͍Ōɏ
+		InterlockedExchange((volatile LONG*)&header_->magic, RING_MAGIC);
+	}
+
+	// ǂݍݑvZXiIo邽߁j
+	void setPeerProcess(HANDLE hProcess) {
+		closeHandle(peer_);
+		if (DuplicateHandle(GetCurrentProcess(), hProcess,
+			GetCurrentProcess(), &peer_, SYNCHRONIZE, FALSE, 0) == 0)
+		{
+			THROW(RuntimeException, "failed to duplicate process handle");
+		}
+	}
+
+	// ̈Ȃ1t[Ƃď
+	void write(const MemoryChunk* chunks, int numChunks) {
+		size_t total = 0;
+		for (int i = 0; i < numChunks; ++i) {
+			total += chunks[i].length;
+		}
+		if (SLOT_HEADER_SIZE + total > header_->slotStride) {
+			THROW(ArgumentException, "frame is larger than shared memory slot");
+		}
+		int64_t w = header_->writeCount;
+		while (w - header_->readCount >= header_->numSlots) {
+			if (!waitEvent(hSpace_)) {
+				THROW(RuntimeException, "frame consumer process exited");
+			}
+		}
+		uint8_t* slot = getSlot(w);
+		*(uint64_t*)slot = total;
+		uint8_t* dst = slot + SLOT_HEADER_SIZE;
+		for (int i = 0; i < numChunks; ++i) {
+			memcpy(dst, chunks[i].data, chunks[i].length);
+			dst += chunks[i].length;
+		}
+		InterlockedExchange64(&header_->writeCount, w + 1);
+		SetEvent(hData_);
+	}
+
+	// I[ʒm
+	void finish() {
+		InterlockedExchange(&header_->closed, 1);
+		SetEvent(hData_);
+	}
+};
+
+class SharedFrameRingReader : public SharedFrameRingBase
+{
+public:
+	SharedFrameRingReader(const tstring& name)
+	{
+		hMap_ = OpenFileMappingW(FILE_MAP_ALL_ACCESS, FALSE, name.c_str());
+		if (hMap_ == NULL) {
+			THROW(RuntimeException, "failed to open shared memory");
+		}
+		header_ = (Header*)MapViewOfFile(hMap_, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+		if (header_ == NULL) {
+			THROW(RuntimeException, "failed to map shared memory");
+		}
+		if (header_->magic != RING_MAGIC || header_->version != RING_VERSION) {
+			THROW(FormatException, "shared memory ring version mismatch");
+		}
+		hData_ = OpenEventW(SYNCHRONIZE | EVENT_MODIFY_STATE, FALSE, dataEventName(name).c_str());
+		hSpace_ = OpenEventW(SYNCHRONIZE | EVENT_MODIFY_STATE, FALSE, spaceEventName(name).c_str());
+		if (hData_ == NULL || hSpace_ == NULL) {
+			THROW(RuntimeException, "failed to open shared memory ring event");
+		}
+		peer_ = OpenProcess(SYNCHRONIZE, FALSE, header_->producerPid);
+	}
+
+	// ̃t[擾BI[Ȃ璷0Ԃ
+	// 擾f[^endRead()ĂԂ܂ŗL
+	MemoryChunk beginRead() {
+		int64_t r = header_->readCount;
+		while (header_->writeCount <= r) {
+			if (header_->closed) {
+				// closed̑Oɏꂽt[邩Ȃ̂ōĊmF
+				if (header_->writeCount > r) {
+					break;
+				}
+				return MemoryChunk();
+			}
+			if (!waitEvent(hData_) && header_->writeCount <= r && !header_->closed) {
+				THROW(RuntimeException, "frame producer process exited");
+			}
+		}
+		uint8_t* slot = getSlot(r);
+		return MemoryChunk(slot + SLOT_HEADER_SIZE, (size_t)*(uint64_t*)slot);
+	}
+
+	void endRead() {
+		InterlockedIncrement64(&header_->readCount);
+		SetEvent(hSpace_);
+	}
+};
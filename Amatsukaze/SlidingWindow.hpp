@@ -0,0 +1,104 @@
+/**
+* Sliding window statistics
+* Copyright (c) 2017-2019 Nekopanda
+*
+* This software is released under the MIT License.
+* http://opensource.org/licenses/mit-license.php
+*/
+#pragma once
+
+#include <deque>
+#include <set>
+#include <iterator>
+#include <utility>
+
+// XCfBOEBhE̓vl
+// 1vf̒ǉE폜O(1)܂O(log w)Ȃ̂ŁASʒuŃEBhE𖈉񑖍ꍇ
+// O(n*w)ifBAO(n*w*log w)jO(n)iO(n*log w)jɂȂ
+// EBhEɓvfƏovf͌ĂяoŎw肷
+// rŏ߂̂NaN͓ȂƁiől⃁fBAj
+
+// őliPL[j
+// vfɂ̓CfbNXtĒǉApopBeforeŃEBhEovf̂Ă
+template <typename T>
+class SlidingWindowMax
+{
+	// l͐擪Piォ痈傫lΑO̒l͍őɂȂ肦Ȃ̂Ŏ̂Ăj
+	std::deque<std::pair<int, T>> queue_;
+public:
+	// index͒Pł邱
+	void push(int index, T v) {
+		while (queue_.size() > 0 && !(v < queue_.back().second)) {
+			queue_.pop_back();
+		}
+		queue_.emplace_back(index, v);
+	}
+
+	// index̗vfEBhEo
+	void popBefore(int index) {
+		while (queue_.size() > 0 && queue_.front().first < index) {
+			queue_.pop_front();
+		}
+	}
+
+	bool empty() const { return queue_.empty(); }
+
+	// EBhE̍őliłȂƁj
+	T get() const { return queue_.front().second; }
+
+	void clear() { queue_.clear(); }
+};
+
+// fBAi2multisetŃEBhEƑ傫ɕĎj
+// vf̏ꍇ͏i\[gƂ(n-1)/2ԖځjԂ
+template <typename T>
+class SlidingWindowMedian
+{
+	std::multiset<T> lower_; // ifBA܂ށj
+	std::multiset<T> upper_; // 傫
+
+	// lower_̗vfupper_Ɠ1
+	void balance() {
+		if (lower_.size() > upper_.size() + 1) {
+			auto it = std::prev(lower_.end());
+			upper_.insert(*it);
+			lower_.erase(it);
+		}
+		else if (upper_.size() > lower_.size()) {
+			auto it = upper_.begin();
+			lower_.insert(*it);
+			upper_.erase(it);
+		}
+	}
+public:
+	void push(T v) {
+		if (lower_.size() == 0 || !(*lower_.rbegin() < v)) {
+			lower_.insert(v);
+		}
+		else {
+			upper_.insert(v);
+		}
+		balance();
+	}
+
+	// lv̗vf1EBhEoiEBhEɂ邱Ɓj
+	void pop(T v) {
+		if (!(*lower_.rbegin() < v)) {
+			lower_.erase(lower_.find(v));
+		}
+		else {
+			upper_.erase(upper_.find(v));
+		}
+		balance();
+	}
+
+	int size() const { return (int)(lower_.size() + upper_.size()); }
+
+	// EBhẼfBAiłȂƁj
+	T get() const { return *lower_.rbegin(); }
+
+	void clear() {
+		lower_.clear();
+		upper_.clear();
+	}
+};
@@ -157,6 +157,12 @@ struct FilterAudioFrame {
 	int frameIndex; // fobOp
 	int64_t waveOffset;
 	int waveLength;
+	// ȉ͉͗pWAVĂȂꍇɒAACt@CfR[h邽߂̏
+	int64_t codedOffset;
+	int codedLength;
+	// Xg[̒Õt[iȂꍇprevCodedOffset=-1j
+	int64_t prevCodedOffset;
+	int prevCodedLength;
 };
 
 struct FilterOutVideoInfo {
@@ -409,12 +415,7 @@ public:
 	std::vector<FilterAudioFrame> getWaveInput(const std::vector<int>& frameList) const {
 		std::vector<FilterAudioFrame> ret;
 		for (int i = 0; i < (int)frameList.size(); ++i) {
-			FilterAudioFrame frame = { 0 };
-			auto& info = audioFrameList_[frameList[i]];
-			frame.frameIndex = frameList[i];
-			frame.waveOffset = info.waveOffset;
-			frame.waveLength = info.waveDataSize;
-			ret.push_back(frame);
+			ret.push_back(getFilterAudioFrame(frameList[i]));
 		}
 		return ret;
 	}
@@ -1211,12 +1212,7 @@ private:
 
 			auto& list = file.audioFrameList[0];
 			for (int i = 0; i < (int)list.size(); ++i) {
-				FilterAudioFrame frame = { 0 };
-				auto& info = audioFrameList_[list[i]];
-				frame.frameIndex = list[i];
-				frame.waveOffset = info.waveOffset;
-				frame.waveLength = info.waveDataSize;
-				filterAudioFrameList_[videoId].push_back(frame);
+				filterAudioFrameList_[videoId].push_back(getFilterAudioFrame(list[i]));
 			}
 		}
 	}
@@ -1287,6 +1283,27 @@ private:
 		}
 	}
 
+	FilterAudioFrame getFilterAudioFrame(int frameIndex) const {
+		FilterAudioFrame frame = { 0 };
+		auto& info = audioFrameList_[frameIndex];
+		frame.frameIndex = frameIndex;
+		frame.waveOffset = info.waveOffset;
+		frame.waveLength = info.waveDataSize;
+		frame.codedOffset = info.fileOffset;
+		frame.codedLength = info.codedDataSize;
+		frame.prevCodedOffset = -1;
+		// AACt@Cɂ͑SXg[̃t[ł̂œXg[̂̂T
+		for (int i = frameIndex - 1; i >= 0; --i) {
+			auto& prev = audioFrameList_[i];
+			if (prev.audioIdx == info.audioIdx) {
+				frame.prevCodedOffset = prev.fileOffset;
+				frame.prevCodedLength = prev.codedDataSize;
+				break;
+			}
+		}
+		return frame;
+	}
+
 	void fillAudioFrames(
 		OutFileState& file, int index, // Ώۃt@CƉCfbNX
 		const AudioFormat* format, // tH[}bg
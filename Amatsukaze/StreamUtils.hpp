@@ -340,12 +340,20 @@ const char* AMT_ERROR_NAMES[] = {
 	 "decode-audio-failed",
 };
 
+// AMTContext̃Oo͂肷
+class AMTLogHandler {
+public:
+	virtual ~AMTLogHandler() { }
+	virtual void onLog(const char* str, AMT_LOG_LEVEL level) = 0;
+};
+
 class AMTContext {
 public:
 	AMTContext()
 		: timePrefix(true)
 		, acp(GetACP())
 		, errCounter()
+		, logHandler(nullptr)
 	{ }
 
 	const CRC32* getCRC() const {
@@ -431,6 +439,11 @@ public:
 		timePrefix = enable;
 	}
 
+	// Oo͂handlerɓninullptrŌɖ߂j
+	void setLogHandler(AMTLogHandler* handler) {
+		logHandler = handler;
+	}
+
 	const std::map<std::string, std::wstring>& getDRCSMapping() const {
 		return drcsMap;
 	}
@@ -479,6 +492,8 @@ private:
 
 	std::map<std::string, std::wstring> drcsMap;
 
+	AMTLogHandler* logHandler;
+
   void printWithTimePrefix(const char* str) const {
     time_t rawtime;
     char buffer[80];
@@ -491,6 +506,10 @@ private:
   }
 
 	void print(const char* str, AMT_LOG_LEVEL level) const {
+		if (logHandler != nullptr) {
+			logHandler->onLog(str, level);
+			return;
+		}
     if (timePrefix) {
       printWithTimePrefix(str);
     }
@@ -527,11 +546,20 @@ struct DecoderSetting {
 	DECODER_TYPE mpeg2;
 	DECODER_TYPE h264;
 	DECODER_TYPE hevc;
+	// AMTSourceŐǂ݃fR[hőt[i0Ȃǂ݂Ȃj
+	int prefetchFrames;
+	// ǂ݃fR[ht[Ɏgő僁(MB)
+	int prefetchMemory;
+	// AMTSourceŃ_ANZXpɎgGOPfR[_̍ő吔i0ȂgȂj
+	int gopDecoders;
 
 	DecoderSetting()
 		: mpeg2(DECODER_DEFAULT)
 		, h264(DECODER_DEFAULT)
 		, hevc(DECODER_DEFAULT)
+		, prefetchFrames(0)
+		, prefetchMemory(256)
+		, gopDecoders(0)
 	{ }
 };
 
@@ -842,6 +870,17 @@ static CCodecPointer make_unique_ptr(CCodec* codec) {
 	return CCodecPointer(codec, DeleteUtVideoCodec);
 }
 
+// LosslessVideoFilẽt[̊i[`
+enum LOSSLESS_CODEC {
+	LOSSLESS_UTVIDEO = 0, // UtVideo(ULH0)ňk
+	LOSSLESS_RAW, // kYV12iCPUfBXNƂpj
+};
+
+// UtVideoňkt[ۑt@C
+// v1: wb_̌Ƀt[TCYzuAt[тɃV[NčXV
+// v2: t[͒ǋL݂̂Ńobt@Ă܂Ƃ߂ď݁At[TCYz͕Ƃɖɏ
+//     wb_̒Ɋi[`(LOSSLESS_CODEC)
+// ǂݍ݂̓t@C}bv̂ŁAt[f[^̓Rs[ɎQƂłiv1ǂ߂j
 // 1CX^X͏orǂݍ݂̂ǂ炩gȂ
 class LosslessVideoFile : AMTObject
 {
@@ -852,85 +891,261 @@ class LosslessVideoFile : AMTObject
 		int height;
 	};
 
-	File file;
+	// v2̃t@C
+	struct LosslessFileTrailer {
+		int64_t indexOffset; // t[TCYz̈ʒu
+		int magic;
+		int numFrames;
+	};
+
+	enum {
+		MAGIC = 0x012345,
+		VERSION = 2,
+		TRAILER_MAGIC = 0x4C544D41, // "AMTL"
+		WRITE_BUFFER_SIZE = 8 * 1024 * 1024
+	};
+
+	std::unique_ptr<File> file; // ݗp
+	std::unique_ptr<MappedFile> mapped; // ǂݍݗp
 	LosslessFileHeader fh;
+	LOSSLESS_CODEC codec;
 	std::vector<uint8_t> extra;
 	std::vector<int> framesizes;
 	std::vector<int64_t> offsets;
 
-	int current;
+	int maxFrames;
+	int64_t writePos; // obt@ɂ镪܂߂݈ʒu
+	std::vector<uint8_t> writeBuffer;
+
+	void flushBuffer() {
+		file->write(MemoryChunk(writeBuffer.data(), writeBuffer.size()));
+		writeBuffer.clear();
+	}
+
+	template <typename T>
+	T readMapped(int64_t& pos) {
+		T v;
+		memcpy(&v, mapped->get(pos, sizeof(T)), sizeof(T));
+		pos += sizeof(T);
+		return v;
+	}
+
+	template <typename T>
+	std::vector<T> readMappedArray(int64_t& pos) {
+		int64_t num = readMapped<int64_t>(pos);
+		if (num < 0 || pos + num * (int64_t)sizeof(T) > mapped->size()) {
+			THROW(FormatException, "[LosslessVideoFile] broken file");
+		}
+		std::vector<T> arr((size_t)num);
+		if (num > 0) {
+			memcpy(arr.data(), mapped->get(pos, sizeof(T) * arr.size()), sizeof(T) * arr.size());
+		}
+		pos += sizeof(T) * arr.size();
+		return arr;
+	}
 
 public:
 	LosslessVideoFile(AMTContext& ctx, const tstring& filepath, const tchar* mode)
 		: AMTObject(ctx)
-		, file(filepath, mode)
-		, current()
+		, codec(LOSSLESS_UTVIDEO)
+		, maxFrames()
+		, writePos()
 	{
+		if (tstring(mode).find(_T('w')) != tstring::npos) {
+			file = std::unique_ptr<File>(new File(filepath, mode));
+		}
+		else {
+			mapped = std::unique_ptr<MappedFile>(new MappedFile(filepath));
+		}
+	}
+
+	~LosslessVideoFile() {
+		if (file != nullptr) {
+			try {
+				close();
+			}
+			catch (const Exception&) {
+				ctx.error("[LosslessVideoFile] t[CfbNX݂̏Ɏs");
+			}
+		}
 	}
 
-	void writeHeader(int width, int height, int numframes, const std::vector<uint8_t>& extra)
+	// numframes͏߂őt[
+	void writeHeader(int width, int height, int numframes, const std::vector<uint8_t>& extra,
+		LOSSLESS_CODEC codec = LOSSLESS_UTVIDEO)
 	{
-		fh.magic = 0x012345;
-		fh.version = 1;
+		fh.magic = MAGIC;
+		fh.version = VERSION;
 		fh.width = width;
 		fh.height = height;
-		framesizes.resize(numframes);
-		offsets.resize(numframes);
+		this->codec = codec;
+		maxFrames = numframes;
+		framesizes.clear();
+		offsets.clear();
+		writeBuffer.reserve(WRITE_BUFFER_SIZE);
 
-		file.writeValue(fh);
-		file.writeArray(extra);
-		file.writeArray(framesizes);
-		offsets[0] = file.pos();
+		file->writeValue(fh);
+		file->writeValue((int)codec);
+		file->writeArray(extra);
+		writePos = file->pos();
+	}
+
+	// t[TCYzŃt@C
+	void close()
+	{
+		if (file == nullptr) {
+			return;
+		}
+		flushBuffer();
+		LosslessFileTrailer trailer = LosslessFileTrailer();
+		trailer.indexOffset = writePos;
+		trailer.magic = TRAILER_MAGIC;
+		trailer.numFrames = (int)framesizes.size();
+		file->writeArray(framesizes);
+		file->writeValue(trailer);
+		file = nullptr;
 	}
 
 	void readHeader()
 	{
-		fh = file.readValue<LosslessFileHeader>();
-		extra = file.readArray<uint8_t>();
-		framesizes = file.readArray<int>();
-		offsets.resize(framesizes.size());
-		offsets[0] = file.pos();
+		int64_t pos = 0;
+		fh = readMapped<LosslessFileHeader>(pos);
+		if (fh.magic != MAGIC) {
+			THROW(FormatException, "[LosslessVideoFile] invalid file");
+		}
+		codec = LOSSLESS_UTVIDEO;
+		if (fh.version == 2) {
+			codec = (LOSSLESS_CODEC)readMapped<int>(pos);
+			if (codec != LOSSLESS_UTVIDEO && codec != LOSSLESS_RAW) {
+				THROWF(FormatException, "[LosslessVideoFile] unknown codec %d", (int)codec);
+			}
+		}
+		extra = readMappedArray<uint8_t>(pos);
+		if (fh.version == 1) {
+			framesizes = readMappedArray<int>(pos);
+		}
+		else if (fh.version == 2) {
+			int64_t trailerPos = mapped->size() - sizeof(LosslessFileTrailer);
+			if (trailerPos < pos) {
+				THROW(FormatException, "[LosslessVideoFile] no frame index (file not closed?)");
+			}
+			LosslessFileTrailer trailer = readMapped<LosslessFileTrailer>(trailerPos);
+			if (trailer.magic != TRAILER_MAGIC) {
+				THROW(FormatException, "[LosslessVideoFile] no frame index (file not closed?)");
+			}
+			int64_t indexPos = trailer.indexOffset;
+			framesizes = readMappedArray<int>(indexPos);
+			if ((int)framesizes.size() != trailer.numFrames) {
+				THROW(FormatException, "[LosslessVideoFile] broken frame index");
+			}
+		}
+		else {
+			THROWF(FormatException, "[LosslessVideoFile] unsupported version %d", fh.version);
+		}
 
-		for (int i = 1; i < (int)framesizes.size(); ++i) {
-			offsets[i] = offsets[i - 1] + framesizes[i - 1];
+		offsets.resize(framesizes.size());
+		for (int i = 0; i < (int)framesizes.size(); ++i) {
+			offsets[i] = (i == 0) ? pos : offsets[i - 1] + framesizes[i - 1];
+		}
+		if (framesizes.size() > 0 && offsets.back() + framesizes.back() > mapped->size()) {
+			THROW(FormatException, "[LosslessVideoFile] broken file");
 		}
 	}
 
 	int getWidth() const { return fh.width; }
 	int getHeight() const { return fh.height; }
 	int getNumFrames() const { return (int)framesizes.size(); }
+	LOSSLESS_CODEC getCodec() const { return codec; }
 	const std::vector<uint8_t>& getExtra() const { return extra; }
 
 	void writeFrame(const uint8_t* data, int len)
 	{
-		int numframes = (int)framesizes.size();
-		int n = current++;
-		if (n >= numframes) {
+		if ((int)framesizes.size() >= maxFrames) {
 			THROWF(InvalidOperationException, "[LosslessVideoFile] attempt to write frame more than specified num frames");
 		}
+		offsets.push_back(writePos);
+		framesizes.push_back(len);
+		writePos += len;
 
-		if (n > 0) {
-			offsets[n] = offsets[n - 1] + framesizes[n - 1];
+		if (writeBuffer.size() + len > WRITE_BUFFER_SIZE) {
+			flushBuffer();
 		}
-		framesizes[n] = len;
-
-		// f[^
-		file.seek(offsets[n], SEEK_SET);
-		file.write(MemoryChunk((uint8_t*)data, len));
+		if (len >= WRITE_BUFFER_SIZE) {
+			// obt@傫̂ł̂܂܏
+			file->write(MemoryChunk((uint8_t*)data, len));
+		}
+		else {
+			writeBuffer.insert(writeBuffer.end(), data, data + len);
+		}
+	}
 
-		// 
-		file.seek(offsets[0] - sizeof(int) * (numframes - n), SEEK_SET);
-		file.writeValue(len);
+	// t[f[^ԂiRs[Ȃj
+	// getFramereadFrameĂԂ܂ŗL
+	MemoryChunk getFrame(int n)
+	{
+		if (framesizes[n] == 0) {
+			return MemoryChunk();
+		}
+		return MemoryChunk(const_cast<uint8_t*>(mapped->get(offsets[n], framesizes[n])), framesizes[n]);
 	}
 
 	int64_t readFrame(int n, uint8_t* data)
 	{
-		file.seek(offsets[n], SEEK_SET);
-		file.read(MemoryChunk(data, framesizes[n]));
+		MemoryChunk frame = getFrame(n);
+		if (frame.length > 0) {
+			memcpy(data, frame.data, frame.length);
+		}
 		return framesizes[n];
 	}
 };
 
+// LosslessVideoFilẽt[YV12ɖ߂
+class LosslessFrameDecoder : NonCopyable
+{
+	LOSSLESS_CODEC codecType;
+	CCodecPointer codec;
+	size_t rawSize;
+public:
+	// filereadHeader()ς݂ł邱
+	LosslessFrameDecoder(LosslessVideoFile& file)
+		: codecType(file.getCodec())
+		, codec(nullptr, DeleteUtVideoCodec)
+		, rawSize((size_t)file.getWidth() * file.getHeight() * 3 / 2)
+	{
+		if (codecType == LOSSLESS_UTVIDEO) {
+			codec = make_unique_ptr(CCodec::CreateInstance(UTVF_ULH0, "Amatsukaze"));
+			size_t cbGrossWidth[] = { CBGROSSWIDTH_WINDOWS, CBGROSSWIDTH_WINDOWS, CBGROSSWIDTH_WINDOWS };
+			auto& extra = file.getExtra();
+			if (codec->DecodeBegin(UTVF_YV12, file.getWidth(), file.getHeight(),
+				cbGrossWidth, extra.data(), (int)extra.size()))
+			{
+				THROW(RuntimeException, "failed to DecodeBegin (UtVideo)");
+			}
+		}
+	}
+
+	~LosslessFrameDecoder() {
+		if (codec != nullptr) {
+			codec->DecodeEnd();
+		}
+	}
+
+	// dstɂwidth*height*3/2oCgKv
+	void decode(LosslessVideoFile& file, int n, uint8_t* dst)
+	{
+		MemoryChunk frame = file.getFrame(n);
+		if (codecType == LOSSLESS_RAW) {
+			if (frame.length != rawSize) {
+				THROWF(FormatException, "[LosslessVideoFile] invalid raw frame size at %d", n);
+			}
+			memcpy(dst, frame.data, rawSize);
+		}
+		else if (codec->DecodeFrame(dst, frame.data) != rawSize) {
+			THROW(RuntimeException, "failed to DecodeFrame (UtVideo)");
+		}
+	}
+};
+
 static void CopyYV12(uint8_t* dst, PVideoFrame& frame, int width, int height)
 {
 	const uint8_t* srcY = frame->GetReadPtr(PLANAR_Y);
@@ -24,8 +24,129 @@
 #include "EncoderOptionParser.hpp"
 #include "NicoJK.hpp"
 #include "AudioEncoder.hpp"
+#include "VirtualTsFile.hpp"
+
+// Xg[ƂɃXbh𗧂ĂAACfR[h
+// fR[hʂ͓onDecodedŎ󂯎ionDecodedput,pop,joinĂ񂾃XbhŌĂ΂j
+class AudioDecodeWorkers : public AMTObject {
+public:
+	AudioDecodeWorkers(AMTContext& ctx)
+		: AMTObject(ctx)
+	{ }
+
+	~AudioDecodeWorkers() {
+		joinThreads();
+	}
+
+	// id: onDecodedɓn鎯ʎq
+	void put(int streamIdx, int id, MemoryChunk frame) {
+		while ((int)workers_.size() <= streamIdx) {
+			workers_.emplace_back(new Worker(ctx));
+			workers_.back()->start();
+		}
+		pending_.emplace_back(streamIdx, id);
+		workers_[streamIdx]->put(std::vector<uint8_t>(frame.data, frame.data + frame.length), frame.length);
+	}
+
+	// fR[hIĂ镪𓊓ɏo͂
+	// 擪̃t[̃fR[hIĂȂΉȂ
+	void pop() {
+		popResults(false);
+	}
+
+	// SẴfR[hÎ҂ďo͂
+	void join() {
+		popResults(true);
+		joinThreads();
+	}
+
+protected:
+	// result!=DECODE_OK̏ꍇApcm͋
+	virtual void onDecoded(int id, AdtsDecoder::DecodeResult result, MemoryChunk pcm) = 0;
+
+private:
+	struct DecodedFrame {
+		AdtsDecoder::DecodeResult result;
+		std::vector<uint8_t> pcm;
+	};
+
+	class Worker : public DataPumpThread<std::vector<uint8_t>> {
+	public:
+		Worker(AMTContext& ctx)
+			: DataPumpThread(4 * 1024 * 1024)
+			, decoder_(ctx)
+		{ }
+
+		bool getResult(DecodedFrame& result, bool wait) {
+			std::unique_lock<std::mutex> lock(mutex_);
+			while (results_.size() == 0) {
+				if (!wait) return false;
+				cond_.wait(lock);
+			}
+			result = std::move(results_.front());
+			results_.pop_front();
+			return true;
+		}
+
+	protected:
+		virtual void OnDataReceived(std::vector<uint8_t>&& data) {
+			DecodedFrame result;
+			NeAACDecFrameInfo frameInfo;
+			void* samples;
+			result.result = decoder_.decode(
+				MemoryChunk(data.data(), data.size()), frameInfo, samples);
+			if (result.result == AdtsDecoder::DECODE_OK) {
+				const uint8_t* ptr = (const uint8_t*)samples;
+				result.pcm.assign(ptr, ptr + frameInfo.samples * 2);
+			}
+			std::lock_guard<std::mutex> lock(mutex_);
+			results_.push_back(std::move(result));
+			cond_.notify_one();
+		}
+
+	private:
+		AdtsDecoder decoder_;
+		std::mutex mutex_;
+		std::condition_variable cond_;
+		std::deque<DecodedFrame> results_;
+	};
+
+	std::vector<std::unique_ptr<Worker>> workers_;
+	// o͑҂ (streamIdx, id)
+	std::deque<std::pair<int, int>> pending_;
+
+	void popResults(bool wait) {
+		DecodedFrame result;
+		while (pending_.size() > 0) {
+			auto& front = pending_.front();
+			if (!workers_[front.first]->getResult(result, wait)) {
+				break;
+			}
+			int id = front.second;
+			pending_.pop_front();
+			onDecoded(id, result.result, MemoryChunk(result.pcm.data(), result.pcm.size()));
+		}
+	}
+
+	void joinThreads() {
+		for (auto& worker : workers_) {
+			if (worker->isRunning()) {
+				worker->join();
+			}
+		}
+	}
+};
 
 class AMTSplitter : public TsSplitter {
+	enum {
+		// ͎1͈͂̑傫
+		SPLIT_CHUNK_SIZE = TS_PACKET_LENGTH * 176 * 1024,
+		// ͎ɏԂ킹邽߂ɔ͈͂̑O͂
+		// 1/3͑O͈̔͂̌ʂƈv邩mF
+		SPLIT_WARMUP_SIZE = TS_PACKET_LENGTH * 32 * 1024,
+		// ͈͂̍Ō̃pPbg܂ŏ邽߂ɔ͈͂̌ɓ
+		SPLIT_LOOKAHEAD_SIZE = TS_PACKET_LENGTH * 64,
+	};
 public:
 	class PacketInfo
 	{
@@ -82,13 +203,77 @@ public:
 		, audioFileSize_(0)
 		, waveFileSize_(0)
 		, srcFileSize_(0)
+		, pipelined_(setting.isPipelinedSplit())
+		, readBuffers_(4 * 1024 * 1024)
+		, parseThread_(this)
+		, parallelAudioDecode_(false)
+		, lazyWave_(false)
+		, audioDecoder_(this)
+		, numSplitThreads_(0)
+		, splitChunkSize_(SPLIT_CHUNK_SIZE)
+		, splitWarmupSize_(SPLIT_WARMUP_SIZE)
+		, numSplitRetries_(0)
+		, virtualVideo_(setting.isVirtualIntVideo())
+		, videoPid_(-1)
 	{
 		psWriter.setHandler(&writeHandler);
+		setParallelAudioDecode(setting.isParallelAudioDecode());
+		setLazyWave(setting.isLazyWave());
+		setParallelSplit(setting.getNumSplitThreads());
+	}
+
+	// ǂݍ݁ÉE݂ʃXbhōsiftHg͐ݒɏ]j
+	// ǂło͓͂
+	void setPipelined(bool enable) {
+		pipelined_ = enable;
+	}
+
+	// ͗pWAV̂߂̉fR[hXg[Ƃ̃XbhōsiftHg͐ݒɏ]j
+	// ȃXg[Ȃo͓͂AꂽXg[ł͏o͂قȂ邱Ƃ
+	// iwb_ăt[m肷̂ŁAfR[hłȂt[ōēȂA
+	//  㑱t[PTS̃t[̕iށBfR[hłȂt[͍ŌɏOj
+	void setParallelAudioDecode(bool enable) {
+		parallelAudioDecode_ = enable;
+		setDeferAudioDecode(parallelAudioDecode_ || lazyWave_);
+	}
+
+	// ͗pWAV炸t[񂾂L^邩iftHg͐ݒɏ]j
+	// WAVWaveReaderŕKvɂȂƂɒAACt@CfR[h
+	// waveOffset͑St[fR[hꍇWAVt@C̈ʒuɂȂ
+	void setLazyWave(bool enable) {
+		lazyWave_ = enable;
+		setDeferAudioDecode(parallelAudioDecode_ || lazyWave_);
+	}
+
+	// ͈͂͂ɕnumThreadsXbhŕɉ͂邩iftHg͐ݒɏ]B1ȉȂ疳j
+	// ͈͂̋ȄԂ͑O͈̔͂ƃCxgv邩Ŕf邾Ȃ̂ŁicheckChunkQƁj
+	// o͂ɂȂ邱Ƃ͕ۏ؂łȂB̃fR[hxݒi񉹐fR[hlazyWavejłȂΖ
+	// chunkSize,warmupSize̓eXgp
+	void setParallelSplit(int numThreads,
+		int64_t chunkSize = SPLIT_CHUNK_SIZE, int64_t warmupSize = SPLIT_WARMUP_SIZE)
+	{
+		numSplitThreads_ = numThreads;
+		splitChunkSize_ = std::max<int64_t>(1, chunkSize / TS_PACKET_LENGTH) * TS_PACKET_LENGTH;
+		splitWarmupSize_ = std::max<int64_t>(3, warmupSize / TS_PACKET_LENGTH) * TS_PACKET_LENGTH;
+	}
+
+	// ԉft@CɌTSQƂCfbNXiftHg͐ݒɏ]j
+	// AMTSourceŃfR[hf͓
+	void setVirtualIntVideo(bool enable) {
+		virtualVideo_ = enable;
+	}
+
+	// ͂Ŕ͈͂̐擪̏Ԃ킸͂
+	int getNumSplitRetries() const {
+		return numSplitRetries_;
 	}
 
 	StreamReformInfo split()
 	{
 		readAll();
+		if (virtualVideo_) {
+			virtualWriter_.close(srcFileSize_);
+		}
 
 		// for debug
 		printInteraceCount();
@@ -102,7 +287,7 @@ public:
 	}
 
 	int64_t getTotalIntVideoSize() const {
-		return writeHandler.getTotalSize();
+		return virtualVideo_ ? virtualWriter_.getTotalSize() : writeHandler.getTotalSize();
 	}
 
 	PacketInfo getPacketInfo() const {
@@ -120,30 +305,111 @@ public:
 
 protected:
 	class StreamFileWriteHandler : public PsStreamWriter::EventHandler {
-		TsSplitter& this_;
+		AMTSplitter& this_;
 		std::unique_ptr<File> file_;
+		// ݃XbhgI܂ŕȂt@C
+		std::vector<std::unique_ptr<File>> closedFiles_;
 		int64_t totalIntVideoSize_;
 	public:
-		StreamFileWriteHandler(TsSplitter& this_)
+		StreamFileWriteHandler(AMTSplitter& this_)
 			: this_(this_), totalIntVideoSize_() { }
 		virtual void onStreamData(MemoryChunk mc) {
 			if (file_ != NULL) {
-				file_->write(mc);
+				this_.writeData(this_.videoWriter_, *file_, mc);
 				totalIntVideoSize_ += mc.length;
 			}
 		}
 		void open(const tstring& path) {
 			totalIntVideoSize_ = 0;
+			close();
 			file_ = std::unique_ptr<File>(new File(path, _T("wb")));
 		}
 		void close() {
+			if (this_.pipelined_ && file_ != nullptr) {
+				closedFiles_.push_back(std::move(file_));
+			}
 			file_ = nullptr;
 		}
+		void releaseClosedFiles() {
+			closedFiles_.clear();
+		}
 		int64_t getTotalSize() const {
 			return totalIntVideoSize_;
 		}
 	};
 
+	struct ReadChunk {
+		std::unique_ptr<uint8_t[]> data;
+		size_t length;
+	};
+
+	// ǂݍ݃obt@
+	// ͂Iobt@͓ǂݍ݃XbhŎg
+	// Ɏĝ͉̓Xbh̃L[ɓ镪ƓǂݍݒE͒̕Ȃ̂Ő͈ȉɎ܂
+	class ReadBufferPool {
+	public:
+		ReadBufferPool(size_t bufSize) : bufSize_(bufSize), numAllocated_(0) { }
+		std::unique_ptr<uint8_t[]> get() {
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (free_.size() > 0) {
+				auto buf = std::move(free_.back());
+				free_.pop_back();
+				return buf;
+			}
+			++numAllocated_;
+			return std::unique_ptr<uint8_t[]>(new uint8_t[bufSize_]);
+		}
+		void release(std::unique_ptr<uint8_t[]>&& buf) {
+			std::lock_guard<std::mutex> lock(mutex_);
+			free_.push_back(std::move(buf));
+		}
+		size_t getBufferSize() const { return bufSize_; }
+		int getNumAllocated() const { return numAllocated_; }
+	private:
+		std::mutex mutex_;
+		std::vector<std::unique_ptr<uint8_t[]>> free_;
+		size_t bufSize_;
+		int numAllocated_;
+	};
+
+	// TS̓Xbh
+	class SpParseThread : public DataPumpThread<ReadChunk> {
+	public:
+		SpParseThread(AMTSplitter* this_)
+			: DataPumpThread(32 * 1024 * 1024)
+			, this_(this_)
+		{ }
+		// ͒ɔO
+		std::exception_ptr exception;
+	protected:
+		virtual void OnDataReceived(ReadChunk&& data) {
+			try {
+				this_->inputTsData(MemoryChunk(data.data.get(), data.length));
+				this_->readBuffers_.release(std::move(data.data));
+			}
+			catch (const Exception&) {
+				exception = std::current_exception();
+				throw;
+			}
+		}
+	private:
+		AMTSplitter* this_;
+	};
+
+	class SpAudioDecodeWorkers : public AudioDecodeWorkers {
+	public:
+		SpAudioDecodeWorkers(AMTSplitter* this_)
+			: AudioDecodeWorkers(this_->ctx)
+			, this_(this_)
+		{ }
+	protected:
+		virtual void onDecoded(int id, AdtsDecoder::DecodeResult result, MemoryChunk pcm) {
+			this_->onAudioDecoded(id, result, pcm);
+		}
+	private:
+		AMTSplitter* this_;
+	};
+
 	const ConfigWrapper& setting_;
 	PsStreamWriter psWriter;
 	StreamFileWriteHandler writeHandler;
@@ -158,6 +424,29 @@ protected:
 	int64_t waveFileSize_;
 	int64_t srcFileSize_;
 
+	bool pipelined_;
+	ReadBufferPool readBuffers_;
+	SpParseThread parseThread_;
+	AsyncFileWriter videoWriter_;
+	AsyncFileWriter audioWriter_;
+	AsyncFileWriter waveWriter_;
+
+	bool parallelAudioDecode_;
+	bool lazyWave_;
+	SpAudioDecodeWorkers audioDecoder_;
+	// fR[hŃfR[hɎst[iaudioFrameList_̃CfbNXj
+	std::vector<int> failedAudioFrames_;
+
+	int numSplitThreads_;
+	int64_t splitChunkSize_;
+	int64_t splitWarmupSize_;
+	int numSplitRetries_;
+
+	// ԉft@C̑ɌTSQƂCfbNX
+	bool virtualVideo_;
+	VirtualTsIndexWriter virtualWriter_;
+	int videoPid_;
+
 	// f[^
 	std::vector<FileVideoFrameInfo> videoFrameList_;
 	std::vector<FileAudioFrameInfo> audioFrameList_;
@@ -166,16 +455,416 @@ protected:
 	std::vector<std::pair<int64_t, JSTTime>> timeList_;
 
 	void readAll() {
+		if (numSplitThreads_ > 1) {
+			if (!parallelAudioDecode_ && !lazyWave_) {
+				ctx.info("TS͒ɃfR[hݒȂ̂ŕTS͍͂s܂");
+			}
+			else {
+				int64_t fileSize = File(setting_.getSrcFilePath(), _T("rb")).size();
+				if (fileSize > splitChunkSize_) {
+					readAllChunked(fileSize);
+					return;
+				}
+			}
+		}
+		if (pipelined_) {
+			readAllPipelined();
+			return;
+		}
 		enum { BUFSIZE = 4 * 1024 * 1024 };
-		auto buffer_ptr = std::unique_ptr<uint8_t[]>(new uint8_t[BUFSIZE]);
-		MemoryChunk buffer(buffer_ptr.get(), BUFSIZE);
-		File srcfile(setting_.getSrcFilePath(), _T("rb"));
+		MappedFile srcfile(setting_.getSrcFilePath());
 		srcFileSize_ = srcfile.size();
-		size_t readBytes;
+		MemoryChunk buffer;
 		do {
-			readBytes = srcfile.read(buffer);
-			inputTsData(MemoryChunk(buffer.data, readBytes));
-		} while (readBytes == buffer.length);
+			buffer = srcfile.read(BUFSIZE);
+			inputTsData(buffer);
+		} while (buffer.length > 0);
+		finishAudioDecode();
+	}
+
+	// ǂݍ(̃Xbh) -> TS(parseThread_) -> (eAsyncFileWriter)
+	// ItZbgt[͑Sĉ̓XbhŌ܂̂ŏo͂̓VOXbhƓ
+	void readAllPipelined() {
+		const size_t BUFSIZE = readBuffers_.getBufferSize();
+		File srcfile(setting_.getSrcFilePath(), _T("rb"));
+		srcFileSize_ = srcfile.size();
+
+		videoWriter_.start();
+		audioWriter_.start();
+		waveWriter_.start();
+		parseThread_.start();
+
+		bool error = false;
+		try {
+			size_t readBytes;
+			do {
+				ReadChunk chunk;
+				chunk.data = readBuffers_.get();
+				readBytes = chunk.length = srcfile.read(MemoryChunk(chunk.data.get(), BUFSIZE));
+				parseThread_.put(std::move(chunk), readBytes);
+			} while (readBytes == BUFSIZE);
+		}
+		catch (const Exception&) {
+			// ̓XbhŃG[NputO𓊂
+			error = true;
+		}
+
+		// SXbhIĂO𓊂
+		parseThread_.join();
+		try {
+			// fR[hʂ݂̏̂ŏ݃XbhɏI
+			finishAudioDecode();
+		}
+		catch (const Exception&) {
+			error = true;
+		}
+		std::exception_ptr writeError = joinWriters();
+		if (writeError && !error) {
+			std::rethrow_exception(writeError);
+		}
+		if (parseThread_.exception) {
+			std::rethrow_exception(parseThread_.exception);
+		}
+		if (error) {
+			THROW(RuntimeException, "TS͒ɃG[");
+		}
+		ctx.debugF("TSǂݍ݃obt@: %d", readBuffers_.getNumAllocated());
+		writeHandler.releaseClosedFiles();
+	}
+
+	// ݃XbhSďI
+	// 1sĂc̃Xbht@Cg܂܎cȂ悤ɑS҂Ăŏ̃G[Ԃ
+	std::exception_ptr joinWriters() {
+		std::exception_ptr error;
+		AsyncFileWriter* writers[] = { &videoWriter_, &audioWriter_, &waveWriter_ };
+		for (AsyncFileWriter* writer : writers) {
+			try {
+				writer->join();
+			}
+			catch (const Exception&) {
+				if (!error) error = std::current_exception();
+			}
+		}
+		return error;
+	}
+
+	// ͈͂Ƃɕɉ(parseChunk) -> ͈͂̏Ɍʂ(replayChunk) -> 
+	// ͈͂̐擪t߂̃CxgO͈̔͂ƈv邩mFĂgivȂΉ͂j
+	// mF̓q[XeBbNȂ̂ŁAo͂Ŝ1ŉ͂ꍇƓɂȂƂ͌Ȃ
+	void readAllChunked(int64_t fileSize) {
+		srcFileSize_ = fileSize;
+		if (pipelined_) {
+			videoWriter_.start();
+			audioWriter_.start();
+			waveWriter_.start();
+		}
+
+		// SXbhIĂO𓊂
+		std::exception_ptr error;
+		try {
+			readChunks();
+		}
+		catch (const Exception&) {
+			error = std::current_exception();
+		}
+		try {
+			finishAudioDecode();
+		}
+		catch (const Exception&) {
+			if (!error) error = std::current_exception();
+		}
+		if (pipelined_) {
+			std::exception_ptr writeError = joinWriters();
+			if (!error) error = writeError;
+		}
+		if (error) {
+			std::rethrow_exception(error);
+		}
+		writeHandler.releaseClosedFiles();
+	}
+
+	// O͈̔͂瑱ĉ͂͊iReLXg͊pj
+	struct SeqChunkSplitter {
+		AMTContext ctx;
+		TsChunkSplitter splitter;
+		SeqChunkSplitter(bool enableVideo, bool enableAudio, bool enableCaption)
+			: splitter(ctx, enableVideo, enableAudio, enableCaption)
+		{
+			splitter.setContinuous(true);
+		}
+	};
+
+	void readChunks() {
+		const int numChunks = (int)((srcFileSize_ + splitChunkSize_ - 1) / splitChunkSize_);
+		// ͒Ə2g
+		std::vector<std::unique_ptr<TsChunkResult>> results[2];
+		std::unique_ptr<TsChunkResult> prev;
+		std::unique_ptr<SeqChunkSplitter> seq;
+		ParallelTaskPool pool(numSplitThreads_);
+		const int waveSize = pool.getNumThreads();
+		const int numWaves = (numChunks + waveSize - 1) / waveSize;
+		ctx.infoF("TS%d͈̔͂ɕ%dXbhŉ͂܂", numChunks, waveSize);
+
+		auto startWave = [&](int wave) {
+			auto& slot = results[wave & 1];
+			int first = wave * waveSize;
+			slot.clear();
+			slot.resize(std::min(waveSize, numChunks - first));
+			pool.start((int)slot.size(), [this, &slot, first](int task, int worker) {
+				slot[task] = parseChunk(first + task, splitWarmupSize_);
+			});
+		};
+
+		startWave(0);
+		for (int wave = 0; wave < numWaves; ++wave) {
+			pool.wait();
+			if (wave + 1 < numWaves) {
+				startWave(wave + 1);
+			}
+			for (auto& result : results[wave & 1]) {
+				for (int retry = 1; !checkChunk(prev.get(), *result); ++retry) {
+					++numSplitRetries_;
+					// O͈̔͂瑱ĉ͂łԂȂ炻ꂪԌy
+					bool canContinue = (seq != nullptr && seq->splitter.getNextStart() == result->start);
+					if (retry < 3 && !canContinue) {
+						// 8{O͂
+						int64_t warmup = splitWarmupSize_ << (3 * retry);
+						ctx.infoF("͈%d̐擪ŉ͏ԂvȂ̂%.1fMBO͂܂",
+							result->chunkIndex, warmup / (1024.0 * 1024.0));
+						result = parseChunk(result->chunkIndex, warmup);
+						continue;
+					}
+					// Ō͑O͈̔͂̍Ō̏Ԃ瑱ĉ͂i͕Kvj
+					ctx.infoF("͈%d͑O͈̔͂瑱ĉ͂܂", result->chunkIndex);
+					result = continueChunk(*prev, result->chunkIndex, seq);
+				}
+				replayChunk(*result);
+				prev = std::move(result);
+			}
+		}
+		if (numSplitRetries_ > 0) {
+			ctx.infoF("TS: ͈͂̐擪ŉ͏ԂvȂ%d͂܂", numSplitRetries_);
+		}
+	}
+
+	// Ăяô̓[J[Xbh
+	std::unique_ptr<TsChunkResult> parseChunk(int chunkIndex, int64_t warmup) {
+		std::unique_ptr<TsChunkResult> result(new TsChunkResult());
+		result->chunkIndex = chunkIndex;
+		result->start = chunkIndex * splitChunkSize_;
+		result->end = std::min(result->start + splitChunkSize_, srcFileSize_);
+		result->feedStart = std::max<int64_t>(0, result->start - warmup);
+		// mF͈͂͑O͈̔͂Ɏ߂
+		result->checkStart = std::max(std::max(result->feedStart, result->start - splitChunkSize_),
+			result->start - warmup / 3 / TS_PACKET_LENGTH * TS_PACKET_LENGTH);
+		result->feedEnd = std::min<int64_t>(result->end + SPLIT_LOOKAHEAD_SIZE, srcFileSize_);
+
+		// OG[JE^𕪂邽߃ReLXg͕ʂɂ
+		AMTContext chunkctx;
+		TsChunkSplitter splitter(chunkctx, enableVideo, enableAudio, enableCaption);
+		if (preferedServiceId > 0) {
+			splitter.setServiceId(preferedServiceId);
+		}
+		splitter.parse(setting_.getSrcFilePath(), *result);
+		return result;
+	}
+
+	// prev̑ƂchunkIndex͈̔͂͂
+	// seqprev̒Ŏ~܂Ă΂̂܂ܑāA
+	// łȂprevƓʒu͂prev̍Ō̏ԂČĂ瑱
+	// Ăяô͏XbhiO͈̔͂̌ʂKvȂ̂ŕɂ͂łȂj
+	std::unique_ptr<TsChunkResult> continueChunk(const TsChunkResult& prev, int chunkIndex,
+		std::unique_ptr<SeqChunkSplitter>& seq)
+	{
+		int64_t start = chunkIndex * splitChunkSize_;
+		if (seq == nullptr || seq->splitter.getNextStart() != start) {
+			seq = std::unique_ptr<SeqChunkSplitter>(
+				new SeqChunkSplitter(enableVideo, enableAudio, enableCaption));
+			if (preferedServiceId > 0) {
+				seq->splitter.setServiceId(preferedServiceId);
+			}
+			TsChunkResult replica;
+			replica.chunkIndex = prev.chunkIndex;
+			replica.feedStart = prev.feedStart;
+			replica.checkStart = replica.start = prev.start;
+			replica.end = prev.end;
+			replica.feedEnd = prev.feedEnd;
+			seq->splitter.parse(setting_.getSrcFilePath(), replica);
+		}
+		int64_t end = std::min(start + splitChunkSize_, srcFileSize_);
+		int64_t feedEnd = std::min<int64_t>(end + SPLIT_LOOKAHEAD_SIZE, srcFileSize_);
+		return seq->splitter.parseNext(setting_.getSrcFilePath(), chunkIndex, end, feedEnd);
+	}
+
+	// result̒S͈͂̒ÕCxgpreviO͈̔́j̍Ō̃Cxgƈv邩
+	// ̓q[XeBbNB͊̓ԁiPSIe[uAPID̊蓖āAr܂ŎMPESj
+	// rȂ̂ŁAEH[Abv̌1/3ŃCxgvĂԂƂ͌Ȃ
+	// vȂꍇ͉͂āÂƂOɏo
+	bool checkChunk(const TsChunkResult* prev, const TsChunkResult& result) {
+		if (result.feedStart == 0 || result.continued) {
+			// 擪炩O͈̔͂瑱ĉ͂Ă̂ŕK
+			return true;
+		}
+		ASSERT(prev != nullptr && prev->chunkIndex == result.chunkIndex - 1);
+		std::vector<const TsSplitEvent*> tail;
+		for (auto it = prev->events.rbegin(); it != prev->events.rend(); ++it) {
+			if (it->offset < result.checkStart) break;
+			if (it->type != TS_EV_LOG) {
+				tail.push_back(&*it);
+			}
+		}
+		std::reverse(tail.begin(), tail.end());
+		if (tail.size() != result.checkEvents.size()) {
+			return false;
+		}
+		bool hasVideo = false;
+		for (int i = 0; i < (int)tail.size(); ++i) {
+			if (!TsSplitEventEquals(*prev, *tail[i], result, result.checkEvents[i])) {
+				return false;
+			}
+			hasVideo |= (tail[i]->type == TS_EV_VIDEO_PES);
+		}
+		if (hasVideo) {
+			return true;
+		}
+		// fȂꍇAmF͈͂̑O瑱ĂfPESƏԂĂ邩Ȃ
+		// O͈̔͑ŜɉfȂ΁if̂ȂԁjfȊÕCxgvĂ΂悢
+		if (tail.size() == 0) {
+			return false;
+		}
+		return std::none_of(prev->events.begin(), prev->events.end(),
+			[](const TsSplitEvent& ev) { return ev.type == TS_EV_VIDEO_PES; });
+	}
+
+	// ͌ʂŜ1ŉ͂ꍇƓԂŏ
+	void replayChunk(const TsChunkResult& result) {
+		for (const TsSplitEvent& ev : result.events) {
+			uint8_t* data = result.data.ptr() + ev.dataOffset;
+			PESPacket packet(MemoryChunk(data, ev.dataLength));
+			switch (ev.type) {
+			case TS_EV_VIDEO_PES: {
+				packet.parse();
+				auto first = result.videoFrames.begin() + ev.itemIndex;
+				std::vector<VideoFrameInfo> frames(first, first + ev.numItems);
+				addVideoPesPacket(ev.clock, frames, packet, ev.pesOffset);
+				break;
+			}
+			case TS_EV_VIDEO_FORMAT:
+				onVideoFormatChanged(result.videoFormats[ev.itemIndex]);
+				break;
+			case TS_EV_AUDIO_PES: {
+				packet.parse();
+				auto first = result.audioFrames.begin() + ev.itemIndex;
+				std::vector<AudioFrameData> frames(first, first + ev.numItems);
+				uint8_t* codedData = data + ev.dataLength;
+				for (auto& frame : frames) {
+					frame.codedData = codedData;
+					codedData += frame.codedDataSize;
+				}
+				onAudioPesPacket(ev.index, ev.clock, frames, packet);
+				break;
+			}
+			case TS_EV_AUDIO_FORMAT:
+				onAudioFormatChanged(ev.index, result.audioFormats[ev.itemIndex]);
+				break;
+			case TS_EV_CAPTION_PES:
+				packet.parse();
+				captionParser.onPesPacket(ev.clock, packet);
+				break;
+			case TS_EV_PID_TABLE: {
+				const TsPidTable& table = result.pidTables[ev.itemIndex];
+				onPidTableChanged(table.video, table.audio, table.caption);
+				break;
+			}
+			case TS_EV_TIME:
+				onTime(ev.clock, result.times[ev.itemIndex]);
+				break;
+			case TS_EV_LOG: {
+				const char* str = result.logs[ev.itemIndex].c_str();
+				switch (ev.index) {
+				case AMT_LOG_DEBUG: ctx.debug(str); break;
+				case AMT_LOG_INFO: ctx.info(str); break;
+				case AMT_LOG_WARN: ctx.warn(str); break;
+				default: ctx.error(str); break;
+				}
+				break;
+			}
+			}
+		}
+		numTotalPackets += result.numTotalPackets;
+		numScramblePackets += result.numScramblePackets;
+		for (int i = 0; i < AMT_ERR_MAX; ++i) {
+			for (int n = 0; n < result.errCounter[i]; ++n) {
+				ctx.incrementCounter((AMT_ERROR_COUNTER)i);
+			}
+		}
+		selectedServiceId = result.selectedServiceId;
+	}
+
+	void writeData(AsyncFileWriter& writer, const File& file, MemoryChunk mc) {
+		if (pipelined_) {
+			writer.write(file, mc);
+		}
+		else {
+			file.write(mc);
+		}
+	}
+
+	void finishAudioDecode() {
+		if (parallelAudioDecode_ && !lazyWave_) {
+			audioDecoder_.join();
+			removeFailedAudioFrames();
+		}
+	}
+
+	// fR[hɎst[̂Ă
+	// TS͒ɃfR[hꍇ̍ē͍ČłȂ̂ŁA㑱t[PTS؂A
+	// PSɓꂽ͂̂܂܁io͂TS͒ɃfR[hꍇƓɂ͂ȂȂj
+	void removeFailedAudioFrames() {
+		if (failedAudioFrames_.size() == 0) {
+			return;
+		}
+		std::sort(failedAudioFrames_.begin(), failedAudioFrames_.end());
+		// l߂̃CfbNXitH[}bgύXCxg̈ʒu킹j
+		std::vector<int> newIndex(audioFrameList_.size() + 1);
+		int numFrames = 0;
+		auto failed = failedAudioFrames_.begin();
+		for (int i = 0; i < (int)audioFrameList_.size(); ++i) {
+			newIndex[i] = numFrames;
+			if (failed != failedAudioFrames_.end() && *failed == i) {
+				++failed;
+				continue;
+			}
+			audioFrameList_[numFrames++] = audioFrameList_[i];
+		}
+		newIndex.back() = numFrames;
+		audioFrameList_.resize(numFrames);
+		for (auto& ev : streamEventList_) {
+			if (ev.type == AUDIO_FORMAT_CHANGED) {
+				ev.frameIdx = newIndex[ev.frameIdx];
+			}
+		}
+		ctx.infoF("fR[hłȂt[%dO܂", (int)failedAudioFrames_.size());
+		failedAudioFrames_.clear();
+	}
+
+	// fR[hIt[ɗiĂяô͉̓Xbhj
+	void onAudioDecoded(int frameIndex, AdtsDecoder::DecodeResult result, MemoryChunk pcm) {
+		// xTS͒ɃfR[hꍇiAdtsParserjƓ2chɂȂȂƂ
+		if (result == AdtsDecoder::DECODE_NOT_STEREO) {
+			ctx.incrementCounter(AMT_ERR_DECODE_AUDIO);
+			ctx.warn("t[𐳂fR[hł܂ł");
+		}
+		if (result != AdtsDecoder::DECODE_OK) {
+			failedAudioFrames_.push_back(frameIndex);
+		}
+		FileAudioFrameInfo& info = audioFrameList_[frameIndex];
+		info.waveDataSize = (int)pcm.length;
+		info.waveOffset = waveFileSize_;
+		if (pcm.length > 0) {
+			writeData(waveWriter_, waveFile_, pcm);
+		}
+		waveFileSize_ += pcm.length;
 	}
 
 	static bool CheckPullDown(PICTURE_TYPE p0, PICTURE_TYPE p1) {
@@ -272,6 +961,25 @@ protected:
 		}
 	}
 
+	// pesOffset: PESpPbg̍ŏTSpPbǧTS̈ʒu
+	void addVideoPesPacket(
+		int64_t clock,
+		const std::vector<VideoFrameInfo>& frames,
+		PESPacket packet,
+		int64_t pesOffset)
+	{
+		int64_t fileOffset = virtualVideo_
+			? virtualWriter_.addPes(pesOffset, videoPid_)
+			: writeHandler.getTotalSize();
+		for (const VideoFrameInfo& frame : frames) {
+			videoFrameList_.push_back(frame);
+			videoFrameList_.back().fileOffset = fileOffset;
+		}
+		if (!virtualVideo_) {
+			psWriter.outVideoPesPacket(clock, frames, packet);
+		}
+	}
+
 	// TsSplitterz֐ //
 
 	virtual void onVideoPesPacket(
@@ -279,11 +987,7 @@ protected:
 		const std::vector<VideoFrameInfo>& frames,
 		PESPacket packet)
 	{
-		for (const VideoFrameInfo& frame : frames) {
-			videoFrameList_.push_back(frame);
-			videoFrameList_.back().fileOffset = writeHandler.getTotalSize();
-		}
-		psWriter.outVideoPesPacket(clock, frames, packet);
+		addVideoPesPacket(clock, frames, packet, getVideoPesOffset());
 	}
 
 	virtual void onVideoFormatChanged(VideoFormat fmt) {
@@ -308,8 +1012,14 @@ protected:
 		if (!curVideoFormat_.isBasicEquals(fmt)) {
 			// AXyNgȊOύXĂt@C𕪂
 			//iStreamReformƏ킹Ȃ΂ȂȂƂɒӁj
-			writeHandler.open(setting_.getIntVideoFilePath(videoFileCount_++));
-			psWriter.outHeader(videoStreamType_, audioStreamType_);
+			if (virtualVideo_) {
+				virtualWriter_.open(setting_.getIntVideoIndexPath(videoFileCount_++),
+					setting_.getSrcFilePath(), videoStreamType_);
+			}
+			else {
+				writeHandler.open(setting_.getIntVideoFilePath(videoFileCount_++));
+				psWriter.outHeader(videoStreamType_, audioStreamType_);
+			}
 		}
 		curVideoFormat_ = fmt;
 
@@ -332,15 +1042,32 @@ protected:
 			info.waveDataSize = frame.decodedDataSize;
 			info.fileOffset = audioFileSize_;
 			info.waveOffset = waveFileSize_;
-			audioFile_.write(MemoryChunk(frame.codedData, frame.codedDataSize));
-			if (frame.decodedDataSize > 0) {
-				waveFile_.write(MemoryChunk((uint8_t*)frame.decodedData, frame.decodedDataSize));
-			}
+			writeData(audioWriter_, audioFile_, MemoryChunk(frame.codedData, frame.codedDataSize));
 			audioFileSize_ += frame.codedDataSize;
-			waveFileSize_ += frame.decodedDataSize;
-			audioFrameList_.push_back(info);
+			if (lazyWave_) {
+				// WAV͏ɃfR[hꍇ̃TCYĂ
+				info.waveDataSize = frame.numDecodedSamples * 4; // 16bitXeI
+				waveFileSize_ += info.waveDataSize;
+				audioFrameList_.push_back(info);
+			}
+			else if (parallelAudioDecode_) {
+				// waveOffset,waveDataSize̓fR[hIĂ
+				audioFrameList_.push_back(info);
+				audioDecoder_.put(audioIdx, (int)audioFrameList_.size() - 1,
+					MemoryChunk(frame.codedData, frame.codedDataSize));
+			}
+			else {
+				if (frame.decodedDataSize > 0) {
+					writeData(waveWriter_, waveFile_, MemoryChunk((uint8_t*)frame.decodedData, frame.decodedDataSize));
+				}
+				waveFileSize_ += frame.decodedDataSize;
+				audioFrameList_.push_back(info);
+			}
+		}
+		if (parallelAudioDecode_ && !lazyWave_) {
+			audioDecoder_.pop();
 		}
-		if (videoFileCount_ > 0) {
+		if (videoFileCount_ > 0 && !virtualVideo_) {
 			psWriter.outAudioPesPacket(audioIdx, clock, frames, packet);
 		}
 	}
@@ -383,6 +1110,7 @@ protected:
 		ASSERT(audio.size() > 0);
 		videoStreamType_ = video.stype;
 		audioStreamType_ = audio[0].stype;
+		videoPid_ = video.pid;
 
 		StreamEvent ev = StreamEvent();
 		ev.type = PID_TABLE_CHANGED;
@@ -612,8 +1340,8 @@ static void transcodeMain(AMTContext& ctx, const ConfigWrapper& setting)
 		auto& fmt = reformInfo.getFormat(EncodeFileKey(videoFileIndex, 0));
 		auto amtsPath = setting.getTmpAMTSourcePath(videoFileIndex);
 		av::SaveAMTSource(amtsPath,
-			setting.getIntVideoFilePath(videoFileIndex),
-			setting.getWaveFilePath(),
+			setting.getIntVideoSourcePath(videoFileIndex),
+			setting.getWaveSourcePath(), setting.isLazyWave(),
 			fmt.videoFormat, fmt.audioFormat[0],
 			reformInfo.getFilterSourceFrames(videoFileIndex),
 			reformInfo.getFilterSourceAudioFrames(videoFileIndex),
@@ -738,7 +1466,8 @@ static void transcodeMain(AMTContext& ctx, const ConfigWrapper& setting)
 				outpath);
 			auto format = reformInfo.getFormat(key);
 			auto audioFrames = reformInfo.getWaveInput(reformInfo.getEncodeFile(key).audioFrames[0]);
-			EncodeAudio(ctx, args, setting.getWaveFilePath(), format.audioFormat[0], audioFrames);
+			EncodeAudio(ctx, args, setting.getWaveSourcePath(), setting.isLazyWave(),
+				format.audioFormat[0], audioFrames);
 		}
 	}
 
@@ -940,14 +1669,12 @@ public:
 	void readAll()
 	{
 		enum { BUFSIZE = 4 * 1024 * 1024 };
-		auto buffer_ptr = std::unique_ptr<uint8_t[]>(new uint8_t[BUFSIZE]);
-		MemoryChunk buffer(buffer_ptr.get(), BUFSIZE);
-		File srcfile(setting_.getSrcFilePath(), _T("rb"));
-		size_t readBytes;
+		MappedFile srcfile(setting_.getSrcFilePath());
+		MemoryChunk buffer;
 		do {
-			readBytes = srcfile.read(buffer);
-			inputTsData(MemoryChunk(buffer.data, readBytes));
-		} while (readBytes == buffer.length);
+			buffer = srcfile.read(BUFSIZE);
+			inputTsData(buffer);
+		} while (buffer.length > 0);
 	}
 
 protected:
@@ -1005,20 +1732,18 @@ public:
 	void readAll(int maxframes)
 	{
 		enum { BUFSIZE = 4 * 1024 * 1024 };
-		auto buffer_ptr = std::unique_ptr<uint8_t[]>(new uint8_t[BUFSIZE]);
-		MemoryChunk buffer(buffer_ptr.get(), BUFSIZE);
-		File srcfile(setting_.getSrcFilePath(), _T("rb"));
+		MappedFile srcfile(setting_.getSrcFilePath());
 		auto fileSize = srcfile.size();
 		// t@C擪10%̂Ƃ납ǂ
 		srcfile.seek(fileSize / 10, SEEK_SET);
 		int64_t totalRead = 0;
 		// Ō10%͓ǂ܂Ȃ
 		int64_t end = fileSize / 10 * 9;
-		size_t readBytes;
+		MemoryChunk buffer;
 		do {
-			readBytes = srcfile.read(buffer);
-			inputTsData(MemoryChunk(buffer.data, readBytes));
-			totalRead += readBytes;
+			buffer = srcfile.read(BUFSIZE);
+			inputTsData(buffer);
+			totalRead += buffer.length;
 		} while (totalRead < end && !hasSubtltle_ && videoFrameList_.size() < maxframes);
 	}
 
@@ -1077,25 +1802,26 @@ public:
 	AudioDetectorSplitter(AMTContext& ctx, const ConfigWrapper& setting)
 		: TsSplitter(ctx, true, true, false)
 		, setting_(setting)
-	{ }
+	{
+		// tH[}bg΂̂ŃfR[h͕sv
+		setDeferAudioDecode(true);
+	}
 
 	void readAll(int maxframes)
 	{
 		enum { BUFSIZE = 4 * 1024 * 1024 };
-		auto buffer_ptr = std::unique_ptr<uint8_t[]>(new uint8_t[BUFSIZE]);
-		MemoryChunk buffer(buffer_ptr.get(), BUFSIZE);
-		File srcfile(setting_.getSrcFilePath(), _T("rb"));
+		MappedFile srcfile(setting_.getSrcFilePath());
 		auto fileSize = srcfile.size();
 		// t@C擪10%̂Ƃ납ǂ
 		srcfile.seek(fileSize / 10, SEEK_SET);
 		int64_t totalRead = 0;
 		// Ō10%͓ǂ܂Ȃ
 		int64_t end = fileSize / 10 * 9;
-		size_t readBytes;
+		MemoryChunk buffer;
 		do {
-			readBytes = srcfile.read(buffer);
-			inputTsData(MemoryChunk(buffer.data, readBytes));
-			totalRead += readBytes;
+			buffer = srcfile.read(BUFSIZE);
+			inputTsData(buffer);
+			totalRead += buffer.length;
 		} while (totalRead < end && videoFrameList_.size() < maxframes);
 	}
 
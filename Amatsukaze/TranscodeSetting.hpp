@@ -579,6 +579,11 @@ struct Config {
 	DecoderSetting decoderSetting;
 	int audioBitrateInKbps;
 	int numEncodeBufferFrames;
+	bool pipelinedSplit;
+	bool parallelAudioDecode;
+	bool lazyWave;
+	int numSplitThreads;
+	bool virtualIntVideo;
 	// CM͗pݒ
 	std::vector<tstring> logoPath;
 	std::vector<tstring> eraseLogoPath;
@@ -587,6 +592,7 @@ struct Config {
 	bool ignoreNicoJKError;
 	double pmtCutSideRate[2];
 	bool looseLogoDetection;
+	int logoPruneTopK;
 	bool noDelogo;
 	int maxFadeLength;
 	tstring chapterExePath;
@@ -781,6 +787,27 @@ public:
 		return conf.numEncodeBufferFrames;
 	}
 
+	bool isPipelinedSplit() const {
+		return conf.pipelinedSplit;
+	}
+
+	bool isParallelAudioDecode() const {
+		return conf.parallelAudioDecode;
+	}
+
+	bool isLazyWave() const {
+		return conf.lazyWave;
+	}
+
+	int getNumSplitThreads() const {
+		return conf.numSplitThreads;
+	}
+
+	// ԉft@CɌTSQƂCfbNXɂ邩
+	bool isVirtualIntVideo() const {
+		return conf.virtualIntVideo;
+	}
+
 	const std::vector<tstring>& getLogoPath() const {
 		return conf.logoPath;
 	}
@@ -813,6 +840,10 @@ public:
 		return conf.looseLogoDetection;
 	}
 
+	int getLogoPruneTopK() const {
+		return conf.logoPruneTopK;
+	}
+
 	bool isNoDelogo() const {
 		return conf.noDelogo;
 	}
@@ -893,10 +924,25 @@ public:
 		return regtmp(StringFormat(_T("%s/audio.wav"), tmpDir.path()));
 	}
 
+	// WaveReaderɓnt@CiisLazyWave()Ȃ璆AACt@Cj
+	tstring getWaveSourcePath() const {
+		return isLazyWave() ? getAudioFilePath() : getWaveFilePath();
+	}
+
 	tstring getIntVideoFilePath(int index) const {
 		return regtmp(StringFormat(_T("%s/i%d.mpg"), tmpDir.path(), index));
 	}
 
+	// ԉft@C̑VirtualTsIndex
+	tstring getIntVideoIndexPath(int index) const {
+		return regtmp(StringFormat(_T("%s/i%d.vts"), tmpDir.path(), index));
+	}
+
+	// AMTSourceɓnt@CiisVirtualIntVideo()ȂVirtualTsIndexj
+	tstring getIntVideoSourcePath(int index) const {
+		return isVirtualIntVideo() ? getIntVideoIndexPath(index) : getIntVideoFilePath(index);
+	}
+
 	tstring getPacketInfoPath() const {
 		return regtmp(tmpDir.path() + _T("/packetinfo.dat"));
 	}
@@ -1232,6 +1278,13 @@ public:
 		ctx.infoF("fR[_: MPEG2:%s H264:%s",
 			decoderToString(conf.decoderSetting.mpeg2),
 			decoderToString(conf.decoderSetting.h264));
+		if (conf.decoderSetting.prefetchFrames > 0) {
+			ctx.infoF("ǂ݃fR[h: %dt[(ő%dMB)",
+				conf.decoderSetting.prefetchFrames, conf.decoderSetting.prefetchMemory);
+		}
+		if (conf.decoderSetting.gopDecoders > 0) {
+			ctx.infoF("GOPfR[h: %dfR[_", conf.decoderSetting.gopDecoders);
+		}
 	}
 
 	void CreateTempDir() {
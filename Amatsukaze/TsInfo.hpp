@@ -470,7 +470,7 @@ public:
 	{ }
 
 	void ReadFile(const tchar* filepath) {
-		File srcfile(std::wstring(filepath), _T("rb"));
+		MappedFile srcfile(std::wstring(filepath));
 		// t@C̐^񒆂ǂ
 		srcfile.seek(srcfile.size() / 2, SEEK_SET);
 		int ret = ReadTS(srcfile);
@@ -589,22 +589,20 @@ private:
 
 	TsInfoParser parser;
 
-	int ReadTS(File& srcfile) {
+	int ReadTS(MappedFile& srcfile) {
 		enum {
 			BUFSIZE = 4 * 1024 * 1024,
 			MAX_BYTES = 100 * 1024 * 1024
 		};
-		auto buffer_ptr = std::unique_ptr<uint8_t[]>(new uint8_t[BUFSIZE]);
-		MemoryChunk buffer(buffer_ptr.get(), BUFSIZE);
 		size_t totalRead = 0;
-		size_t readBytes;
+		MemoryChunk buffer;
 		SpTsPacketParser packetParser(*this);
 		do {
-			readBytes = srcfile.read(buffer);
-			packetParser.inputTS(MemoryChunk(buffer.data, readBytes));
+			buffer = srcfile.read(BUFSIZE);
+			packetParser.inputTS(buffer);
 			if (parser.isOK()) return 0;
-			totalRead += readBytes;
-		} while (readBytes == buffer.length && totalRead < MAX_BYTES);
+			totalRead += buffer.length;
+		} while (buffer.length > 0 && totalRead < MAX_BYTES);
 		if (parser.isProgramOK()) return 0;
 		if (parser.isScrampbled()) return 2;
 		return 1;
@@ -651,22 +649,20 @@ public:
 	bool exec(const tchar* srcpath, const tchar* dstpath, TS_SLIM_CALLBACK cb)
 	{
 		try {
-			File srcfile(std::wstring(srcpath), L"rb");
+			MappedFile srcfile(std::wstring(srcpath));
 			File dstfile(std::wstring(dstpath), L"wb");
 			pfile = &dstfile;
 			videoOk = false;
 			enum {
 				BUFSIZE = 4 * 1024 * 1024
 			};
-			auto buffer_ptr = std::unique_ptr<uint8_t[]>(new uint8_t[BUFSIZE]);
-			MemoryChunk buffer(buffer_ptr.get(), BUFSIZE);
-			size_t readBytes;
+			MemoryChunk buffer;
 			SpTsPacketParser packetParser(*this);
 			do {
-				readBytes = srcfile.read(buffer);
-				packetParser.inputTS(MemoryChunk(buffer.data, readBytes));
+				buffer = srcfile.read(BUFSIZE);
+				packetParser.inputTS(buffer);
 				if (cb() == false) return false;
-			} while (readBytes == buffer.length);
+			} while (buffer.length > 0);
 			packetParser.flush();
 			return true;
 		}
@@ -13,6 +13,7 @@
 #include <vector>
 #include <map>
 #include <array>
+#include <deque>
 
 #include "StreamUtils.hpp"
 #include "Mpeg2TsParser.hpp"
@@ -148,6 +149,11 @@ public:
 
 	virtual void onAudioFormatChanged(AudioFormat fmt) = 0;
 
+	// AdtsParser::setDeferDecodeQ
+	void setDeferDecode(bool defer) {
+		adtsParser.setDeferDecode(defer);
+	}
+
 private:
 	AudioFormat format;
 
@@ -258,6 +264,8 @@ public:
 		, numBefferedPackets_(0)
 		, numMaxPackets(0)
 		, buffering(false)
+		, currentOffset(0)
+		, packetOffset(0)
 	{ }
 
 	void setHandler(TsPacketHandler* handler) {
@@ -270,6 +278,7 @@ public:
 
 	void clearBuffer() {
 		buffer.clear();
+		bufferedOffsets.clear();
 		numBefferedPackets_ = 0;
 	}
 
@@ -289,19 +298,35 @@ public:
 			for (int i = 0; i < (int)buffer.size(); i += TS_PACKET_LENGTH) {
 				TsPacket packet(buffer.ptr() + i);
 				if (packet.parse() && packet.check()) {
+					packetOffset = bufferedOffsets[i / TS_PACKET_LENGTH];
 					handler->onTsPacket(-1, packet);
 				}
 			}
+			packetOffset = currentOffset;
 		}
 	}
 
+	// Ōɓ͂ꂽpPbg̓͑Ŝ̐擪̈ʒuibackAndInputōē͂pPbg͊܂܂Ȃj
+	int64_t getCurrentPacketOffset() const {
+		return currentOffset;
+	}
+
+	// ̃pPbg̓͑Ŝ̐擪̈ʒuibackAndInputōē͂pPbg͂̃pPbg̈ʒuj
+	int64_t getPacketOffset() const {
+		return packetOffset;
+	}
+
 	virtual void onTsPacket(TsPacket packet) {
+		currentOffset = packetOffset = TsPacketParser::getPacketOffset(packet.data);
 		if (buffering) {
 			if (numBefferedPackets_ >= numMaxPackets) {
-				buffer.trimHead((numMaxPackets - numBefferedPackets_ + 1) * TS_PACKET_LENGTH);
+				int numTrim = numMaxPackets - numBefferedPackets_ + 1;
+				buffer.trimHead(numTrim * TS_PACKET_LENGTH);
+				bufferedOffsets.erase(bufferedOffsets.begin(), bufferedOffsets.begin() + numTrim);
 				numBefferedPackets_ = numMaxPackets - 1;
 			}
 			buffer.add(MemoryChunk(packet.data, TS_PACKET_LENGTH));
+			bufferedOffsets.push_back(currentOffset);
 			++numBefferedPackets_;
 		}
 		if (handler != NULL) {
@@ -315,6 +340,9 @@ private:
 	int numBefferedPackets_;
 	int numMaxPackets;
 	bool buffering;
+	std::deque<int64_t> bufferedOffsets;
+	int64_t currentOffset;
+	int64_t packetOffset;
 };
 
 class TsSystemClock {
@@ -413,6 +441,7 @@ public:
 		, enableVideo(enableVideo)
 		, enableAudio(enableAudio)
 		, enableCaption(enableCaption)
+		, deferAudioDecode(false)
 		, numTotalPackets(0)
 		, numScramblePackets(0)
 	{
@@ -438,6 +467,15 @@ public:
 		return selectedServiceId;
 	}
 
+	// trueɂƉfR[hȂiAudioFrameData.decodedDataSize0ɂȂj
+	// fR[hf[^Kvȏꍇ͌ĂяoŃfR[h邱
+	void setDeferAudioDecode(bool defer) {
+		deferAudioDecode = defer;
+		for (auto parser : audioParsers) {
+			parser->setDeferDecode(defer);
+		}
+	}
+
 	void inputTsData(MemoryChunk data) {
 		tsPacketParser.inputTS(data);
 	}
@@ -565,6 +603,7 @@ protected:
 	bool enableVideo;
 	bool enableAudio;
 	bool enableCaption;
+	bool deferAudioDecode;
 	int preferedServiceId;
 	int selectedServiceId;
 
@@ -651,6 +690,7 @@ protected:
 			while (audioParsers.size() < numAudios) {
 				int audioIdx = int(audioParsers.size());
 				audioParsers.push_back(new SpAudioFrameParser(ctx, *this, audioIdx));
+				audioParsers.back()->setDeferDecode(deferAudioDecode);
 				ctx.infoF("p[T %d ǉ", audioIdx);
 			}
 		}
@@ -666,7 +706,16 @@ protected:
 	}
 
 	virtual void onVideoPacket(int64_t clock, TsPacket packet) {
-		if (enableVideo && checkScramble(packet)) videoParser.onTsPacket(clock, packet);
+		if (enableVideo && checkScramble(packet)) {
+			// PES̈ʒu悤ɃpPbg̈ʒunĂ
+			videoParser.setPacketTag(tsPacketParser.getPacketOffset());
+			videoParser.onTsPacket(clock, packet);
+		}
+	}
+
+	// onVideoPesPacket̒ŌĂԂƂPESpPbg̍ŏTSpPbg̓͑Ŝ̐擪̈ʒu
+	int64_t getVideoPesOffset() const {
+		return videoParser.getPesTag();
 	}
 
 	virtual void onAudioPacket(int64_t clock, TsPacket packet, int audioIdx) {
@@ -681,3 +730,427 @@ protected:
 	}
 };
 
+// `NTS͂ŋL^Cxg
+enum TS_SPLIT_EVENT_TYPE {
+	TS_EV_VIDEO_PES,
+	TS_EV_VIDEO_FORMAT,
+	TS_EV_AUDIO_PES,
+	TS_EV_AUDIO_FORMAT,
+	TS_EV_CAPTION_PES,
+	TS_EV_PID_TABLE,
+	TS_EV_TIME,
+	TS_EV_LOG,
+};
+
+struct TsSplitEvent {
+	TS_SPLIT_EVENT_TYPE type;
+	int64_t offset;     // CxgɏĂTSpPbg̃t@Cʒu
+	int64_t clock;
+	int index;          // CfbNX or Ox
+	int itemIndex;      // ނƂ̃Xg̈ʒu
+	int numItems;
+	size_t dataOffset;  // datäʒuimFpCxg̓f[^Ȃj
+	int dataLength;     // PESpPbg
+	int64_t pesOffset;  // fPES̍ŏTSpPbg̃t@Cʒu
+};
+
+struct TsPidTable {
+	PMTESInfo video;
+	std::vector<PMTESInfo> audio;
+	PMTESInfo caption;
+};
+
+// 1͈͂̉͌
+struct TsChunkResult {
+	int chunkIndex;
+	int64_t feedStart;  // ͂n߂ʒui0ȂŜ͂ꍇƕKj
+	int64_t checkStart; // [checkStart,start)͑O͈̔͂Ƃ̈vmFp
+	int64_t start;      // [start,end)͈̔͂̒S
+	int64_t end;
+	int64_t feedEnd;    // S͈͂̌čŌ̃pPbg܂ŏ
+	bool continued;     // O͈̔͂̉͂̑Ƃĉ͂iԂ͑O͈̔͂ƓȂ̂ŊmFsvj
+
+	std::vector<TsSplitEvent> events;
+	std::vector<TsSplitEvent> checkEvents;
+	std::vector<VideoFrameInfo> videoFrames;
+	std::vector<AudioFrameData> audioFrames; // codedDataPESpPbǧɏɓĂ
+	std::vector<VideoFormat> videoFormats;
+	std::vector<AudioFormat> audioFormats;
+	std::vector<TsPidTable> pidTables;
+	std::vector<JSTTime> times;
+	std::vector<std::string> logs;
+	AutoBuffer data;
+
+	// S͈͂ő
+	int64_t numTotalPackets;
+	int64_t numScramblePackets;
+	std::array<int, AMT_ERR_MAX> errCounter;
+
+	int selectedServiceId;
+
+	TsChunkResult()
+		: chunkIndex(), feedStart(), checkStart(), start(), end(), feedEnd(), continued()
+		, numTotalPackets(), numScramblePackets(), errCounter(), selectedServiceId(-1)
+	{ }
+};
+
+// ʁXɉ͂2̌ʂ̃Cxgif[^̒g͌Ȃj
+static bool TsSplitEventEquals(
+	const TsChunkResult& ra, const TsSplitEvent& a,
+	const TsChunkResult& rb, const TsSplitEvent& b)
+{
+	if (a.type != b.type || a.offset != b.offset || a.clock != b.clock ||
+		a.index != b.index || a.numItems != b.numItems || a.dataLength != b.dataLength ||
+		a.pesOffset != b.pesOffset) {
+		return false;
+	}
+	switch (a.type) {
+	case TS_EV_VIDEO_PES:
+		for (int i = 0; i < a.numItems; ++i) {
+			const VideoFrameInfo& fa = ra.videoFrames[a.itemIndex + i];
+			const VideoFrameInfo& fb = rb.videoFrames[b.itemIndex + i];
+			if (fa.PTS != fb.PTS || fa.DTS != fb.DTS || fa.isGopStart != fb.isGopStart ||
+				fa.progressive != fb.progressive || fa.pic != fb.pic || fa.type != fb.type ||
+				fa.codedDataSize != fb.codedDataSize || fa.format != fb.format) {
+				return false;
+			}
+		}
+		return true;
+	case TS_EV_AUDIO_PES:
+		for (int i = 0; i < a.numItems; ++i) {
+			const AudioFrameData& fa = ra.audioFrames[a.itemIndex + i];
+			const AudioFrameData& fb = rb.audioFrames[b.itemIndex + i];
+			if (fa.PTS != fb.PTS || fa.numSamples != fb.numSamples || fa.format != fb.format ||
+				fa.codedDataSize != fb.codedDataSize || fa.numDecodedSamples != fb.numDecodedSamples) {
+				return false;
+			}
+		}
+		return true;
+	case TS_EV_VIDEO_FORMAT:
+		return ra.videoFormats[a.itemIndex] == rb.videoFormats[b.itemIndex];
+	case TS_EV_AUDIO_FORMAT:
+		return ra.audioFormats[a.itemIndex] == rb.audioFormats[b.itemIndex];
+	case TS_EV_PID_TABLE: {
+		const TsPidTable& ta = ra.pidTables[a.itemIndex];
+		const TsPidTable& tb = rb.pidTables[b.itemIndex];
+		if (ta.video.pid != tb.video.pid || ta.video.stype != tb.video.stype ||
+			ta.caption.pid != tb.caption.pid || ta.caption.stype != tb.caption.stype ||
+			ta.audio.size() != tb.audio.size()) {
+			return false;
+		}
+		for (int i = 0; i < (int)ta.audio.size(); ++i) {
+			if (ta.audio[i].pid != tb.audio[i].pid || ta.audio[i].stype != tb.audio[i].stype) {
+				return false;
+			}
+		}
+		return true;
+	}
+	case TS_EV_TIME:
+		return ra.times[a.itemIndex].time == rb.times[b.itemIndex].time;
+	default:
+		return true;
+	}
+}
+
+// TS̈ꕔ͈͂͂ăCxgL^
+// Cxg͂̎ĂTSpPbg̈ʒuŒS͈͂߂̂
+// e͈͂̒SCxgȂƑŜ1ŉ͂ꍇƓԂɂȂ
+// O͈̔͂͂n߂ďԂ킹邪A{ɍĂ邩
+// [checkStart,start)̃CxgO͈̔͂̌ʂƔrĊmF邱
+// iԂ͔rȂ̂ŃCxgvĂԂƂ͌Ȃj
+// ̓fR[hx[hAPESpPbĝ܂܋L^邾iDLL͕ɎgȂ̂Łj
+// ctx͐p̂̂nƁiO荞ނ߁j
+// setContinuousĂparseNextŒ͈̔͂Ԃp܂܉͂ł
+class TsChunkSplitter : public TsSplitter, private AMTLogHandler {
+public:
+	TsChunkSplitter(AMTContext& ctx, bool enableVideo, bool enableAudio, bool enableCaption)
+		: TsSplitter(ctx, enableVideo, enableAudio, enableCaption)
+		, captionRecorder(*this)
+		, result(nullptr)
+		, target(nullptr)
+		, continuous(false)
+		, feedBase(0)
+		, fedEnd(0)
+		, ownState(0)
+		, startNumTotalPackets(0)
+		, startNumScramblePackets(0)
+		, startErrCounter()
+	{
+		setDeferAudioDecode(true);
+		ctx.setLogHandler(this);
+	}
+
+	~TsChunkSplitter() {
+		ctx.setLogHandler(nullptr);
+	}
+
+	// S͈͂̌ŔCxg͈̔͂̕ƂĎĂ
+	// parsȇOɐݒ肷邱
+	void setContinuous(bool enable) {
+		continuous = enable;
+	}
+
+	void parse(const tstring& srcpath, TsChunkResult& result) {
+		feedBase = fedEnd = result.feedStart;
+		this->result = &result;
+		startNext();
+		feed(srcpath, result.feedEnd);
+		finish();
+	}
+
+	// O͈͈͂͂̒̔[Oend,end)ȌԂ瑱ĉ͂
+	// ʂ͑ȎȂ̂ŁAO͈̔͂܂łΑŜ1ŉ͂ꍇƓɂȂ
+	std::unique_ptr<TsChunkResult> parseNext(const tstring& srcpath, int chunkIndex, int64_t end, int64_t feedEnd) {
+		ASSERT(next != nullptr && next->start < end);
+		// O̐ǂ݂ŋL^Cxg͂̂܂܎g
+		std::unique_ptr<TsChunkResult> cur = std::move(next);
+		cur->chunkIndex = chunkIndex;
+		cur->end = end;
+		cur->feedEnd = feedEnd;
+		cur->continued = true;
+		this->result = cur.get();
+		// S͈͂ɓƂ̃JE^͑O͈̔͂oƂɋL^ς
+		ownState = 1;
+		startNext();
+		feed(srcpath, feedEnd);
+		finish();
+		return cur;
+	}
+
+	// parseNextŉ͂ł͈͂̐擪iĉ͂łȂ-1j
+	int64_t getNextStart() const {
+		return (next != nullptr) ? next->start : -1;
+	}
+
+protected:
+	class CaptionPesRecorder : public PesParser {
+		TsChunkSplitter& this_;
+	public:
+		CaptionPesRecorder(TsChunkSplitter& this_) : this_(this_) { }
+	protected:
+		virtual void onPesPacket(int64_t clock, PESPacket packet) {
+			TsSplitEvent* ev = this_.addEvent(TS_EV_CAPTION_PES, clock, 0);
+			if (ev != nullptr) {
+				this_.addData(*ev, packet);
+			}
+		}
+	};
+
+	CaptionPesRecorder captionRecorder;
+	TsChunkResult* result;
+	TsChunkResult* target; // ŌaddEventCxg̋L^iresultnextj
+	bool continuous;
+	std::unique_ptr<TsChunkResult> next; // continuous̏ꍇ̒S͈͌̃CxgL^
+	int64_t feedBase; // ŏɓ͂f[^̃t@Cʒu
+	int64_t fedEnd;   // ͍ς݂̃f[^̏I
+	int ownState; // 0:S͈͑O 1:S͈ 2:S͈͌
+	int64_t startNumTotalPackets;
+	int64_t startNumScramblePackets;
+	std::array<int, AMT_ERR_MAX> startErrCounter;
+
+	int64_t currentOffset() const {
+		return feedBase + tsPacketParser.getCurrentPacketOffset();
+	}
+
+	void startNext() {
+		next = nullptr;
+		if (continuous) {
+			next = std::unique_ptr<TsChunkResult>(new TsChunkResult());
+			next->feedStart = feedBase;
+			next->checkStart = next->start = result->end;
+			next->end = next->feedEnd = INT64_MAX;
+		}
+	}
+
+	void feed(const tstring& srcpath, int64_t feedEnd) {
+		size_t length = (size_t)(feedEnd - fedEnd);
+		MappedFile view(srcpath, length + 2 * 1024 * 1024);
+		view.seek(fedEnd, SEEK_SET);
+		MemoryChunk data = view.read(length);
+		if (data.length != length) {
+			THROW(IOException, "failed to map TS chunk");
+		}
+		inputTsData(data);
+		fedEnd = feedEnd;
+	}
+
+	void finish() {
+		updateOwnState(INT64_MAX);
+		result->selectedServiceId = getActualServiceId();
+		result = nullptr;
+	}
+
+	// S͈͂ɓ/oƂ̃JE^L^
+	void updateOwnState(int64_t offset) {
+		if (ownState == 0 && offset >= result->start) {
+			startNumTotalPackets = numTotalPackets;
+			startNumScramblePackets = numScramblePackets;
+			for (int i = 0; i < AMT_ERR_MAX; ++i) {
+				startErrCounter[i] = ctx.getErrorCount((AMT_ERROR_COUNTER)i);
+			}
+			ownState = 1;
+		}
+		if (ownState == 1 && offset >= result->end) {
+			result->numTotalPackets = numTotalPackets - startNumTotalPackets;
+			result->numScramblePackets = numScramblePackets - startNumScramblePackets;
+			for (int i = 0; i < AMT_ERR_MAX; ++i) {
+				result->errCounter[i] = ctx.getErrorCount((AMT_ERROR_COUNTER)i) - startErrCounter[i];
+			}
+			ownState = 2;
+			if (next != nullptr) {
+				// ͈̔͂͂
+				startNumTotalPackets = numTotalPackets;
+				startNumScramblePackets = numScramblePackets;
+				for (int i = 0; i < AMT_ERR_MAX; ++i) {
+					startErrCounter[i] = ctx.getErrorCount((AMT_ERROR_COUNTER)i);
+				}
+			}
+		}
+	}
+
+	// L^Ȃ͈͂ȂnullptriL^ꍇ͋L^悪targetɓj
+	TsSplitEvent* addEvent(TS_SPLIT_EVENT_TYPE type, int64_t clock, int index) {
+		int64_t offset = currentOffset();
+		target = (next != nullptr && offset >= result->end) ? next.get() : result;
+		if (offset < target->checkStart || offset >= target->end) {
+			return nullptr;
+		}
+		TsSplitEvent ev = TsSplitEvent();
+		ev.type = type;
+		ev.offset = offset;
+		ev.clock = clock;
+		ev.index = index;
+		auto& list = (offset < target->start) ? target->checkEvents : target->events;
+		list.push_back(ev);
+		return &list.back();
+	}
+
+	bool isOwned(const TsSplitEvent& ev) const {
+		return ev.offset >= target->start;
+	}
+
+	void addData(TsSplitEvent& ev, PESPacket packet) {
+		ev.dataLength = (int)packet.length;
+		if (isOwned(ev)) {
+			ev.dataOffset = target->data.size();
+			target->data.add(MemoryChunk(packet.data, packet.length));
+		}
+	}
+
+	virtual void onVideoPesPacket(
+		int64_t clock,
+		const std::vector<VideoFrameInfo>& frames,
+		PESPacket packet)
+	{
+		TsSplitEvent* ev = addEvent(TS_EV_VIDEO_PES, clock, 0);
+		if (ev != nullptr) {
+			ev->pesOffset = feedBase + getVideoPesOffset();
+			ev->itemIndex = (int)target->videoFrames.size();
+			ev->numItems = (int)frames.size();
+			target->videoFrames.insert(target->videoFrames.end(), frames.begin(), frames.end());
+			addData(*ev, packet);
+		}
+	}
+
+	virtual void onVideoFormatChanged(VideoFormat fmt) {
+		TsSplitEvent* ev = addEvent(TS_EV_VIDEO_FORMAT, -1, 0);
+		if (ev != nullptr) {
+			ev->itemIndex = (int)target->videoFormats.size();
+			target->videoFormats.push_back(fmt);
+		}
+	}
+
+	virtual void onAudioPesPacket(
+		int audioIdx,
+		int64_t clock,
+		const std::vector<AudioFrameData>& frames,
+		PESPacket packet)
+	{
+		TsSplitEvent* ev = addEvent(TS_EV_AUDIO_PES, clock, audioIdx);
+		if (ev != nullptr) {
+			ev->itemIndex = (int)target->audioFrames.size();
+			ev->numItems = (int)frames.size();
+			addData(*ev, packet);
+			for (const AudioFrameData& frame : frames) {
+				AudioFrameData info = frame;
+				info.codedData = nullptr;
+				info.decodedData = nullptr;
+				target->audioFrames.push_back(info);
+				if (isOwned(*ev)) {
+					target->data.add(MemoryChunk(frame.codedData, frame.codedDataSize));
+				}
+			}
+		}
+	}
+
+	virtual void onAudioFormatChanged(int audioIdx, AudioFormat fmt) {
+		TsSplitEvent* ev = addEvent(TS_EV_AUDIO_FORMAT, -1, audioIdx);
+		if (ev != nullptr) {
+			ev->itemIndex = (int)target->audioFormats.size();
+			target->audioFormats.push_back(fmt);
+		}
+	}
+
+	virtual void onCaptionPesPacket(
+		int64_t clock,
+		std::vector<CaptionItem>& captions,
+		PESPacket packet)
+	{
+		// captionRecorderŋL^̂łɂ͗Ȃ
+	}
+
+	virtual DRCSOutInfo getDRCSOutPath(int64_t PTS, const std::string& md5) {
+		return DRCSOutInfo();
+	}
+
+	virtual void onPidTableChanged(const PMTESInfo video, const std::vector<PMTESInfo>& audio, const PMTESInfo caption) {
+		// x[XNX̏
+		TsSplitter::onPidTableChanged(video, audio, caption);
+
+		TsSplitEvent* ev = addEvent(TS_EV_PID_TABLE, -1, 0);
+		if (ev != nullptr) {
+			ev->itemIndex = (int)target->pidTables.size();
+			TsPidTable table;
+			table.video = video;
+			table.audio = audio;
+			table.caption = caption;
+			target->pidTables.push_back(table);
+		}
+	}
+
+	virtual void onTime(int64_t clock, JSTTime time) {
+		TsSplitEvent* ev = addEvent(TS_EV_TIME, clock, 0);
+		if (ev != nullptr) {
+			ev->itemIndex = (int)target->times.size();
+			target->times.push_back(time);
+		}
+	}
+
+	virtual void onVideoPacket(int64_t clock, TsPacket packet) {
+		updateOwnState(currentOffset());
+		TsSplitter::onVideoPacket(clock, packet);
+	}
+
+	virtual void onAudioPacket(int64_t clock, TsPacket packet, int audioIdx) {
+		updateOwnState(currentOffset());
+		TsSplitter::onAudioPacket(clock, packet, audioIdx);
+	}
+
+	virtual void onCaptionPacket(int64_t clock, TsPacket packet) {
+		updateOwnState(currentOffset());
+		if (enableCaption && checkScramble(packet)) captionRecorder.onTsPacket(clock, packet);
+	}
+
+	// AMTLogHandler
+	virtual void onLog(const char* str, AMT_LOG_LEVEL level) {
+		// O͈vmFȂ̂ŒS͈͂̂̂L^
+		if (result == nullptr || currentOffset() < result->start) {
+			return;
+		}
+		TsSplitEvent* ev = addEvent(TS_EV_LOG, -1, level);
+		if (ev != nullptr) {
+			ev->itemIndex = (int)target->logs.size();
+			target->logs.push_back(str);
+		}
+	}
+};
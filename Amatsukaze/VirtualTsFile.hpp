@@ -0,0 +1,354 @@
+/**
+* Virtual intermediate video file
+* Copyright (c) 2017-2019 Nekopanda
+*
+* This software is released under the MIT License.
+* http://opensource.org/licenses/mit-license.php
+*/
+#pragma once
+
+#include <vector>
+
+#include "StreamUtils.hpp"
+#include "Mpeg2TsParser.hpp"
+#include "ReaderWriterFFmpeg.hpp"
+
+// ԉft@CɌTS璼ڃfR[h邽߂̉zTS
+// TS͈̔[start,end)IĂfPID̃pPbgc
+// iȊÕpPbg͓ʒuNULLpPbgɂj擪PAT,PMTt
+// TSƃoCgʒuΉ̂ŁAzTS̈ʒu
+// TS̈ʒu - start + VIRTUAL_TS_HEADER_SIZE ɂȂ
+// ԉft@C̑ɂ̓CfbNXiVirtualTsIndexj
+enum {
+	VIRTUAL_TS_HEADER_SIZE = TS_PACKET_LENGTH * 2, // PAT,PMT
+	VIRTUAL_TS_PMT_PID = 0x1F0,
+	VIRTUAL_TS_VIDEO_PID = 0x1F1,
+};
+
+struct VirtualTsVideoPid {
+	int64_t offset; // TSłPIDɂȂʒu
+	int pid;
+};
+
+struct VirtualTsIndex {
+	enum {
+		MAGIC = 0x56544D41, // "AMTV"
+		VERSION = 1,
+	};
+
+	tstring srcpath;  // TS
+	int streamType;   // fstream_type
+	int64_t start;    // TS͈̔
+	int64_t end;
+	std::vector<VirtualTsVideoPid> pids; // offset
+
+	VirtualTsIndex()
+		: streamType(-1), start(-1), end(-1)
+	{ }
+
+	int64_t toVirtualOffset(int64_t srcOffset) const {
+		return srcOffset - start + VIRTUAL_TS_HEADER_SIZE;
+	}
+
+	int64_t virtualSize() const {
+		return end - start + VIRTUAL_TS_HEADER_SIZE;
+	}
+
+	// TSoffseẗʒuł̉fPIDi܂Ȃꍇ-1j
+	int getVideoPid(int64_t offset) const {
+		auto it = std::upper_bound(pids.begin(), pids.end(), offset,
+			[](int64_t offset, const VirtualTsVideoPid& e) { return offset < e.offset; });
+		return (it == pids.begin()) ? -1 : (it - 1)->pid;
+	}
+
+	void serialize(const tstring& path) const {
+		File file(path, _T("wb"));
+		file.writeValue((int)MAGIC);
+		file.writeValue((int)VERSION);
+		file.writeTString(srcpath);
+		file.writeValue(streamType);
+		file.writeValue(start);
+		file.writeValue(end);
+		file.writeArray(pids);
+	}
+
+	static VirtualTsIndex deserialize(const tstring& path) {
+		File file(path, _T("rb"));
+		if (file.readValue<int>() != MAGIC || file.readValue<int>() != VERSION) {
+			THROWF(FormatException, "zԉft@Cł͂܂: %s", path);
+		}
+		VirtualTsIndex index;
+		index.srcpath = file.readTString();
+		index.streamType = file.readValue<int>();
+		index.start = file.readValue<int64_t>();
+		index.end = file.readValue<int64_t>();
+		index.pids = file.readArray<VirtualTsVideoPid>();
+		return index;
+	}
+
+	// ԉft@CiPSjł͂ȂCfbNX
+	static bool IsIndexFile(const tstring& path) {
+		File file(path, _T("rb"));
+		int magic = 0;
+		return file.read(MemoryChunk((uint8_t*)&magic, sizeof(magic))) == sizeof(magic) &&
+			magic == MAGIC;
+	}
+};
+
+// TS͂ŉfPESpPbg̈ʒu󂯎ĉft@CƂɃCfbNX
+// t@C͈͍̔͂ŏPESpPbg玟̃t@C̍ŏPESpPbg̑O܂
+class VirtualTsIndexWriter {
+public:
+	VirtualTsIndexWriter()
+		: totalSize_(0)
+	{ }
+
+	void open(const tstring& path, const tstring& srcpath, int streamType) {
+		if (path_.size() > 0) {
+			pending_.emplace_back(path_, cur_);
+		}
+		path_ = path;
+		cur_ = VirtualTsIndex();
+		cur_.srcpath = srcpath;
+		cur_.streamType = streamType;
+	}
+
+	// offset: PESpPbg̍ŏTSpPbǧTS̈ʒu
+	// ߂l: zTS̈ʒu
+	int64_t addPes(int64_t offset, int pid) {
+		flushPending(offset);
+		if (cur_.start < 0) {
+			cur_.start = offset;
+		}
+		if (cur_.pids.size() == 0 || cur_.pids.back().pid != pid) {
+			VirtualTsVideoPid entry = { offset, pid };
+			cur_.pids.push_back(entry);
+		}
+		return cur_.toVirtualOffset(offset);
+	}
+
+	// end: TS̏I[
+	void close(int64_t end) {
+		if (path_.size() > 0) {
+			pending_.emplace_back(path_, cur_);
+			path_.clear();
+		}
+		flushPending(end);
+	}
+
+	// zTS̃TCY̍v
+	int64_t getTotalSize() const {
+		return totalSize_;
+	}
+
+private:
+	tstring path_;
+	VirtualTsIndex cur_;
+	// ͈͂̏I肪܂ĂȂt@C
+	std::vector<std::pair<tstring, VirtualTsIndex>> pending_;
+	int64_t totalSize_;
+
+	void flushPending(int64_t end) {
+		for (auto& entry : pending_) {
+			VirtualTsIndex& index = entry.second;
+			if (index.start < 0) {
+				// PESpPbgȂ
+				index.start = end;
+			}
+			index.end = end;
+			index.serialize(entry.first);
+			totalSize_ += index.virtualSize();
+		}
+		pending_.clear();
+	}
+};
+
+// CfbNX牼zTSēǂ
+class VirtualTsReader : NonCopyable {
+	enum {
+		// TƂɃ`FbNpPbg
+		CHECK_PACKET_NUM = 4,
+	};
+public:
+	VirtualTsReader(const VirtualTsIndex& index)
+		: index_(index)
+		, file_(index.srcpath, _T("rb"))
+		, fileSize_(file_.size())
+	{
+		makeHeader();
+	}
+
+	int64_t size() const {
+		return index_.virtualSize();
+	}
+
+	// posősizeoCgǂœǂ񂾃oCgԂiI[Ȃ0j
+	int read(int64_t pos, uint8_t* dst, int size) {
+		int64_t total = this->size();
+		if (pos < 0 || pos >= total || size <= 0) {
+			return 0;
+		}
+		size = (int)std::min<int64_t>(size, total - pos);
+		int done = 0;
+		if (pos < VIRTUAL_TS_HEADER_SIZE) {
+			done = (int)std::min<int64_t>(size, VIRTUAL_TS_HEADER_SIZE - pos);
+			memcpy(dst, header_ + pos, done);
+		}
+		if (done < size) {
+			readSource(index_.start + (pos + done - VIRTUAL_TS_HEADER_SIZE), dst + done, size - done);
+		}
+		return size;
+	}
+
+private:
+	VirtualTsIndex index_;
+	File file_;
+	int64_t fileSize_;
+	uint8_t header_[VIRTUAL_TS_HEADER_SIZE];
+	std::vector<uint8_t> buf_;
+
+	void makeHeader() {
+		memset(header_, 0xFF, sizeof(header_));
+		CRC32 crc;
+
+		// PAT
+		uint8_t* pat = header_;
+		const uint8_t patData[] = {
+			0x47, 0x40, 0x00, 0x10, // PID=0 payload_unit_start
+			0x00, // pointer_field
+			0x00, 0xB0, 0x0D, // table_id, section_length
+			0x00, 0x01, 0xC1, 0x00, 0x00, // transport_stream_id, version, section_number
+			0x00, 0x01, // program_number
+			0xE0 | (VIRTUAL_TS_PMT_PID >> 8), VIRTUAL_TS_PMT_PID & 0xFF,
+		};
+		memcpy(pat, patData, sizeof(patData));
+		write32(pat + sizeof(patData), crc.calc(pat + 5, sizeof(patData) - 5, uint32_t(-1)));
+
+		// PMT
+		uint8_t* pmt = header_ + TS_PACKET_LENGTH;
+		const uint8_t pmtData[] = {
+			0x47, 0x40 | (VIRTUAL_TS_PMT_PID >> 8), VIRTUAL_TS_PMT_PID & 0xFF, 0x10,
+			0x00, // pointer_field
+			0x02, 0xB0, 0x12, // table_id, section_length
+			0x00, 0x01, 0xC1, 0x00, 0x00, // program_number, version, section_number
+			0xFF, 0xFF, // PCR_PIDiȂj
+			0xF0, 0x00, // program_info_length
+			(uint8_t)index_.streamType,
+			0xE0 | (VIRTUAL_TS_VIDEO_PID >> 8), VIRTUAL_TS_VIDEO_PID & 0xFF,
+			0xF0, 0x00, // ES_info_length
+		};
+		memcpy(pmt, pmtData, sizeof(pmtData));
+		write32(pmt + sizeof(pmtData), crc.calc(pmt + 5, sizeof(pmtData) - 5, uint32_t(-1)));
+	}
+
+	// TSsrcPossizeoCg̉zTS̃f[^
+	void readSource(int64_t srcPos, uint8_t* dst, int size) {
+		// pPbg̓rn܂邱Ƃ̂1pPbgOǂ
+		int64_t readStart = std::max(index_.start, srcPos - (TS_PACKET_LENGTH - 1));
+		int64_t readEnd = std::min(fileSize_, srcPos + size + TS_PACKET_LENGTH * CHECK_PACKET_NUM);
+		int length = 0;
+		if (readEnd > readStart) {
+			buf_.resize((size_t)(readEnd - readStart));
+			file_.seek(readStart, SEEK_SET);
+			while (length < (int)buf_.size()) {
+				size_t ret = file_.read(MemoryChunk(buf_.data() + length, buf_.size() - length));
+				if (ret == 0) break;
+				length += (int)ret;
+			}
+		}
+
+		const int64_t dstEnd = srcPos + size;
+		bool syncOK = false;
+		int pos = 0;
+		for (; readStart + pos < dstEnd && pos < length; ) {
+			int64_t packetPos = readStart + pos;
+			if (checkSyncByte(pos, length, syncOK ? 2 : CHECK_PACKET_NUM)) {
+				syncOK = true;
+				uint8_t packet[TS_PACKET_LENGTH];
+				filterPacket(packetPos, &buf_[pos], packet);
+				int64_t copyStart = std::max(packetPos, srcPos);
+				int64_t copyEnd = std::min(packetPos + TS_PACKET_LENGTH, dstEnd);
+				memcpy(dst + (copyStart - srcPos), packet + (copyStart - packetPos), (size_t)(copyEnd - copyStart));
+				pos += TS_PACKET_LENGTH;
+			}
+			else {
+				// pPbgłȂ͂̂܂
+				syncOK = false;
+				if (packetPos >= srcPos) {
+					dst[packetPos - srcPos] = buf_[pos];
+				}
+				++pos;
+			}
+		}
+		// t@CȂ
+		if (readStart + pos < dstEnd) {
+			int64_t fillStart = std::max(readStart + pos, srcPos);
+			memset(dst + (fillStart - srcPos), 0xFF, (size_t)(dstEnd - fillStart));
+		}
+	}
+
+	// posnumPacket̃pPbg̓oCgĂ邩if[^Ȃ͌Ȃj
+	bool checkSyncByte(int pos, int length, int numPacket) {
+		if (pos + TS_PACKET_LENGTH > length) {
+			return false;
+		}
+		for (int i = 0; i < numPacket; ++i) {
+			int p = pos + TS_PACKET_LENGTH * i;
+			if (p >= length) break;
+			if (buf_[p] != TS_SYNC_BYTE) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// fpPbgPIDŒɂăRs[AȊONULLpPbgɂ
+	void filterPacket(int64_t offset, uint8_t* src, uint8_t* dst) {
+		TsPacket packet(src);
+		if (packet.parse() && packet.check() &&
+			packet.transport_scrambling_control() == 0 &&
+			packet.PID() == index_.getVideoPid(offset))
+		{
+			memcpy(dst, src, TS_PACKET_LENGTH);
+			dst[1] = (dst[1] & 0xE0) | (VIRTUAL_TS_VIDEO_PID >> 8);
+			dst[2] = VIRTUAL_TS_VIDEO_PID & 0xFF;
+		}
+		else {
+			memset(dst, 0xFF, TS_PACKET_LENGTH);
+			dst[0] = TS_SYNC_BYTE;
+			dst[1] = 0x1F; // PID=0x1FFF
+			dst[2] = 0xFF;
+			dst[3] = 0x10;
+		}
+	}
+
+	static void write32(uint8_t* ptr, uint32_t v) {
+		ptr[0] = (uint8_t)(v >> 24);
+		ptr[1] = (uint8_t)(v >> 16);
+		ptr[2] = (uint8_t)(v >> 8);
+		ptr[3] = (uint8_t)v;
+	}
+};
+
+namespace av {
+
+// zTSFFmpegɓǂ܂
+class VirtualTsIOContext : public ReadIOContext {
+	enum { BUFSIZE = TS_PACKET_LENGTH * 1024 };
+public:
+	VirtualTsIOContext(const tstring& indexpath)
+		: ReadIOContext(BUFSIZE)
+		, reader_(VirtualTsIndex::deserialize(indexpath))
+	{ }
+protected:
+	virtual int onRead(int64_t pos, uint8_t* buf, int size) {
+		return reader_.read(pos, buf, size);
+	}
+	virtual int64_t getSize() {
+		return reader_.size();
+	}
+private:
+	VirtualTsReader reader_;
+};
+
+} // namespace av
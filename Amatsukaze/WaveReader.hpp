@@ -0,0 +1,112 @@
+/**
+* Analysis wave reader
+* Copyright (c) 2017-2019 Nekopanda
+*
+* This software is released under the MIT License.
+* http://opensource.org/licenses/mit-license.php
+*/
+#pragma once
+
+#include <deque>
+#include <vector>
+
+#include "StreamUtils.hpp"
+#include "StreamReform.hpp"
+#include "AdtsParser.hpp"
+
+// ͗pWAV(16bitXeI)̓ǂݍ
+// lazy=truȅꍇATS͎WAVĂȂ̂
+// AACt@CKvɂȂt[fR[h
+class WaveReader : public AMTObject {
+public:
+	// lazy=falseȂpath͉͗pWAVt@CAtrueȂ璆AACt@C
+	WaveReader(AMTContext& ctx, const tstring& path, bool lazy)
+		: AMTObject(ctx)
+		, file_(path, _T("rb"))
+		, lazy_(lazy)
+		, decoder_(ctx)
+		, lastDecoded_(-1)
+	{ }
+
+	// frameWAVf[^offsetoCgڂdst.lengthoCgǂ
+	// fR[hłȂꍇAȂ̓[Ŗ߂
+	void read(const FilterAudioFrame& frame, int offset, MemoryChunk dst) {
+		if (!lazy_) {
+			file_.seek(frame.waveOffset + offset, SEEK_SET);
+			file_.read(dst);
+			return;
+		}
+		const std::vector<uint8_t>& pcm = getFrame(frame);
+		size_t copyBytes = 0;
+		if ((size_t)offset < pcm.size()) {
+			copyBytes = std::min(pcm.size() - offset, dst.length);
+			memcpy(dst.data, pcm.data() + offset, copyBytes);
+		}
+		memset(dst.data + copyBytes, 0, dst.length - copyBytes);
+	}
+
+private:
+	enum {
+		CACHE_FRAMES = 16,
+	};
+
+	struct CacheEntry {
+		int64_t codedOffset;
+		std::vector<uint8_t> pcm;
+	};
+
+	File file_;
+	bool lazy_;
+	AdtsDecoder decoder_;
+	// ŌɃfR[_ɓꂽt[codedOffset
+	int64_t lastDecoded_;
+	AutoBuffer codedBuffer_;
+	// ŋ߃fR[ht[i擪ŐVj
+	std::deque<CacheEntry> cache_;
+
+	const std::vector<uint8_t>& getFrame(const FilterAudioFrame& frame) {
+		for (const auto& entry : cache_) {
+			if (entry.codedOffset == frame.codedOffset) {
+				return entry.pcm;
+			}
+		}
+		// AAC͑Õt[Əd˂ďo͂̂
+		// Õt[fR[hĂȂꍇ͒Õt[
+		if (frame.prevCodedOffset >= 0 && frame.prevCodedOffset != lastDecoded_) {
+			decode(frame.prevCodedOffset, frame.prevCodedLength, nullptr);
+		}
+		if (cache_.size() >= CACHE_FRAMES) {
+			cache_.pop_back();
+		}
+		cache_.emplace_front();
+		cache_.front().codedOffset = frame.codedOffset;
+		decode(frame.codedOffset, frame.codedLength, &cache_.front().pcm);
+		return cache_.front().pcm;
+	}
+
+	void decode(int64_t codedOffset, int codedLength, std::vector<uint8_t>* pcm) {
+		MemoryChunk coded = codedBuffer_.space(codedLength);
+		coded.length = codedLength;
+		file_.seek(codedOffset, SEEK_SET);
+		if (file_.read(coded) != coded.length) {
+			THROW(FormatException, "AACt@C̃TCY܂");
+		}
+		lastDecoded_ = codedOffset;
+		NeAACDecFrameInfo frameInfo;
+		void* samples;
+		bool success = (decoder_.decode(coded, frameInfo, samples) == AdtsDecoder::DECODE_OK);
+		if (pcm == nullptr) {
+			// Õt[͏d˂镔̂߂ɓ邾
+			return;
+		}
+		if (!success) {
+			ctx.incrementCounter(AMT_ERR_DECODE_AUDIO);
+			ctx.warn("t[𐳂fR[hł܂ł");
+		}
+		else {
+			const uint8_t* ptr = (const uint8_t*)samples;
+			pcm->assign(ptr, ptr + frameInfo.samples * 2);
+		}
+	}
+};
+
@@ -265,7 +265,8 @@ namespace Amatsukaze.Models
         }
 
         // 失敗するとIOExceptionが飛ぶ
-        public async Task Analyze(string filepath, int serviceid, string workpath, Point pt, Size sz, int thy, int maxFrames)
+        public async Task Analyze(string filepath, int serviceid, string workpath, Point pt, Size sz, int thy, int maxFrames,
+            bool rawWorkfile, bool sampleScan)
         {
             int pid = System.Diagnostics.Process.GetCurrentProcess().Id;
             string workfile = workpath + "\\logotmp" + pid + ".dat";
@@ -285,7 +286,8 @@ namespace Amatsukaze.Models
             try
             {
                 await Task.Run(() => LogoFile.ScanLogo(
-                    context, filepath, serviceid, workfile, tmppath, imgx, imgy, w, h, thy, maxFrames, LogoScanCallback));
+                    context, filepath, serviceid, workfile, tmppath, imgx, imgy, w, h, thy, maxFrames,
+                    rawWorkfile, sampleScan, LogoScanCallback));
 
                 // TsInfoでサービス名を取得する
                 using (var info = new TsInfo(context))
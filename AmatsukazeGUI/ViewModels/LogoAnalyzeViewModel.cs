@@ -157,6 +157,34 @@ namespace Amatsukaze.ViewModels
         }
         #endregion
 
+        #region SampleScan変更通知プロパティ
+        private bool _SampleScan;
+
+        public bool SampleScan {
+            get { return _SampleScan; }
+            set { 
+                if (_SampleScan == value)
+                    return;
+                _SampleScan = value;
+                RaisePropertyChanged();
+            }
+        }
+        #endregion
+
+        #region RawWorkfile変更通知プロパティ
+        private bool _RawWorkfile;
+
+        public bool RawWorkfile {
+            get { return _RawWorkfile; }
+            set { 
+                if (_RawWorkfile == value)
+                    return;
+                _RawWorkfile = value;
+                RaisePropertyChanged();
+            }
+        }
+        #endregion
+
         #region StartScanCommand
         private ViewModelCommand _StartScanCommand;
 
@@ -188,7 +216,7 @@ namespace Amatsukaze.ViewModels
             {
                 var srcpath = App.Option.SlimTs ? tmpTs : App.Option.FilePath;
                 currentTask = Model.Analyze(srcpath, App.Option.ServiceId,
-                    App.Option.WorkPath, RectPosition, RectSize, Threshold, MaxFrames);
+                    App.Option.WorkPath, RectPosition, RectSize, Threshold, MaxFrames, RawWorkfile, SampleScan);
                 await currentTask;
 
                 var vm = new LogoImageViewModel();
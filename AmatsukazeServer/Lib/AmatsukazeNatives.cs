@@ -427,6 +427,11 @@ namespace Amatsukaze.Lib
         [DllImport("Amatsukaze.dll", CharSet = CharSet.Unicode)]
         private static extern int ScanLogo(IntPtr ctx, string srcpath, int serviceid, string workfile, string dstpath,
             int imgx, int imgy, int w, int h, int thy, int numMaxFrames, LogoAnalyzeCallback cb);
+
+        [DllImport("Amatsukaze.dll", CharSet = CharSet.Unicode)]
+        private static extern int ScanLogoEx(IntPtr ctx, string srcpath, int serviceid, string workfile, string dstpath,
+            int imgx, int imgy, int w, int h, int thy, int numMaxFrames,
+            int workCodec, int numThreads, int sampleScan, LogoAnalyzeCallback cb);
 #endregion
 
         public LogoFile(AMTContext ctx, string filepath)
@@ -525,6 +530,19 @@ namespace Amatsukaze.Lib
                 throw new IOException(ctx.GetError());
             }
         }
+
+        // rawWorkfile: 中間ファイルを無圧縮で書く（CPU負荷が減る代わりにディスクを使う）
+        // sampleScan: ファイル全体をデコードせず等間隔のキーフレームだけ読む
+        public static void ScanLogo(AMTContext ctx, string srcpath, int serviceid, string workfile, string dstpath,
+            int imgx, int imgy, int w, int h, int thy, int numMaxFrames,
+            bool rawWorkfile, bool sampleScan, LogoAnalyzeCallback cb)
+        {
+            if (ScanLogoEx(ctx.Ptr, srcpath, serviceid, workfile, dstpath, imgx, imgy, w, h, thy, numMaxFrames,
+                rawWorkfile ? 1 : 0, 0, sampleScan ? 1 : 0, cb) == 0)
+            {
+                throw new IOException(ctx.GetError());
+            }
+        }
     }
 
     public delegate bool TsSlimCallback();
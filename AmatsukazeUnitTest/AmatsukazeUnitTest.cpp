@@ -124,6 +124,7 @@ protected:
 	std::wstring LargeTsFile;
 
 	void ParserTest(const std::wstring& filename, bool verify = true);
+	void StreamFilesTest(const wchar_t* mode);
 
 	void EncoderOptionTest(const wchar_t* option) {
 		printf("Option: %ls\n", option);
@@ -199,6 +200,27 @@ void TestBase::ParserTest(const std::wstring& filename, bool verify) {
 	//}
 }
 
+// MPEG2H264̃eXgt@CꂼmodẽeXgs
+void TestBase::StreamFilesTest(const wchar_t* mode) {
+	const std::wstring files[] = { MPEG2VideoTsFile, H264VideoTsFile };
+	for (const auto& file : files) {
+		std::wstring srcfile = TestDataDir + L"\\" + file + L".ts";
+		std::wstring dstDir = TestWorkDir + L"\\";
+
+		if (!fileExists(srcfile.c_str())) {
+			printf("eXgt@CȂ̂ŃXLbv: %ls\n", srcfile.c_str());
+			continue;
+		}
+
+		const wchar_t* args[] = {
+			L"AmatsukazeTest.exe", L"--mode", mode,
+			L"-i", srcfile.c_str(),
+			L"-w", dstDir.c_str(),
+		};
+		EXPECT_EQ(AmatsukazeCLI(LEN(args), args), 0);
+	}
+}
+
 TEST_F(TestBase, MPEG2Parser) {
 	ParserTest(MPEG2VideoTsFile);
 }
@@ -215,6 +237,80 @@ TEST_F(TestBase, Pulldown) {
 	ParserTest(PullDownTsFile);
 }
 
+// pCvCło͂ςȂ
+TEST_F(TestBase, SplitPipeline) {
+	std::wstring srcfile = TestDataDir + L"\\" + MPEG2VideoTsFile + L".ts";
+	std::wstring dstDir = TestWorkDir + L"\\";
+
+	if (!fileExists(srcfile.c_str())) {
+		printf("eXgt@CȂ̂ŃXLbv: %ls\n", srcfile.c_str());
+		return;
+	}
+
+	const wchar_t* args[] = {
+		L"AmatsukazeTest.exe", L"--mode", L"test_split_pipeline",
+		L"-i", srcfile.c_str(),
+		L"-w", dstDir.c_str(),
+	};
+	EXPECT_EQ(AmatsukazeCLI(LEN(args), args), 0);
+}
+
+// ͈͂ɕĕTS͂Ăo͂ςȂ
+TEST_F(TestBase, SplitParallel) {
+	StreamFilesTest(L"test_split_parallel");
+}
+
+// ԉft@C̑ɌTSQƂĂfpPbgǂ߂邱
+TEST_F(TestBase, VirtualIntVideo) {
+	StreamFilesTest(L"test_virtual_int_video");
+}
+
+// AMTSource̐ǂ݃fR[hŏo͂ςȂƁ{xv
+TEST_F(TestBase, AMTSourcePrefetch) {
+	StreamFilesTest(L"test_amtsource_prefetch");
+}
+
+// AMTSourceGOPfR[_ŕɃfR[hĂo͂ςȂƁ{xv
+TEST_F(TestBase, AMTSourceGOPDecode) {
+	StreamFilesTest(L"test_amtsource_gop");
+}
+
+// fR[hʃXbhɂĂo͂ςȂƁ{xv
+TEST_F(TestBase, SplitAudioDecode) {
+	std::wstring srcfile = TestDataDir + L"\\" + MPEG2VideoTsFile + L".ts";
+	std::wstring dstDir = TestWorkDir + L"\\";
+
+	if (!fileExists(srcfile.c_str())) {
+		printf("eXgt@CȂ̂ŃXLbv: %ls\n", srcfile.c_str());
+		return;
+	}
+
+	const wchar_t* args[] = {
+		L"AmatsukazeTest.exe", L"--mode", L"test_split_audiodec",
+		L"-i", srcfile.c_str(),
+		L"-w", dstDir.c_str(),
+	};
+	EXPECT_EQ(AmatsukazeCLI(LEN(args), args), 0);
+}
+
+// ͗pWAVxfR[hĂf[^ǂ߂邱
+TEST_F(TestBase, LazyWave) {
+	std::wstring srcfile = TestDataDir + L"\\" + MPEG2VideoTsFile + L".ts";
+	std::wstring dstDir = TestWorkDir + L"\\";
+
+	if (!fileExists(srcfile.c_str())) {
+		printf("eXgt@CȂ̂ŃXLbv: %ls\n", srcfile.c_str());
+		return;
+	}
+
+	const wchar_t* args[] = {
+		L"AmatsukazeTest.exe", L"--mode", L"test_lazywave",
+		L"-i", srcfile.c_str(),
+		L"-w", dstDir.c_str(),
+	};
+	EXPECT_EQ(AmatsukazeCLI(LEN(args), args), 0);
+}
+
 // TODO: ʏ̓It
 TEST_F(TestBase, LargeTsParse) {
 	ParserTest(LargeTsFile, false);
@@ -329,6 +425,21 @@ TEST_F(TestBase, LosslessTest)
 	EXPECT_EQ(AmatsukazeCLI(LEN(args), args), 0);
 }
 
+TEST_F(TestBase, LosslessParallelTest)
+{
+	std::wstring srcDir = TestDataDir + L"\\";
+	std::wstring dstDir = TestWorkDir + L"\\";
+	std::wstring inavs = srcDir + L"input.avs";
+	std::wstring dstPath = dstDir + L"lossless_parallel.utv";
+
+	const wchar_t* args[] = {
+		L"AmatsukazeTest.exe", L"--mode", L"test_lossless_parallel",
+		L"-o", dstPath.c_str(),
+		L"-f", inavs.c_str()
+	};
+	EXPECT_EQ(AmatsukazeCLI(LEN(args), args), 0);
+}
+
 TEST_F(TestBase, LogoFrameTest)
 {
 	std::wstring srcDir = TestDataDir + L"\\";
@@ -346,6 +457,134 @@ TEST_F(TestBase, LogoFrameTest)
 	EXPECT_EQ(AmatsukazeCLI(LEN(args), args), 0);
 }
 
+TEST_F(TestBase, LogoFramePerformance)
+{
+	std::wstring srcDir = TestDataDir + L"\\";
+	std::wstring dstDir = TestWorkDir + L"\\";
+	std::wstring inavs = srcDir + L"input.avs";
+	std::wstring outtxt = dstDir + L"logoframe.txt";
+
+	const wchar_t* args[] = {
+		L"AmatsukazeTest.exe", L"--mode", L"test_logoframe_perf",
+		L"--logo", L"logo\\SID410-1.lgd",
+		L"--logo", L"logo\\SID410-2.lgd",
+		L"-a", outtxt.c_str(),
+		L"-f", inavs.c_str()
+	};
+	EXPECT_EQ(AmatsukazeCLI(LEN(args), args), 0);
+}
+
+TEST_F(TestBase, LogoEvaluatePerformance)
+{
+	const wchar_t* args[] = {
+		L"AmatsukazeTest.exe", L"--mode", L"test_logo_eval",
+		L"--logo", L"logo\\SID410-1.lgd",
+		L"--logo", L"logo\\SID410-2.lgd",
+	};
+	EXPECT_EQ(AmatsukazeCLI(LEN(args), args), 0);
+}
+
+TEST_F(TestBase, LogoMultiFadePerformance)
+{
+	const wchar_t* args[] = {
+		L"AmatsukazeTest.exe", L"--mode", L"test_logo_multifade",
+		L"--logo", L"logo\\SID410-1.lgd",
+		L"--logo", L"logo\\SID410-2.lgd",
+	};
+	EXPECT_EQ(AmatsukazeCLI(LEN(args), args), 0);
+}
+
+TEST_F(TestBase, ScratchArenaTest)
+{
+	const wchar_t* args[] = {
+		L"AmatsukazeTest.exe", L"--mode", L"test_scratch"
+	};
+	EXPECT_EQ(AmatsukazeCLI(LEN(args), args), 0);
+}
+
+TEST_F(TestBase, LogoAnalyzeCacheTest)
+{
+	const wchar_t* args[] = {
+		L"AmatsukazeTest.exe", L"--mode", L"test_logo_analyze_cache"
+	};
+	EXPECT_EQ(AmatsukazeCLI(LEN(args), args), 0);
+}
+
+TEST_F(TestBase, DelogoKernelTest)
+{
+	const wchar_t* args[] = {
+		L"AmatsukazeTest.exe", L"--mode", L"test_delogo_kernel"
+	};
+	EXPECT_EQ(AmatsukazeCLI(LEN(args), args), 0);
+}
+
+TEST_F(TestBase, SampledLogoScanTest)
+{
+	std::wstring srcfile = TestDataDir + L"\\" + MPEG2VideoTsFile + L".ts";
+	std::wstring dstDir = TestWorkDir + L"\\";
+	std::wstring outfile = dstDir + L"sampled_logoscan";
+
+	if (!fileExists(srcfile.c_str())) {
+		printf("eXgt@CȂ̂ŃXLbv: %ls\n", srcfile.c_str());
+		return;
+	}
+
+	const wchar_t* args[] = {
+		L"AmatsukazeTest.exe", L"--mode", L"test_sampled_logoscan",
+		L"-i", srcfile.c_str(),
+		L"-o", outfile.c_str(),
+		L"--logo", L"logo\\SID410-1.lgd",
+	};
+	EXPECT_EQ(AmatsukazeCLI(LEN(args), args), 0);
+}
+
+TEST_F(TestBase, LogoScanParallelTest)
+{
+	const wchar_t* args[] = {
+		L"AmatsukazeTest.exe", L"--mode", L"test_logoscan_parallel"
+	};
+	EXPECT_EQ(AmatsukazeCLI(LEN(args), args), 0);
+}
+
+TEST_F(TestBase, LogoMaskCacheTest)
+{
+	std::wstring dstDir = TestWorkDir + L"\\";
+	std::wstring outfile = dstDir + L"logo_mask_cache";
+
+	const wchar_t* args[] = {
+		L"AmatsukazeTest.exe", L"--mode", L"test_logo_mask_cache",
+		L"-o", outfile.c_str(),
+		L"--logo", L"logo\\SID410-1.lgd",
+		L"--logo", L"logo\\SID410-2.lgd",
+	};
+	EXPECT_EQ(AmatsukazeCLI(LEN(args), args), 0);
+}
+
+TEST_F(TestBase, LogoCandidatePruningTest)
+{
+	std::wstring srcDir = TestDataDir + L"\\";
+	std::wstring dstDir = TestWorkDir + L"\\";
+	std::wstring inavs = srcDir + L"input.avs";
+	std::wstring outtxt = dstDir + L"logoframe.txt";
+
+	const wchar_t* args[] = {
+		L"AmatsukazeTest.exe", L"--mode", L"test_logo_pruning",
+		L"--logo", L"logo\\SID410-1.lgd",
+		L"--logo", L"logo\\SID410-2.lgd",
+		L"-a", outtxt.c_str(),
+		L"-f", inavs.c_str()
+	};
+	EXPECT_EQ(AmatsukazeCLI(LEN(args), args), 0);
+}
+
+TEST_F(TestBase, SlidingWindowTest)
+{
+	const wchar_t* args[] = {
+		L"AmatsukazeTest.exe", L"--mode", L"test_sliding_window"
+	};
+	EXPECT_EQ(AmatsukazeCLI(LEN(args), args), 0);
+}
+
 TEST_F(TestBase, SplitDualMonoAAC)
 {
 	std::wstring srcDir = TestDataDir + L"\\";
@@ -479,6 +718,44 @@ TEST_F(TestBase, DecodePerformance)
 	EXPECT_EQ(AmatsukazeCLI(LEN(args), args), 0);
 }
 
+TEST_F(TestBase, TsParsePerformance)
+{
+	std::wstring srcDir = TestDataDir + L"\\";
+
+	std::wstring srcfile = srcDir + LargeTsFile + L".ts";
+
+	const wchar_t* args[] = {
+		L"AmatsukazeTest.exe", L"--mode", L"test_readts_perf",
+		L"-i", srcfile.c_str(),
+	};
+	EXPECT_EQ(AmatsukazeCLI(LEN(args), args), 0);
+}
+
+TEST_F(TestBase, DataPumpPerformance)
+{
+	const wchar_t* args[] = {
+		L"AmatsukazeTest.exe", L"--mode", L"test_pump_perf",
+	};
+	EXPECT_EQ(AmatsukazeCLI(LEN(args), args), 0);
+}
+
+TEST_F(TestBase, Y4MWritePerformance)
+{
+	const wchar_t* args[] = {
+		L"AmatsukazeTest.exe", L"--mode", L"test_y4m_perf",
+	};
+	EXPECT_EQ(AmatsukazeCLI(LEN(args), args), 0);
+}
+
+TEST_F(TestBase, FrameTransportPerformance)
+{
+	const wchar_t* args[] = {
+		L"AmatsukazeTest.exe", L"--mode", L"test_frame_transport",
+		L"-w", TestWorkDir.c_str()
+	};
+	EXPECT_EQ(AmatsukazeCLI(LEN(args), args), 0);
+}
+
 TEST_F(TestBase, VfrZonesBug)
 {
 	std::wstring srcfile = L"zone_param.dat";